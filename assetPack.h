@@ -0,0 +1,263 @@
+//
+//  assetPack.h
+//  one archive for the shaders and images read at startup: a header, an index table and
+//  16 byte aligned blobs. blobs that LZ4 shrinks by at least an eighth are stored compressed,
+//  the rest (the already compressed images) as they are. the runtime maps the archive once,
+//  images are decoded straight from the mapping and shader sources are decompressed on demand
+//
+
+#ifndef assetPack_h
+#define assetPack_h
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <chrono>
+#include <mutex>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include "mappedFile.h"
+#include "lz4Block.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#endif
+
+using namespace std;
+
+#define ASSET_PACK_MAGIC 0x31504154u     // "TAP1"
+
+class AssetPack {
+public:
+    // statistics
+    unsigned int decompressedCount = 0;
+    double decompressMs = 0.0;
+
+    // the pack the loaders read from, null for the loose files
+    static AssetPack*& current()
+    {
+        static AssetPack* pack = nullptr;
+        return pack;
+    }
+
+    // the files in directory the runtime reads: shader stages and images
+    static vector<string> runtimeAssets(const string& directory = ".")
+    {
+        const char* extensions[] = { ".vs", ".fs", ".gs", ".tcs", ".tes", ".glsl", ".jpg", ".png" };
+        vector<string> names;
+        error_code error;
+        for (const filesystem::directory_entry& entry : filesystem::directory_iterator(directory, error))
+        {
+            if (!entry.is_regular_file())
+                continue;
+            string extension = entry.path().extension().string();
+            for (const char* wanted : extensions)
+                if (extension == wanted)
+                    names.push_back(entry.path().filename().string());
+        }
+        sort(names.begin(), names.end());
+        return names;
+    }
+
+    // the packer: files are stored under the names given, relative to directory
+    static bool write(const string& path, const vector<string>& names, const string& directory = ".")
+    {
+        vector<Entry> entries(names.size());
+        vector<vector<unsigned char>> blobs(names.size());
+        uint64_t offset = align(sizeof(Header) + entries.size() * sizeof(Entry));
+        size_t totalSize = 0, storedSize = 0;
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            if (names[i].size() >= sizeof(entries[i].name))
+            {
+                std::cout << "ERROR::ASSET_PACK::NAME_TOO_LONG: " << names[i] << std::endl;
+                return false;
+            }
+            ifstream file(directory + "/" + names[i], ios::binary);
+            if (!file)
+            {
+                std::cout << "ERROR::ASSET_PACK::FILE_NOT_READ: " << names[i] << std::endl;
+                return false;
+            }
+            vector<unsigned char> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+            vector<unsigned char> compressed = Lz4Block::compress(data.data(), data.size());
+
+            Entry& entry = entries[i];
+            memcpy(entry.name, names[i].c_str(), names[i].size());
+            entry.size = data.size();
+            if (compressed.size() <= data.size() - data.size() / 8)
+            {
+                entry.compression = COMPRESSION_LZ4;
+                blobs[i].swap(compressed);
+            }
+            else
+                blobs[i].swap(data);
+            entry.storedSize = blobs[i].size();
+            entry.offset = offset;
+            offset = align(offset + entry.storedSize);
+            totalSize += (size_t)entry.size;
+            storedSize += (size_t)entry.storedSize;
+        }
+
+        ofstream file(path, ios::binary);
+        if (!file)
+        {
+            std::cout << "ERROR::ASSET_PACK::FILE_NOT_WRITTEN: " << path << std::endl;
+            return false;
+        }
+        Header header = {};
+        header.magic = ASSET_PACK_MAGIC;
+        header.entryCount = (uint32_t)entries.size();
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)entries.data(), entries.size() * sizeof(Entry));
+        for (size_t i = 0; i < blobs.size(); i++)
+        {
+            file.seekp((streamoff)entries[i].offset);
+            file.write((const char*)blobs[i].data(), blobs[i].size());
+        }
+        // pad the last blob so the file ends aligned too
+        file.seekp((streamoff)offset - 1);
+        file.put(0);
+        cout << "asset pack: " << entries.size() << " files, " << totalSize / 1024 << " KB stored as " << storedSize / 1024 << " KB in " << path << endl;
+        return (bool)file;
+    }
+
+    bool open(const string& path)
+    {
+        lookup.clear();
+        expanded.clear();
+        if (!file.open(path))
+        {
+            std::cout << "ERROR::ASSET_PACK::NOT_OPENED: " << path << std::endl;
+            return false;
+        }
+        const Header* header = (const Header*)file.data();
+        if (file.size() < sizeof(Header) || header->magic != ASSET_PACK_MAGIC
+            || file.size() < sizeof(Header) + (uint64_t)header->entryCount * sizeof(Entry))
+        {
+            std::cout << "ERROR::ASSET_PACK::INVALID: " << path << std::endl;
+            file.close();
+            return false;
+        }
+        const Entry* entries = (const Entry*)(file.data() + sizeof(Header));
+        for (uint32_t i = 0; i < header->entryCount; i++)
+        {
+            if (entries[i].offset > file.size() || entries[i].storedSize > file.size() - entries[i].offset)
+            {
+                std::cout << "ERROR::ASSET_PACK::INVALID: " << path << std::endl;
+                file.close();
+                lookup.clear();
+                return false;
+            }
+            lookup[string(entries[i].name, strnlen(entries[i].name, sizeof(entries[i].name)))] = &entries[i];
+        }
+        return true;
+    }
+
+    bool isOpen() const
+    {
+        return file.isOpen();
+    }
+
+    // stored blobs point into the mapping, compressed ones are expanded once and kept.
+    // safe to call from several threads once the pack is open
+    bool find(const string& name, const unsigned char*& data, size_t& size)
+    {
+        auto found = lookup.find(name);
+        if (found == lookup.end())
+            return false;
+        const Entry& entry = *found->second;
+        size = (size_t)entry.size;
+        if (entry.compression == COMPRESSION_NONE)
+        {
+            data = file.data() + entry.offset;
+            return true;
+        }
+        lock_guard<mutex> lock(expandedLock);
+        auto cached = expanded.find(name);
+        if (cached == expanded.end())
+        {
+            auto start = chrono::high_resolution_clock::now();
+            vector<unsigned char> bytes(size);
+            if (!Lz4Block::decompress(file.data() + entry.offset, (size_t)entry.storedSize, bytes.data(), size))
+            {
+                std::cout << "ERROR::ASSET_PACK::CORRUPT_ENTRY: " << name << std::endl;
+                return false;
+            }
+            decompressMs += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+            decompressedCount++;
+            cached = expanded.emplace(name, move(bytes)).first;
+        }
+        data = cached->second.data();
+        return true;
+    }
+
+    bool read(const string& name, string& text)
+    {
+        const unsigned char* data;
+        size_t size;
+        if (!find(name, data, size))
+            return false;
+        text.assign((const char*)data, size);
+        return true;
+    }
+
+    // asks the OS to drop a file from its page cache so the next read comes from the disk.
+    // POSIX only, on Windows a cold start needs a reboot or an emptied standby list
+    static bool evictFromCache(const string& path)
+    {
+#if !defined(_WIN32) && defined(POSIX_FADV_DONTNEED)
+        int descriptor = ::open(path.c_str(), O_RDONLY);
+        if (descriptor < 0)
+            return false;
+        fdatasync(descriptor);
+        bool evicted = posix_fadvise(descriptor, 0, 0, POSIX_FADV_DONTNEED) == 0;
+        ::close(descriptor);
+        return evicted;
+#else
+        (void)path;
+        return false;
+#endif
+    }
+
+    void printStats()
+    {
+        cout << "asset pack: " << lookup.size() << " entries in " << file.size() / 1024 << " KB mapped, " << decompressedCount
+            << " decompressed in " << decompressMs << " ms" << endl;
+    }
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t entryCount;
+        uint32_t padding[2];
+    };
+    struct Entry {
+        char name[80];
+        uint64_t offset;
+        uint64_t storedSize;
+        uint64_t size;
+        uint32_t compression;
+        uint32_t padding;
+    };
+    static_assert(sizeof(Header) % 16 == 0 && sizeof(Entry) % 16 == 0, "asset pack tables must keep the blobs aligned");
+    static const uint32_t COMPRESSION_NONE = 0;
+    static const uint32_t COMPRESSION_LZ4 = 1;
+
+    MappedFile file;
+    unordered_map<string, const Entry*> lookup;
+    unordered_map<string, vector<unsigned char>> expanded;
+    mutex expandedLock;
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + 15) & ~15ull;
+    }
+};
+
+#endif /* assetPack_h */
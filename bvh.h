@@ -0,0 +1,535 @@
+//
+//  bvh.h
+//  bounding volume hierarchy over a triangle soup for CPU ray casting, with
+//  single rays and SSE packets of 4 rays that share one traversal. the top of the
+//  tree is split on one thread, the subtrees below it are built in parallel
+//
+
+#ifndef bvh_h
+#define bvh_h
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define BVH_SSE 1
+#endif
+
+using namespace std;
+
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float tMax = FLT_MAX;
+};
+
+struct RayHit {
+    float t = FLT_MAX;
+    int triangle = -1;      // -1 when nothing was hit
+    float u = 0.0f;         // barycentrics of vertex 1 and 2
+    float v = 0.0f;
+};
+
+// 4 rays in structure of arrays layout, active lanes are traced and the others ignored
+struct RayPacket {
+    float ox[4], oy[4], oz[4];
+    float dx[4], dy[4], dz[4];
+    float tMax[4];
+    bool active[4] = { true, true, true, true };
+
+    void set(int lane, const Ray& ray)
+    {
+        ox[lane] = ray.origin.x; oy[lane] = ray.origin.y; oz[lane] = ray.origin.z;
+        dx[lane] = ray.direction.x; dy[lane] = ray.direction.y; dz[lane] = ray.direction.z;
+        tMax[lane] = ray.tMax;
+        active[lane] = true;
+    }
+    Ray get(int lane) const
+    {
+        Ray ray;
+        ray.origin = glm::vec3(ox[lane], oy[lane], oz[lane]);
+        ray.direction = glm::vec3(dx[lane], dy[lane], dz[lane]);
+        ray.tMax = tMax[lane];
+        return ray;
+    }
+};
+
+class Bvh {
+public:
+    // statistics of the last build
+    unsigned int nodeCount = 0;
+    unsigned int leafCount = 0;
+
+    // positions holds 3 vertices per triangle
+    void build(const vector<glm::vec3>& positions, int threadCount = 1)
+    {
+        unsigned int triangleCount = (unsigned int)positions.size() / 3;
+        v0.resize(triangleCount);
+        e1.resize(triangleCount);
+        e2.resize(triangleCount);
+        centroids.resize(triangleCount);
+        triangleIndices.resize(triangleCount);
+        for (unsigned int i = 0; i < triangleCount; i++)
+        {
+            v0[i] = positions[i * 3];
+            e1[i] = positions[i * 3 + 1] - positions[i * 3];
+            e2[i] = positions[i * 3 + 2] - positions[i * 3];
+            centroids[i] = (positions[i * 3] + positions[i * 3 + 1] + positions[i * 3 + 2]) / 3.0f;
+            triangleIndices[i] = i;
+        }
+
+        nodes.clear();
+        nodes.reserve(triangleCount * 2);
+        Node root;
+        root.first = 0;
+        root.count = triangleCount;
+        nodes.push_back(root);
+        leafCount = 0;
+        if (triangleCount > 0)
+        {
+            // about 4 subtrees per thread, so the uneven ones even out
+            int splitDepth = 0;
+            while (threadCount > 1 && (1 << splitDepth) < threadCount * 4)
+                splitDepth++;
+            vector<unsigned int> subtrees;
+            subdivide(nodes, 0, leafCount, splitDepth > 0 ? &subtrees : nullptr, splitDepth);
+            if (!subtrees.empty())
+                buildSubtrees(subtrees, threadCount);
+        }
+        nodeCount = (unsigned int)nodes.size();
+    }
+
+    // closest hit along the ray
+    bool intersect(const Ray& ray, RayHit& hit) const
+    {
+        return traverse(ray, hit, false);
+    }
+
+    // any hit before ray.tMax, used for shadow rays
+    bool occluded(const Ray& ray) const
+    {
+        RayHit hit;
+        return traverse(ray, hit, true);
+    }
+
+    // closest hits of up to 4 rays, the packet walks the tree once and descends while any lane needs a node
+    void intersect(const RayPacket& packet, RayHit hits[4]) const
+    {
+        tracePacket(packet, hits, false);
+    }
+
+    // occlusion of up to 4 rays, inactive lanes report false
+    void occluded(const RayPacket& packet, bool result[4]) const
+    {
+        RayHit hits[4];
+        tracePacket(packet, hits, true);
+        for (int lane = 0; lane < 4; lane++)
+            result[lane] = packet.active[lane] && hits[lane].triangle >= 0;
+    }
+
+private:
+    struct Node {
+        glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+        glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+        unsigned int first = 0;     // first triangle of a leaf, left child of an inner node
+        unsigned int count = 0;     // 0 for inner nodes
+    };
+    static const unsigned int MAX_LEAF_TRIANGLES = 4;
+    static const int SAH_BINS = 12;
+
+    vector<Node> nodes;
+    vector<unsigned int> triangleIndices;
+    vector<glm::vec3> v0, e1, e2, centroids;
+
+    void growBounds(glm::vec3& boundsMin, glm::vec3& boundsMax, unsigned int triangle) const
+    {
+        glm::vec3 p[3] = { v0[triangle], v0[triangle] + e1[triangle], v0[triangle] + e2[triangle] };
+        for (const glm::vec3& q : p)
+        {
+            boundsMin = glm::min(boundsMin, q);
+            boundsMax = glm::max(boundsMax, q);
+        }
+    }
+
+    static float area(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+    {
+        glm::vec3 e = boundsMax - boundsMin;
+        return e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+
+    // binned SAH split, recursion depth stays small since the split is always balanced enough.
+    // with deferred set, inner nodes reached at depth 0 are left for buildSubtrees
+    void subdivide(vector<Node>& tree, unsigned int nodeIndex, unsigned int& leaves, vector<unsigned int>* deferred, int depth)
+    {
+        Node& node = tree[nodeIndex];
+        node.boundsMin = glm::vec3(FLT_MAX);
+        node.boundsMax = glm::vec3(-FLT_MAX);
+        for (unsigned int i = 0; i < node.count; i++)
+            growBounds(node.boundsMin, node.boundsMax, triangleIndices[node.first + i]);
+        if (node.count <= MAX_LEAF_TRIANGLES)
+        {
+            leaves++;
+            return;
+        }
+        if (deferred != nullptr && depth == 0)
+        {
+            deferred->push_back(nodeIndex);
+            return;
+        }
+
+        glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+        for (unsigned int i = 0; i < node.count; i++)
+        {
+            centroidMin = glm::min(centroidMin, centroids[triangleIndices[node.first + i]]);
+            centroidMax = glm::max(centroidMax, centroids[triangleIndices[node.first + i]]);
+        }
+
+        int bestAxis = -1;
+        int bestSplit = 0;
+        float bestCost = node.count * area(node.boundsMin, node.boundsMax);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float extent = centroidMax[axis] - centroidMin[axis];
+            if (extent <= 0.0f)
+                continue;
+            glm::vec3 binMin[SAH_BINS], binMax[SAH_BINS];
+            unsigned int binCount[SAH_BINS] = {};
+            for (int b = 0; b < SAH_BINS; b++)
+            {
+                binMin[b] = glm::vec3(FLT_MAX);
+                binMax[b] = glm::vec3(-FLT_MAX);
+            }
+            float scale = SAH_BINS / extent;
+            for (unsigned int i = 0; i < node.count; i++)
+            {
+                unsigned int triangle = triangleIndices[node.first + i];
+                int b = std::min(SAH_BINS - 1, (int)((centroids[triangle][axis] - centroidMin[axis]) * scale));
+                binCount[b]++;
+                growBounds(binMin[b], binMax[b], triangle);
+            }
+            // sweep from the left and the right to get the cost of every split plane
+            float leftArea[SAH_BINS - 1];
+            unsigned int leftCount[SAH_BINS - 1];
+            glm::vec3 accMin(FLT_MAX), accMax(-FLT_MAX);
+            unsigned int acc = 0;
+            for (int b = 0; b < SAH_BINS - 1; b++)
+            {
+                acc += binCount[b];
+                if (binCount[b] > 0)
+                {
+                    accMin = glm::min(accMin, binMin[b]);
+                    accMax = glm::max(accMax, binMax[b]);
+                }
+                leftCount[b] = acc;
+                leftArea[b] = acc > 0 ? area(accMin, accMax) : 0.0f;
+            }
+            accMin = glm::vec3(FLT_MAX);
+            accMax = glm::vec3(-FLT_MAX);
+            acc = 0;
+            for (int b = SAH_BINS - 1; b > 0; b--)
+            {
+                acc += binCount[b];
+                if (binCount[b] > 0)
+                {
+                    accMin = glm::min(accMin, binMin[b]);
+                    accMax = glm::max(accMax, binMax[b]);
+                }
+                float rightArea = acc > 0 ? area(accMin, accMax) : 0.0f;
+                float cost = leftCount[b - 1] * leftArea[b - 1] + acc * rightArea;
+                if (leftCount[b - 1] > 0 && acc > 0 && cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = b;
+                }
+            }
+        }
+        if (bestAxis < 0)
+        {
+            leaves++;
+            return;
+        }
+
+        // partition the triangle range around the chosen bin boundary
+        float scale = SAH_BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+        unsigned int* begin = &triangleIndices[node.first];
+        unsigned int* middle = std::partition(begin, begin + node.count, [&](unsigned int triangle)
+            {
+                return std::min(SAH_BINS - 1, (int)((centroids[triangle][bestAxis] - centroidMin[bestAxis]) * scale)) < bestSplit;
+            });
+        unsigned int leftTriangles = (unsigned int)(middle - begin);
+
+        Node left, right;
+        left.first = node.first;
+        left.count = leftTriangles;
+        right.first = node.first + leftTriangles;
+        right.count = node.count - leftTriangles;
+        unsigned int leftIndex = (unsigned int)tree.size();
+        tree.push_back(left);
+        tree.push_back(right);
+        // node may have moved with the push_backs
+        tree[nodeIndex].first = leftIndex;
+        tree[nodeIndex].count = 0;
+        subdivide(tree, leftIndex, leaves, deferred, depth - 1);
+        subdivide(tree, leftIndex + 1, leaves, deferred, depth - 1);
+    }
+
+    // every deferred node is built into its own node array on some thread, the triangle ranges
+    // are disjoint so the partitions do not interfere. the arrays are then appended to the tree
+    // with their child indices moved
+    void buildSubtrees(const vector<unsigned int>& subtrees, int threadCount)
+    {
+        vector<unsigned int> order = subtrees;
+        sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return nodes[a].count > nodes[b].count; });
+        vector<vector<Node>> built(order.size());
+        vector<unsigned int> builtLeaves(order.size(), 0);
+        atomic<int> next(0);
+        auto worker = [&]()
+        {
+            for (int i = next++; i < (int)order.size(); i = next++)
+            {
+                built[i].reserve(nodes[order[i]].count * 2);
+                built[i].push_back(nodes[order[i]]);
+                subdivide(built[i], 0, builtLeaves[i], nullptr, 0);
+            }
+        };
+        vector<thread> workers;
+        for (int i = 1; i < std::min(threadCount, (int)order.size()); i++)
+            workers.emplace_back(worker);
+        worker();
+        for (thread& t : workers)
+            t.join();
+
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            // local node k > 0 lands at base + k - 1, the local root replaces the deferred node
+            unsigned int base = (unsigned int)nodes.size();
+            for (Node& node : built[i])
+                if (node.count == 0)
+                    node.first = base + node.first - 1;
+            nodes[order[i]] = built[i][0];
+            nodes.insert(nodes.end(), built[i].begin() + 1, built[i].end());
+            leafCount += builtLeaves[i];
+        }
+    }
+
+    bool hitBounds(const Node& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float tMax) const
+    {
+        glm::vec3 t1 = (node.boundsMin - origin) * inverseDirection;
+        glm::vec3 t2 = (node.boundsMax - origin) * inverseDirection;
+        glm::vec3 tLow = glm::min(t1, t2);
+        glm::vec3 tHigh = glm::max(t1, t2);
+        float tNear = std::max(std::max(tLow.x, tLow.y), std::max(tLow.z, 0.0f));
+        float tFar = std::min(std::min(tHigh.x, tHigh.y), std::min(tHigh.z, tMax));
+        return tNear <= tFar;
+    }
+
+    // Moller-Trumbore, both faces count since the architecture is not closed
+    bool hitTriangle(unsigned int triangle, const Ray& ray, RayHit& hit) const
+    {
+        glm::vec3 p = glm::cross(ray.direction, e2[triangle]);
+        float det = glm::dot(e1[triangle], p);
+        if (fabs(det) < 1e-10f)
+            return false;
+        float inverseDet = 1.0f / det;
+        glm::vec3 s = ray.origin - v0[triangle];
+        float u = glm::dot(s, p) * inverseDet;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+        glm::vec3 q = glm::cross(s, e1[triangle]);
+        float v = glm::dot(ray.direction, q) * inverseDet;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+        float t = glm::dot(e2[triangle], q) * inverseDet;
+        if (t <= 0.0f || t >= hit.t || t >= ray.tMax)
+            return false;
+        hit.t = t;
+        hit.triangle = (int)triangle;
+        hit.u = u;
+        hit.v = v;
+        return true;
+    }
+
+    bool traverse(const Ray& ray, RayHit& hit, bool anyHit) const
+    {
+        if (nodes.empty() || (nodes[0].count == 0 && nodes.size() == 1))
+            return false;
+        glm::vec3 inverseDirection = 1.0f / ray.direction;
+        unsigned int stack[64];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        bool found = false;
+        while (stackSize > 0)
+        {
+            const Node& node = nodes[stack[--stackSize]];
+            if (!hitBounds(node, ray.origin, inverseDirection, std::min(hit.t, ray.tMax)))
+                continue;
+            if (node.count > 0)
+            {
+                for (unsigned int i = 0; i < node.count; i++)
+                {
+                    if (hitTriangle(triangleIndices[node.first + i], ray, hit))
+                    {
+                        found = true;
+                        if (anyHit)
+                            return true;
+                    }
+                }
+            }
+            else
+            {
+                stack[stackSize++] = node.first;
+                stack[stackSize++] = node.first + 1;
+            }
+        }
+        return found;
+    }
+
+#ifdef BVH_SSE
+    // slab test of 4 rays against one box, returns a lane mask
+    int hitBounds4(const Node& node, const __m128 o[3], const __m128 inv[3], __m128 tMax) const
+    {
+        __m128 tNear = _mm_setzero_ps();
+        __m128 tFar = tMax;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin[axis]), o[axis]), inv[axis]);
+            __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax[axis]), o[axis]), inv[axis]);
+            tNear = _mm_max_ps(tNear, _mm_min_ps(t1, t2));
+            tFar = _mm_min_ps(tFar, _mm_max_ps(t1, t2));
+        }
+        return _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+    }
+
+    // Moller-Trumbore of 4 rays against one triangle, updates the hit of every lane that got closer
+    int hitTriangle4(unsigned int triangle, const __m128 o[3], const __m128 d[3], __m128& tBest, RayHit hits[4]) const
+    {
+        __m128 e1x = _mm_set1_ps(e1[triangle].x), e1y = _mm_set1_ps(e1[triangle].y), e1z = _mm_set1_ps(e1[triangle].z);
+        __m128 e2x = _mm_set1_ps(e2[triangle].x), e2y = _mm_set1_ps(e2[triangle].y), e2z = _mm_set1_ps(e2[triangle].z);
+        // p = d x e2
+        __m128 px = _mm_sub_ps(_mm_mul_ps(d[1], e2z), _mm_mul_ps(d[2], e2y));
+        __m128 py = _mm_sub_ps(_mm_mul_ps(d[2], e2x), _mm_mul_ps(d[0], e2z));
+        __m128 pz = _mm_sub_ps(_mm_mul_ps(d[0], e2y), _mm_mul_ps(d[1], e2x));
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+        __m128 inverseDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+        // s = o - v0
+        __m128 sx = _mm_sub_ps(o[0], _mm_set1_ps(v0[triangle].x));
+        __m128 sy = _mm_sub_ps(o[1], _mm_set1_ps(v0[triangle].y));
+        __m128 sz = _mm_sub_ps(o[2], _mm_set1_ps(v0[triangle].z));
+        __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverseDet);
+        // q = s x e1
+        __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+        __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+        __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+        __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], qx), _mm_mul_ps(d[1], qy)), _mm_mul_ps(d[2], qz)), inverseDet);
+        __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverseDet);
+
+        __m128 zero = _mm_setzero_ps();
+        __m128 absDet = _mm_max_ps(det, _mm_sub_ps(zero, det));
+        __m128 mask = _mm_cmpgt_ps(absDet, _mm_set1_ps(1e-10f));
+        mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+        mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+        mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+        mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, zero));
+        mask = _mm_and_ps(mask, _mm_cmplt_ps(t, tBest));
+        int laneMask = _mm_movemask_ps(mask);
+        if (laneMask == 0)
+            return 0;
+
+        tBest = _mm_or_ps(_mm_and_ps(mask, t), _mm_andnot_ps(mask, tBest));
+        float tLanes[4], uLanes[4], vLanes[4];
+        _mm_storeu_ps(tLanes, t);
+        _mm_storeu_ps(uLanes, u);
+        _mm_storeu_ps(vLanes, v);
+        for (int lane = 0; lane < 4; lane++)
+        {
+            if (laneMask & (1 << lane))
+            {
+                hits[lane].t = tLanes[lane];
+                hits[lane].triangle = (int)triangle;
+                hits[lane].u = uLanes[lane];
+                hits[lane].v = vLanes[lane];
+            }
+        }
+        return laneMask;
+    }
+
+    void tracePacket(const RayPacket& packet, RayHit hits[4], bool anyHit) const
+    {
+        for (int lane = 0; lane < 4; lane++)
+            hits[lane] = RayHit();
+        if (nodes.empty() || (nodes[0].count == 0 && nodes.size() == 1))
+            return;
+
+        __m128 o[3] = { _mm_loadu_ps(packet.ox), _mm_loadu_ps(packet.oy), _mm_loadu_ps(packet.oz) };
+        __m128 d[3] = { _mm_loadu_ps(packet.dx), _mm_loadu_ps(packet.dy), _mm_loadu_ps(packet.dz) };
+        __m128 inv[3];
+        for (int axis = 0; axis < 3; axis++)
+            inv[axis] = _mm_div_ps(_mm_set1_ps(1.0f), d[axis]);
+        // inactive lanes get a negative range so they never hit anything
+        float tLanes[4];
+        int activeMask = 0;
+        for (int lane = 0; lane < 4; lane++)
+        {
+            tLanes[lane] = packet.active[lane] ? packet.tMax[lane] : -1.0f;
+            if (packet.active[lane])
+                activeMask |= 1 << lane;
+        }
+        __m128 tBest = _mm_loadu_ps(tLanes);
+        int doneMask = 0;     // lanes with an any-hit result
+
+        unsigned int stack[64];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize > 0)
+        {
+            const Node& node = nodes[stack[--stackSize]];
+            if ((hitBounds4(node, o, inv, tBest) & activeMask & ~doneMask) == 0)
+                continue;
+            if (node.count > 0)
+            {
+                for (unsigned int i = 0; i < node.count; i++)
+                {
+                    int laneMask = hitTriangle4(triangleIndices[node.first + i], o, d, tBest, hits);
+                    if (anyHit && laneMask)
+                    {
+                        doneMask |= laneMask;
+                        // finished lanes stop taking part in the box tests
+                        _mm_storeu_ps(tLanes, tBest);
+                        for (int lane = 0; lane < 4; lane++)
+                            if (doneMask & (1 << lane))
+                                tLanes[lane] = -1.0f;
+                        tBest = _mm_loadu_ps(tLanes);
+                        if ((doneMask & activeMask) == activeMask)
+                            return;
+                    }
+                }
+            }
+            else
+            {
+                stack[stackSize++] = node.first;
+                stack[stackSize++] = node.first + 1;
+            }
+        }
+    }
+#else
+    // without SSE every lane is traced on its own
+    void tracePacket(const RayPacket& packet, RayHit hits[4], bool anyHit) const
+    {
+        for (int lane = 0; lane < 4; lane++)
+        {
+            hits[lane] = RayHit();
+            if (packet.active[lane])
+                traverse(packet.get(lane), hits[lane], anyHit);
+        }
+    }
+#endif
+};
+
+#endif /* bvh_h */
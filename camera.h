@@ -133,6 +133,15 @@ public:
             Zoom = 45.0f;
     }
 
+    // places the camera at an exact position and orientation, used when replaying a camera route
+    void SetPose(glm::vec3 position, float yaw, float pitch)
+    {
+        Position = position;
+        Yaw = yaw;
+        Pitch = pitch;
+        updateCameraVectors();
+    }
+
 private:
     // calculates the front vector from the Camera's (updated) Euler Angles
     void updateCameraVectors()
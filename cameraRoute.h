@@ -0,0 +1,57 @@
+//
+//  cameraRoute.h
+//  fixed camera fly-through so render paths can be compared on identical frames
+//
+
+#ifndef cameraRoute_h
+#define cameraRoute_h
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "camera.h"
+
+using namespace std;
+
+class CameraRoute {
+public:
+    struct Keyframe {
+        glm::vec3 position;
+        float yaw;
+        float pitch;
+    };
+    vector<Keyframe> keyframes;
+
+    // default route: down the walkway, around the mausoleum and back to the gate
+    CameraRoute()
+    {
+        keyframes.push_back({ glm::vec3(0.0f, 35.0f, 135.0f), -90.0f, -10.0f });
+        keyframes.push_back({ glm::vec3(0.0f, 12.0f, 80.0f), -90.0f, -5.0f });
+        keyframes.push_back({ glm::vec3(0.0f, 8.0f, 30.0f), -90.0f, 10.0f });
+        keyframes.push_back({ glm::vec3(30.0f, 15.0f, 0.0f), -120.0f, 0.0f });
+        keyframes.push_back({ glm::vec3(40.0f, 25.0f, -60.0f), -210.0f, -10.0f });
+        keyframes.push_back({ glm::vec3(-40.0f, 25.0f, -60.0f), -330.0f, -10.0f });
+        keyframes.push_back({ glm::vec3(-30.0f, 15.0f, 40.0f), -420.0f, -5.0f });
+        keyframes.push_back({ glm::vec3(0.0f, 35.0f, 135.0f), -450.0f, -10.0f });
+    }
+
+    // moves the camera to the route position at t in [0, 1], linear between keyframes
+    void apply(Camera& camera, float t) const
+    {
+        if (keyframes.empty())
+            return;
+        t = glm::clamp(t, 0.0f, 1.0f) * (keyframes.size() - 1);
+        unsigned int i = (unsigned int)t;
+        if (i >= keyframes.size() - 1)
+        {
+            const Keyframe& last = keyframes.back();
+            camera.SetPose(last.position, last.yaw, last.pitch);
+            return;
+        }
+        float f = t - i;
+        const Keyframe& a = keyframes[i];
+        const Keyframe& b = keyframes[i + 1];
+        camera.SetPose(glm::mix(a.position, b.position, f), glm::mix(a.yaw, b.yaw, f), glm::mix(a.pitch, b.pitch, f));
+    }
+};
+
+#endif /* cameraRoute_h */
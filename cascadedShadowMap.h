@@ -0,0 +1,245 @@
+//
+//  cascadedShadowMap.h
+//  cascaded shadow maps for a direction light: the camera frustum is split into
+//  cascades and each one gets its own layer of a depth texture array
+//
+
+#ifndef cascadedShadowMap_h
+#define cascadedShadowMap_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <string>
+#include <functional>
+#include <iostream>
+#include "shader.h"
+#include "frameArena.h"
+
+using namespace std;
+
+const int NR_CASCADES = 4;
+
+// texture units of the two direction light shadow maps, after the cluster buffers
+const int DAY_SHADOW_UNIT = 5;
+const int MOON_SHADOW_UNIT = 6;
+
+class CascadedShadowMap {
+public:
+    int resolution;
+    float shadowDistance;       // view distance covered by the last cascade
+    float splitLambda;          // 0 = uniform splits, 1 = logarithmic splits
+    bool pcf = true;            // 3x3 PCF instead of a single hardware filtered tap
+
+    // view space far distance and light matrix of every cascade
+    float splitFar[NR_CASCADES];
+    glm::mat4 lightMatrices[NR_CASCADES];
+
+    // statistics
+    unsigned int renderedCascades = 0;      // cascades rendered by the last update()
+    unsigned long long cascadeRenders = 0;
+    unsigned long long cacheHits = 0;
+    double gpuTimeMs[NR_CASCADES] = {};     // last measured depth pass of each cascade
+
+    // constructor
+    CascadedShadowMap(int resolution = 1024, float shadowDistance = 150.0f, float splitLambda = 0.75f)
+    {
+        this->resolution = resolution;
+        this->shadowDistance = shadowDistance;
+        this->splitLambda = splitLambda;
+
+        glGenTextures(1, &depthArray);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, depthArray);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, NR_CASCADES, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        // hardware depth compare, linear filtering then gives 2x2 PCF for free
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        glGenFramebuffers(1, &depthFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: cascaded shadow map is not complete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        glGenQueries(NR_CASCADES, timerQueries);
+    }
+
+    // destructor
+    ~CascadedShadowMap()
+    {
+        glDeleteQueries(NR_CASCADES, timerQueries);
+        glDeleteFramebuffers(1, &depthFBO);
+        glDeleteTextures(1, &depthArray);
+    }
+
+    // forget the cached depth, needed when a caster changes
+    void invalidate()
+    {
+        for (int c = 0; c < NR_CASCADES; c++)
+            cacheValid[c] = false;
+    }
+
+    // fit the cascades to the camera frustum and re-render the ones whose light matrix changed.
+    // a cascade keeps its depth until the light direction changes, its texel snapped bounds move or
+    // invalidate() is called
+    void update(const glm::vec3& lightDirection, const glm::mat4& view, float fovY, float aspect, float zNear,
+        Shader& depthShader, const function<void(Shader&)>& drawCasters)
+    {
+        readTimerQueries();
+        fitCascades(lightDirection, view, fovY, aspect, zNear);
+
+        renderedCascades = 0;
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        for (int c = 0; c < NR_CASCADES; c++)
+        {
+            if (cacheValid[c] && lightMatrices[c] == cachedMatrices[c])
+            {
+                cacheHits++;
+                continue;
+            }
+            if (renderedCascades == 0)
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+                glViewport(0, 0, resolution, resolution);
+                glEnable(GL_POLYGON_OFFSET_FILL);
+                glPolygonOffset(2.0f, 4.0f);
+            }
+            // a query still in flight from an earlier frame is not reused, that render goes untimed
+            bool timed = !queryPending[c];
+            if (timed)
+                glBeginQuery(GL_TIME_ELAPSED, timerQueries[c]);
+
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0, c);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            depthShader.use();
+            depthShader.setMat4("lightSpaceMatrix", lightMatrices[c]);
+            drawCasters(depthShader);
+
+            if (timed)
+            {
+                glEndQuery(GL_TIME_ELAPSED);
+                queryPending[c] = true;
+            }
+            cachedMatrices[c] = lightMatrices[c];
+            cacheValid[c] = true;
+            renderedCascades++;
+            cascadeRenders++;
+        }
+        if (renderedCascades > 0)
+        {
+            glDisable(GL_POLYGON_OFFSET_FILL);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        }
+    }
+
+    // binds the depth array and sets <prefix>ShadowMap and <prefix>ShadowMatrices
+    void bind(Shader& shader, const string& prefix, int textureUnit)
+    {
+        shader.setInt(frameFormat("%sShadowMap", prefix.c_str()), textureUnit);
+        for (int c = 0; c < NR_CASCADES; c++)
+            shader.setMat4(frameFormat("%sShadowMatrices[%d]", prefix.c_str(), c), lightMatrices[c]);
+        shader.setBool("shadowPCF", pcf);
+        glActiveTexture(GL_TEXTURE0 + textureUnit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, depthArray);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void printStats(const string& name)
+    {
+        cout << name << " shadows: " << renderedCascades << " cascades rendered last frame, " << cascadeRenders << " renders, "
+            << cacheHits << " cache hits, pcf " << (pcf ? "on" : "off") << endl;
+        for (int c = 0; c < NR_CASCADES; c++)
+            cout << "  cascade " << c << " to " << splitFar[c] << " m: " << gpuTimeMs[c] << " ms gpu" << endl;
+    }
+
+private:
+    unsigned int depthArray = 0;
+    unsigned int depthFBO = 0;
+    unsigned int timerQueries[NR_CASCADES];
+    bool queryPending[NR_CASCADES] = {};
+    bool cacheValid[NR_CASCADES] = {};
+    glm::mat4 cachedMatrices[NR_CASCADES];
+
+    void fitCascades(const glm::vec3& lightDirection, const glm::mat4& view, float fovY, float aspect, float zNear)
+    {
+        glm::vec3 dir = glm::normalize(lightDirection);
+        glm::vec3 up = fabs(dir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        // fixed orientation, only the ortho window moves with the camera so snapping keeps texels stable
+        glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), dir, up);
+        glm::mat4 inverseView = glm::inverse(view);
+        float tanHalfY = tan(fovY * 0.5f);
+        float tanHalfX = tanHalfY * aspect;
+
+        float splitNear = zNear;
+        for (int c = 0; c < NR_CASCADES; c++)
+        {
+            // practical split scheme, blend of logarithmic and uniform
+            float p = (float)(c + 1) / NR_CASCADES;
+            float logSplit = zNear * pow(shadowDistance / zNear, p);
+            float uniformSplit = zNear + (shadowDistance - zNear) * p;
+            splitFar[c] = splitLambda * logSplit + (1.0f - splitLambda) * uniformSplit;
+
+            // bounding sphere of the cascade's slice of the frustum, its size does not change as the camera turns
+            glm::vec3 corners[8];
+            int i = 0;
+            float depths[2] = { splitNear, splitFar[c] };
+            for (float d : depths)
+                for (int x = -1; x <= 1; x += 2)
+                    for (int y = -1; y <= 1; y += 2)
+                        corners[i++] = glm::vec3(inverseView * glm::vec4(x * d * tanHalfX, y * d * tanHalfY, -d, 1.0f));
+            glm::vec3 center(0.0f);
+            for (const glm::vec3& corner : corners)
+                center += corner;
+            center /= 8.0f;
+            float radius = 0.0f;
+            for (const glm::vec3& corner : corners)
+                radius = glm::max(radius, glm::length(corner - center));
+            radius = ceil(radius);
+
+            // snap to whole texels across and to coarse steps in depth
+            float texel = 2.0f * radius / resolution;
+            float depthStep = radius * 0.5f;
+            glm::vec3 lc = glm::vec3(lightView * glm::vec4(center, 1.0f));
+            lc.x = floor(lc.x / texel) * texel;
+            lc.y = floor(lc.y / texel) * texel;
+            lc.z = floor(lc.z / depthStep) * depthStep;
+            // casters behind the slice (the whole Taj towards the light) still have to land in the map
+            float casterDistance = 150.0f;
+            glm::mat4 lightProjection = glm::ortho(lc.x - radius, lc.x + radius, lc.y - radius, lc.y + radius,
+                -lc.z - radius - depthStep - casterDistance, -lc.z + radius + depthStep);
+            lightMatrices[c] = lightProjection * lightView;
+
+            splitNear = splitFar[c];
+        }
+    }
+
+    void readTimerQueries()
+    {
+        for (int c = 0; c < NR_CASCADES; c++)
+        {
+            if (!queryPending[c])
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(timerQueries[c], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(timerQueries[c], GL_QUERY_RESULT, &elapsed);
+            gpuTimeMs[c] = elapsed / 1000000.0;
+            queryPending[c] = false;
+        }
+    }
+};
+
+#endif /* cascadedShadowMap_h */
@@ -0,0 +1,325 @@
+//
+//  clusteredLighting.h
+//  clustered forward shading: the view frustum is split into a 3D grid of clusters
+//  and every cluster keeps the list of point lights whose radius reaches it. the lists
+//  are rebuilt every frame and stream to the GPU through the frame ring buffer
+//
+
+#ifndef clusteredLighting_h
+#define clusteredLighting_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include "shader.h"
+#include "pointLight.h"
+#include "jobSystem.h"
+#include "frameRingBuffer.h"
+#include "frameArena.h"
+
+using namespace std;
+
+// texture units used by the cluster buffers, kept clear of the diffuse/specular maps
+const int CLUSTER_LIGHTS_UNIT = 2;
+const int CLUSTER_GRID_UNIT = 3;
+const int CLUSTER_INDEX_UNIT = 4;
+
+class ClusteredLighting {
+public:
+    // cluster grid
+    unsigned int gridX;
+    unsigned int gridY;
+    unsigned int gridZ;
+    float zNear;
+    float zFar;
+    JobSystem* jobs = nullptr;      // slices are assigned on its threads when set, on the caller's otherwise
+
+    // statistics of the last assignLights()
+    unsigned int lightCount = 0;
+    unsigned int indexCount = 0;
+    double assignTimeMs = 0.0;
+
+    // constructor
+    ClusteredLighting(FrameRingBuffer& ring, float screenWidth, float screenHeight, float zNear, float zFar, unsigned int gridX = 16, unsigned int gridY = 12, unsigned int gridZ = 24)
+        : ring(ring)
+    {
+        this->screenWidth = screenWidth;
+        this->screenHeight = screenHeight;
+        this->zNear = zNear;
+        this->zFar = zFar;
+        this->gridX = gridX;
+        this->gridY = gridY;
+        this->gridZ = gridZ;
+        clusterMin.resize(gridX * gridY * gridZ);
+        clusterMax.resize(gridX * gridY * gridZ);
+        grid.resize(gridX * gridY * gridZ * 2);
+        sliceIndices.resize(gridZ);
+
+        glGenTextures(1, &lightsTex);
+        glGenTextures(1, &gridTex);
+        glGenTextures(1, &indexTex);
+    }
+
+    // destructor
+    ~ClusteredLighting()
+    {
+        glDeleteTextures(1, &lightsTex);
+        glDeleteTextures(1, &gridTex);
+        glDeleteTextures(1, &indexTex);
+    }
+
+    void setScreenSize(float width, float height)
+    {
+        screenWidth = width;
+        screenHeight = height;
+    }
+
+    // rebuild the view space bounds of every cluster, only needed when the projection changes
+    void updateClusters(const glm::mat4& projection)
+    {
+        if (clustersValid && projection == lastProjection)
+            return;
+        lastProjection = projection;
+        clustersValid = true;
+
+        glm::mat4 invProjection = glm::inverse(projection);
+        for (unsigned int z = 0; z < gridZ; z++)
+        {
+            float sliceNear = sliceDepth(z);
+            float sliceFar = sliceDepth(z + 1);
+            for (unsigned int y = 0; y < gridY; y++)
+            {
+                for (unsigned int x = 0; x < gridX; x++)
+                {
+                    float ndcX[2] = { -1.0f + 2.0f * x / gridX, -1.0f + 2.0f * (x + 1) / gridX };
+                    float ndcY[2] = { -1.0f + 2.0f * y / gridY, -1.0f + 2.0f * (y + 1) / gridY };
+                    glm::vec3 minPoint(FLT_MAX), maxPoint(-FLT_MAX);
+                    for (int i = 0; i < 2; i++)
+                    {
+                        for (int j = 0; j < 2; j++)
+                        {
+                            // ray from the eye through the tile corner, cut by the two slice planes
+                            glm::vec4 p = invProjection * glm::vec4(ndcX[i], ndcY[j], -1.0f, 1.0f);
+                            glm::vec3 corner = glm::vec3(p) / p.w;
+                            glm::vec3 nearCorner = corner * (sliceNear / -corner.z);
+                            glm::vec3 farCorner = corner * (sliceFar / -corner.z);
+                            minPoint = glm::min(minPoint, glm::min(nearCorner, farCorner));
+                            maxPoint = glm::max(maxPoint, glm::max(nearCorner, farCorner));
+                        }
+                    }
+                    unsigned int index = clusterIndex(x, y, z);
+                    clusterMin[index] = minPoint;
+                    clusterMax[index] = maxPoint;
+                }
+            }
+        }
+    }
+
+    // build the per cluster light lists of the count lights on the CPU and write them to this frame's part of the ring
+    void assignLights(PointLight* const* lights, size_t count, const glm::mat4& view)
+    {
+        auto start = chrono::high_resolution_clock::now();
+
+        // pack the lights that are switched on, in view space
+        viewLights.clear();
+        lightData.clear();
+        for (size_t i = 0; i < count; i++)
+        {
+            PointLight* light = lights[i];
+            if (!light->isOn())
+                continue;
+            glm::vec3 viewPos = glm::vec3(view * glm::vec4(light->position, 1.0f));
+            viewLights.push_back(glm::vec4(viewPos, light->radius));
+            pushVec4(glm::vec4(light->position, light->radius));
+            pushVec4(glm::vec4(light->getAmbient(), light->k_c));
+            pushVec4(glm::vec4(light->getDiffuse(), light->k_l));
+            pushVec4(glm::vec4(light->getSpecular(), light->k_q));
+        }
+        lightCount = (unsigned int)viewLights.size();
+
+        // slices are independent, one job each
+        if (jobs == nullptr || lightCount < 32)
+            assignSlices(0, gridZ);
+        else
+            jobs->parallelFor((int)gridZ, 1, [this](int first, int last) { assignSlices(first, last); });
+
+        // stitch the slice lists together and fix up the grid offsets
+        indices.clear();
+        unsigned int clustersPerSlice = gridX * gridY;
+        for (unsigned int z = 0; z < gridZ; z++)
+        {
+            unsigned int base = (unsigned int)indices.size();
+            for (unsigned int c = 0; c < clustersPerSlice; c++)
+                grid[(z * clustersPerSlice + c) * 2] += base;
+            indices.insert(indices.end(), sliceIndices[z].begin(), sliceIndices[z].end());
+        }
+        indexCount = (unsigned int)indices.size();
+        if (indices.empty())
+            indices.push_back(0);
+        if (lightData.empty())
+            pushVec4(glm::vec4(0.0f));
+
+        // one block for the three, every part starts on 16 bytes so its offset is a whole number of texels
+        size_t lightBytes = lightData.size() * sizeof(float);
+        size_t gridBytes = grid.size() * sizeof(unsigned int);
+        size_t indexBytes = indices.size() * sizeof(unsigned int);
+        size_t gridStart = (lightBytes + 15) / 16 * 16;
+        size_t indexStart = gridStart + (gridBytes + 15) / 16 * 16;
+        FrameRingBuffer::Allocation block = ring.allocate(indexStart + indexBytes, 16);
+        memcpy(block.data, lightData.data(), lightBytes);
+        memcpy(block.data + gridStart, grid.data(), gridBytes);
+        memcpy(block.data + indexStart, indices.data(), indexBytes);
+        ring.commit(block);
+        attachRing();
+        lightsBase = (int)(block.offset / (4 * sizeof(float)));
+        gridBase = (int)((block.offset + gridStart) / (2 * sizeof(unsigned int)));
+        indexBase = (int)((block.offset + indexStart) / sizeof(unsigned int));
+
+        auto end = chrono::high_resolution_clock::now();
+        assignTimeMs = chrono::duration<double, milli>(end - start).count();
+    }
+
+    // bind the cluster buffers and grid parameters to a shader using fragmentShaderForClusteredShading.fs
+    void bind(Shader& shader)
+    {
+        shader.use();
+
+        glActiveTexture(GL_TEXTURE0 + CLUSTER_LIGHTS_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, lightsTex);
+        glActiveTexture(GL_TEXTURE0 + CLUSTER_GRID_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, gridTex);
+        glActiveTexture(GL_TEXTURE0 + CLUSTER_INDEX_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, indexTex);
+        glActiveTexture(GL_TEXTURE0);
+
+        shader.setInt("clusterLights", CLUSTER_LIGHTS_UNIT);
+        shader.setInt("clusterGrid", CLUSTER_GRID_UNIT);
+        shader.setInt("clusterLightIndices", CLUSTER_INDEX_UNIT);
+        shader.setInt("clusterLightsBase", lightsBase);
+        shader.setInt("clusterGridBase", gridBase);
+        shader.setInt("clusterIndexBase", indexBase);
+        shader.setVec3("clusterDims", glm::vec3((float)gridX, (float)gridY, (float)gridZ));
+        shader.setVec2("screenSize", screenWidth, screenHeight);
+        shader.setFloat("clusterNear", zNear);
+        shader.setFloat("clusterFar", zFar);
+    }
+
+    float averageLightsPerCluster() const
+    {
+        return (float)indexCount / (gridX * gridY * gridZ);
+    }
+
+private:
+    float screenWidth;
+    float screenHeight;
+    bool clustersValid = false;
+    glm::mat4 lastProjection;
+
+    vector<glm::vec3> clusterMin;
+    vector<glm::vec3> clusterMax;
+    vector<glm::vec4> viewLights;               // view space position, radius
+    vector<float> lightData;                    // 4 texels per light for the shader
+    vector<unsigned int> grid;                  // per cluster: offset, count
+    vector<unsigned int> indices;
+    vector<vector<unsigned int>> sliceIndices;  // per slice light lists, filled by the jobs
+
+    FrameRingBuffer& ring;
+    unsigned int lightsTex, gridTex, indexTex;     // views of the whole ring, the shader adds the bases below
+    unsigned int attachedGeneration = 0;
+    int lightsBase = 0, gridBase = 0, indexBase = 0;
+
+    unsigned int clusterIndex(unsigned int x, unsigned int y, unsigned int z) const
+    {
+        return (z * gridY + y) * gridX + x;
+    }
+
+    // view space distance of the near plane of slice k, slices are spaced exponentially
+    float sliceDepth(unsigned int k) const
+    {
+        return zNear * pow(zFar / zNear, (float)k / gridZ);
+    }
+
+    void assignSlices(unsigned int firstSlice, unsigned int lastSlice)
+    {
+        pmr::vector<unsigned int> candidates(FrameArena::resource());
+        for (unsigned int z = firstSlice; z < lastSlice; z++)
+        {
+            vector<unsigned int>& list = sliceIndices[z];
+            list.clear();
+
+            // only lights that overlap the depth range of this slice are tested against its tiles
+            float sliceNear = sliceDepth(z);
+            float sliceFar = sliceDepth(z + 1);
+            candidates.clear();
+            for (unsigned int i = 0; i < viewLights.size(); i++)
+            {
+                float depth = -viewLights[i].z;
+                float r = viewLights[i].w;
+                if (depth + r >= sliceNear && depth - r <= sliceFar)
+                    candidates.push_back(i);
+            }
+
+            for (unsigned int y = 0; y < gridY; y++)
+            {
+                for (unsigned int x = 0; x < gridX; x++)
+                {
+                    unsigned int index = clusterIndex(x, y, z);
+                    unsigned int offset = (unsigned int)list.size();
+                    for (unsigned int i : candidates)
+                    {
+                        if (sphereIntersectsAABB(viewLights[i], clusterMin[index], clusterMax[index]))
+                            list.push_back(i);
+                    }
+                    // offset is relative to the slice until assignLights() stitches the slices
+                    grid[index * 2] = offset;
+                    grid[index * 2 + 1] = (unsigned int)list.size() - offset;
+                }
+            }
+        }
+    }
+
+    static bool sphereIntersectsAABB(const glm::vec4& sphere, const glm::vec3& minPoint, const glm::vec3& maxPoint)
+    {
+        float distSq = 0.0f;
+        for (int i = 0; i < 3; i++)
+        {
+            float v = sphere[i];
+            if (v < minPoint[i])
+                distSq += (minPoint[i] - v) * (minPoint[i] - v);
+            else if (v > maxPoint[i])
+                distSq += (v - maxPoint[i]) * (v - maxPoint[i]);
+        }
+        return distSq <= sphere.w * sphere.w;
+    }
+
+    void pushVec4(const glm::vec4& v)
+    {
+        lightData.push_back(v.x);
+        lightData.push_back(v.y);
+        lightData.push_back(v.z);
+        lightData.push_back(v.w);
+    }
+
+    // the ring's buffer object changes when it grows, the textures follow it
+    void attachRing()
+    {
+        if (attachedGeneration == ring.generation())
+            return;
+        attachedGeneration = ring.generation();
+        attachTexture(lightsTex, GL_RGBA32F);
+        attachTexture(gridTex, GL_RG32UI);
+        attachTexture(indexTex, GL_R32UI);
+    }
+
+    void attachTexture(unsigned int texture, GLenum format)
+    {
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, ring.buffer());
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+};
+
+#endif /* clusteredLighting_h */
@@ -14,6 +14,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "shader.h"
+#include "vertexFormat.h"
 
 using namespace std;
 
@@ -91,7 +92,7 @@ public:
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_2D, this->specularMap);
 
-        lightingShaderWithTexture.setMat4("model", model);
+        lightingShaderWithTexture.setMat4("model", model * positionTransform);
 
         glBindVertexArray(lightTexCubeVAO);
         glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
@@ -106,7 +107,7 @@ public:
         lightingShader.setVec3("material.specular", this->specular);
         lightingShader.setFloat("material.shininess", this->shininess);
 
-        lightingShader.setMat4("model", model);
+        lightingShader.setMat4("model", model * positionTransform);
 
         glBindVertexArray(lightCubeVAO);
         glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
@@ -117,7 +118,7 @@ public:
         shader.use();
 
         shader.setVec3("color", glm::vec3(r, g, b));
-        shader.setMat4("model", model);
+        shader.setMat4("model", model * positionTransform);
 
         glBindVertexArray(cubeVAO);
         glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
@@ -144,6 +145,7 @@ private:
     unsigned int lightTexCubeVAO;
     unsigned int cubeVBO;
     unsigned int cubeEBO;
+    glm::mat4 positionTransform = glm::mat4(1.0f);     // from the stored positions, see VertexData
 
     void setUpCubeVertexDataAndConfigureVertexAttribute()
     {
@@ -202,6 +204,9 @@ private:
             22, 23, 20
         };
 
+        VertexData vertexData(cube_vertices, 24, 8, true);
+        positionTransform = vertexData.positionTransform;
+
         glGenVertexArrays(1, &cubeVAO);
         glGenVertexArrays(1, &lightCubeVAO);
         glGenVertexArrays(1, &lightTexCubeVAO);
@@ -212,22 +217,13 @@ private:
         glBindVertexArray(lightTexCubeVAO);
 
         glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, vertexData.bytes.size(), vertexData.bytes.data(), GL_STATIC_DRAW);
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEBO);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cube_indices), cube_indices, GL_STATIC_DRAW);
 
-        // position attribute
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
-
-        // vertex normal attribute
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)12);
-        glEnableVertexAttribArray(1);
-
-        // texture coordinate attribute
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)24);
-        glEnableVertexAttribArray(2);
+        // position, vertex normal and texture coordinate attributes
+        vertexData.setAttributes(true, true);
 
 
         glBindVertexArray(lightCubeVAO);
@@ -235,11 +231,7 @@ private:
         glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEBO);
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
-
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)12);
-        glEnableVertexAttribArray(1);
+        vertexData.setAttributes(true, false);
 
 
         glBindVertexArray(cubeVAO);
@@ -247,8 +239,7 @@ private:
         glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEBO);
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
+        vertexData.setAttributes(false, false);
     }
 
 };
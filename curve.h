@@ -4,15 +4,25 @@
 
 #include <glad/glad.h>
 #include <vector>
+#include <string>
+#include <mutex>
+#include <iostream>
+#include <cstring>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "shader.h"
+#include "meshBuilder.h"
 
 # define PI 3.1416
 
 using namespace std;
 
+// texture unit the profile of a vertex pulled surface is bound to, above the shadow maps
+const int REVOLUTION_PROFILE_UNIT = 12;
+// and the cubic segments of a surface drawn as tessellated patches
+const int PROFILE_SEGMENT_UNIT = 13;
+
 class BezierCurve
 {
 public:
@@ -24,9 +34,34 @@ public:
 
     unsigned int diffuseMap;
     unsigned int specularMap;
+
+    // the profile as cubic Bezier segments uniform in t, 4 points each, sharing their ends' points and slopes with
+    // their neighbours. a point is 4 control points away instead of all of them
+    struct CubicProfile {
+        int segments = 0;
+        vector<glm::vec2> points;       // 4 a segment
+        float error = 0.0f;             // farthest from the global Bezier where the fit was measured
+
+        void evaluate(double t, float xy[2], float dxy[2] = nullptr) const
+        {
+            double scaled = std::min(std::max(t, 0.0), 1.0) * segments;
+            int segment = std::min((int)scaled, segments - 1);
+            float u = (float)(scaled - segment), s = 1.0f - u;
+            const glm::vec2* p = &points[(size_t)segment * 4];
+            glm::vec2 point = s * s * s * p[0] + 3.0f * s * s * u * p[1] + 3.0f * s * u * u * p[2] + u * u * u * p[3];
+            xy[0] = point.x;
+            xy[1] = point.y;
+            if (dxy == nullptr)
+                return;
+            glm::vec2 derivative = 3.0f * (float)segments * (s * s * (p[1] - p[0]) + 2.0f * s * u * (p[2] - p[1]) + u * u * (p[3] - p[2]));
+            dxy[0] = derivative.x;
+            dxy[1] = derivative.y;
+        }
+    };
     // ctor/dtor
     
-    BezierCurve(GLfloat controlpoints[], int size, glm::vec4 amb = glm::vec4(0.9098039215686274, 0.8549019607843137, 0.8, 1.0f), glm::vec4 diff = glm::vec4(0.9098039215686274, 0.8549019607843137, 0.8, 1.0f), glm::vec4 spec = glm::vec4(0.1f, 0.1f, 0.1f, 0.5f), float shiny = 32.0f, int flag = 0)
+    // with deferBuild the surface is left to generate() and upload(), so it can be built off the context thread
+    BezierCurve(GLfloat controlpoints[], int size, glm::vec4 amb = glm::vec4(0.9098039215686274, 0.8549019607843137, 0.8, 1.0f), glm::vec4 diff = glm::vec4(0.9098039215686274, 0.8549019607843137, 0.8, 1.0f), glm::vec4 spec = glm::vec4(0.1f, 0.1f, 0.1f, 0.5f), float shiny = 32.0f, int flag = 0, bool deferBuild = false)
     {
         for (int i = 0; i < size; i++)
         {
@@ -36,14 +71,13 @@ public:
         this->diffuse = diff;
         this->specular = spec;
         this->shininess = shiny;
-        if (flag == 0) {
-            this->sphereVAO = hollowBezier(cntrlPoints.data(), ((unsigned int)cntrlPoints.size() / 3) - 1);
-        }
-        else {
-            this->sphereVAO = semiHollowBezier(cntrlPoints.data(), ((unsigned int)cntrlPoints.size() / 3) - 1);
+        this->flag = flag;
+        cubic = fitProfile(cntrlPoints.data(), ((int)cntrlPoints.size() / 3) - 1);
+        if (!deferBuild)
+        {
+            generate();
+            upload();
         }
-        
-
     }
     BezierCurve(GLfloat controlpoints[], int size, unsigned int dMap, unsigned int sMap, float shiny = 32.0f)
     {
@@ -54,123 +88,221 @@ public:
         this->diffuseMap = dMap;
         this->specularMap = sMap;
         this->shininess = shiny;
-        this->sphereVAO = hollowBezier(cntrlPoints.data(), ((unsigned int)cntrlPoints.size() / 3) - 1);
+        cubic = fitProfile(cntrlPoints.data(), ((int)cntrlPoints.size() / 3) - 1);
+        generate();
+        upload();
 
     }
     ~BezierCurve() {}
-    // draw in VertexArray mode
-    void drawBezierCurvewithTex(Shader& lightingShader, glm::mat4 model, glm::vec3 amb)   // draw surface
+
+    // with vertex pulling the surfaces keep only their profile on the GPU, one texel per step along it, and the
+    // vertex shaders revolve it around the axis from gl_VertexID. set before the first generate()
+    static bool& vertexPulling()
     {
-        lightingShader.use();
-        lightingShader.setMat4("model", model);
-        lightingShader.setVec3("material.ambient", amb);
-        lightingShader.setVec3("material.diffuse", amb);
-        lightingShader.setVec3("material.specular", glm::vec3(0.5f, 0.5f, 0.5f));
-        lightingShader.setFloat("material.shininess", 32.0f);
+        static bool enabled = false;
+        return enabled;
+    }
 
-        // Set texture properties
-        lightingShader.setInt("material.diffuseMap", 0);  // 0 corresponds to GL_TEXTURE0
-        lightingShader.setInt("material.specularMap", 1); // 1 corresponds to GL_TEXTURE1
+    // angular resolution of every vertex pulled surface, takes effect with the next draw
+    static int& pulledSlices()
+    {
+        static int slices = SLICES;
+        return slices;
+    }
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMap);
+    // largest distance between the profile and the chords of its sampled steps, in the surface's own units. the
+    // steps are placed where the profile bends, 0 samples it at STEPS uniform steps. set before the first generate()
+    static float& profileTolerance()
+    {
+        static float tolerance = PROFILE_TOLERANCE;
+        return tolerance;
+    }
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specularMap);
+    // with tessellation the surfaces also keep their control points on the GPU, and the forward pass draws them
+    // as patches the tessellation stages evaluate, split by their size on the screen. the other passes pull the
+    // profile like vertexPulling(). set before the first generate(), only when ARB_tessellation_shader is there
+    static bool& tessellation()
+    {
+        static bool enabled = false;
+        return enabled;
+    }
 
-        glBindVertexArray(sphereVAO);
-        glDrawElements(GL_TRIANGLES, (unsigned int)indices.size(), GL_UNSIGNED_INT, (void*)0);
+    // the program drawing the patches in place of lightingProgram, the frame's forward Phong program. a draw
+    // with any other program draws the pulled profile. set per frame, patchShader is left nullptr when no
+    // program draws patches
+    struct PatchSettings {
+        unsigned int lightingProgram = 0;
+        Shader* patchShader = nullptr;
+        float pixelsPerEdge = 8.0f;     // screen length the edges of the patches are split into
+    };
+    static PatchSettings& patches()
+    {
+        static PatchSettings settings;
+        return settings;
+    }
 
-        // unbind VAO
-        glBindVertexArray(0);
+    // tessellates the surface (or with vertexPulling() or tessellation() only its profile) into staging, a mesh is
+    // optimized and reported as name. touches no GL state
+    void generate(const char* name = "surface of revolution")
+    {
+        vector<double> parameters;
+        ProfileReport report;
+        report.name = name;
+        report.error = profileParameters(parameters, cubic, STEPS, profileTolerance(), &report.uniformError);
+        report.steps = (int)parameters.size() - 1;
+        addProfileReport(report);
+        if (vertexPulling() || tessellation())
+        {
+            sampleProfile(profile, cubic, parameters);
+            return;
+        }
+        tessellate(staging, parameters, SLICES);
+        staging.optimize(name);
     }
-    void drawBezierCurve(Shader& lightingShader, glm::mat4 model) const      // draw surface
+
+    // this surface into any builder, with detail times the steps in both directions. adaptive steps are
+    // placed for a tolerance detail squared times smaller, the chord error falls with the square of the steps
+    void tessellate(MeshBuilder& builder, int detail = 1) const
     {
-        lightingShader.use();
+        vector<double> parameters;
+        profileParameters(parameters, cubic, STEPS * detail, profileTolerance() / (detail * detail));
+        tessellate(builder, parameters, SLICES * detail);
+    }
 
-        lightingShader.setVec3("material.ambient", this->ambient);
-        lightingShader.setVec3("material.diffuse", this->diffuse);
-        lightingShader.setVec3("material.specular", this->specular);
-        lightingShader.setFloat("material.shininess", this->shininess);
-        
+    // how the profiles were sampled by generate(), against the uniform steps
+    static void printProfileStats()
+    {
+        lock_guard<mutex> lock(profileReportLock());
+        for (const ProfileReport& report : profileReports())
+        {
+            cout << "profile " << report.name << ": " << report.steps + 1 << " rings, " << (report.steps + 1) * (SLICES + 1) << " vertices, chord error "
+                << report.error << " (uniform " << STEPS + 1 << " rings, " << (STEPS + 1) * (SLICES + 1) << " vertices, chord error " << report.uniformError << ")" << endl;
+        }
+        profileReports().clear();
+    }
 
-        lightingShader.setMat4("model", model);
+    // copies the generated surface into a VAO, or the profile (and the control points) into a buffer texture,
+    // and frees the staging. needs the context
+    void upload()
+    {
+        if (tessellation())
+            uploadSegments();
+        if (profile.empty())
+        {
+            this->mesh = staging.upload();
+            return;
+        }
+        profileSteps = (int)profile.size() / 4 - 1;
+        glGenBuffers(1, &profileBuffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, profileBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, profile.size() * sizeof(float), profile.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glGenTextures(1, &profileTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, profileTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, profileBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        vector<float>().swap(profile);
+        // core profiles draw nothing without a vertex array, even when no attribute is read
+        if (emptyVertexArray() == 0)
+            glGenVertexArrays(1, &emptyVertexArray());
+    }
 
-        glBindVertexArray(sphereVAO);
-        glDrawElements(GL_TRIANGLES,                    // primitive type
-            (unsigned int)indices.size(),          // # of indices
-            GL_UNSIGNED_INT,                 // data type
-            (void*)0);                       // offset to indices
+    // bytes the surface keeps on the GPU
+    size_t gpuBytes() const
+    {
+        if (profileTexture != 0)
+            return (size_t)(profileSteps + 1 + (segmentTexture != 0 ? cubic.segments * 2 : 0)) * 4 * sizeof(float);
+        return (size_t)mesh.vertexCount * VertexData::strideOf(mesh.format, false) + (size_t)mesh.indexCount * sizeof(unsigned int);
+    }
 
-        // unbind VAO
-        glBindVertexArray(0);
+    const GpuMesh& getMesh() const
+    {
+        return mesh;
     }
-    void setTextureProperty(unsigned int dMap, unsigned int sMap, float shiny)
+
+    const CubicProfile& getProfile() const
     {
-        this->diffuseMap = dMap;
-        this->specularMap = sMap;
-        this->shininess = shiny;
+        return cubic;
     }
 
-private:
-    // member functions
-    long long nCr(int n, int r)
+    // the profile from the global Bezier of all the control points, what the cubic segments are fitted to
+    void evaluateBezier(double t, float xy[2]) const
     {
-        if (r > n / 2)
-            r = n - r; // because C(n, r) == C(n, n - r)
-        long long ans = 1;
-        int i;
+        BezierCurveFN(t, xy, cntrlPoints.data(), ((int)cntrlPoints.size() / 3) - 1);
+    }
 
-        for (i = 1; i <= r; i++)
+    // parameters the profile is sampled at into parameters, returns the largest chord error measured at
+    // PROFILE_CANDIDATES + 1 uniform parameters. with a tolerance they are the fewest of those candidates that
+    // keep it, each chord reaching as far along as it can, otherwise steps + 1 uniform ones. uniformError gets
+    // the error of steps uniform steps
+    static float profileParameters(vector<double>& parameters, const CubicProfile& cubic, int steps, float tolerance, float* uniformError = nullptr)
+    {
+        const int candidates = PROFILE_CANDIDATES;
+        vector<glm::vec2> points(candidates + 1);
+        for (int i = 0; i <= candidates; i++)
         {
-            ans *= n - r + i;
-            ans /= i;
+            float xy[2];
+            cubic.evaluate((double)i / candidates, xy);
+            points[i] = glm::vec2(xy[0], xy[1]);
         }
-
-        return ans;
-    }
-//polynomial interpretation for N points
-    void BezierCurveFN(double t, float xy[2], GLfloat ctrlpoints[], int L)
-    {
-        double y = 0;
-        double x = 0;
-        t = t > 1.0 ? 1.0 : t;
-        for (int i = 0; i < L + 1; i++)
+        // a step between candidates is measured at the candidates it covers
+        auto nearest = [candidates](double t) { return (int)lround(t * candidates); };
+        float error = 0.0f;
+        for (int i = 0; i < steps && uniformError != nullptr; i++)
+            error = std::max(error, chordError(points, nearest((double)i / steps), nearest((double)(i + 1) / steps)));
+        if (uniformError != nullptr)
+            *uniformError = error;
+
+        parameters.clear();
+        if (tolerance <= 0.0f)
         {
-            long long ncr = nCr(L, i);
-            double oneMinusTpow = pow(1 - t, double(L - i));
-            double tPow = pow(t, double(i));
-            double coef = oneMinusTpow * tPow * ncr;
-            x += coef * ctrlpoints[i * 3];
-            y += coef * ctrlpoints[(i * 3) + 1];
-
+            for (int i = 0; i <= steps; i++)
+                parameters.push_back((double)i / steps);
+            return error;
         }
-        xy[0] = float(x);
-        xy[1] = float(y);
+        error = 0.0f;
+        parameters.push_back(0.0);
+        for (int from = 0; from < candidates; )
+        {
+            int to = from + 1;
+            while (to < candidates && chordError(points, from, to + 1) <= tolerance)
+                to++;
+            error = std::max(error, chordError(points, from, to));
+            parameters.push_back((double)to / candidates);
+            from = to;
+        }
+        return error;
     }
 
+    // the surface of revolution of the profile cubic (x the radius) with nt steps along the profile and ntheta
+    // around the y axis. half keeps the vertices with z <= 0
+    static void tessellate(MeshBuilder& builder, const CubicProfile& cubic, int nt, int ntheta, bool half)
+    {
+        vector<double> parameters;
+        for (int i = 0; i <= nt; i++)
+            parameters.push_back((double)i / nt);
+        tessellate(builder, cubic, parameters, ntheta, half);
+    }
 
-    unsigned int hollowBezier(GLfloat ctrlpoints[], int L)
+    // the same with a ring at each of the parameters along the profile
+    static void tessellate(MeshBuilder& builder, const CubicProfile& cubic, const vector<double>& parameters, int ntheta, bool half)
     {
         int i, j;
         float x, y, z, r;                //current coordinates
         float theta;
         float nx, ny, nz, lengthInv;    // vertex normal
-        float u, v;                     // texture coordinates
 
         const float dtheta = 2 * pi / ntheta;        //angular step size
 
-        float t = 0;
-        float dt = 1.0 / nt;
+        int nt = (int)parameters.size() - 1;
         float xy[2];
 
         for (i = 0; i <= nt; ++i)              //step through y
         {
-            BezierCurveFN(t, xy, ctrlpoints, L);
+            cubic.evaluate(parameters[i], xy);
             r = xy[0];
             y = xy[1];
             theta = 0;
-            t += dt;
             lengthInv = 1.0 / r;
 
             for (j = 0; j <= ntheta; ++j)
@@ -180,26 +312,16 @@ private:
                 z = r * cosa;
                 x = r * sina;
 
-                coordinates.push_back(x);
-                coordinates.push_back(y);
-                coordinates.push_back(z);
-
-                // normalized vertex normal (nx, ny, nz)
-                // center point of the circle (0,y,0)
-                nx = (x - 0) * lengthInv;
-                ny = (y - y) * lengthInv;
-                nz = (z - 0) * lengthInv;
-
-                normals.push_back(nx);
-                normals.push_back(ny);
-                normals.push_back(nz);
-
-                // Calculate texture coordinates (s, t)
-                u = static_cast<float>(j) / ntheta;
-                v = static_cast<float>(i) / nt;
-                texCoords.push_back(u);
-                texCoords.push_back(v);
+                if (!half || z <= 0) {
+                    // normalized vertex normal (nx, ny, nz)
+                    // center point of the circle (0,y,0)
+                    nx = (x - 0) * lengthInv;
+                    ny = (y - y) * lengthInv;
+                    nz = (z - 0) * lengthInv;
 
+                    // the surface is seen from inside, so the normals point to the axis
+                    builder.vertex(x, y, z, -1 * nx, -1 * ny, -1 * nz);
+                }
 
                 theta += dtheta;
             }
@@ -220,245 +342,342 @@ private:
             for (int j = 0; j < ntheta; ++j, ++k1, ++k2)
             {
                 // k1 => k2 => k1+1
-                indices.push_back(k1);
-                indices.push_back(k2);
-                indices.push_back(k1 + 1);
-
+                builder.triangle(k1, k2, k1 + 1);
                 // k1+1 => k2 => k2+1
-                indices.push_back(k1 + 1);
-                indices.push_back(k2);
-                indices.push_back(k2 + 1);
+                builder.triangle(k1 + 1, k2, k2 + 1);
             }
         }
+    }
 
-        size_t count = coordinates.size();
-        for (i = 0, j = 0; i < count; i += 3, j += 2)
-        {
-            vertices.push_back(coordinates[i]);
-            vertices.push_back(coordinates[i + 1]);
-            vertices.push_back(coordinates[i + 2]);
-
-            if (i < normals.size())
-                vertices.push_back(-1*normals[i]);
-            if (i + 1 < normals.size())
-                vertices.push_back(-1*normals[i + 1]);
-            if (i + 2 < normals.size())
-                vertices.push_back(-1*normals[i + 2]);
-
-            // Add texture coordinates
-            /*if (j < texCoords.size())
-                vertices.push_back(texCoords[j]);
-            if (j + 1 < texCoords.size())
-                vertices.push_back(texCoords[j + 1]);*/
-            
-        }
+    // draw in VertexArray mode
+    void drawBezierCurvewithTex(Shader& lightingShader, glm::mat4 model, glm::vec3 amb)   // draw surface
+    {
+        lightingShader.use();
+        lightingShader.setMat4("model", model * drawTransform());
+        lightingShader.setVec3("material.ambient", amb);
+        lightingShader.setVec3("material.diffuse", amb);
+        lightingShader.setVec3("material.specular", glm::vec3(0.5f, 0.5f, 0.5f));
+        lightingShader.setFloat("material.shininess", 32.0f);
 
-        unsigned int bezierVAO;
-        glGenVertexArrays(1, &bezierVAO);
-        glBindVertexArray(bezierVAO);
-
-        // create VBO to copy vertex data to VBO
-        unsigned int bezierVBO;
-        glGenBuffers(1, &bezierVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, bezierVBO);           // for vertex data
-        glBufferData(GL_ARRAY_BUFFER,                   // target
-            (unsigned int)vertices.size() * sizeof(float), // data size, # of bytes
-            vertices.data(),   // ptr to vertex data
-            GL_STATIC_DRAW);                   // usage
-
-        // create EBO to copy index data
-        unsigned int bezierEBO;
-        glGenBuffers(1, &bezierEBO);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bezierEBO);   // for index data
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER,           // target
-            (unsigned int)indices.size() * sizeof(unsigned int),             // data size, # of bytes
-            indices.data(),               // ptr to index data
-            GL_STATIC_DRAW);                   // usage
-
-        // activate attrib arrays
-        glEnableVertexAttribArray(0);
-        glEnableVertexAttribArray(1);
-        glEnableVertexAttribArray(2);
-        // set attrib arrays with stride and offset
-        int stride = 24;     // should be 24 bytes
-        glVertexAttribPointer(0, 3, GL_FLOAT, false, stride, (void*)0);
-        glVertexAttribPointer(1, 3, GL_FLOAT, false, stride, (void*)(sizeof(float) * 3));
-        glVertexAttribPointer(2, 2, GL_FLOAT, false, stride, (void*)(sizeof(float) * 6));
-
-        // unbind VAO, VBO and EBO
-        glBindVertexArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        // Set texture properties
+        lightingShader.setInt("material.diffuseMap", 0);  // 0 corresponds to GL_TEXTURE0
+        lightingShader.setInt("material.specularMap", 1); // 1 corresponds to GL_TEXTURE1
 
-        return bezierVAO;
-    }
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, diffuseMap);
 
-    unsigned int semiHollowBezier(GLfloat ctrlpoints[], int L)
-    {
-        int i, j;
-        float x, y, z, r;                //current coordinates
-        float theta;
-        float nx, ny, nz, lengthInv;    // vertex normal
-        float u, v;                     // texture coordinates
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, specularMap);
 
-        const float dtheta = 2 * pi / ntheta;        //angular step size
+        drawSurface(lightingShader);
+    }
+    void drawBezierCurve(Shader& lightingShader, glm::mat4 model) const      // draw surface
+    {
+        bool tessellated = segmentTexture != 0 && patches().patchShader != nullptr && patches().lightingProgram == lightingShader.ID;
+        Shader& shader = tessellated ? *patches().patchShader : lightingShader;
+        shader.use();
+
+        shader.setVec3("material.ambient", this->ambient);
+        shader.setVec3("material.diffuse", this->diffuse);
+        shader.setVec3("material.specular", this->specular);
+        shader.setFloat("material.shininess", this->shininess);
+        
 
-        float t = 0;
-        float dt = 1.0 / nt;
-        float xy[2];
+        shader.setMat4("model", model * drawTransform());
 
-        for (i = 0; i <= nt; ++i)              //step through y
+        if (!tessellated)
         {
-            BezierCurveFN(t, xy, ctrlpoints, L);
-            r = xy[0];
-            y = xy[1];
-            theta = 0;
-            t += dt;
-            lengthInv = 1.0 / r;
-
-            for (j = 0; j <= ntheta; ++j)
-            {
-                double cosa = cos(theta);
-                double sina = sin(theta);
-                z = r * cosa;
-                x = r * sina;
+            drawSurface(lightingShader);
+            return;
+        }
+        drawPatches(shader);
+        // the caller goes on setting uniforms of its own program
+        lightingShader.use();
+    }
+    void setTextureProperty(unsigned int dMap, unsigned int sMap, float shiny)
+    {
+        this->diffuseMap = dMap;
+        this->specularMap = sMap;
+        this->shininess = shiny;
+    }
 
-                if (z <= 0) {
-                    coordinates.push_back(x);
-                    coordinates.push_back(y);
-                    coordinates.push_back(z);
+private:
+    // member functions
+    // the pulled vertices are in the surface's own space, the mesh's positions may be packed
+    glm::mat4 drawTransform() const
+    {
+        return profileTexture != 0 ? glm::mat4(1.0f) : mesh.positionTransform;
+    }
 
-                    // normalized vertex normal (nx, ny, nz)
-                    // center point of the circle (0,y,0)
-                    nx = (x - 0) * lengthInv;
-                    ny = (y - y) * lengthInv;
-                    nz = (z - 0) * lengthInv;
+    void drawSurface(const Shader& lightingShader) const
+    {
+        if (profileTexture == 0)
+        {
+            glBindVertexArray(mesh.vao);
+            glDrawElements(GL_TRIANGLES,                    // primitive type
+                mesh.indexCount,                 // # of indices
+                GL_UNSIGNED_INT,                 // data type
+                (void*)0);                       // offset to indices
+
+            // unbind VAO
+            glBindVertexArray(0);
+            return;
+        }
 
-                    normals.push_back(nx);
-                    normals.push_back(ny);
-                    normals.push_back(nz);
+        // the half surface is the slices with z <= 0, a quarter turn to three quarters
+        int slices = flag != 0 ? pulledSlices() / 2 : pulledSlices();
+        float step = (float)(2 * pi / pulledSlices());
+        glActiveTexture(GL_TEXTURE0 + REVOLUTION_PROFILE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, profileTexture);
+        glActiveTexture(GL_TEXTURE0);
+        lightingShader.setInt("revolutionSlices", slices);
+        lightingShader.setFloat("revolutionStart", flag != 0 ? (float)(pi / 2) : 0.0f);
+        lightingShader.setFloat("revolutionStep", step);
 
-                    // Calculate texture coordinates (s, t)
-                    u = static_cast<float>(j) / ntheta;
-                    v = static_cast<float>(i) / nt;
-                    texCoords.push_back(u);
-                    texCoords.push_back(v);
+        glBindVertexArray(emptyVertexArray());
+        glDrawArrays(GL_TRIANGLES, 0, profileSteps * slices * 6);
+        glBindVertexArray(0);
+        // the program's other meshes read their attributes again
+        lightingShader.setInt("revolutionSlices", 0);
+    }
 
+    // PATCH_ROWS along the profile times PATCH_COLUMNS around the axis (half of them for the half surface),
+    // the tessellation stages take the vertices and the normals from the cubic segments
+    void drawPatches(const Shader& patchShader) const
+    {
+#ifdef GL_ARB_tessellation_shader
+        int columns = flag != 0 ? PATCH_COLUMNS / 2 : PATCH_COLUMNS;
+        glActiveTexture(GL_TEXTURE0 + PROFILE_SEGMENT_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, segmentTexture);
+        glActiveTexture(GL_TEXTURE0);
+        patchShader.setInt("profileSegmentCount", cubic.segments);
+        patchShader.setFloat("profileOrientation", orientation);
+        patchShader.setInt("patchRows", PATCH_ROWS);
+        patchShader.setInt("patchColumns", columns);
+        patchShader.setFloat("revolutionStart", flag != 0 ? (float)(pi / 2) : 0.0f);
+        patchShader.setFloat("revolutionSpan", (float)(flag != 0 ? pi : 2 * pi));
+
+        glPatchParameteri(GL_PATCH_VERTICES, 4);
+        glBindVertexArray(emptyVertexArray());
+        glDrawArrays(GL_PATCHES, 0, PATCH_ROWS * columns * 4);
+        glBindVertexArray(0);
+#endif
+    }
 
-                }
+    // the cubic segments for the tessellation stages, two texels of two points (radius and height) each
+    void uploadSegments()
+    {
+        const vector<glm::vec2>& points = cubic.points;
+        vector<float> texels(points.size() * 2);
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            texels[i * 2] = points[i].x;
+            texels[i * 2 + 1] = points[i].y;
+        }
+        // the height the profile gains from its first to its last point, like the sampled profile's rise
+        orientation = points.back().y < points.front().y ? -1.0f : 1.0f;
+        glGenBuffers(1, &segmentBuffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, segmentBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, texels.size() * sizeof(float), texels.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glGenTextures(1, &segmentTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, segmentTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, segmentBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
 
-                
+    static unsigned int& emptyVertexArray()
+    {
+        static unsigned int vao = 0;
+        return vao;
+    }
 
-                theta += dtheta;
+    // radius, height and the profile's derivative at each of the parameters, 4 floats each. the derivative is
+    // turned so the profile runs upwards, then (-dy, dr) is the normal towards the axis like the mesh's
+    static void sampleProfile(vector<float>& samples, const CubicProfile& cubic, const vector<double>& parameters)
+    {
+        int steps = (int)parameters.size() - 1;
+        samples.resize((size_t)(steps + 1) * 4);
+        double rise = 0.0;
+        for (int i = 0; i <= steps; i++)
+        {
+            double t = parameters[i];
+            float xy[2], derivative[2];
+            cubic.evaluate(t, xy, derivative);
+            float values[4] = { xy[0], xy[1], derivative[0], derivative[1] };
+            memcpy(&samples[(size_t)i * 4], values, sizeof(values));
+            rise += derivative[1];
+        }
+        if (rise < 0.0)
+            for (int i = 0; i <= steps; i++)
+            {
+                samples[(size_t)i * 4 + 2] = -samples[(size_t)i * 4 + 2];
+                samples[(size_t)i * 4 + 3] = -samples[(size_t)i * 4 + 3];
             }
+    }
+
+    // tessellate() with the surface's own settings, a ring at each of the parameters
+    void tessellate(MeshBuilder& builder, const vector<double>& parameters, int ntheta) const
+    {
+        int nt = (int)parameters.size() - 1;
+        builder.reserve((size_t)(nt + 1) * (ntheta + 1), (size_t)nt * ntheta * 6);
+        tessellate(builder, cubic, parameters, ntheta, flag != 0);
+    }
+
+    // farthest of the points strictly between from and to from the chord between them
+    static float chordError(const vector<glm::vec2>& points, int from, int to)
+    {
+        glm::vec2 a = points[from], chord = points[to] - points[from];
+        float length2 = glm::dot(chord, chord);
+        float error = 0.0f;
+        for (int k = from + 1; k < to; k++)
+        {
+            float along = length2 > 0.0f ? glm::clamp(glm::dot(points[k] - a, chord) / length2, 0.0f, 1.0f) : 0.0f;
+            error = std::max(error, glm::length(points[k] - (a + along * chord)));
         }
+        return error;
+    }
 
+    struct ProfileReport {
+        string name;
+        int steps = 0;
+        float error = 0.0f;
+        float uniformError = 0.0f;
+    };
 
-        // generate index list of triangles
-        // k1--k1+1
-        // |  / |
-        // | /  |
-        // k2--k2+1
+    static vector<ProfileReport>& profileReports()
+    {
+        static vector<ProfileReport> reports;
+        return reports;
+    }
 
-        int k1, k2;
-        for (int i = 0; i < nt; ++i)
-        {
-            k1 = i * (ntheta + 1);     // beginning of current stack
-            k2 = k1 + ntheta + 1;      // beginning of next stack
+    static mutex& profileReportLock()
+    {
+        static mutex lock;
+        return lock;
+    }
 
-            for (int j = 0; j < ntheta; ++j, ++k1, ++k2)
-            {
-                // k1 => k2 => k1+1
-                indices.push_back(k1);
-                indices.push_back(k2);
-                indices.push_back(k1 + 1);
+    // generate() runs on the startup graph's workers
+    static void addProfileReport(const ProfileReport& report)
+    {
+        lock_guard<mutex> lock(profileReportLock());
+        profileReports().push_back(report);
+    }
 
-                // k1+1 => k2 => k2+1
-                indices.push_back(k1 + 1);
-                indices.push_back(k2);
-                indices.push_back(k2 + 1);
+    // the global Bezier of the control points as the fewest of 1, 2, 4 .. MAX_PROFILE_SEGMENTS cubic segments that
+    // interpolate its points and derivatives at their ends and stay within CUBIC_PROFILE_TOLERANCE of it, measured
+    // at 4 points inside each segment
+    static CubicProfile fitProfile(const GLfloat ctrlpoints[], int L)
+    {
+        CubicProfile cubic;
+        for (int segments = 1; ; segments *= 2)
+        {
+            double h = 1.0 / segments;
+            cubic.segments = segments;
+            cubic.points.resize((size_t)segments * 4);
+            for (int i = 0; i < segments; i++)
+            {
+                float a[2], da[2], b[2], db[2];
+                BezierCurveFN(i * h, a, ctrlpoints, L);
+                BezierDerivativeFN(i * h, da, ctrlpoints, L);
+                BezierCurveFN((i + 1) * h, b, ctrlpoints, L);
+                BezierDerivativeFN((i + 1) * h, db, ctrlpoints, L);
+                glm::vec2* p = &cubic.points[(size_t)i * 4];
+                p[0] = glm::vec2(a[0], a[1]);
+                p[1] = p[0] + glm::vec2(da[0], da[1]) * (float)(h / 3);
+                p[3] = glm::vec2(b[0], b[1]);
+                p[2] = p[3] - glm::vec2(db[0], db[1]) * (float)(h / 3);
             }
+            cubic.error = 0.0f;
+            for (int i = 0; i < segments; i++)
+                for (int k = 1; k <= 4; k++)
+                {
+                    double t = (i + k / 5.0) * h;
+                    float exact[2], fitted[2];
+                    BezierCurveFN(t, exact, ctrlpoints, L);
+                    cubic.evaluate(t, fitted);
+                    cubic.error = std::max(cubic.error, glm::length(glm::vec2(fitted[0] - exact[0], fitted[1] - exact[1])));
+                }
+            if (cubic.error <= CUBIC_PROFILE_TOLERANCE || segments >= MAX_PROFILE_SEGMENTS)
+                return cubic;
         }
+    }
 
-        size_t count = coordinates.size();
-        for (i = 0, j = 0; i < count; i += 3, j += 2)
-        {
-            vertices.push_back(coordinates[i]);
-            vertices.push_back(coordinates[i + 1]);
-            vertices.push_back(coordinates[i + 2]);
-
-            if (i < normals.size())
-                vertices.push_back(-1 * normals[i]);
-            if (i + 1 < normals.size())
-                vertices.push_back(-1 * normals[i + 1]);
-            if (i + 2 < normals.size())
-                vertices.push_back(-1 * normals[i + 2]);
-
-            // Add texture coordinates
-            /*if (j < texCoords.size())
-                vertices.push_back(texCoords[j]);
-            if (j + 1 < texCoords.size())
-                vertices.push_back(texCoords[j + 1]);*/
+    static long long nCr(int n, int r)
+    {
+        if (r > n / 2)
+            r = n - r; // because C(n, r) == C(n, n - r)
+        long long ans = 1;
+        int i;
 
+        for (i = 1; i <= r; i++)
+        {
+            ans *= n - r + i;
+            ans /= i;
         }
 
-        unsigned int bezierVAO;
-        glGenVertexArrays(1, &bezierVAO);
-        glBindVertexArray(bezierVAO);
-
-        // create VBO to copy vertex data to VBO
-        unsigned int bezierVBO;
-        glGenBuffers(1, &bezierVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, bezierVBO);           // for vertex data
-        glBufferData(GL_ARRAY_BUFFER,                   // target
-            (unsigned int)vertices.size() * sizeof(float), // data size, # of bytes
-            vertices.data(),   // ptr to vertex data
-            GL_STATIC_DRAW);                   // usage
-
-        // create EBO to copy index data
-        unsigned int bezierEBO;
-        glGenBuffers(1, &bezierEBO);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bezierEBO);   // for index data
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER,           // target
-            (unsigned int)indices.size() * sizeof(unsigned int),             // data size, # of bytes
-            indices.data(),               // ptr to index data
-            GL_STATIC_DRAW);                   // usage
-
-        // activate attrib arrays
-        glEnableVertexAttribArray(0);
-        glEnableVertexAttribArray(1);
-        glEnableVertexAttribArray(2);
-        // set attrib arrays with stride and offset
-        int stride = 24;     // should be 24 bytes
-        glVertexAttribPointer(0, 3, GL_FLOAT, false, stride, (void*)0);
-        glVertexAttribPointer(1, 3, GL_FLOAT, false, stride, (void*)(sizeof(float) * 3));
-        glVertexAttribPointer(2, 2, GL_FLOAT, false, stride, (void*)(sizeof(float) * 6));
-
-        // unbind VAO, VBO and EBO
-        glBindVertexArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        return ans;
+    }
+//polynomial interpretation for N points
+    static void BezierCurveFN(double t, float xy[2], const GLfloat ctrlpoints[], int L)
+    {
+        double y = 0;
+        double x = 0;
+        t = t > 1.0 ? 1.0 : t;
+        for (int i = 0; i < L + 1; i++)
+        {
+            long long ncr = nCr(L, i);
+            double oneMinusTpow = pow(1 - t, double(L - i));
+            double tPow = pow(t, double(i));
+            double coef = oneMinusTpow * tPow * ncr;
+            x += coef * ctrlpoints[i * 3];
+            y += coef * ctrlpoints[(i * 3) + 1];
 
-        return bezierVAO;
+        }
+        xy[0] = float(x);
+        xy[1] = float(y);
+    }
+//the derivative, the Bezier curve of the L differences of the control points times L
+    static void BezierDerivativeFN(double t, float dxy[2], const GLfloat ctrlpoints[], int L)
+    {
+        double dy = 0;
+        double dx = 0;
+        t = t > 1.0 ? 1.0 : t;
+        for (int i = 0; i < L; i++)
+        {
+            double coef = pow(1 - t, double(L - 1 - i)) * pow(t, double(i)) * nCr(L - 1, i) * L;
+            dx += coef * (ctrlpoints[(i + 1) * 3] - ctrlpoints[i * 3]);
+            dy += coef * (ctrlpoints[(i + 1) * 3 + 1] - ctrlpoints[i * 3 + 1]);
+        }
+        dxy[0] = float(dx);
+        dxy[1] = float(dy);
     }
 
 
     // memeber vars
-    unsigned int sphereVAO;
-
-    const double pi = 3.14159265389;
-    const int nt = 40;
-    const int ntheta = 20;
-    vector<float> vertices;
-    vector<float> normals;
-    vector<float> texCoords;
-    vector<unsigned int> indices;
-    vector<float> coordinates;
-    int verticesStride;                 // # of bytes to hop to the next vertex (should be 24 bytes)
+    GpuMesh mesh;
+    MeshBuilder staging;                // empty again after upload()
+    vector<float> profile;              // staging of the vertex pulled profile, empty again after upload()
+    unsigned int profileBuffer = 0;
+    unsigned int profileTexture = 0;    // 0 unless the surface is vertex pulled
+    int profileSteps = 0;
+    CubicProfile cubic;
+    unsigned int segmentBuffer = 0;
+    unsigned int segmentTexture = 0;    // 0 unless the surface is drawn as patches
+    float orientation = 1.0f;
+    int flag = 0;                       // 0 for the full surface of revolution, 1 for the half with z <= 0
+
+    static constexpr double pi = 3.14159265389;
+    static const int STEPS = 40;        // along the profile
+    static const int SLICES = 20;       // around the axis
+    static const int PROFILE_CANDIDATES = STEPS * 8;     // the adaptive steps start and end at these
+    static constexpr float PROFILE_TOLERANCE = 0.001f;
+    static constexpr float CUBIC_PROFILE_TOLERANCE = 0.00001f;
+    static const int MAX_PROFILE_SEGMENTS = 64;
+    static const int PATCH_ROWS = 4;
+    static const int PATCH_COLUMNS = 4;
 
 };
 
 
 #endif /* sphere_h */
-
-
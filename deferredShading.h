@@ -0,0 +1,168 @@
+//
+//  deferredShading.h
+//  deferred render path: the scene is written once into a G-buffer and every
+//  light is evaluated a single time per pixel in a full screen pass
+//
+
+#ifndef deferredShading_h
+#define deferredShading_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <iostream>
+#include "shader.h"
+
+// G-buffer layout
+//   0: RGBA8   diffuse colour, shininess / 256
+//   1: RGBA8   specular colour
+//   2: RG16F   octahedral encoded world space normal
+//   3: RGBA8   ambient colour
+//   depth:     DEPTH24_STENCIL8, world position is rebuilt from it
+class DeferredRenderer {
+public:
+    Shader geometryShader;
+    Shader geometryShaderWithTexture;
+    Shader lightingPassShader;
+
+    // constructor, with deferLinkCheck the programs are finished on their first use
+    DeferredRenderer(int width, int height, bool deferLinkCheck = false) :
+        geometryShader("vertexShaderForPhongShading.vs", "fragmentShaderForGBuffer.fs", nullptr, "", deferLinkCheck),
+        geometryShaderWithTexture("vertexShaderForPhongShadingWithTexture.vs", "fragmentShaderForGBufferWithTexture.fs", nullptr, "", deferLinkCheck),
+        lightingPassShader("vertexShaderForFullScreen.vs", "fragmentShaderForDeferredLighting.fs", nullptr, "", deferLinkCheck)
+    {
+        glGenVertexArrays(1, &fullScreenVAO);
+        createGBuffer(width, height);
+    }
+
+    // destructor
+    ~DeferredRenderer()
+    {
+        deleteGBuffer();
+        glDeleteVertexArrays(1, &fullScreenVAO);
+    }
+
+    void resize(int width, int height)
+    {
+        // a minimized window reports 0x0, keep the old buffers until it comes back
+        if (width <= 0 || height <= 0 || (width == this->width && height == this->height))
+            return;
+        deleteGBuffer();
+        createGBuffer(width, height);
+    }
+
+    // start writing the scene into the G-buffer
+    void beginGeometryPass(const glm::mat4& projection, const glm::mat4& view)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        geometryShader.use();
+        geometryShader.setMat4("projection", projection);
+        geometryShader.setMat4("view", view);
+        geometryShaderWithTexture.use();
+        geometryShaderWithTexture.setMat4("projection", projection);
+        geometryShaderWithTexture.setMat4("view", view);
+    }
+
+    // light the G-buffer into the default framebuffer, then copy its depth across so
+    // forward drawn objects (light bulbs) are still depth tested against the scene.
+    // the lights must already be set up on lightingPassShader.
+    void lightingPass(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& viewPos)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        lightingPassShader.use();
+        lightingPassShader.setMat4("inverseProjection", glm::inverse(projection));
+        lightingPassShader.setMat4("inverseView", glm::inverse(view));
+        lightingPassShader.setVec3("viewPos", viewPos);
+        lightingPassShader.setInt("gAlbedo", 0);
+        lightingPassShader.setInt("gSpecular", 1);
+        lightingPassShader.setInt("gNormal", 2);
+        lightingPassShader.setInt("gDepth", 3);
+        lightingPassShader.setInt("gAmbient", 4);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, gAlbedo);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, gSpecular);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, gNormal);
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, gDepth);
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D, gAmbient);
+
+        // full screen triangle, no depth test or write so the sky clear colour survives where nothing was drawn
+        glDisable(GL_DEPTH_TEST);
+        glDepthMask(GL_FALSE);
+        glBindVertexArray(fullScreenVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glDepthMask(GL_TRUE);
+        glEnable(GL_DEPTH_TEST);
+        glActiveTexture(GL_TEXTURE0);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+private:
+    int width = 0;
+    int height = 0;
+    unsigned int gBuffer = 0;
+    unsigned int gAlbedo = 0, gSpecular = 0, gNormal = 0, gAmbient = 0, gDepth = 0;
+    unsigned int fullScreenVAO = 0;
+
+    unsigned int createTarget(GLint internalFormat, GLenum format, GLenum type)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+
+    void createGBuffer(int width, int height)
+    {
+        this->width = width;
+        this->height = height;
+
+        glGenFramebuffers(1, &gBuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+
+        gAlbedo = createTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gAlbedo, 0);
+        gSpecular = createTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gSpecular, 0);
+        gNormal = createTarget(GL_RG16F, GL_RG, GL_FLOAT);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, gNormal, 0);
+        gAmbient = createTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, gAmbient, 0);
+        gDepth = createTarget(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, gDepth, 0);
+
+        unsigned int attachments[4] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
+        glDrawBuffers(4, attachments);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: G-buffer is not complete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    void deleteGBuffer()
+    {
+        unsigned int textures[5] = { gAlbedo, gSpecular, gNormal, gAmbient, gDepth };
+        glDeleteTextures(5, textures);
+        glDeleteFramebuffers(1, &gBuffer);
+    }
+};
+
+#endif /* deferredShading_h */
@@ -9,6 +9,7 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include "shader.h"
+#include "cascadedShadowMap.h"
 
 class DirectionLight {
 public:
@@ -18,6 +19,7 @@ public:
     glm::vec3 specular;
     int lightNumber;
     //bool directionLightOn;
+    CascadedShadowMap* shadows = nullptr;   // set once there is a GL context, null means no shadows
 
     DirectionLight(float dirX, float dirY, float dirZ, float ambR, float ambG, float ambB, float diffR, float diffG, float diffB, float specR, float specG, float specB, int num) {
 
@@ -37,6 +39,7 @@ public:
             lightingShader.setVec3("directionLight[0].diffuse", diffuseOn * diffuse);
             lightingShader.setVec3("directionLight[0].specular", specularOn * specular);
             lightingShader.setBool("dayLightOn", true);
+            setUpShadows(lightingShader, "day", DAY_SHADOW_UNIT);
         }
 
         if (lightNumber == 7) {
@@ -45,8 +48,35 @@ public:
             lightingShader.setVec3("directionLight[1].diffuse", diffuseOn * diffuse);
             lightingShader.setVec3("directionLight[1].specular", specularOn * specular);
             lightingShader.setBool("moonLightOn", true);
+            setUpShadows(lightingShader, "moon", MOON_SHADOW_UNIT);
         }
     }
+    // colours as they are currently sent to the shader
+    glm::vec3 getAmbient() const
+    {
+        return ambientOn * ambient;
+    }
+    glm::vec3 getDiffuse() const
+    {
+        return diffuseOn * diffuse;
+    }
+    glm::vec3 getSpecular() const
+    {
+        return specularOn * specular;
+    }
+    bool isOn() const
+    {
+        return ambientOn != 0.0f || diffuseOn != 0.0f || specularOn != 0.0f;
+    }
+    // the sampler unit is set even without shadows, two sampler types may not share unit 0
+    void setUpShadows(Shader& lightingShader, const std::string& prefix, int textureUnit)
+    {
+        lightingShader.setBool(prefix + "ShadowOn", shadows != nullptr);
+        if (shadows != nullptr)
+            shadows->bind(lightingShader, prefix, textureUnit);
+        else
+            lightingShader.setInt(prefix + "ShadowMap", textureUnit);
+    }
     void turnOff()
     {
         ambientOn = 0.0;
@@ -0,0 +1,279 @@
+#version 330 core
+out vec4 FragColor;
+
+struct Material {
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+};
+
+
+
+struct PointLight {
+    vec3 position;
+    
+    float k_c;  // attenuation factors
+    float k_l;  // attenuation factors
+    float k_q;  // attenuation factors
+    
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct DirectionLight {
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 position;
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+
+    float cos_theta;
+    
+    float k_c; 
+    float k_l; 
+    float k_q;    
+};
+
+
+#define NR_DIRECTION_LIGHTS 2
+
+in vec3 FragPos;
+in vec3 Normal;
+
+
+uniform vec3 viewPos;
+
+// clustered point lights, filled by ClusteredLighting
+uniform samplerBuffer clusterLights;          // 4 texels per light: position/radius, ambient/k_c, diffuse/k_l, specular/k_q
+uniform usamplerBuffer clusterGrid;           // per cluster: offset into clusterLightIndices, light count
+uniform usamplerBuffer clusterLightIndices;
+uniform int clusterLightsBase;                // first texel of this frame's block in each buffer, they stream through a ring
+uniform int clusterGridBase;
+uniform int clusterIndexBase;
+uniform vec3 clusterDims;
+uniform vec2 screenSize;
+uniform float clusterNear;
+uniform float clusterFar;
+uniform Material material;
+uniform SpotLight spotLight;
+uniform DirectionLight directionLight[NR_DIRECTION_LIGHTS];
+
+// cascaded shadow maps of the direction lights, written by CascadedShadowMap
+#define NR_CASCADES 4
+uniform sampler2DArrayShadow dayShadowMap;
+uniform sampler2DArrayShadow moonShadowMap;
+uniform mat4 dayShadowMatrices[NR_CASCADES];
+uniform mat4 moonShadowMatrices[NR_CASCADES];
+uniform bool dayShadowOn;
+uniform bool moonShadowOn;
+uniform bool shadowPCF;
+
+// shadow map of the entrance spot light
+uniform sampler2DShadow spotShadowMap;
+uniform mat4 spotShadowMatrix;
+uniform bool spotShadowOn;
+uniform bool spotLightOn;
+uniform bool dayLightOn;
+uniform bool moonLightOn;
+
+// function prototypes
+vec3 CalcPointLight(Material material, PointLight light, vec3 N, vec3 fragPos, vec3 V);
+PointLight FetchPointLight(int index);
+int ClusterIndex();
+vec3 CalcDirectionLight(Material material, DirectionLight light, vec3 N, vec3 V, float shadow);
+float DirectionShadow(int light, vec3 fragPos, vec3 N);
+float CascadeShadow(sampler2DArrayShadow shadowMap, mat4 matrices[NR_CASCADES], vec3 fragPos, vec3 N);
+vec3 CalcSpotLight(Material material, SpotLight light, vec3 N, vec3 fragPos, vec3 V, float shadow);
+float SpotShadow(vec3 fragPos, vec3 N);
+
+void main()
+{
+    // properties
+    vec3 N = normalize(Normal);
+    vec3 V = normalize(viewPos - FragPos);
+    
+    vec3 result = vec3(0.0);
+    // point lights, only the ones whose radius reaches this fragment's cluster
+    uvec2 cluster = texelFetch(clusterGrid, clusterGridBase + ClusterIndex()).xy;
+    for(uint i = 0u; i < cluster.y; i++)
+    {
+        int lightIndex = int(texelFetch(clusterLightIndices, clusterIndexBase + int(cluster.x + i)).r);
+        result += CalcPointLight(material, FetchPointLight(lightIndex), N, FragPos, V);
+    }
+    if(dayLightOn)
+        result += CalcDirectionLight(material, directionLight[0], N, V, DirectionShadow(0, FragPos, N));
+    if(moonLightOn)
+        result += CalcDirectionLight(material, directionLight[1], N, V, DirectionShadow(1, FragPos, N));
+    if(spotLightOn)
+        result += CalcSpotLight(material, spotLight, N, FragPos, V, SpotShadow(FragPos, N));  
+    
+        FragColor = vec4(result, 1.0);
+}
+
+// finds the cluster of the current fragment from its window position and linear depth.
+int ClusterIndex()
+{
+    float ndcZ = gl_FragCoord.z * 2.0 - 1.0;
+    float depth = 2.0 * clusterNear * clusterFar / (clusterFar + clusterNear - ndcZ * (clusterFar - clusterNear));
+
+    ivec3 dims = ivec3(clusterDims);
+    ivec2 tile = ivec2(gl_FragCoord.xy / screenSize * clusterDims.xy);
+    int slice = int(log(depth / clusterNear) / log(clusterFar / clusterNear) * clusterDims.z);
+    tile = clamp(tile, ivec2(0), dims.xy - 1);
+    slice = clamp(slice, 0, dims.z - 1);
+
+    return (slice * dims.y + tile.y) * dims.x + tile.x;
+}
+
+// reads one light of the cluster light buffer.
+PointLight FetchPointLight(int index)
+{
+    vec4 t0 = texelFetch(clusterLights, clusterLightsBase + index * 4);
+    vec4 t1 = texelFetch(clusterLights, clusterLightsBase + index * 4 + 1);
+    vec4 t2 = texelFetch(clusterLights, clusterLightsBase + index * 4 + 2);
+    vec4 t3 = texelFetch(clusterLights, clusterLightsBase + index * 4 + 3);
+
+    PointLight light;
+    light.position = t0.xyz;
+    light.ambient = t1.xyz;
+    light.k_c = t1.w;
+    light.diffuse = t2.xyz;
+    light.k_l = t2.w;
+    light.specular = t3.xyz;
+    light.k_q = t3.w;
+    return light;
+}
+
+// calculates the color when using a point light.
+vec3 CalcPointLight(Material material, PointLight light, vec3 N, vec3 fragPos, vec3 V)
+{
+    vec3 L = normalize(light.position - fragPos);
+    vec3 R = reflect(-L, N);
+    
+    vec3 K_A = material.ambient;
+    vec3 K_D = material.diffuse;
+    vec3 K_S = material.specular;
+    
+    // attenuation
+    float d = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.k_c + light.k_l * d + light.k_q * (d * d));
+    
+    vec3 ambient = K_A * light.ambient;
+    vec3 diffuse = K_D * max(dot(N, L), 0.0) * light.diffuse;
+    vec3 specular = K_S * pow(max(dot(V, R), 0.0), material.shininess) * light.specular;
+    
+    ambient *= attenuation;
+    diffuse *= attenuation;
+    specular *= attenuation;
+    
+    return (ambient + diffuse + specular);
+}
+
+// calculates the color when using a direction light.
+vec3 CalcDirectionLight(Material material, DirectionLight light, vec3 N, vec3 V, float shadow)
+{
+    vec3 L = normalize(-light.direction);
+    vec3 R = reflect(-L, N);
+    
+    vec3 K_A = material.ambient;
+    vec3 K_D = material.diffuse;
+    vec3 K_S = material.specular;
+    
+    vec3 ambient = K_A * light.ambient;
+    vec3 diffuse = K_D * max(dot(N, L), 0.0) * light.diffuse;
+    vec3 specular = K_S * pow(max(dot(V, R), 0.0), material.shininess) * light.specular;
+    
+    return (ambient + shadow * (diffuse + specular));
+}
+
+// fraction of a direction light reaching the fragment, 1 when its shadows are off.
+float DirectionShadow(int light, vec3 fragPos, vec3 N)
+{
+    if(light == 0)
+        return dayShadowOn ? CascadeShadow(dayShadowMap, dayShadowMatrices, fragPos, N) : 1.0;
+    return moonShadowOn ? CascadeShadow(moonShadowMap, moonShadowMatrices, fragPos, N) : 1.0;
+}
+
+// picks the first (sharpest) cascade that contains the fragment, so no view depth is needed.
+float CascadeShadow(sampler2DArrayShadow shadowMap, mat4 matrices[NR_CASCADES], vec3 fragPos, vec3 N)
+{
+    for(int c = 0; c < NR_CASCADES; c++)
+    {
+        // the ortho x scale is 1 / radius, which gives the world size of one shadow texel
+        vec3 row0 = vec3(matrices[c][0][0], matrices[c][1][0], matrices[c][2][0]);
+        float texelWorld = 2.0 / (length(row0) * float(textureSize(shadowMap, 0).x));
+        // normal offset against acne, scaled to the cascade's texel size
+        vec4 p = matrices[c] * vec4(fragPos + N * texelWorld * 1.5, 1.0);
+        vec3 coord = p.xyz / p.w * 0.5 + 0.5;
+        if(any(lessThan(coord.xy, vec2(0.01))) || any(greaterThan(coord.xy, vec2(0.99))) || coord.z > 1.0)
+            continue;
+
+        float ref = coord.z - 0.0005;
+        if(!shadowPCF)
+            return texture(shadowMap, vec4(coord.xy, float(c), ref));
+        vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+        float lit = 0.0;
+        for(int x = -1; x <= 1; x++)
+            for(int y = -1; y <= 1; y++)
+                lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texel, float(c), ref));
+        return lit / 9.0;
+    }
+    return 1.0;     // beyond the last cascade
+}
+
+
+// calculates the color when using a spot light.
+vec3 CalcSpotLight(Material material, SpotLight light, vec3 N, vec3 fragPos, vec3 V, float shadow)
+{
+    vec3 L = normalize(light.position - fragPos);
+    vec3 R = reflect(-L, N);
+    
+    vec3 K_A = material.ambient;
+    vec3 K_D = material.diffuse;
+    vec3 K_S = material.specular;
+    
+    // attenuation
+    float d = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.k_c + light.k_l * d + light.k_q * (d * d));
+    
+    vec3 ambient = K_A * light.ambient;
+    vec3 diffuse = K_D * max(dot(N, L), 0.0) * light.diffuse;
+    vec3 specular = K_S * pow(max(dot(V, R), 0.0), material.shininess) * light.specular;
+
+    float cos_alpha = dot(L, normalize(-light.direction)); 
+    float intensity = 0.0;
+
+    if(cos_alpha >= light.cos_theta) 
+       intensity = cos_alpha;    
+
+
+    ambient *= attenuation * intensity;
+    diffuse *= attenuation * intensity;
+    specular *= attenuation * intensity;
+    
+    return (ambient + shadow * (diffuse + specular));
+} 
+
+// fraction of the spot light reaching the fragment, 1 outside its shadow frustum.
+float SpotShadow(vec3 fragPos, vec3 N)
+{
+    if(!spotShadowOn)
+        return 1.0;
+    vec4 p = spotShadowMatrix * vec4(fragPos + N * 0.05, 1.0);
+    if(p.w <= 0.0)
+        return 1.0;
+    vec3 coord = p.xyz / p.w * 0.5 + 0.5;
+    if(any(lessThan(coord.xy, vec2(0.0))) || any(greaterThan(coord.xy, vec2(1.0))) || coord.z > 1.0)
+        return 1.0;
+    return texture(spotShadowMap, vec3(coord.xy, coord.z - 0.0005));
+}
+
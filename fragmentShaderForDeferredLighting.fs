@@ -0,0 +1,300 @@
+#version 330 core
+out vec4 FragColor;
+
+struct Material {
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+};
+
+
+
+struct PointLight {
+    vec3 position;
+    
+    float k_c;  // attenuation factors
+    float k_l;  // attenuation factors
+    float k_q;  // attenuation factors
+    
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct DirectionLight {
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 position;
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+
+    float cos_theta;
+    
+    float k_c; 
+    float k_l; 
+    float k_q;    
+};
+
+
+#define NR_POINT_LIGHTS 4
+#define NR_DIRECTION_LIGHTS 2
+
+in vec2 TexCoords;
+
+// G-buffer written by fragmentShaderForGBuffer.fs
+uniform sampler2D gAlbedo;
+uniform sampler2D gSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform sampler2D gAmbient;
+uniform mat4 inverseProjection;
+uniform mat4 inverseView;
+
+uniform vec3 viewPos;
+uniform PointLight pointLights[NR_POINT_LIGHTS];
+uniform SpotLight spotLight;
+uniform DirectionLight directionLight[NR_DIRECTION_LIGHTS];
+
+// cascaded shadow maps of the direction lights, written by CascadedShadowMap
+#define NR_CASCADES 4
+uniform sampler2DArrayShadow dayShadowMap;
+uniform sampler2DArrayShadow moonShadowMap;
+uniform mat4 dayShadowMatrices[NR_CASCADES];
+uniform mat4 moonShadowMatrices[NR_CASCADES];
+uniform bool dayShadowOn;
+uniform bool moonShadowOn;
+uniform bool shadowPCF;
+
+// cube shadow maps of the point lamps, stored as distance / far, written by the ShadowCache
+#if NR_POINT_LIGHTS > 0
+uniform samplerCubeShadow pointShadowMap0;
+uniform samplerCubeShadow pointShadowMap1;
+uniform samplerCubeShadow pointShadowMap2;
+uniform samplerCubeShadow pointShadowMap3;
+uniform bool pointShadowOn[NR_POINT_LIGHTS];
+uniform float pointShadowFar[NR_POINT_LIGHTS];
+#endif
+
+// shadow map of the entrance spot light
+uniform sampler2DShadow spotShadowMap;
+uniform mat4 spotShadowMatrix;
+uniform bool spotShadowOn;
+uniform bool spotLightOn;
+uniform bool dayLightOn;
+uniform bool moonLightOn;
+
+// function prototypes
+vec3 CalcPointLight(Material material, PointLight light, vec3 N, vec3 fragPos, vec3 V, float shadow);
+vec3 CalcDirectionLight(Material material, DirectionLight light, vec3 N, vec3 V, float shadow);
+float DirectionShadow(int light, vec3 fragPos, vec3 N);
+float CascadeShadow(sampler2DArrayShadow shadowMap, mat4 matrices[NR_CASCADES], vec3 fragPos, vec3 N);
+vec3 CalcSpotLight(Material material, SpotLight light, vec3 N, vec3 fragPos, vec3 V, float shadow);
+#if NR_POINT_LIGHTS > 0
+float PointShadow(int light, vec3 fragPos, vec3 lightPos);
+#endif
+float SpotShadow(vec3 fragPos, vec3 N);
+vec3 DecodeNormal(vec2 e);
+vec3 ReconstructPosition(vec2 uv, float depth);
+
+void main()
+{
+    float depth = texture(gDepth, TexCoords).r;
+    if(depth >= 1.0)
+        discard;    // nothing was drawn here, keep the clear colour
+
+    // unpack the G-buffer
+    vec4 albedo = texture(gAlbedo, TexCoords);
+    vec4 spec = texture(gSpecular, TexCoords);
+    Material material;
+    material.diffuse = albedo.rgb;
+    material.ambient = texture(gAmbient, TexCoords).rgb;
+    material.specular = spec.rgb;
+    material.shininess = albedo.a * 256.0;
+
+    vec3 FragPos = ReconstructPosition(TexCoords, depth);
+    vec3 N = DecodeNormal(texture(gNormal, TexCoords).xy);
+    vec3 V = normalize(viewPos - FragPos);
+
+    vec3 result = vec3(0.0);
+    // point lights
+    for(int i = 0; i < NR_POINT_LIGHTS; i++)
+        result += CalcPointLight(material, pointLights[i], N, FragPos, V, PointShadow(i, FragPos, pointLights[i].position));
+    if(dayLightOn)
+        result += CalcDirectionLight(material, directionLight[0], N, V, DirectionShadow(0, FragPos, N));
+    if(moonLightOn)
+        result += CalcDirectionLight(material, directionLight[1], N, V, DirectionShadow(1, FragPos, N));
+    if(spotLightOn)
+        result += CalcSpotLight(material, spotLight, N, FragPos, V, SpotShadow(FragPos, N));
+
+    FragColor = vec4(result, 1.0);
+}
+
+// inverse of the octahedral encoding in the G-buffer shaders.
+vec3 DecodeNormal(vec2 e)
+{
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// world space position from the depth buffer, no position target needed.
+vec3 ReconstructPosition(vec2 uv, float depth)
+{
+    vec4 ndc = vec4(uv * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 viewSpace = inverseProjection * ndc;
+    viewSpace /= viewSpace.w;
+    return vec3(inverseView * viewSpace);
+}
+
+// calculates the color when using a point light.
+vec3 CalcPointLight(Material material, PointLight light, vec3 N, vec3 fragPos, vec3 V, float shadow)
+{
+    vec3 L = normalize(light.position - fragPos);
+    vec3 R = reflect(-L, N);
+    
+    vec3 K_A = material.ambient;
+    vec3 K_D = material.diffuse;
+    vec3 K_S = material.specular;
+    
+    // attenuation
+    float d = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.k_c + light.k_l * d + light.k_q * (d * d));
+    
+    vec3 ambient = K_A * light.ambient;
+    vec3 diffuse = K_D * max(dot(N, L), 0.0) * light.diffuse;
+    vec3 specular = K_S * pow(max(dot(V, R), 0.0), material.shininess) * light.specular;
+    
+    ambient *= attenuation;
+    diffuse *= attenuation;
+    specular *= attenuation;
+    
+    return (ambient + shadow * (diffuse + specular));
+}
+
+// calculates the color when using a direction light.
+vec3 CalcDirectionLight(Material material, DirectionLight light, vec3 N, vec3 V, float shadow)
+{
+    vec3 L = normalize(-light.direction);
+    vec3 R = reflect(-L, N);
+    
+    vec3 K_A = material.ambient;
+    vec3 K_D = material.diffuse;
+    vec3 K_S = material.specular;
+    
+    vec3 ambient = K_A * light.ambient;
+    vec3 diffuse = K_D * max(dot(N, L), 0.0) * light.diffuse;
+    vec3 specular = K_S * pow(max(dot(V, R), 0.0), material.shininess) * light.specular;
+    
+    return (ambient + shadow * (diffuse + specular));
+}
+
+// fraction of a direction light reaching the fragment, 1 when its shadows are off.
+float DirectionShadow(int light, vec3 fragPos, vec3 N)
+{
+    if(light == 0)
+        return dayShadowOn ? CascadeShadow(dayShadowMap, dayShadowMatrices, fragPos, N) : 1.0;
+    return moonShadowOn ? CascadeShadow(moonShadowMap, moonShadowMatrices, fragPos, N) : 1.0;
+}
+
+// picks the first (sharpest) cascade that contains the fragment, so no view depth is needed.
+float CascadeShadow(sampler2DArrayShadow shadowMap, mat4 matrices[NR_CASCADES], vec3 fragPos, vec3 N)
+{
+    for(int c = 0; c < NR_CASCADES; c++)
+    {
+        // the ortho x scale is 1 / radius, which gives the world size of one shadow texel
+        vec3 row0 = vec3(matrices[c][0][0], matrices[c][1][0], matrices[c][2][0]);
+        float texelWorld = 2.0 / (length(row0) * float(textureSize(shadowMap, 0).x));
+        // normal offset against acne, scaled to the cascade's texel size
+        vec4 p = matrices[c] * vec4(fragPos + N * texelWorld * 1.5, 1.0);
+        vec3 coord = p.xyz / p.w * 0.5 + 0.5;
+        if(any(lessThan(coord.xy, vec2(0.01))) || any(greaterThan(coord.xy, vec2(0.99))) || coord.z > 1.0)
+            continue;
+
+        float ref = coord.z - 0.0005;
+        if(!shadowPCF)
+            return texture(shadowMap, vec4(coord.xy, float(c), ref));
+        vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+        float lit = 0.0;
+        for(int x = -1; x <= 1; x++)
+            for(int y = -1; y <= 1; y++)
+                lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texel, float(c), ref));
+        return lit / 9.0;
+    }
+    return 1.0;     // beyond the last cascade
+}
+
+
+// calculates the color when using a spot light.
+vec3 CalcSpotLight(Material material, SpotLight light, vec3 N, vec3 fragPos, vec3 V, float shadow)
+{
+    vec3 L = normalize(light.position - fragPos);
+    vec3 R = reflect(-L, N);
+    
+    vec3 K_A = material.ambient;
+    vec3 K_D = material.diffuse;
+    vec3 K_S = material.specular;
+    
+    // attenuation
+    float d = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.k_c + light.k_l * d + light.k_q * (d * d));
+    
+    vec3 ambient = K_A * light.ambient;
+    vec3 diffuse = K_D * max(dot(N, L), 0.0) * light.diffuse;
+    vec3 specular = K_S * pow(max(dot(V, R), 0.0), material.shininess) * light.specular;
+
+    float cos_alpha = dot(L, normalize(-light.direction)); 
+    float intensity = 0.0;
+
+    if(cos_alpha >= light.cos_theta) 
+       intensity = cos_alpha;    
+
+
+    ambient *= attenuation * intensity;
+    diffuse *= attenuation * intensity;
+    specular *= attenuation * intensity;
+    
+    return (ambient + shadow * (diffuse + specular));
+} 
+
+#if NR_POINT_LIGHTS > 0
+// fraction of a point light reaching the fragment, the cube maps hold only the first four lamps.
+float PointShadow(int light, vec3 fragPos, vec3 lightPos)
+{
+    if(light > 3 || !pointShadowOn[light])
+        return 1.0;
+    vec3 fragToLight = fragPos - lightPos;
+    float ref = length(fragToLight) / pointShadowFar[light] - 0.002;
+    if(light == 0)
+        return texture(pointShadowMap0, vec4(fragToLight, ref));
+    if(light == 1)
+        return texture(pointShadowMap1, vec4(fragToLight, ref));
+    if(light == 2)
+        return texture(pointShadowMap2, vec4(fragToLight, ref));
+    return texture(pointShadowMap3, vec4(fragToLight, ref));
+}
+#endif
+
+// fraction of the spot light reaching the fragment, 1 outside its shadow frustum.
+float SpotShadow(vec3 fragPos, vec3 N)
+{
+    if(!spotShadowOn)
+        return 1.0;
+    vec4 p = spotShadowMatrix * vec4(fragPos + N * 0.05, 1.0);
+    if(p.w <= 0.0)
+        return 1.0;
+    vec3 coord = p.xyz / p.w * 0.5 + 0.5;
+    if(any(lessThan(coord.xy, vec2(0.0))) || any(greaterThan(coord.xy, vec2(1.0))) || coord.z > 1.0)
+        return 1.0;
+    return texture(spotShadowMap, vec3(coord.xy, coord.z - 0.0005));
+}
+
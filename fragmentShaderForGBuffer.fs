@@ -0,0 +1,38 @@
+#version 330 core
+layout (location = 0) out vec4 gAlbedo;
+layout (location = 1) out vec4 gSpecular;
+layout (location = 2) out vec2 gNormal;
+layout (location = 3) out vec4 gAmbient;
+
+struct Material {
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+};
+
+in vec3 FragPos;
+in vec3 Normal;
+
+uniform Material material;
+
+// octahedral normal encoding: the unit sphere folded onto a square, two channels instead of three
+vec2 OctWrap(vec2 v)
+{
+    return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 EncodeNormal(vec3 n)
+{
+    n /= (abs(n.x) + abs(n.y) + abs(n.z));
+    n.xy = n.z >= 0.0 ? n.xy : OctWrap(n.xy);
+    return n.xy;
+}
+
+void main()
+{
+    gAlbedo = vec4(material.diffuse, material.shininess / 256.0);
+    gSpecular = vec4(material.specular, 1.0);
+    gNormal = EncodeNormal(normalize(Normal));
+    gAmbient = vec4(material.ambient, 1.0);
+}
@@ -0,0 +1,12 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 LightmapUV;
+
+uniform sampler2D lightmap;
+
+// baked ambient, direct and one bounce of diffuse light, specular is not baked
+void main()
+{
+    FragColor = vec4(texture(lightmap, LightmapUV).rgb, 1.0);
+}
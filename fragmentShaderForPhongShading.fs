@@ -44,7 +44,11 @@ struct SpotLight {
 };
 
 
+// light setup is overridable by ShaderPermutations: with SHADER_PERMUTATION defined the
+// enabled lights are fixed at compile time and disabled ones are compiled out
+#ifndef NR_POINT_LIGHTS
 #define NR_POINT_LIGHTS 4
+#endif
 #define NR_DIRECTION_LIGHTS 2
 
 in vec3 FragPos;
@@ -52,18 +56,53 @@ in vec3 Normal;
 
 
 uniform vec3 viewPos;
+#if NR_POINT_LIGHTS > 0
 uniform PointLight pointLights[NR_POINT_LIGHTS];
+#endif
 uniform Material material;
 uniform SpotLight spotLight;
 uniform DirectionLight directionLight[NR_DIRECTION_LIGHTS];
+
+// cascaded shadow maps of the direction lights, written by CascadedShadowMap
+#define NR_CASCADES 4
+uniform sampler2DArrayShadow dayShadowMap;
+uniform sampler2DArrayShadow moonShadowMap;
+uniform mat4 dayShadowMatrices[NR_CASCADES];
+uniform mat4 moonShadowMatrices[NR_CASCADES];
+uniform bool dayShadowOn;
+uniform bool moonShadowOn;
+uniform bool shadowPCF;
+
+// cube shadow maps of the point lamps, stored as distance / far, written by the ShadowCache
+#if NR_POINT_LIGHTS > 0
+uniform samplerCubeShadow pointShadowMap0;
+uniform samplerCubeShadow pointShadowMap1;
+uniform samplerCubeShadow pointShadowMap2;
+uniform samplerCubeShadow pointShadowMap3;
+uniform bool pointShadowOn[NR_POINT_LIGHTS];
+uniform float pointShadowFar[NR_POINT_LIGHTS];
+#endif
+
+// shadow map of the entrance spot light
+uniform sampler2DShadow spotShadowMap;
+uniform mat4 spotShadowMatrix;
+uniform bool spotShadowOn;
+#ifndef SHADER_PERMUTATION
 uniform bool spotLightOn;
 uniform bool dayLightOn;
 uniform bool moonLightOn;
+#endif
 
 // function prototypes
-vec3 CalcPointLight(Material material, PointLight light, vec3 N, vec3 fragPos, vec3 V);
-vec3 CalcDirectionLight(Material material, DirectionLight light, vec3 N, vec3 V);
-vec3 CalcSpotLight(Material material, SpotLight light, vec3 N, vec3 fragPos, vec3 V);
+vec3 CalcPointLight(Material material, PointLight light, vec3 N, vec3 fragPos, vec3 V, float shadow);
+vec3 CalcDirectionLight(Material material, DirectionLight light, vec3 N, vec3 V, float shadow);
+float DirectionShadow(int light, vec3 fragPos, vec3 N);
+float CascadeShadow(sampler2DArrayShadow shadowMap, mat4 matrices[NR_CASCADES], vec3 fragPos, vec3 N);
+vec3 CalcSpotLight(Material material, SpotLight light, vec3 N, vec3 fragPos, vec3 V, float shadow);
+#if NR_POINT_LIGHTS > 0
+float PointShadow(int light, vec3 fragPos, vec3 lightPos);
+#endif
+float SpotShadow(vec3 fragPos, vec3 N);
 
 void main()
 {
@@ -71,22 +110,36 @@ void main()
     vec3 N = normalize(Normal);
     vec3 V = normalize(viewPos - FragPos);
     
-    vec3 result;
+    vec3 result = vec3(0.0);
     // point lights
+#if NR_POINT_LIGHTS > 0
     for(int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(material, pointLights[i], N, FragPos, V);
+        result += CalcPointLight(material, pointLights[i], N, FragPos, V, PointShadow(i, FragPos, pointLights[i].position));
+#endif
+#ifdef SHADER_PERMUTATION
+#if DAY_LIGHT
+    result += CalcDirectionLight(material, directionLight[0], N, V, DirectionShadow(0, FragPos, N));
+#endif
+#if MOON_LIGHT
+    result += CalcDirectionLight(material, directionLight[1], N, V, DirectionShadow(1, FragPos, N));
+#endif
+#if SPOT_LIGHT
+    result += CalcSpotLight(material, spotLight, N, FragPos, V, SpotShadow(FragPos, N));
+#endif
+#else
     if(dayLightOn)
-        result += CalcDirectionLight(material, directionLight[0], N, V);
+        result += CalcDirectionLight(material, directionLight[0], N, V, DirectionShadow(0, FragPos, N));
     if(moonLightOn)
-        result += CalcDirectionLight(material, directionLight[1], N, V);
+        result += CalcDirectionLight(material, directionLight[1], N, V, DirectionShadow(1, FragPos, N));
     if(spotLightOn)
-        result += CalcSpotLight(material, spotLight, N, FragPos, V);  
+        result += CalcSpotLight(material, spotLight, N, FragPos, V, SpotShadow(FragPos, N));  
+#endif
     
         FragColor = vec4(result, 1.0);
 }
 
 // calculates the color when using a point light.
-vec3 CalcPointLight(Material material, PointLight light, vec3 N, vec3 fragPos, vec3 V)
+vec3 CalcPointLight(Material material, PointLight light, vec3 N, vec3 fragPos, vec3 V, float shadow)
 {
     vec3 L = normalize(light.position - fragPos);
     vec3 R = reflect(-L, N);
@@ -107,11 +160,11 @@ vec3 CalcPointLight(Material material, PointLight light, vec3 N, vec3 fragPos, v
     diffuse *= attenuation;
     specular *= attenuation;
     
-    return (ambient + diffuse + specular);
+    return (ambient + shadow * (diffuse + specular));
 }
 
 // calculates the color when using a direction light.
-vec3 CalcDirectionLight(Material material, DirectionLight light, vec3 N, vec3 V)
+vec3 CalcDirectionLight(Material material, DirectionLight light, vec3 N, vec3 V, float shadow)
 {
     vec3 L = normalize(-light.direction);
     vec3 R = reflect(-L, N);
@@ -124,12 +177,47 @@ vec3 CalcDirectionLight(Material material, DirectionLight light, vec3 N, vec3 V)
     vec3 diffuse = K_D * max(dot(N, L), 0.0) * light.diffuse;
     vec3 specular = K_S * pow(max(dot(V, R), 0.0), material.shininess) * light.specular;
     
-    return (ambient + diffuse + specular);
+    return (ambient + shadow * (diffuse + specular));
+}
+
+// fraction of a direction light reaching the fragment, 1 when its shadows are off.
+float DirectionShadow(int light, vec3 fragPos, vec3 N)
+{
+    if(light == 0)
+        return dayShadowOn ? CascadeShadow(dayShadowMap, dayShadowMatrices, fragPos, N) : 1.0;
+    return moonShadowOn ? CascadeShadow(moonShadowMap, moonShadowMatrices, fragPos, N) : 1.0;
+}
+
+// picks the first (sharpest) cascade that contains the fragment, so no view depth is needed.
+float CascadeShadow(sampler2DArrayShadow shadowMap, mat4 matrices[NR_CASCADES], vec3 fragPos, vec3 N)
+{
+    for(int c = 0; c < NR_CASCADES; c++)
+    {
+        // the ortho x scale is 1 / radius, which gives the world size of one shadow texel
+        vec3 row0 = vec3(matrices[c][0][0], matrices[c][1][0], matrices[c][2][0]);
+        float texelWorld = 2.0 / (length(row0) * float(textureSize(shadowMap, 0).x));
+        // normal offset against acne, scaled to the cascade's texel size
+        vec4 p = matrices[c] * vec4(fragPos + N * texelWorld * 1.5, 1.0);
+        vec3 coord = p.xyz / p.w * 0.5 + 0.5;
+        if(any(lessThan(coord.xy, vec2(0.01))) || any(greaterThan(coord.xy, vec2(0.99))) || coord.z > 1.0)
+            continue;
+
+        float ref = coord.z - 0.0005;
+        if(!shadowPCF)
+            return texture(shadowMap, vec4(coord.xy, float(c), ref));
+        vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+        float lit = 0.0;
+        for(int x = -1; x <= 1; x++)
+            for(int y = -1; y <= 1; y++)
+                lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texel, float(c), ref));
+        return lit / 9.0;
+    }
+    return 1.0;     // beyond the last cascade
 }
 
 
 // calculates the color when using a spot light.
-vec3 CalcSpotLight(Material material, SpotLight light, vec3 N, vec3 fragPos, vec3 V)
+vec3 CalcSpotLight(Material material, SpotLight light, vec3 N, vec3 fragPos, vec3 V, float shadow)
 {
     vec3 L = normalize(light.position - fragPos);
     vec3 R = reflect(-L, N);
@@ -157,6 +245,38 @@ vec3 CalcSpotLight(Material material, SpotLight light, vec3 N, vec3 fragPos, vec
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
     
-    return (ambient + diffuse + specular);
+    return (ambient + shadow * (diffuse + specular));
 } 
 
+#if NR_POINT_LIGHTS > 0
+// fraction of a point light reaching the fragment, the cube maps hold only the first four lamps.
+float PointShadow(int light, vec3 fragPos, vec3 lightPos)
+{
+    if(light > 3 || !pointShadowOn[light])
+        return 1.0;
+    vec3 fragToLight = fragPos - lightPos;
+    float ref = length(fragToLight) / pointShadowFar[light] - 0.002;
+    if(light == 0)
+        return texture(pointShadowMap0, vec4(fragToLight, ref));
+    if(light == 1)
+        return texture(pointShadowMap1, vec4(fragToLight, ref));
+    if(light == 2)
+        return texture(pointShadowMap2, vec4(fragToLight, ref));
+    return texture(pointShadowMap3, vec4(fragToLight, ref));
+}
+#endif
+
+// fraction of the spot light reaching the fragment, 1 outside its shadow frustum.
+float SpotShadow(vec3 fragPos, vec3 N)
+{
+    if(!spotShadowOn)
+        return 1.0;
+    vec4 p = spotShadowMatrix * vec4(fragPos + N * 0.05, 1.0);
+    if(p.w <= 0.0)
+        return 1.0;
+    vec3 coord = p.xyz / p.w * 0.5 + 0.5;
+    if(any(lessThan(coord.xy, vec2(0.0))) || any(greaterThan(coord.xy, vec2(1.0))) || coord.z > 1.0)
+        return 1.0;
+    return texture(spotShadowMap, vec3(coord.xy, coord.z - 0.0005));
+}
+
@@ -0,0 +1,11 @@
+#version 330 core
+in vec4 FragPos;
+
+uniform vec3 lightPos;
+uniform float farPlane;
+
+void main()
+{
+    // linear distance to the light, compared against distance / far when shading
+    gl_FragDepth = length(FragPos.xyz - lightPos) / farPlane;
+}
@@ -0,0 +1,6 @@
+#version 330 core
+
+void main()
+{
+    // depth only, written by the fixed function
+}
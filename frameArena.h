@@ -0,0 +1,202 @@
+//
+//  frameArena.h
+//  monotonic allocator for data that only lives for one frame: temporary lists, sort
+//  keys, uniform names. allocations bump a pointer in one block and are all released
+//  at once when the next frame begins. containers take it as a std::pmr::memory_resource,
+//  and the frame loop reports how many heap allocations a frame still made
+//
+
+#ifndef frameArena_h
+#define frameArena_h
+
+#include <memory_resource>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <cstdio>
+#include <cstdarg>
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+class FrameArena : public pmr::memory_resource {
+public:
+    // statistics, summed until resetStats()
+    unsigned long long frames = 0;
+    size_t peakBytes = 0;
+    unsigned long long overflows = 0;           // allocations that did not fit the block and went to the heap
+    unsigned long long firstFrameHeapAllocations = 0;
+    unsigned long long steadyHeapAllocations = 0;   // in the frames after the first
+    unsigned long long maxHeapAllocations = 0;
+    unsigned long long framesWithoutHeap = 0;
+
+    // constructor, the block grows at a reset when the frame before did not fit
+    FrameArena(size_t capacity)
+    {
+        allocateBlock(capacity);
+    }
+
+    // destructor
+    ~FrameArena()
+    {
+        releaseOverflow();
+        ::operator delete(block, align_val_t(BLOCK_ALIGNMENT));
+        if (current() == this)
+            current() = nullptr;
+    }
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // the arena of the running frame, per frame code allocates through resource() so it also runs without one
+    static FrameArena*& current()
+    {
+        static FrameArena* arena = nullptr;
+        return arena;
+    }
+
+    static pmr::memory_resource* resource()
+    {
+        return current() != nullptr ? (pmr::memory_resource*)current() : pmr::get_default_resource();
+    }
+
+    // every operator new of the process, counted by the replacement in main.cpp
+    static atomic<unsigned long long>& heapAllocations()
+    {
+        static atomic<unsigned long long> count{ 0 };
+        return count;
+    }
+
+    // releases everything the last frame allocated. nothing allocated from it may be used after this
+    void beginFrame()
+    {
+        frameHeapStart = heapAllocations().load(memory_order_relaxed);
+        size_t used = head.load(memory_order_relaxed) + overflowBytes;
+        peakBytes = std::max(peakBytes, used);
+        if (overflowBytes > 0)
+        {
+            // the next frame of the same size fits in one block again
+            releaseOverflow();
+            ::operator delete(block, align_val_t(BLOCK_ALIGNMENT));
+            allocateBlock(std::max(capacity * 2, used));
+        }
+        head.store(0, memory_order_relaxed);
+    }
+
+    void endFrame()
+    {
+        unsigned long long count = heapAllocations().load(memory_order_relaxed) - frameHeapStart;
+        peakBytes = std::max(peakBytes, head.load(memory_order_relaxed) + overflowBytes);
+        if (frames++ == 0)
+        {
+            firstFrameHeapAllocations = count;
+            return;
+        }
+        steadyHeapAllocations += count;
+        maxHeapAllocations = std::max(maxHeapAllocations, count);
+        if (count == 0)
+            framesWithoutHeap++;
+    }
+
+    void resetStats()
+    {
+        frames = 0;
+        peakBytes = 0;
+        overflows = 0;
+        firstFrameHeapAllocations = 0;
+        steadyHeapAllocations = 0;
+        maxHeapAllocations = 0;
+        framesWithoutHeap = 0;
+    }
+
+    void printStats()
+    {
+        unsigned long long steadyFrames = frames > 0 ? frames - 1 : 0;
+        cout << "frame arena: " << capacity / 1024 << " KB, peak " << peakBytes / 1024 << " KB, " << overflows << " overflows; heap allocations per frame: "
+            << firstFrameHeapAllocations << " in the first, then " << (steadyFrames > 0 ? (double)steadyHeapAllocations / steadyFrames : 0.0)
+            << " average, " << maxHeapAllocations << " worst, " << framesWithoutHeap << " of " << steadyFrames << " frames with none" << endl;
+    }
+
+protected:
+    // any thread may allocate while the frame runs, the block is claimed with one atomic add
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        uintptr_t base = (uintptr_t)block;
+        size_t used = head.load(memory_order_relaxed);
+        size_t offset;
+        do
+        {
+            offset = (size_t)(((base + used + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base);
+            if (offset + bytes > capacity)
+                return allocateOverflow(bytes, alignment);
+        } while (!head.compare_exchange_weak(used, offset + bytes, memory_order_relaxed));
+        return block + offset;
+    }
+
+    // released all at once by beginFrame()
+    void do_deallocate(void*, size_t, size_t) override
+    {
+    }
+
+    bool do_is_equal(const pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+private:
+    static const size_t BLOCK_ALIGNMENT = 64;
+
+    struct Overflow {
+        void* memory;
+        size_t alignment;
+    };
+
+    unsigned char* block = nullptr;
+    size_t capacity = 0;
+    atomic<size_t> head{ 0 };
+    mutex overflowLock;
+    vector<Overflow> overflowBlocks;
+    size_t overflowBytes = 0;
+    unsigned long long frameHeapStart = 0;
+
+    void allocateBlock(size_t size)
+    {
+        capacity = (size + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+        block = (unsigned char*)::operator new(capacity, align_val_t(BLOCK_ALIGNMENT));
+    }
+
+    void* allocateOverflow(size_t bytes, size_t alignment)
+    {
+        lock_guard<mutex> lock(overflowLock);
+        void* memory = ::operator new(bytes, align_val_t(alignment));
+        overflowBlocks.push_back({ memory, alignment });
+        overflowBytes += bytes;
+        overflows++;
+        return memory;
+    }
+
+    void releaseOverflow()
+    {
+        for (const Overflow& overflow : overflowBlocks)
+            ::operator delete(overflow.memory, align_val_t(overflow.alignment));
+        overflowBlocks.clear();
+        overflowBytes = 0;
+    }
+};
+
+// printf into a string of the current frame arena, for uniform names built while drawing
+inline pmr::string frameFormat(const char* format, ...)
+{
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    return pmr::string(text, FrameArena::resource());
+}
+
+#endif /* frameArena_h */
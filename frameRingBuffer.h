@@ -0,0 +1,221 @@
+//
+//  frameRingBuffer.h
+//  one buffer object for the data that is rewritten every frame, split into a partition
+//  per frame in flight. the CPU bump-allocates from the current partition while the GPU
+//  still reads the two before it, a fence per partition says when it may be reused.
+//  with ARB_buffer_storage the buffer stays mapped and writes need no driver call at all
+//
+
+#ifndef frameRingBuffer_h
+#define frameRingBuffer_h
+
+#include <glad/glad.h>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+class FrameRingBuffer {
+public:
+    static const int FRAMES = 3;
+
+    // a block of the current partition, valid for the commands of this frame
+    struct Allocation {
+        unsigned char* data;        // write the block here
+        size_t offset;              // in bytes from the start of buffer()
+        size_t size;
+    };
+
+    // statistics, summed until resetStats()
+    unsigned long long frames = 0;
+    unsigned long long stalls = 0;          // beginFrame() found its partition still in use
+    double stallMs = 0.0;
+    unsigned long long resizes = 0;         // a frame did not fit and the buffer was recreated
+    size_t peakFrameBytes = 0;
+
+    // constructor, partitionSize grows when a frame needs more. alignment is the default for allocate()
+    FrameRingBuffer(size_t partitionSize, size_t alignment = 256)
+    {
+        this->alignment = alignment;
+        create(alignUp(partitionSize, PARTITION_ALIGNMENT));
+    }
+
+    // destructor
+    ~FrameRingBuffer()
+    {
+        destroy();
+    }
+
+    FrameRingBuffer(const FrameRingBuffer&) = delete;
+    FrameRingBuffer& operator=(const FrameRingBuffer&) = delete;
+
+    unsigned int buffer() const
+    {
+        return id;
+    }
+
+    // changes when the buffer object is recreated, views of it (buffer textures) have to be attached again
+    unsigned int generation() const
+    {
+        return bufferGeneration;
+    }
+
+    bool persistent() const
+    {
+        return mapped != nullptr;
+    }
+
+    // moves to the next partition, waiting for the GPU if it still reads what was written there FRAMES frames ago
+    void beginFrame()
+    {
+        current = (current + 1) % FRAMES;
+        head = 0;
+        frames++;
+        waitFor(current);
+    }
+
+    // after the last command that reads this frame's allocations
+    void endFrame()
+    {
+        if (persistent())
+            fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // alignment 0 uses the constructor's. a frame that does not fit recreates the buffer twice as large,
+    // allocations made earlier in the frame stay valid only for the commands already issued
+    Allocation allocate(size_t size, size_t alignment = 0)
+    {
+        size_t offset = alignUp(head, alignment != 0 ? alignment : this->alignment);
+        if (offset + size > partitionSize)
+        {
+            resize(alignUp(std::max(partitionSize * 2, size), PARTITION_ALIGNMENT));
+            offset = 0;
+        }
+        head = offset + size;
+        peakFrameBytes = std::max(peakFrameBytes, head);
+        size_t start = (size_t)current * partitionSize + offset;
+        Allocation allocation;
+        allocation.data = (persistent() ? mapped : shadow.data()) + start;
+        allocation.offset = start;
+        allocation.size = size;
+        return allocation;
+    }
+
+    // makes a written block visible to the GPU. the persistent mapping is coherent, without it the block is uploaded
+    void commit(const Allocation& allocation)
+    {
+        if (persistent())
+            return;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.offset, allocation.size, allocation.data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    void resetStats()
+    {
+        frames = 0;
+        stalls = 0;
+        stallMs = 0.0;
+        resizes = 0;
+        peakFrameBytes = 0;
+    }
+
+    void printStats()
+    {
+        cout << "frame ring buffer: " << (persistent() ? "persistent mapped" : "buffer sub data") << ", " << FRAMES << " x " << partitionSize / 1024
+            << " KB, peak " << peakFrameBytes / 1024 << " KB per frame, " << stalls << " stalls in " << frames << " frames (" << stallMs << " ms), "
+            << resizes << " resizes" << endl;
+    }
+
+private:
+    static const size_t PARTITION_ALIGNMENT = 256;     // keeps every partition start aligned for any allocation
+
+    unsigned int id = 0;
+    unsigned int bufferGeneration = 0;
+    size_t partitionSize = 0;
+    size_t alignment;
+    int current = 0;
+    size_t head = 0;
+    unsigned char* mapped = nullptr;
+    vector<unsigned char> shadow;       // written blocks before commit() when the buffer cannot stay mapped
+    GLsync fences[FRAMES] = {};
+
+    static size_t alignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    void create(size_t partitionSize)
+    {
+        this->partitionSize = partitionSize;
+        size_t total = partitionSize * FRAMES;
+        glGenBuffers(1, &id);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+#ifdef GL_ARB_buffer_storage
+        // buffer storage is core in 4.4, on a 3.3 context it needs ARB_buffer_storage
+        if (GLAD_GL_ARB_buffer_storage)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_COPY_WRITE_BUFFER, total, NULL, flags);
+            mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, total, flags);
+            if (mapped == nullptr)
+                cout << "ERROR::FRAME_RING_BUFFER::MAP_FAILED: falling back to buffer sub data" << endl;
+        }
+#endif
+        if (mapped == nullptr)
+        {
+            glBufferData(GL_COPY_WRITE_BUFFER, total, NULL, GL_STREAM_DRAW);
+            shadow.assign(total, 0);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        bufferGeneration++;
+    }
+
+    void destroy()
+    {
+        for (int i = 0; i < FRAMES; i++)
+            waitFor(i);
+        if (mapped != nullptr)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            mapped = nullptr;
+        }
+        glDeleteBuffers(1, &id);
+        id = 0;
+        shadow.clear();
+    }
+
+    // waits for every partition, so the new buffer starts with none in use
+    void resize(size_t partitionSize)
+    {
+        destroy();
+        create(partitionSize);
+        resizes++;
+    }
+
+    void waitFor(int partition)
+    {
+        if (fences[partition] == nullptr)
+            return;
+        if (glClientWaitSync(fences[partition], 0, 0) == GL_TIMEOUT_EXPIRED)
+        {
+            auto start = chrono::high_resolution_clock::now();
+            while (true)
+            {
+                GLenum status = glClientWaitSync(fences[partition], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+                if (status != GL_TIMEOUT_EXPIRED)
+                    break;
+            }
+            stalls++;
+            stallMs += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+        }
+        glDeleteSync(fences[partition]);
+        fences[partition] = nullptr;
+    }
+};
+
+#endif /* frameRingBuffer_h */
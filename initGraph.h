@@ -0,0 +1,245 @@
+//
+//  initGraph.h
+//  dependency graph for the work done before the first frame. tasks that only touch
+//  memory (tessellation, image decoding) run on a pool of worker threads, tasks that
+//  need the context are run by the thread that owns it as soon as their inputs are done.
+//  every task is timed, and the timeline marks the chain that decided when startup ended
+//
+
+#ifndef initGraph_h
+#define initGraph_h
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+using namespace std;
+
+class InitGraph {
+public:
+    // statistics, valid after finish()
+    double totalMs = 0.0;
+    double criticalPathMs = 0.0;    // summed run time of the tasks on the critical path
+    int workerCount = 0;
+
+    // destructor
+    ~InitGraph()
+    {
+        joinWorkers();
+    }
+
+    // work that does not touch the context, run on the pool
+    int addTask(const string& name, function<void()> work, const vector<int>& dependencies = {})
+    {
+        return add(name, move(work), dependencies, false);
+    }
+
+    // work that needs the context, run by the thread that calls finish()
+    int addContextTask(const string& name, function<void()> work, const vector<int>& dependencies = {})
+    {
+        return add(name, move(work), dependencies, true);
+    }
+
+    // starts the workers on the tasks without dependencies, the calling thread is free for
+    // other context work until finish(). every task has to be added before this
+    void start(int threadCount)
+    {
+        startTime = chrono::high_resolution_clock::now();
+        for (int i = 0; i < (int)tasks.size(); i++)
+            if (tasks[i].remaining == 0)
+                (tasks[i].context ? readyContext : readyPool).push_back(i);
+        workerCount = std::max(1, threadCount);
+        for (int i = 0; i < workerCount; i++)
+            workers.emplace_back(&InitGraph::workerLoop, this, i + 1);
+    }
+
+    double now() const
+    {
+        return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - startTime).count();
+    }
+
+    // context work the caller did itself between start() and finish(), shown in the timeline
+    void recordContextWork(const string& name, double startMs)
+    {
+        Span span;
+        span.name = name;
+        span.startMs = startMs;
+        span.endMs = now();
+        spans.push_back(span);
+    }
+
+    // runs the context tasks as they become ready and helps the pool while none is, returns when all are done
+    void finish()
+    {
+        unique_lock<mutex> lock(mutexLock);
+        while (completed < tasks.size())
+        {
+            wake.wait(lock, [this] { return !readyContext.empty() || !readyPool.empty() || completed == tasks.size(); });
+            if (completed == tasks.size())
+                break;
+            deque<int>& queue = !readyContext.empty() ? readyContext : readyPool;
+            int task = queue.front();
+            queue.pop_front();
+            lock.unlock();
+            run(task, 0);
+            lock.lock();
+        }
+        lock.unlock();
+        joinWorkers();
+        totalMs = now();
+        findCriticalPath();
+    }
+
+    void printTimeline()
+    {
+        const int BAR_WIDTH = 48;
+        struct Row { string name; int thread; double startMs, endMs; bool critical; };
+        vector<Row> rows;
+        for (const Task& task : tasks)
+            rows.push_back({ task.name, task.thread, task.startMs, task.endMs, task.critical });
+        for (const Span& span : spans)
+            rows.push_back({ span.name, 0, span.startMs, span.endMs, span.critical });
+        sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) { return a.startMs < b.startMs; });
+
+        cout << "startup timeline: " << tasks.size() << " tasks on " << workerCount << " workers and the context thread, "
+            << totalMs << " ms, critical path (*) " << criticalPathMs << " ms" << endl;
+        double scale = totalMs > 0.0 ? BAR_WIDTH / totalMs : 0.0;
+        for (const Row& row : rows)
+        {
+            int from = std::min(BAR_WIDTH - 1, (int)(row.startMs * scale));
+            int to = std::max(from + 1, std::min(BAR_WIDTH, (int)(row.endMs * scale + 0.5)));
+            string bar(BAR_WIDTH, ' ');
+            for (int i = from; i < to; i++)
+                bar[i] = row.thread == 0 ? '#' : '=';
+            char line[256];
+            snprintf(line, sizeof(line), "  %c %-36.36s %-7s %8.2f %8.2f ms |%s|", row.critical ? '*' : ' ', row.name.c_str(),
+                row.thread == 0 ? "context" : ("worker" + to_string(row.thread)).c_str(), row.startMs, row.endMs, bar.c_str());
+            cout << line << endl;
+        }
+    }
+
+private:
+    struct Task {
+        string name;
+        function<void()> work;
+        vector<int> dependencies;
+        vector<int> dependents;
+        int remaining = 0;          // dependencies not done yet
+        bool context = false;
+        bool critical = false;
+        int thread = 0;             // 0 for the context thread
+        double startMs = 0.0;
+        double endMs = 0.0;
+    };
+    struct Span {
+        string name;
+        double startMs, endMs;
+        bool critical = false;
+    };
+
+    vector<Task> tasks;
+    vector<Span> spans;
+    vector<thread> workers;
+    deque<int> readyPool;
+    deque<int> readyContext;
+    size_t completed = 0;
+    mutex mutexLock;
+    condition_variable wake;
+    chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+
+    int add(const string& name, function<void()> work, const vector<int>& dependencies, bool context)
+    {
+        Task task;
+        task.name = name;
+        task.work = move(work);
+        task.dependencies = dependencies;
+        task.remaining = (int)dependencies.size();
+        task.context = context;
+        int index = (int)tasks.size();
+        for (int dependency : dependencies)
+            tasks[dependency].dependents.push_back(index);
+        tasks.push_back(move(task));
+        return index;
+    }
+
+    void run(int index, int threadNumber)
+    {
+        Task& task = tasks[index];
+        task.thread = threadNumber;
+        task.startMs = now();
+        task.work();
+        task.endMs = now();
+
+        lock_guard<mutex> lock(mutexLock);
+        for (int dependent : task.dependents)
+            if (--tasks[dependent].remaining == 0)
+                (tasks[dependent].context ? readyContext : readyPool).push_back(dependent);
+        completed++;
+        wake.notify_all();
+    }
+
+    void workerLoop(int threadNumber)
+    {
+        unique_lock<mutex> lock(mutexLock);
+        while (true)
+        {
+            wake.wait(lock, [this] { return !readyPool.empty() || completed == tasks.size(); });
+            if (readyPool.empty())
+                return;
+            int task = readyPool.front();
+            readyPool.pop_front();
+            lock.unlock();
+            run(task, threadNumber);
+            lock.lock();
+        }
+    }
+
+    void joinWorkers()
+    {
+        for (thread& t : workers)
+            t.join();
+        workers.clear();
+    }
+
+    // back from the task that finished last, always through the input that finished last. a context
+    // task whose inputs were done before the caller's own context work ended waited for that work
+    void findCriticalPath()
+    {
+        criticalPathMs = 0.0;
+        int last = -1;
+        for (int i = 0; i < (int)tasks.size(); i++)
+            if (last < 0 || tasks[i].endMs > tasks[last].endMs)
+                last = i;
+        while (last >= 0)
+        {
+            Task& task = tasks[last];
+            task.critical = true;
+            criticalPathMs += task.endMs - task.startMs;
+            last = -1;
+            for (int dependency : task.dependencies)
+                if (last < 0 || tasks[dependency].endMs > tasks[last].endMs)
+                    last = dependency;
+            double inputsDoneMs = last >= 0 ? tasks[last].endMs : 0.0;
+            for (Span& span : spans)
+            {
+                if (task.thread == 0 && span.endMs > inputsDoneMs && span.endMs <= task.startMs)
+                {
+                    span.critical = true;
+                    criticalPathMs += span.endMs - span.startMs;
+                    last = -1;
+                    break;
+                }
+            }
+        }
+    }
+};
+
+#endif /* initGraph_h */
@@ -0,0 +1,142 @@
+//
+//  inputQueue.h
+//  hand-over of input from the thread that polls the window to the render thread:
+//  a lock-free single producer, single consumer ring for discrete events, a snapshot
+//  buffer for state that only matters in its latest version (the camera), and the
+//  input-to-present latency measured on the render thread
+//
+
+#ifndef inputQueue_h
+#define inputQueue_h
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+// fixed size ring, push() only from one thread and pop() only from one other. CAPACITY is a power of 2
+template <typename T, size_t CAPACITY>
+class SpscQueue {
+public:
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "the queue capacity must be a power of 2");
+
+    // false when the queue is full, the value is dropped
+    bool push(const T& value)
+    {
+        size_t tail = this->tail.load(memory_order_relaxed);
+        if (tail - head.load(memory_order_acquire) == CAPACITY)
+            return false;
+        slots[tail & (CAPACITY - 1)] = value;
+        this->tail.store(tail + 1, memory_order_release);
+        return true;
+    }
+
+    // false when the queue is empty
+    bool pop(T& value)
+    {
+        size_t head = this->head.load(memory_order_relaxed);
+        if (head == tail.load(memory_order_acquire))
+            return false;
+        value = slots[head & (CAPACITY - 1)];
+        this->head.store(head + 1, memory_order_release);
+        return true;
+    }
+
+private:
+    T slots[CAPACITY];
+    // on their own cache lines, each is written by one side only
+    alignas(64) atomic<size_t> head{ 0 };
+    alignas(64) atomic<size_t> tail{ 0 };
+};
+
+// discrete window input, in the order the window system delivered it
+enum InputEventType { INPUT_KEY, INPUT_RESIZE };
+
+struct InputEvent {
+    InputEventType type;
+    int key, action;            // INPUT_KEY
+    int width, height;          // INPUT_RESIZE
+    double time;                // when it was received, for the latency
+};
+
+// double buffered state between one writer and one reader, each works on its own copy and they are
+// exchanged through a third slot, so neither side ever waits or sees a half written value
+template <typename T>
+class SnapshotBuffer {
+public:
+    // the writer's copy
+    T& back()
+    {
+        return slots[backIndex];
+    }
+
+    // hands the writer's copy to the reader, replacing a published copy the reader has not taken yet
+    void publish()
+    {
+        backIndex = middle.exchange(backIndex | FRESH, memory_order_acq_rel) & ~FRESH;
+    }
+
+    // takes the newest published copy if there is one the reader has not seen
+    bool update()
+    {
+        if ((middle.load(memory_order_relaxed) & FRESH) == 0)
+            return false;
+        frontIndex = middle.exchange(frontIndex, memory_order_acq_rel) & ~FRESH;
+        return true;
+    }
+
+    // the reader's copy
+    const T& front() const
+    {
+        return slots[frontIndex];
+    }
+
+private:
+    static const int FRESH = 4;     // set on the middle index while the reader has not taken it
+    T slots[3];
+    int backIndex = 0;
+    int frontIndex = 1;
+    atomic<int> middle{ 2 };
+};
+
+// time from an input arriving to the buffer swap of the first frame that shows it. the swap is the
+// last point the application sees, so scan-out and the display add to this
+class InputLatency {
+public:
+    // statistics
+    unsigned long long frames = 0;      // frames that showed new input
+    double totalMs = 0.0;
+    double maxMs = 0.0;
+
+    // an input applied to the frame being rendered, received at inputTime
+    void applied(double inputTime)
+    {
+        oldestInput = oldestInput == 0.0 ? inputTime : std::min(oldestInput, inputTime);
+    }
+
+    // the frame's buffers were swapped at presentTime
+    void presented(double presentTime)
+    {
+        if (oldestInput == 0.0)
+            return;
+        double ms = (presentTime - oldestInput) * 1000.0;
+        frames++;
+        totalMs += ms;
+        maxMs = std::max(maxMs, ms);
+        oldestInput = 0.0;
+    }
+
+    void printStats(const char* mode)
+    {
+        cout << "input latency (" << mode << "): " << frames << " frames with new input, " << (frames > 0 ? totalMs / frames : 0.0)
+            << " ms average to the swap, " << maxMs << " ms worst" << endl;
+    }
+
+private:
+    double oldestInput = 0.0;
+};
+
+#endif /* inputQueue_h */
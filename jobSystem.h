@@ -0,0 +1,246 @@
+//
+//  jobSystem.h
+//  work-stealing job scheduler for the CPU work of a frame. every thread has its own
+//  deque: it pushes and pops jobs at the back, idle threads steal from the front of the
+//  others. jobs are grouped by counters, waiting on a counter runs jobs until it drops
+//  to zero, so the thread that forks work helps with it instead of blocking
+//
+
+#ifndef jobSystem_h
+#define jobSystem_h
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <iostream>
+
+using namespace std;
+
+// number of unfinished jobs of a fork, jobs may add more to it while it runs
+class JobCounter {
+public:
+    bool done() const
+    {
+        return pending.load(memory_order_acquire) == 0;
+    }
+
+private:
+    friend class JobSystem;
+    atomic<int> pending{ 0 };
+};
+
+class JobSystem {
+public:
+    // statistics, summed until resetStats()
+    atomic<unsigned long long> jobsRun{ 0 };
+    atomic<unsigned long long> jobsStolen{ 0 };
+
+    // constructor, threadCount 0 uses every core. the constructing thread is one of them and
+    // only runs jobs while it waits on a counter
+    JobSystem(int threadCount = 0)
+    {
+        if (threadCount <= 0)
+            threadCount = std::max(1, (int)thread::hardware_concurrency());
+        queues.reset(new Queue[threadCount]);
+        queueCount = threadCount;
+        for (int i = 1; i < threadCount; i++)
+            workers.emplace_back(&JobSystem::workerLoop, this, i);
+    }
+
+    // destructor
+    ~JobSystem()
+    {
+        {
+            lock_guard<mutex> lock(sleepLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (thread& worker : workers)
+            worker.join();
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    int threadCount() const
+    {
+        return queueCount;
+    }
+
+    // fork: queues job on the calling thread's deque, counted on counter
+    void run(JobCounter& counter, function<void()> job)
+    {
+        counter.pending.fetch_add(1, memory_order_relaxed);
+        push(Job{ move(job), &counter });
+        notify(false);
+    }
+
+    // fork: body(first, last) over [0, count) in chunks of grain, counted on counter. the
+    // chunks are queued in reverse so the owner pops them in order while thieves take the far end
+    void parallelFor(JobCounter& counter, int count, int grain, function<void(int, int)> body)
+    {
+        if (count <= 0)
+            return;
+        grain = std::max(1, grain);
+        int chunks = (count + grain - 1) / grain;
+        shared_ptr<function<void(int, int)>> shared = make_shared<function<void(int, int)>>(move(body));
+        counter.pending.fetch_add(chunks, memory_order_relaxed);
+        Queue& queue = queues[currentQueue()];
+        {
+            lock_guard<mutex> lock(queue.lock);
+            for (int chunk = chunks - 1; chunk >= 0; chunk--)
+            {
+                int first = chunk * grain;
+                int last = std::min(count, first + grain);
+                queue.jobs.push_back(Job{ [shared, first, last] { (*shared)(first, last); }, &counter });
+            }
+        }
+        queued.fetch_add(chunks, memory_order_release);
+        notify(true);
+    }
+
+    // fork and join in one call
+    void parallelFor(int count, int grain, function<void(int, int)> body)
+    {
+        JobCounter counter;
+        parallelFor(counter, count, grain, move(body));
+        wait(counter);
+    }
+
+    // join: runs queued jobs, its own first and then stolen ones, until counter drops to zero
+    void wait(JobCounter& counter)
+    {
+        int self = currentQueue();
+        while (!counter.done())
+        {
+            if (!runOne(self))
+                this_thread::yield();
+        }
+    }
+
+    void resetStats()
+    {
+        jobsRun = 0;
+        jobsStolen = 0;
+    }
+
+    void printStats()
+    {
+        cout << "job system: " << queueCount << " threads, " << jobsRun << " jobs run, " << jobsStolen << " stolen" << endl;
+    }
+
+private:
+    struct Job {
+        function<void()> work;
+        JobCounter* counter;
+    };
+    struct Queue {
+        mutex lock;
+        deque<Job> jobs;
+    };
+
+    unique_ptr<Queue[]> queues;
+    int queueCount = 0;
+    vector<thread> workers;
+    atomic<int> queued{ 0 };        // jobs in all deques, lets idle workers sleep
+    mutex sleepLock;
+    condition_variable wake;
+    bool stopping = false;
+
+    // which deque the calling thread owns, threads outside the system share the first
+    static JobSystem*& currentSystem()
+    {
+        static thread_local JobSystem* system = nullptr;
+        return system;
+    }
+    static int& currentIndex()
+    {
+        static thread_local int index = 0;
+        return index;
+    }
+    int currentQueue() const
+    {
+        return currentSystem() == this ? currentIndex() : 0;
+    }
+
+    void push(Job job)
+    {
+        Queue& queue = queues[currentQueue()];
+        {
+            lock_guard<mutex> lock(queue.lock);
+            queue.jobs.push_back(move(job));
+        }
+        queued.fetch_add(1, memory_order_release);
+    }
+
+    // taking the lock orders the notify after a sleeper's check of queued
+    void notify(bool all)
+    {
+        {
+            lock_guard<mutex> lock(sleepLock);
+        }
+        if (all)
+            wake.notify_all();
+        else
+            wake.notify_one();
+    }
+
+    // the newest job of its own deque, or the oldest of the next deque that has one
+    bool runOne(int self)
+    {
+        Job job;
+        bool found = false;
+        {
+            Queue& own = queues[self];
+            lock_guard<mutex> lock(own.lock);
+            if (!own.jobs.empty())
+            {
+                job = move(own.jobs.back());
+                own.jobs.pop_back();
+                found = true;
+            }
+        }
+        for (int i = 1; i < queueCount && !found; i++)
+        {
+            Queue& victim = queues[(self + i) % queueCount];
+            lock_guard<mutex> lock(victim.lock);
+            if (!victim.jobs.empty())
+            {
+                job = move(victim.jobs.front());
+                victim.jobs.pop_front();
+                found = true;
+                jobsStolen.fetch_add(1, memory_order_relaxed);
+            }
+        }
+        if (!found)
+            return false;
+        queued.fetch_sub(1, memory_order_relaxed);
+        job.work();
+        jobsRun.fetch_add(1, memory_order_relaxed);
+        job.counter->pending.fetch_sub(1, memory_order_acq_rel);
+        return true;
+    }
+
+    void workerLoop(int index)
+    {
+        currentSystem() = this;
+        currentIndex() = index;
+        while (true)
+        {
+            if (runOne(index))
+                continue;
+            unique_lock<mutex> lock(sleepLock);
+            wake.wait(lock, [this] { return stopping || queued.load(memory_order_acquire) > 0; });
+            if (stopping)
+                return;
+        }
+    }
+};
+
+#endif /* jobSystem_h */
@@ -0,0 +1,639 @@
+//
+//  lightmap.h
+//  offline lightmap for the static scene: the geometry is captured once with transform
+//  feedback, every triangle gets its own chart in an atlas, and a multithreaded CPU ray
+//  tracer bakes ambient, shadowed direct light and one diffuse bounce into it. the baked
+//  scene is then drawn with one draw call and a single texture fetch per fragment
+//
+
+#ifndef lightmap_h
+#define lightmap_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <cstdint>
+#include <cmath>
+#include <iostream>
+#include "shader.h"
+#include "bvh.h"
+#include "sceneCapture.h"
+#include "pointLight.h"
+#include "directionLight.h"
+#include "spotLight.h"
+
+using namespace std;
+
+// baked lightmaps are stored here, keyed on the geometry, the lights and the bake settings
+#define LIGHTMAP_CACHE_DIR "lightmap_cache"
+
+class Lightmap {
+public:
+    int resolution;             // atlas size in texels, grows when the charts do not fit at the minimum density
+    float texelsPerUnit;        // requested density, lowered until every chart fits
+    int indirectSamples;        // bounce rays per texel, rounded up to whole packets of 4
+    int threadCount;
+
+    // statistics of the last build()
+    unsigned int triangleCount = 0;
+    unsigned int coveredTexels = 0;
+    float usedTexelsPerUnit = 0.0f;
+    unsigned long long raysTraced = 0;
+    double captureMs = 0.0;
+    double unwrapMs = 0.0;
+    double bakeMs = 0.0;
+    bool loadedFromCache = false;
+
+    // constructor, needs a current context
+    Lightmap(int resolution = 2048, float texelsPerUnit = 4.0f, int indirectSamples = 16)
+        : captureShader("vertexShaderForCapture.vs", "fragmentShaderForShadowDepth.fs", nullptr, "", false,
+            { "worldPos", "worldNormal", "ambientColor", "diffuseColor" }),
+          lightmapShader("vertexShaderForLightmap.vs", "fragmentShaderForLightmap.fs")
+    {
+        this->resolution = resolution;
+        this->texelsPerUnit = texelsPerUnit;
+        this->indirectSamples = indirectSamples;
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // destructor
+    ~Lightmap()
+    {
+        glDeleteTextures(1, &texture);
+        glDeleteBuffers(1, &VBO);
+        glDeleteVertexArrays(1, &VAO);
+    }
+
+    // lights are taken with their current on/off state, specular is not baked
+    void clearLights()
+    {
+        lights.clear();
+    }
+    void addLight(const PointLight& light)
+    {
+        if (!light.isOn())
+            return;
+        BakeLight bakeLight;
+        bakeLight.type = BakeLight::POINT;
+        bakeLight.position = light.position;
+        bakeLight.ambient = light.getAmbient();
+        bakeLight.diffuse = light.getDiffuse();
+        bakeLight.k_c = light.k_c;
+        bakeLight.k_l = light.k_l;
+        bakeLight.k_q = light.k_q;
+        bakeLight.range = light.radius;
+        lights.push_back(bakeLight);
+    }
+    void addLight(const DirectionLight& light)
+    {
+        if (!light.isOn())
+            return;
+        BakeLight bakeLight;
+        bakeLight.type = BakeLight::DIRECTION;
+        bakeLight.direction = glm::normalize(light.direction);
+        bakeLight.ambient = light.getAmbient();
+        bakeLight.diffuse = light.getDiffuse();
+        lights.push_back(bakeLight);
+    }
+    void addLight(const SpotLight& light)
+    {
+        if (!light.isOn())
+            return;
+        BakeLight bakeLight;
+        bakeLight.type = BakeLight::SPOT;
+        bakeLight.position = light.position;
+        bakeLight.direction = glm::normalize(light.direction);
+        bakeLight.ambient = light.getAmbient();
+        bakeLight.diffuse = light.getDiffuse();
+        bakeLight.k_c = light.k_c;
+        bakeLight.k_l = light.k_l;
+        bakeLight.k_q = light.k_q;
+        bakeLight.cosCutOff = glm::cos(glm::radians(light.Angle));
+        lights.push_back(bakeLight);
+    }
+
+    // captures the geometry on the first call, then loads or bakes the lightmap for the current lights.
+    // drawStatic issues the static draws with the given shader, every draw has to be GL_TRIANGLES
+    void build(const function<void(Shader&)>& drawStatic)
+    {
+        if (triangles.empty())
+        {
+            auto start = chrono::high_resolution_clock::now();
+            triangleCount = captureTriangles(captureShader, drawStatic, triangles, positions);
+            captureMs = elapsedMs(start);
+            start = chrono::high_resolution_clock::now();
+            unwrap();
+            uploadGeometry();
+            bvh.build(positions, threadCount);
+            unwrapMs = elapsedMs(start);
+        }
+
+        string key = cacheKey();
+        if (key == bakedKey)
+            return;
+        raysTraced = 0;
+        bakeMs = 0.0;
+        loadedFromCache = load(key);
+        if (!loadedFromCache)
+        {
+            auto start = chrono::high_resolution_clock::now();
+            bake();
+            bakeMs = elapsedMs(start);
+            save(key);
+        }
+        uploadTexture();
+        bakedKey = key;
+    }
+
+    // the static geometry changed: the next build() captures it again and bakes for it
+    void invalidateGeometry()
+    {
+        glDeleteBuffers(1, &VBO);
+        glDeleteVertexArrays(1, &VAO);
+        VBO = VAO = 0;
+        triangles.clear();
+        positions.clear();
+        bakedKey.clear();
+    }
+
+    bool isReady() const
+    {
+        return texture != 0;
+    }
+
+    // the whole baked scene in a single draw
+    void draw(const glm::mat4& projection, const glm::mat4& view)
+    {
+        lightmapShader.use();
+        lightmapShader.setMat4("projection", projection);
+        lightmapShader.setMat4("view", view);
+        lightmapShader.setInt("lightmap", 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glBindVertexArray(VAO);
+        glDrawArrays(GL_TRIANGLES, 0, (GLsizei)positions.size());
+        glBindVertexArray(0);
+    }
+
+    void printStats()
+    {
+        cout << "lightmap: " << triangleCount << " triangles, " << resolution << "x" << resolution << " atlas at "
+            << usedTexelsPerUnit << " texels per unit, " << coveredTexels << " texels covered" << endl;
+        cout << "  capture " << captureMs << " ms, unwrap and bvh " << unwrapMs << " ms ("
+            << bvh.nodeCount << " nodes), ";
+        if (loadedFromCache)
+            cout << "loaded from " << LIGHTMAP_CACHE_DIR << endl;
+        else
+            cout << "bake " << bakeMs << " ms on " << threadCount << " threads, " << raysTraced << " rays, "
+                << (bakeMs > 0.0 ? raysTraced / (bakeMs * 1000.0) : 0.0) << " Mrays/s" << endl;
+    }
+
+private:
+    struct BakeLight {
+        enum Type { POINT, DIRECTION, SPOT } type = POINT;
+        glm::vec3 position = glm::vec3(0.0f);
+        glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+        glm::vec3 ambient = glm::vec3(0.0f);
+        glm::vec3 diffuse = glm::vec3(0.0f);
+        float k_c = 1.0f;
+        float k_l = 0.0f;
+        float k_q = 0.0f;
+        float cosCutOff = -1.0f;
+        float range = FLT_MAX;
+    };
+    // where a triangle sits in the atlas, in texels: corner a at origin, b on the x axis
+    struct Chart {
+        int x = 0, y = 0, width = 0, height = 0;
+        glm::vec2 origin = glm::vec2(0.0f);     // atlas position of corner a
+        float bx = 0.0f;
+        glm::vec2 c = glm::vec2(0.0f);
+    };
+    struct CapturedVertex {
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec3 ambient;
+        glm::vec3 diffuse;
+    };
+    static const int CHART_PADDING = 1;         // texels around every chart so bilinear filtering stays inside
+    static const uint32_t LIGHTMAP_MAGIC = 0x314D4C42;   // "BLM1"
+
+    Shader captureShader;
+    Shader lightmapShader;
+    vector<BakeLight> lights;
+
+    vector<CapturedVertex> triangles;           // 3 vertices per triangle
+    vector<glm::vec3> positions;
+    vector<glm::vec2> lightmapUVs;
+    vector<Chart> charts;
+    vector<int> texelTriangle;                  // triangle owning each texel, -1 for none
+    vector<unsigned char> texels;               // RGB8
+    Bvh bvh;
+    string bakedKey;
+
+    unsigned int texture = 0;
+    unsigned int VAO = 0;
+    unsigned int VBO = 0;
+
+    static double elapsedMs(chrono::high_resolution_clock::time_point start)
+    {
+        return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // one chart per triangle, laid flat in its own plane and shelf packed by height.
+    // the density drops until everything fits, and the atlas grows once charts are down to a single texel
+    void unwrap()
+    {
+        usedTexelsPerUnit = texelsPerUnit;
+        while (!pack(usedTexelsPerUnit))
+        {
+            usedTexelsPerUnit *= 0.85f;
+            if (usedTexelsPerUnit * 0.85f < 0.01f)
+            {
+                resolution *= 2;
+                usedTexelsPerUnit = texelsPerUnit;
+            }
+        }
+
+        lightmapUVs.resize(positions.size());
+        for (unsigned int t = 0; t < triangleCount; t++)
+        {
+            const Chart& chart = charts[t];
+            lightmapUVs[t * 3] = chart.origin / (float)resolution;
+            lightmapUVs[t * 3 + 1] = (chart.origin + glm::vec2(chart.bx, 0.0f)) / (float)resolution;
+            lightmapUVs[t * 3 + 2] = (chart.origin + chart.c) / (float)resolution;
+        }
+
+        texelTriangle.assign((size_t)resolution * resolution, -1);
+        coveredTexels = 0;
+        for (unsigned int t = 0; t < triangleCount; t++)
+        {
+            const Chart& chart = charts[t];
+            for (int y = chart.y; y < chart.y + chart.height; y++)
+                for (int x = chart.x; x < chart.x + chart.width; x++)
+                    texelTriangle[(size_t)y * resolution + x] = (int)t;
+            coveredTexels += chart.width * chart.height;
+        }
+    }
+
+    bool pack(float density)
+    {
+        charts.assign(triangleCount, Chart());
+        for (unsigned int t = 0; t < triangleCount; t++)
+        {
+            glm::vec3 e1 = positions[t * 3 + 1] - positions[t * 3];
+            glm::vec3 e2 = positions[t * 3 + 2] - positions[t * 3];
+            float length1 = glm::length(e1);
+            glm::vec3 xAxis = length1 > 0.0f ? e1 / length1 : glm::vec3(1.0f, 0.0f, 0.0f);
+            float cx = glm::dot(e2, xAxis);
+            float cy = glm::length(e2 - cx * xAxis);
+
+            Chart& chart = charts[t];
+            chart.bx = length1 * density;
+            chart.c = glm::vec2(cx, cy) * density;
+            float minX = std::min(0.0f, chart.c.x);
+            float maxX = std::max(chart.bx, chart.c.x);
+            chart.width = std::max(1, (int)ceil(maxX - minX)) + 2 * CHART_PADDING;
+            chart.height = std::max(1, (int)ceil(chart.c.y)) + 2 * CHART_PADDING;
+            chart.origin = glm::vec2(CHART_PADDING - minX, (float)CHART_PADDING);
+        }
+
+        vector<unsigned int> order(triangleCount);
+        for (unsigned int t = 0; t < triangleCount; t++)
+            order[t] = t;
+        sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return charts[a].height > charts[b].height; });
+
+        int shelfX = 0, shelfY = 0, shelfHeight = 0;
+        for (unsigned int t : order)
+        {
+            Chart& chart = charts[t];
+            if (chart.width > resolution)
+                return false;
+            if (shelfX + chart.width > resolution)
+            {
+                shelfY += shelfHeight;
+                shelfX = 0;
+                shelfHeight = 0;
+            }
+            if (shelfY + chart.height > resolution)
+                return false;
+            chart.x = shelfX;
+            chart.y = shelfY;
+            chart.origin += glm::vec2((float)shelfX, (float)shelfY);
+            shelfX += chart.width;
+            shelfHeight = std::max(shelfHeight, chart.height);
+        }
+        return true;
+    }
+
+    // barycentrics of a texel centre, clamped onto the triangle so the padding repeats the edge
+    void texelBarycentrics(const Chart& chart, int x, int y, float& u, float& v) const
+    {
+        glm::vec2 p = glm::vec2(x + 0.5f, y + 0.5f) - chart.origin;
+        if (chart.bx * chart.c.y < 1e-6f)
+        {
+            u = v = 1.0f / 3.0f;
+            return;
+        }
+        v = p.y / chart.c.y;
+        u = (p.x - v * chart.c.x) / chart.bx;
+        u = std::max(u, 0.0f);
+        v = std::max(v, 0.0f);
+        if (u + v > 1.0f)
+        {
+            float sum = u + v;
+            u /= sum;
+            v /= sum;
+        }
+    }
+
+    glm::vec3 geometricNormal(unsigned int triangle) const
+    {
+        glm::vec3 n = glm::cross(positions[triangle * 3 + 1] - positions[triangle * 3], positions[triangle * 3 + 2] - positions[triangle * 3]);
+        float length = glm::length(n);
+        return length > 0.0f ? n / length : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+
+    template <typename T>
+    static T interpolate(const T& a, const T& b, const T& c, float u, float v)
+    {
+        return a * (1.0f - u - v) + b * u + c * v;
+    }
+
+    // diffuse light arriving at p, shadow rays go out 4 lights at a time. ambient is not shadowed,
+    // like in the forward shaders
+    glm::vec3 directLight(const glm::vec3& p, const glm::vec3& n, const glm::vec3& offsetNormal, glm::vec3* ambient, unsigned long long& rays) const
+    {
+        glm::vec3 diffuse(0.0f);
+        glm::vec3 origin = p + offsetNormal * 0.01f;
+        for (size_t first = 0; first < lights.size(); first += 4)
+        {
+            RayPacket packet;
+            glm::vec3 contribution[4];
+            for (int lane = 0; lane < 4; lane++)
+            {
+                packet.active[lane] = false;
+                if (first + lane >= lights.size())
+                    continue;
+                const BakeLight& light = lights[first + lane];
+                glm::vec3 L;
+                float attenuation = 1.0f;
+                float distance = 1000.0f;
+                if (light.type == BakeLight::DIRECTION)
+                    L = -light.direction;
+                else
+                {
+                    distance = glm::length(light.position - p);
+                    if (distance > light.range || distance <= 0.0f)
+                        continue;
+                    L = (light.position - p) / distance;
+                    attenuation = 1.0f / (light.k_c + light.k_l * distance + light.k_q * distance * distance);
+                    if (light.type == BakeLight::SPOT)
+                    {
+                        float cosAlpha = glm::dot(L, -light.direction);
+                        attenuation *= cosAlpha >= light.cosCutOff ? cosAlpha : 0.0f;
+                    }
+                }
+                if (ambient != nullptr)
+                    *ambient += light.ambient * attenuation;
+                float nDotL = glm::dot(n, L);
+                if (nDotL <= 0.0f || attenuation <= 0.0f)
+                    continue;
+                contribution[lane] = light.diffuse * nDotL * attenuation;
+                Ray ray;
+                ray.origin = origin;
+                ray.direction = L;
+                ray.tMax = distance - 0.02f;
+                packet.set(lane, ray);
+            }
+            if (!packet.active[0] && !packet.active[1] && !packet.active[2] && !packet.active[3])
+                continue;
+            bool blocked[4];
+            bvh.occluded(packet, blocked);
+            for (int lane = 0; lane < 4; lane++)
+            {
+                if (!packet.active[lane])
+                    continue;
+                rays++;
+                if (!blocked[lane])
+                    diffuse += contribution[lane];
+            }
+        }
+        return diffuse;
+    }
+
+    // cosine weighted direction around n
+    static glm::vec3 sampleHemisphere(const glm::vec3& n, float r1, float r2)
+    {
+        glm::vec3 tangent = fabs(n.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+        tangent = glm::normalize(glm::cross(tangent, n));
+        glm::vec3 bitangent = glm::cross(n, tangent);
+        float phi = 6.2831853f * r1;
+        float r = sqrt(r2);
+        return glm::normalize(tangent * (r * cos(phi)) + bitangent * (r * sin(phi)) + n * sqrt(std::max(0.0f, 1.0f - r2)));
+    }
+
+    glm::vec3 bakeTexel(unsigned int triangle, float u, float v, mt19937& random, unsigned long long& rays) const
+    {
+        const CapturedVertex* vertex = &triangles[triangle * 3];
+        glm::vec3 p = interpolate(vertex[0].position, vertex[1].position, vertex[2].position, u, v);
+        glm::vec3 n = glm::normalize(interpolate(vertex[0].normal, vertex[1].normal, vertex[2].normal, u, v));
+        glm::vec3 K_A = interpolate(vertex[0].ambient, vertex[1].ambient, vertex[2].ambient, u, v);
+        glm::vec3 K_D = interpolate(vertex[0].diffuse, vertex[1].diffuse, vertex[2].diffuse, u, v);
+        glm::vec3 offsetNormal = geometricNormal(triangle);
+        if (glm::dot(offsetNormal, n) < 0.0f)
+            offsetNormal = -offsetNormal;
+
+        glm::vec3 ambient(0.0f);
+        glm::vec3 direct = directLight(p, n, offsetNormal, &ambient, rays);
+
+        // one bounce: diffuse light leaving the surfaces the cosine weighted rays hit
+        glm::vec3 indirect(0.0f);
+        uniform_real_distribution<float> uniform(0.0f, 1.0f);
+        int packets = (indirectSamples + 3) / 4;
+        for (int i = 0; i < packets; i++)
+        {
+            RayPacket packet;
+            for (int lane = 0; lane < 4; lane++)
+            {
+                Ray ray;
+                ray.origin = p + offsetNormal * 0.01f;
+                ray.direction = sampleHemisphere(n, uniform(random), uniform(random));
+                packet.set(lane, ray);
+            }
+            RayHit hits[4];
+            bvh.intersect(packet, hits);
+            rays += 4;
+            for (int lane = 0; lane < 4; lane++)
+            {
+                if (hits[lane].triangle < 0)
+                    continue;
+                const CapturedVertex* hitVertex = &triangles[hits[lane].triangle * 3];
+                float hu = hits[lane].u, hv = hits[lane].v;
+                glm::vec3 q = interpolate(hitVertex[0].position, hitVertex[1].position, hitVertex[2].position, hu, hv);
+                glm::vec3 nq = glm::normalize(interpolate(hitVertex[0].normal, hitVertex[1].normal, hitVertex[2].normal, hu, hv));
+                glm::vec3 dir = packet.get(lane).direction;
+                // the architecture is drawn double sided, light the side the ray arrived at
+                if (glm::dot(nq, dir) > 0.0f)
+                    nq = -nq;
+                glm::vec3 offsetHit = geometricNormal(hits[lane].triangle);
+                if (glm::dot(offsetHit, dir) > 0.0f)
+                    offsetHit = -offsetHit;
+                glm::vec3 albedo = interpolate(hitVertex[0].diffuse, hitVertex[1].diffuse, hitVertex[2].diffuse, hu, hv);
+                indirect += albedo * directLight(q, nq, offsetHit, nullptr, rays);
+            }
+        }
+        indirect /= (float)(packets * 4);
+
+        return glm::clamp(K_A * ambient + K_D * (direct + indirect), glm::vec3(0.0f), glm::vec3(1.0f));
+    }
+
+    // rows are handed out through an atomic counter, each row has its own seed so the result
+    // does not depend on the thread count
+    void bake()
+    {
+        texels.assign((size_t)resolution * resolution * 3, 0);
+        atomic<int> nextRow(0);
+        atomic<unsigned long long> totalRays(0);
+        auto worker = [&]()
+        {
+            unsigned long long rays = 0;
+            for (int y = nextRow++; y < resolution; y = nextRow++)
+            {
+                mt19937 random(y * 7919u + 1u);
+                for (int x = 0; x < resolution; x++)
+                {
+                    int triangle = texelTriangle[(size_t)y * resolution + x];
+                    if (triangle < 0)
+                        continue;
+                    float u, v;
+                    texelBarycentrics(charts[triangle], x, y, u, v);
+                    glm::vec3 color = bakeTexel((unsigned int)triangle, u, v, random, rays);
+                    unsigned char* texel = &texels[((size_t)y * resolution + x) * 3];
+                    texel[0] = (unsigned char)(color.x * 255.0f + 0.5f);
+                    texel[1] = (unsigned char)(color.y * 255.0f + 0.5f);
+                    texel[2] = (unsigned char)(color.z * 255.0f + 0.5f);
+                }
+            }
+            totalRays += rays;
+        };
+        vector<thread> workers;
+        for (int i = 1; i < threadCount; i++)
+            workers.emplace_back(worker);
+        worker();
+        for (thread& t : workers)
+            t.join();
+        raysTraced = totalRays;
+    }
+
+    // FNV-1a over the captured geometry, the lights and the settings
+    string cacheKey() const
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](const void* data, size_t size)
+        {
+            const unsigned char* bytes = (const unsigned char*)data;
+            for (size_t i = 0; i < size; i++)
+            {
+                hash ^= bytes[i];
+                hash *= 1099511628211ull;
+            }
+        };
+        if (!triangles.empty())
+            mix(triangles.data(), triangles.size() * sizeof(CapturedVertex));
+        for (const BakeLight& light : lights)
+            mix(&light, sizeof(BakeLight));
+        int settings[3] = { resolution, indirectSamples, (int)(usedTexelsPerUnit * 1000.0f) };
+        mix(settings, sizeof(settings));
+
+        stringstream key;
+        key << hex << hash;
+        return key.str();
+    }
+
+    static string cachePath(const string& key)
+    {
+        return string(LIGHTMAP_CACHE_DIR) + "/" + key + ".bin";
+    }
+
+    bool load(const string& key)
+    {
+        ifstream file(cachePath(key), ios::binary);
+        if (!file)
+            return false;
+        uint32_t header[3] = {};
+        file.read((char*)header, sizeof(header));
+        if (!file || header[0] != LIGHTMAP_MAGIC || (int)header[1] != resolution || (int)header[2] != resolution)
+            return false;
+        texels.resize((size_t)resolution * resolution * 3);
+        file.read((char*)texels.data(), texels.size());
+        return (bool)file;
+    }
+
+    void save(const string& key)
+    {
+        error_code error;
+        filesystem::create_directories(LIGHTMAP_CACHE_DIR, error);
+        ofstream file(cachePath(key), ios::binary);
+        if (!file)
+        {
+            std::cout << "ERROR::LIGHTMAP::CACHE_NOT_WRITTEN: " << cachePath(key) << std::endl;
+            return;
+        }
+        uint32_t header[3] = { LIGHTMAP_MAGIC, (uint32_t)resolution, (uint32_t)resolution };
+        file.write((const char*)header, sizeof(header));
+        file.write((const char*)texels.data(), texels.size());
+    }
+
+    void uploadTexture()
+    {
+        if (texture == 0)
+            glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, resolution, resolution, 0, GL_RGB, GL_UNSIGNED_BYTE, texels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        // no mipmaps, the charts are only padded by one texel
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // merged world space positions with their lightmap coordinates
+    void uploadGeometry()
+    {
+        vector<float> vertices;
+        vertices.reserve(positions.size() * 5);
+        for (size_t i = 0; i < positions.size(); i++)
+        {
+            vertices.push_back(positions[i].x);
+            vertices.push_back(positions[i].y);
+            vertices.push_back(positions[i].z);
+            vertices.push_back(lightmapUVs[i].x);
+            vertices.push_back(lightmapUVs[i].y);
+        }
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        glBindVertexArray(0);
+    }
+};
+
+#endif /* lightmap_h */
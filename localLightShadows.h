@@ -0,0 +1,212 @@
+//
+//  localLightShadows.h
+//  shadow maps of the local lights: a depth cube map per point light, filled in one
+//  layered pass, and a single depth map for the spot light
+//
+
+#ifndef localLightShadows_h
+#define localLightShadows_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <iostream>
+#include "shader.h"
+#include "frameArena.h"
+
+using namespace std;
+
+// texture units, after the cascaded shadow maps. point light i uses POINT_SHADOW_UNIT + i
+const int POINT_SHADOW_UNIT = 7;
+const int MAX_POINT_SHADOWS = 4;
+const int SPOT_SHADOW_UNIT = 11;
+
+class PointShadowMap {
+public:
+    int resolution;
+    float farPlane = 1.0f;
+    bool valid = false;     // rendered at least once
+
+    // constructor
+    PointShadowMap(int resolution = 512)
+    {
+        this->resolution = resolution;
+
+        glGenTextures(1, &cubeMap);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
+        for (unsigned int face = 0; face < 6; face++)
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, resolution, resolution, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+        // the whole cube is attached, the geometry shader selects the face with gl_Layer
+        glGenFramebuffers(1, &depthFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cubeMap, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: point shadow map is not complete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // destructor
+    ~PointShadowMap()
+    {
+        glDeleteFramebuffers(1, &depthFBO);
+        glDeleteTextures(1, &cubeMap);
+    }
+
+    // all six faces in a single draw of the casters
+    void render(const glm::vec3& lightPos, float farPlane, Shader& cubeDepthShader, const function<void(Shader&)>& drawCasters)
+    {
+        this->farPlane = farPlane;
+        glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, farPlane);
+        // cube map face order with the up vectors the cube map convention expects
+        glm::vec3 directions[6] = { glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+            glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f) };
+        glm::vec3 ups[6] = { glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+            glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f) };
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+        glViewport(0, 0, resolution, resolution);
+        glClear(GL_DEPTH_BUFFER_BIT);
+
+        cubeDepthShader.use();
+        for (int face = 0; face < 6; face++)
+            cubeDepthShader.setMat4(frameFormat("shadowMatrices[%d]", face), projection * glm::lookAt(lightPos, lightPos + directions[face], ups[face]));
+        cubeDepthShader.setVec3("lightPos", lightPos);
+        cubeDepthShader.setFloat("farPlane", farPlane);
+        drawCasters(cubeDepthShader);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        valid = true;
+    }
+
+    // pointShadowOn[index], pointShadowFar[index] and pointShadowMap<index>
+    void bind(Shader& shader, int index)
+    {
+        if (index >= MAX_POINT_SHADOWS)
+            return;
+        shader.setInt(frameFormat("pointShadowMap%d", index), POINT_SHADOW_UNIT + index);
+        shader.setBool(frameFormat("pointShadowOn[%d]", index), valid);
+        shader.setFloat(frameFormat("pointShadowFar[%d]", index), farPlane);
+        glActiveTexture(GL_TEXTURE0 + POINT_SHADOW_UNIT + index);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // the sampler unit is set even without shadows, two sampler types may not share unit 0
+    static void bindNone(Shader& shader, int index)
+    {
+        if (index >= MAX_POINT_SHADOWS)
+            return;
+        shader.setInt(frameFormat("pointShadowMap%d", index), POINT_SHADOW_UNIT + index);
+        shader.setBool(frameFormat("pointShadowOn[%d]", index), false);
+    }
+
+private:
+    unsigned int cubeMap = 0;
+    unsigned int depthFBO = 0;
+};
+
+class SpotShadowMap {
+public:
+    int resolution;
+    glm::mat4 lightMatrix = glm::mat4(1.0f);
+    bool valid = false;     // rendered at least once
+
+    // constructor
+    SpotShadowMap(int resolution = 1024)
+    {
+        this->resolution = resolution;
+
+        glGenTextures(1, &depthMap);
+        glBindTexture(GL_TEXTURE_2D, depthMap);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, resolution, resolution, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &depthFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: spot shadow map is not complete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // destructor
+    ~SpotShadowMap()
+    {
+        glDeleteFramebuffers(1, &depthFBO);
+        glDeleteTextures(1, &depthMap);
+    }
+
+    // angle is the cut off angle of the cone in degrees, the frustum is slightly wider than the cone
+    void render(const glm::vec3& position, const glm::vec3& direction, float angle, float farPlane, Shader& depthShader, const function<void(Shader&)>& drawCasters)
+    {
+        glm::vec3 dir = glm::normalize(direction);
+        glm::vec3 up = fabs(dir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        float fov = std::min(2.0f * angle + 10.0f, 170.0f);
+        lightMatrix = glm::perspective(glm::radians(fov), 1.0f, 0.1f, farPlane) * glm::lookAt(position, position + dir, up);
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+        glViewport(0, 0, resolution, resolution);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+
+        depthShader.use();
+        depthShader.setMat4("lightSpaceMatrix", lightMatrix);
+        drawCasters(depthShader);
+
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        valid = true;
+    }
+
+    void bind(Shader& shader)
+    {
+        shader.setInt("spotShadowMap", SPOT_SHADOW_UNIT);
+        shader.setBool("spotShadowOn", valid);
+        shader.setMat4("spotShadowMatrix", lightMatrix);
+        glActiveTexture(GL_TEXTURE0 + SPOT_SHADOW_UNIT);
+        glBindTexture(GL_TEXTURE_2D, depthMap);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    static void bindNone(Shader& shader)
+    {
+        shader.setInt("spotShadowMap", SPOT_SHADOW_UNIT);
+        shader.setBool("spotShadowOn", false);
+    }
+
+private:
+    unsigned int depthMap = 0;
+    unsigned int depthFBO = 0;
+};
+
+#endif /* localLightShadows_h */
@@ -0,0 +1,152 @@
+//
+//  lz4Block.h
+//  compressor and decompressor for the LZ4 block format: greedy matching through a
+//  hash of the next 4 bytes, fast enough to pack the assets and cheap to decode at
+//  startup. the output can be read by any LZ4 block decoder
+//
+
+#ifndef lz4Block_h
+#define lz4Block_h
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+
+using namespace std;
+
+class Lz4Block {
+public:
+    static vector<unsigned char> compress(const unsigned char* source, size_t size)
+    {
+        vector<unsigned char> out;
+        out.reserve(size + size / 255 + 16);
+        size_t anchor = 0;
+        if (size > MATCH_START_LIMIT)
+        {
+            vector<uint32_t> table(HASH_SIZE, 0);      // position + 1 of the last 4 bytes with each hash, 0 for none
+            size_t matchEndLimit = size - LAST_LITERALS;
+            size_t i = 0;
+            while (i + MATCH_START_LIMIT <= size)
+            {
+                uint32_t sequence = read32(source + i);
+                uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+                size_t candidate = table[hash];
+                table[hash] = (uint32_t)i + 1;
+                if (candidate == 0 || i - (candidate - 1) > MAX_OFFSET || read32(source + candidate - 1) != sequence)
+                {
+                    i++;
+                    continue;
+                }
+                candidate--;
+                size_t matchLength = MIN_MATCH;
+                while (i + matchLength < matchEndLimit && source[candidate + matchLength] == source[i + matchLength])
+                    matchLength++;
+                writeSequence(out, source + anchor, i - anchor, i - candidate, matchLength);
+                i += matchLength;
+                anchor = i;
+            }
+        }
+        // the block ends with literals only
+        size_t literals = size - anchor;
+        out.push_back((unsigned char)(std::min<size_t>(literals, 15) << 4));
+        writeLength(out, literals);
+        out.insert(out.end(), source + anchor, source + size);
+        return out;
+    }
+
+    // false for malformed input or when the block does not decode to exactly size bytes
+    static bool decompress(const unsigned char* source, size_t sourceSize, unsigned char* destination, size_t size)
+    {
+        size_t in = 0, out = 0;
+        while (in < sourceSize)
+        {
+            unsigned char token = source[in++];
+            size_t literals = token >> 4;
+            if (literals == 15 && !readLength(source, sourceSize, in, literals))
+                return false;
+            if (literals > sourceSize - in || literals > size - out)
+                return false;
+            memcpy(destination + out, source + in, literals);
+            in += literals;
+            out += literals;
+            if (in == sourceSize)
+                break;
+
+            if (sourceSize - in < 2)
+                return false;
+            size_t offset = source[in] | (source[in + 1] << 8);
+            in += 2;
+            if (offset == 0 || offset > out)
+                return false;
+            size_t matchLength = token & 15;
+            if (matchLength == 15 && !readLength(source, sourceSize, in, matchLength))
+                return false;
+            matchLength += MIN_MATCH;
+            if (matchLength > size - out)
+                return false;
+            // byte by byte, the match may overlap what it writes
+            const unsigned char* match = destination + out - offset;
+            for (size_t k = 0; k < matchLength; k++)
+                destination[out + k] = match[k];
+            out += matchLength;
+        }
+        return out == size;
+    }
+
+private:
+    static const size_t MIN_MATCH = 4;
+    static const size_t LAST_LITERALS = 5;         // the last 5 bytes are always literals
+    static const size_t MATCH_START_LIMIT = 12;    // and no match starts in the last 12
+    static const size_t MAX_OFFSET = 65535;
+    static const int HASH_BITS = 16;
+    static const size_t HASH_SIZE = 1 << HASH_BITS;
+
+    static uint32_t read32(const unsigned char* p)
+    {
+        uint32_t value;
+        memcpy(&value, p, 4);
+        return value;
+    }
+
+    // lengths of 15 and more continue in bytes of 255 and a final byte below 255
+    static void writeLength(vector<unsigned char>& out, size_t length)
+    {
+        if (length < 15)
+            return;
+        length -= 15;
+        while (length >= 255)
+        {
+            out.push_back(255);
+            length -= 255;
+        }
+        out.push_back((unsigned char)length);
+    }
+
+    static bool readLength(const unsigned char* source, size_t sourceSize, size_t& in, size_t& length)
+    {
+        unsigned char byte;
+        do
+        {
+            if (in >= sourceSize)
+                return false;
+            byte = source[in++];
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+    static void writeSequence(vector<unsigned char>& out, const unsigned char* literals, size_t literalCount, size_t offset, size_t matchLength)
+    {
+        size_t matchCode = matchLength - MIN_MATCH;
+        out.push_back((unsigned char)((std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchCode, 15)));
+        writeLength(out, literalCount);
+        out.insert(out.end(), literals, literals + literalCount);
+        out.push_back((unsigned char)(offset & 0xFF));
+        out.push_back((unsigned char)(offset >> 8));
+        writeLength(out, matchCode);
+    }
+};
+
+#endif /* lz4Block_h */
@@ -22,16 +22,57 @@
 #include "curve.h"
 #include "sphere.h"
 #include "octagon.h"
+#include "clusteredLighting.h"
+#include "deferredShading.h"
+#include "cameraRoute.h"
+#include "shaderPermutations.h"
+#include "shaderCompiler.h"
+#include "shadowCache.h"
+#include "lightmap.h"
+#include "pathTracer.h"
+#include "softwareDevice.h"
+#include "sceneFile.h"
+#include "sceneExporter.h"
+#include "assetPack.h"
+#include "initGraph.h"
+#include "jobSystem.h"
+#include "inputQueue.h"
+#include "frameRingBuffer.h"
+#include "frameArena.h"
 
 #include <iostream>
+#include <thread>
+#include <new>
+#include <cstdlib>
 
 using namespace std;
 
+// every heap allocation of the process is counted, the frame arena reports how many a frame made
+void* operator new(size_t size)
+{
+    FrameArena::heapAllocations().fetch_add(1, memory_order_relaxed);
+    void* memory = malloc(size > 0 ? size : 1);
+    if (memory == nullptr)
+        throw bad_alloc();
+    return memory;
+}
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+void operator delete(void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
+void pollInput(GLFWwindow* window);
+void cameraInput();
+void handleKey(int key);
 void drawCube(unsigned int& cubeVAO, Shader& lightingShader, glm::mat4 model, float r, float g, float b);
 //void bed(unsigned int& cubeVAO, Shader& lightingShader, glm::mat4 alTogether);
 void drawField(unsigned int& cubeVAO, Shader& lightingShader, glm::mat4 alTogether);
@@ -53,7 +94,25 @@ void drawNormalTree(BezierCurve& NormalTree, BezierCurve& CylinderGrey, Shader&
 void drawTrees(BezierCurve& NormalTree, BezierCurve& CylinderGreen, BezierCurve& CylinderGrey, Shader& lightingShader, glm::mat4 alTogether);
 void drawMinar(unsigned int& cubeVAO, BezierCurve& cylinder, BezierCurve& semiDome, Octagon& base, Octagon& oct, Shader& lightingShader, glm::mat4 alTogether);
 void drawNarrowMinar(unsigned int& cubeVAO, BezierCurve& cylinder, BezierCurve& semiDome, Octagon& base, Octagon& oct, Shader& lightingShader, glm::mat4 alTogether);
-void drawNarrowMinarTogether(unsigned int& cubeVAO, BezierCurve& minar, BezierCurve& semiDome, Octagon& oct3, Octagon& oct2, Shader& lightingShader, glm::mat4 next); unsigned int loadTexture(char const* path, GLenum textureWrappingModeS, GLenum textureWrappingModeT, GLenum textureFilteringModeMin, GLenum textureFilteringModeMax);
+void drawNarrowMinarTogether(unsigned int& cubeVAO, BezierCurve& minar, BezierCurve& semiDome, Octagon& oct3, Octagon& oct2, Shader& lightingShader, glm::mat4 next);
+void buildGardenLamps(int count);
+void updateClusterBenchmark(ClusteredLighting& clusteredLighting);
+void updateRouteBenchmark();
+unsigned int currentLightFeatures();
+void setUpPointLights(Shader& lightingShader);
+// an image decoded on any thread, turned into textures on the context thread
+struct DecodedImage {
+    unsigned char* data = nullptr;
+    int width = 0, height = 0, components = 0;
+};
+DecodedImage decodeImage(char const* path);
+unsigned int createTexture(const DecodedImage& image, GLenum textureWrappingModeS, GLenum textureWrappingModeT, GLenum textureFilteringModeMin, GLenum textureFilteringModeMax);
+unsigned int loadTexture(char const* path, GLenum textureWrappingModeS, GLenum textureWrappingModeT, GLenum textureFilteringModeMin, GLenum textureFilteringModeMax);
+void benchmarkAssetLoading(const string& packPath);
+void benchmarkJobSystem();
+void benchmarkMeshMemory(BezierCurve* curves[], int curveCount, const Sphere& sphere);
+void benchmarkVertexFormats(BezierCurve* curves[], int curveCount, const Sphere& sphere);
+void benchmarkProfiles(BezierCurve* curves[], const char* names[], int curveCount);
 
 
 
@@ -61,6 +120,9 @@ void drawNarrowMinarTogether(unsigned int& cubeVAO, BezierCurve& minar, BezierCu
 // settings
 const unsigned int SCR_WIDTH = 1200;
 const unsigned int SCR_HEIGHT = 1000;
+// the window's size in pixels, larger than SCR_WIDTH x SCR_HEIGHT on HiDPI displays; follows resize events
+int framebufferWidth = SCR_WIDTH;
+int framebufferHeight = SCR_HEIGHT;
 
 
 
@@ -70,12 +132,26 @@ float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
+// the window is polled on the main thread and the frame is drawn on the render thread. input moves
+// inputCamera and hands copies to the render thread's camera, keys and resizes are queued in order
+Camera inputCamera = camera;
+SnapshotBuffer<Camera> cameraSnapshots;
+SpscQueue<InputEvent, 256> inputEvents;
+double cameraInputTime = 0.0;                   // oldest camera input not published yet, main thread only
+atomic<double> publishedCameraInput{ 0.0 };     // oldest published camera input no frame has shown yet
+InputLatency inputLatency;
+const double INPUT_POLL_SECONDS = 0.002;        // held movement keys send no events, so waiting for input times out
+
 float eyeX = 0.0, eyeY = 1.0, eyeZ = 3.0;
 float lookAtX = 0.0, lookAtY = 0.0, lookAtZ = 0.0;
 glm::vec3 V = glm::vec3(0.0f, 1.0f, 0.0f);
 //BasicCamera basic_camera(eyeX, eyeY, eyeZ, lookAtX, lookAtY, lookAtZ, V);
 
 
+// the unit cube most of the building is drawn from; cubePositionTransform maps the cube's packed
+// 16-bit positions back to its own model space (see VertexData)
+glm::mat4 cubePositionTransform = glm::mat4(1.0f);
+
 // positions of the point lights
 glm::vec3 pointLightPositions[] = {
     glm::vec3(2.50f,  20.50f,  -28.0f),
@@ -172,6 +248,103 @@ bool moonLightOn = true;
 bool ambientToggle = true;
 bool diffuseToggle = true;
 bool specularToggle = true;
+bool clusteredShadingOn = false;
+
+// garden lamps, only lit by the clustered path
+vector<PointLight> gardenLamps;
+const int DEFAULT_CLUSTERED_LIGHTS = 256;
+
+// per frame data streams through one buffer, each of its 3 partitions starts at this size and grows when a frame needs more
+const size_t FRAME_RING_PARTITION_SIZE = 1 << 20;
+// transient CPU data of a frame, grows when a frame needs more
+const size_t FRAME_ARENA_SIZE = 256 << 10;
+
+// clustered lighting benchmark: forward path with 4 lights, then the clustered path from 4 to 1024 lights
+const int clusterBenchmarkCounts[] = { 4, 4, 8, 16, 32, 64, 128, 256, 512, 1024 };
+const int CLUSTER_BENCHMARK_STAGES = 10;
+const int BENCHMARK_WARMUP_FRAMES = 10;
+const int BENCHMARK_FRAMES = 60;
+int clusterBenchmarkStage = -1;
+
+// render path comparison: forward, then deferred, each flown along the same camera route
+bool deferredShadingOn = false;
+CameraRoute cameraRoute;
+const int ROUTE_FRAMES = 600;
+int routeBenchmarkStage = -1;
+int routeBenchmarkFrame = 0;
+
+// cascaded shadows of the day and moon light
+bool directionShadowsOn = true;
+bool shadowPCFOn = true;
+bool printShadowStats = false;
+
+// cube map shadows of the four lamps and the entrance spot light, re-rendered on change within a per frame budget
+bool localShadowsOn = true;
+const int SHADOW_UPDATES_PER_FRAME = 1;
+
+// static scene drawn from a baked lightmap, baked (or loaded from the cache) for the current lights when switched on
+bool lightmapOn = false;
+bool lightmapRequested = false;
+
+// the red sphere's live parameters: [ and ] halve and double its sectors and stacks, - and = shrink and grow it.
+// a new resolution is tessellated off the render thread and swapped in when ready, a new radius is only a scale
+int sphereSectors = 48;
+int sphereStacks = 18;
+float sphereRadius = 0.5f;
+const int SPHERE_SECTORS_MAX = 768;
+const int SPHERE_STACKS_MAX = 288;
+const float SPHERE_RADIUS_MIN = 0.1f;
+const float SPHERE_RADIUS_MAX = 2.0f;
+const float SPHERE_RADIUS_STEP = 1.25f;
+
+// reference image of the current view from the path tracer, accumulated in batches with a checkpoint after each
+bool referenceRequested = false;
+const int REFERENCE_SAMPLES = 64;
+const int REFERENCE_BATCH = 4;
+
+// --scene [file] draws the static scene from a binary scene file instead of the draw functions below,
+// --export-scene [file] records those draw functions into one (on the software device, no window needed)
+const char* SCENE_FILE_DEFAULT = "tajmahal.scene";
+
+// --pack-assets [file] bundles the shaders and images into one archive, --assets [file] reads them from it,
+// --asset-benchmark [file] times loading everything from the loose files and from the archive
+const char* ASSET_PACK_DEFAULT = "assets.pack";
+
+// --job-benchmark times the job system's per job overhead and its scaling on frame-like work from 1 thread to every core
+const int JOB_BENCHMARK_JOBS = 100000;
+const int JOB_BENCHMARK_INSTANCES = 100000;
+const int JOB_BENCHMARK_REPEATS = 20;
+
+// --mesh-memory-benchmark compares the CPU memory the generated meshes keep now that their staging is
+// released after upload with the copies they kept before, at higher tessellation and with the scene repeated
+const int MESH_MEMORY_DETAILS[] = { 1, 2, 4, 8 };
+const int MESH_MEMORY_SCENE_SCALES[] = { 1, 10, 100 };
+
+// --float-vertices builds every mesh with 32-bit float attributes instead of the packed VertexFormat,
+// --vertex-format-benchmark compares the two on the scene's meshes: size, conversion time and precision
+const int VERTEX_FORMAT_BENCHMARK_DETAIL = 4;
+
+// --vertex-pulling keeps only the profiles of the surfaces of revolution on the GPU, 6 and 7 halve and
+// double their angular resolution within these bounds (even, so the half surfaces stay whole slices)
+const int PULLED_SLICES_MIN = 10;
+const int PULLED_SLICES_MAX = 320;
+
+// --profile-tolerance [units] sets how far the sampled profiles of the surfaces of revolution may stray from
+// their curves, 0 samples them uniformly like before
+
+// --profile-benchmark times evaluating the profiles from the global Bezier of all their control points and from
+// the cubic segments fitted to it, at this many parameters each
+const int PROFILE_BENCHMARK_SAMPLES = 200000;
+
+// --tessellation draws the surfaces of revolution as Bezier patches in the forward pass, split into edges of
+// about this many pixels on the screen. 8 and 9 halve and double it within the bounds
+const float PATCH_PIXELS_PER_EDGE_MIN = 1.0f;
+const float PATCH_PIXELS_PER_EDGE_MAX = 64.0f;
+
+// --software [frames] renders the camera route on the CPU into software_frames/ and benchmarks it, no window or GPU needed
+const int SOFTWARE_DEFAULT_FRAMES = 60;
+const int SOFTWARE_BENCHMARK_FRAMES = 30;
+const char* SOFTWARE_FRAMES_DIR = "software_frames";
 
 
 // timing
@@ -179,55 +352,125 @@ float deltaTime = 0.0f;    // time between current frame and last frame
 float lastFrame = 0.0f;
 
 
-int main()
+int main(int argc, char** argv)
 {
+    int softwareFrames = -1;
+    bool renderOnMain = false;      // input and rendering on one thread as before, to compare the latency
+    bool meshMemoryBenchmark = false;
+    bool vertexFormatBenchmark = false;
+    bool tessellationRequested = false;
+    bool profileBenchmark = false;
+    string scenePath, exportScenePath, assetPackPath;
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc && argv[i + 1][0] != '-';
+        if (string(argv[i]) == "--software")
+            softwareFrames = (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) ? atoi(argv[++i]) : SOFTWARE_DEFAULT_FRAMES;
+        else if (string(argv[i]) == "--scene")
+            scenePath = hasValue ? argv[++i] : SCENE_FILE_DEFAULT;
+        else if (string(argv[i]) == "--export-scene")
+            exportScenePath = hasValue ? argv[++i] : SCENE_FILE_DEFAULT;
+        else if (string(argv[i]) == "--assets")
+            assetPackPath = hasValue ? argv[++i] : ASSET_PACK_DEFAULT;
+        else if (string(argv[i]) == "--pack-assets")
+            return AssetPack::write(hasValue ? argv[++i] : ASSET_PACK_DEFAULT, AssetPack::runtimeAssets()) ? 0 : -1;
+        else if (string(argv[i]) == "--asset-benchmark")
+        {
+            benchmarkAssetLoading(hasValue ? argv[++i] : ASSET_PACK_DEFAULT);
+            return 0;
+        }
+        else if (string(argv[i]) == "--render-on-main")
+            renderOnMain = true;
+        else if (string(argv[i]) == "--job-benchmark")
+        {
+            benchmarkJobSystem();
+            return 0;
+        }
+        else if (string(argv[i]) == "--mesh-memory-benchmark")
+            meshMemoryBenchmark = true;
+        else if (string(argv[i]) == "--float-vertices")
+            VertexData::defaultFormat() = VERTEX_FLOAT;
+        else if (string(argv[i]) == "--vertex-format-benchmark")
+            vertexFormatBenchmark = true;
+        else if (string(argv[i]) == "--vertex-pulling")
+            BezierCurve::vertexPulling() = true;
+        else if (string(argv[i]) == "--tessellation")
+            tessellationRequested = true;
+        else if (string(argv[i]) == "--profile-tolerance" && i + 1 < argc)
+            BezierCurve::profileTolerance() = (float)atof(argv[++i]);
+        else if (string(argv[i]) == "--profile-benchmark")
+            profileBenchmark = true;
+    }
 
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
+    // everything below reads its shaders and images through the pack while it is current
+    AssetPack assetPack;
+    if (!assetPackPath.empty() && assetPack.open(assetPackPath))
+        AssetPack::current() = &assetPack;
 
-    // glfw window creation
-    // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "CSE 4208: Computer Graphics Laboratory", NULL, NULL);
-    if (window == NULL)
+    GLFWwindow* window = NULL;
+    unique_ptr<SoftwareDevice> softwareDevice;
+    if (softwareFrames >= 0 || !exportScenePath.empty() || meshMemoryBenchmark || vertexFormatBenchmark || profileBenchmark)
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+        // the software device stands in for the context, every gl call below goes to the CPU rasterizer
+        softwareDevice.reset(new SoftwareDevice(SCR_WIDTH, SCR_HEIGHT));
+        softwareDevice->install();
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetKeyCallback(window, key_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-
-    // tell GLFW to capture our mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_HIDDEN);
-
-    // glad: load all OpenGL function pointers
-    // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    else
     {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+        // glfw: initialize and configure
+        // ------------------------------
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+        // glfw window creation
+        // --------------------
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "CSE 4208: Computer Graphics Laboratory", NULL, NULL);
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetKeyCallback(window, key_callback);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+
+        // tell GLFW to capture our mouse
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_HIDDEN);
+
+        // glad: load all OpenGL function pointers
+        // ---------------------------------------
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
     }
 
     // configure global opengl state
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
 
-    // build and compile our shader zprogram
-    // ------------------------------------
-    Shader lightingShader("vertexShaderForPhongShading.vs", "fragmentShaderForPhongShading.fs");
-    //Shader lightingShader("vertexShaderForGouraudShading.vs", "fragmentShaderForGouraudShading.fs");
-    Shader ourShader("vertexShader.vs", "fragmentShader.fs");
+    // the patches need tessellation stages, without them the surfaces stay meshes
+    int maxTessLevel = 0;
+#ifdef GL_ARB_tessellation_shader
+    if (tessellationRequested && GLAD_GL_ARB_tessellation_shader)
+    {
+        glGetIntegerv(GL_MAX_TESS_GEN_LEVEL, &maxTessLevel);
+        BezierCurve::tessellation() = true;
+    }
+#endif
+    if (tessellationRequested && !BezierCurve::tessellation())
+        cout << "tessellation shaders are not available, the surfaces of revolution are drawn as meshes" << endl;
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
     // ------------------------------------------------------------------
@@ -382,29 +625,29 @@ int main()
     glm::vec4 domeSpecular = glm::vec4(1.0, 1.0, 0.8, 1.0);
     float domeShiny = 32.0f;
 
-    BezierCurve dome = BezierCurve(domeVerties, 75, domeAmbient, domeDiffusive, domeSpecular, domeShiny,0);
-    BezierCurve semiDome = BezierCurve(semiDomeVerties, 54, domeAmbient, domeDiffusive, domeSpecular, domeShiny,0);
-    BezierCurve minar = BezierCurve(minarVertices, 60, domeAmbient, domeDiffusive, domeSpecular, domeShiny,0);
+    BezierCurve dome = BezierCurve(domeVerties, 75, domeAmbient, domeDiffusive, domeSpecular, domeShiny, 0, true);
+    BezierCurve semiDome = BezierCurve(semiDomeVerties, 54, domeAmbient, domeDiffusive, domeSpecular, domeShiny, 0, true);
+    BezierCurve minar = BezierCurve(minarVertices, 60, domeAmbient, domeDiffusive, domeSpecular, domeShiny, 0, true);
 
     glm::vec4 cylinderAmbient = glm::vec4(0.1, 0.9, 0.1, 1.0);
     glm::vec4 cylinderDiffusive = glm::vec4(0.1, 0.9, 0.1, 1.0);
     glm::vec4 cylinderSpecular = glm::vec4(0.0, 0.9, 0.0, 1.0);
     float cylinderShiny = 12.0f;
-    BezierCurve greencylinder = BezierCurve(solinoidVertices, 66, cylinderAmbient, cylinderDiffusive, cylinderSpecular, cylinderShiny,0);
+    BezierCurve greencylinder = BezierCurve(solinoidVertices, 66, cylinderAmbient, cylinderDiffusive, cylinderSpecular, cylinderShiny, 0, true);
 
     cylinderAmbient = glm::vec4(0.7, 0.3, 0.3, 1.0);
     cylinderDiffusive = glm::vec4(0.7, 0.3, 0.3, 1.0);
     cylinderSpecular = glm::vec4(0.7, 0.3, 0.3, 1.0);
-    BezierCurve greycylinder = BezierCurve(solinoidVertices, 66, cylinderAmbient, cylinderDiffusive, cylinderSpecular, cylinderShiny,0);
+    BezierCurve greycylinder = BezierCurve(solinoidVertices, 66, cylinderAmbient, cylinderDiffusive, cylinderSpecular, cylinderShiny, 0, true);
     
     glm::vec4 treeAmbient = glm::vec4(0.0, 0.9, 0.0, 1.0);
     glm::vec4 treeDiffusive = glm::vec4(0.0, 0.9, 0.0, 1.0);
     glm::vec4 treeSpecular = glm::vec4(0.0, 1.0, 0.0, 1.0);
     float treeShiny = 12.0f;
-    BezierCurve tree = BezierCurve(treeVertices, 138, treeAmbient, treeDiffusive, treeSpecular, treeShiny, 0);
+    BezierCurve tree = BezierCurve(treeVertices, 138, treeAmbient, treeDiffusive, treeSpecular, treeShiny, 0, true);
 
 
-    BezierCurve dome2 = BezierCurve(domeVerties, 75, domeAmbient, domeDiffusive, domeSpecular, domeShiny, 1);
+    BezierCurve dome2 = BezierCurve(domeVerties, 75, domeAmbient, domeDiffusive, domeSpecular, domeShiny, 1, true);
 
     glm::vec4 octAmbient = glm::vec4(0.5, 0.5, 0.5, 1.0);
     glm::vec4 octDiffusive = glm::vec4(0.5, 0.5, 0.5, 1.0);
@@ -472,6 +715,9 @@ int main()
         22, 23, 20
     };
 
+    VertexData cubeVertexData(cube_vertices, 24, 6, false);
+    cubePositionTransform = cubeVertexData.positionTransform;
+
     unsigned int cubeVAO, cubeVBO, cubeEBO;
     glGenVertexArrays(1, &cubeVAO);
     glGenBuffers(1, &cubeVBO);
@@ -480,7 +726,7 @@ int main()
     glBindVertexArray(cubeVAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, cubeVertexData.bytes.size(), cubeVertexData.bytes.data(), GL_STATIC_DRAW);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cube_indices), cube_indices, GL_STATIC_DRAW);
@@ -504,13 +750,8 @@ int main()
     */
 
 
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    // vertex normal attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)12);
-    glEnableVertexAttribArray(1);
+    // position and vertex normal attributes
+    cubeVertexData.setAttributes(true, false);
 
     // second, configure the light's VAO (VBO stays the same; the vertices are the same for the light object which is also a 3D cube)
     unsigned int lightCubeVAO;
@@ -520,39 +761,148 @@ int main()
     glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEBO);
     // note that we update the lamp's position attribute's stride to reflect the updated buffer data
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    cubeVertexData.setAttributes(false, false);
 
-    string diffuseMapPath = "rsz_11field_image.jpg";
-    string specularMapPath = "rsz_11field_image.jpg";
-
-
-    unsigned int diffMap = loadTexture(diffuseMapPath.c_str(), GL_REPEAT, GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
-    unsigned int specMap = loadTexture(specularMapPath.c_str(), GL_REPEAT, GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
-    Sphere sphere = Sphere(diffMap,specMap,0,0,2,1);
-
-    Cube texcube = Cube(diffMap, specMap, 32.0f, 0.0f, 0.0f, 1.0f, 1.0f);
+    // the meshes are built and the textures filled in by the startup graph below
+    Sphere sphere = Sphere(0, 0, 0, 0, 2, 1, sphereRadius, sphereSectors, sphereStacks, glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.5f, 0.5f, 0.5f), 32.0f, true);
+    Cube texcube = Cube(0, 0, 32.0f, 0.0f, 0.0f, 1.0f, 1.0f);
+    Cube cube = Cube(0, 0, 32.0f, 0.0f, 0.0f, 2.0f, 2.0f);
+    Cube texcube2 = Cube(0, 0, 32.0f, 0.0f, 0.0f, 1.0f, 1.0f);
 
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    Shader lightingShaderWithTexture("vertexShaderForPhongShadingWithTexture.vs", "fragmentShaderForPhongShadingWithTexture.fs");
     //Shader ourShader("vertexShader.vs", "fragmentShader.fs");
 
-    diffuseMapPath = "rsz_1texture-grass-field.jpg";
-    specularMapPath = "rsz_1texture-grass-field.jpg";
-
-
-    diffMap = loadTexture(diffuseMapPath.c_str(), GL_CLAMP, GL_CLAMP, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
-    specMap = loadTexture(specularMapPath.c_str(), GL_CLAMP, GL_CLAMP, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
-    Cube cube = Cube(diffMap, specMap, 32.0f, 0.0f, 0.0f, 2.0f, 2.0f);
-    
+    // startup graph: the surfaces are tessellated and the images decoded on the workers while this
+    // thread submits the shader programs, then each upload runs here as soon as its data is ready
+    InitGraph initGraph;
+    // the decodes take longest, so they are queued first. every image is decoded once and
+    // becomes both the diffuse and the specular map of its surfaces
+    DecodedImage fieldImage, grassImage, skyImage;
+    int fieldDecoded = initGraph.addTask("decode rsz_11field_image.jpg", [&fieldImage] { fieldImage = decodeImage("rsz_11field_image.jpg"); });
+    int grassDecoded = initGraph.addTask("decode rsz_1texture-grass-field.jpg", [&grassImage] { grassImage = decodeImage("rsz_1texture-grass-field.jpg"); });
+    int skyDecoded = initGraph.addTask("decode sky.jpg", [&skyImage] { skyImage = decodeImage("sky.jpg"); });
+    initGraph.addContextTask("upload field textures", [&]
+        {
+            unsigned int diffMap = createTexture(fieldImage, GL_REPEAT, GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+            unsigned int specMap = createTexture(fieldImage, GL_REPEAT, GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+            sphere.diffuseMap = diffMap;
+            sphere.specularMap = specMap;
+            texcube.setTextureProperty(diffMap, specMap, 32.0f);
+            stbi_image_free(fieldImage.data);
+        }, { fieldDecoded });
+    initGraph.addContextTask("upload grass textures", [&]
+        {
+            unsigned int diffMap = createTexture(grassImage, GL_CLAMP, GL_CLAMP, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+            unsigned int specMap = createTexture(grassImage, GL_CLAMP, GL_CLAMP, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+            cube.setTextureProperty(diffMap, specMap, 32.0f);
+            stbi_image_free(grassImage.data);
+        }, { grassDecoded });
+    initGraph.addContextTask("upload sky textures", [&]
+        {
+            unsigned int diffMap = createTexture(skyImage, GL_REPEAT, GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+            unsigned int specMap = createTexture(skyImage, GL_REPEAT, GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+            texcube2.setTextureProperty(diffMap, specMap, 32.0f);
+            stbi_image_free(skyImage.data);
+        }, { skyDecoded });
+
+    BezierCurve* curves[] = { &dome, &semiDome, &minar, &greencylinder, &greycylinder, &tree, &dome2 };
+    const char* curveNames[] = { "dome", "semiDome", "minar", "greencylinder", "greycylinder", "tree", "dome2" };
+    if (meshMemoryBenchmark)
+    {
+        benchmarkMeshMemory(curves, 7, sphere);
+        return 0;
+    }
+    if (vertexFormatBenchmark)
+    {
+        benchmarkVertexFormats(curves, 7, sphere);
+        return 0;
+    }
+    if (profileBenchmark)
+    {
+        benchmarkProfiles(curves, curveNames, 7);
+        return 0;
+    }
+    for (int i = 0; i < 7; i++)
+    {
+        BezierCurve* curve = curves[i];
+        const char* name = curveNames[i];
+        int generated = initGraph.addTask(string("tessellate ") + name, [curve, name] { curve->generate(name); });
+        initGraph.addContextTask(string("upload ") + curveNames[i], [curve] { curve->upload(); }, { generated });
+    }
+    int sphereGenerated = initGraph.addTask("tessellate sphere", [&sphere] { sphere.generate(); });
+    initGraph.addContextTask("upload sphere", [&sphere] { sphere.upload(); }, { sphereGenerated });
 
-    diffuseMapPath = "sky.jpg";
-    specularMapPath = "sky.jpg";
+    // stb_image's flip flag is global, so it is set once before the decoders start
+    stbi_set_flip_vertically_on_load(true);
+    initGraph.start((int)thread::hardware_concurrency() - 1);
+    double submitStart = initGraph.now();
 
+    // build and compile our shader zprogram
+    // ------------------------------------
+    // every program is submitted here while the workers tessellate and decode, and only checked
+    // on first use, so the driver compiles while the uploads of the startup graph run
+    ShaderCompiler shaderCompiler;
+    Shader::vertexLibraries().push_back({ "revolutionVertex", "revolutionVertex.glsl" });
+    Shader::fixedSamplerUnits().push_back({ "revolutionProfile", REVOLUTION_PROFILE_UNIT });
+    Shader::fixedSamplerUnits().push_back({ "profileSegments", PROFILE_SEGMENT_UNIT });
+    // forward Phong programs are built per light setup, so switched off lights are compiled out
+    ShaderPermutations phongPermutations("vertexShaderForPhongShading.vs", "fragmentShaderForPhongShading.fs", "vertexShaderForPhongShadingWithTexture.vs", "fragmentShaderForPhongShadingWithTexture.fs",
+        "vertexShaderForBezierPatch.vs", "tessControlShaderForBezierPatch.tcs", "tessEvaluationShaderForBezierPatch.tes");
+    shaderCompiler.track(phongPermutations.submit(currentLightFeatures()));
+    shaderCompiler.track(phongPermutations.submit(currentLightFeatures() | FEATURE_TEXTURED));
+    if (BezierCurve::tessellation())
+        shaderCompiler.track(phongPermutations.submit(currentLightFeatures() | FEATURE_TESSELLATED));
+    //Shader lightingShader("vertexShaderForGouraudShading.vs", "fragmentShaderForGouraudShading.fs");
+    Shader& ourShader = shaderCompiler.add("vertexShader.vs", "fragmentShader.fs");
+    Shader& clusteredShader = shaderCompiler.add("vertexShaderForPhongShading.vs", "fragmentShaderForClusteredShading.fs");
+    // per frame CPU work (cluster light lists, scene file culling) runs on the job system, GL calls stay on this thread
+    JobSystem jobSystem;
+    FrameRingBuffer frameRing(FRAME_RING_PARTITION_SIZE);
+    FrameArena frameArena(FRAME_ARENA_SIZE);
+    FrameArena::current() = &frameArena;
+    ClusteredLighting clusteredLighting(frameRing, framebufferWidth, framebufferHeight, 0.1f, 400.0f);
+    clusteredLighting.jobs = &jobSystem;
+    DeferredRenderer deferredRenderer(framebufferWidth, framebufferHeight, true);
+    shaderCompiler.track(deferredRenderer.geometryShader);
+    shaderCompiler.track(deferredRenderer.geometryShaderWithTexture);
+    shaderCompiler.track(deferredRenderer.lightingPassShader);
+    Shader& shadowDepthShader = shaderCompiler.add("vertexShaderForShadowDepth.vs", "fragmentShaderForShadowDepth.fs");
+    CascadedShadowMap dayShadows;
+    CascadedShadowMap moonShadows;
+    Shader& pointShadowShader = shaderCompiler.add("vertexShaderForPointShadow.vs", "fragmentShaderForPointShadow.fs", "geometryShaderForPointShadow.gs");
+    PointShadowMap lampShadows[4];
+    SpotShadowMap entranceShadow;
+    ShadowCache shadowCache(SHADOW_UPDATES_PER_FRAME);
+    shadowCache.add(pointlight1, lampShadows[0]);
+    shadowCache.add(pointlight2, lampShadows[1]);
+    shadowCache.add(pointlight3, lampShadows[2]);
+    shadowCache.add(pointlight4, lampShadows[3]);
+    shadowCache.add(spotlight, entranceShadow, 120.0f);
+    Lightmap lightmap;
+    PathTracer pathTracer(SCR_WIDTH, SCR_HEIGHT);
+    SceneFile sceneFile;
+    if (!scenePath.empty() && exportScenePath.empty() && sceneFile.load(scenePath))
+    {
+        sceneFile.applyLight(pointlight1);
+        sceneFile.applyLight(pointlight2);
+        sceneFile.applyLight(pointlight3);
+        sceneFile.applyLight(pointlight4);
+        sceneFile.applyLight(spotlight);
+        sceneFile.applyLight(daylight);
+        sceneFile.applyLight(moonlight);
+        sceneFile.printStats();
+    }
+    initGraph.recordContextWork("shader programs and render targets", submitStart);
 
-    diffMap = loadTexture(diffuseMapPath.c_str(), GL_REPEAT, GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
-    specMap = loadTexture(specularMapPath.c_str(), GL_REPEAT, GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
-    Cube texcube2 = Cube(diffMap, specMap, 32.0f, 0.0f, 0.0f, 1.0f, 1.0f);
+    initGraph.finish();
+    initGraph.printTimeline();
+    MeshOptimizer::printStats();
+    BezierCurve::printProfileStats();
+    size_t surfaceBytes = 0;
+    for (BezierCurve* curve : curves)
+        surfaceBytes += curve->gpuBytes();
+    cout << "surfaces of revolution: " << surfaceBytes << " bytes on the GPU"
+        << (BezierCurve::tessellation() ? " as tessellated patches and pulled profiles" : (BezierCurve::vertexPulling() ? " as vertex pulled profiles" : " as meshes")) << endl;
 
 
 
@@ -561,77 +911,30 @@ int main()
     //ourShader.use();
     //lightingShader.use();
 
-    // render loop
-    // -----------
-    while (!glfwWindowShouldClose(window))
-    {
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-        processInput(window);
-
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        lightingShader.use();
-        lightingShader.setVec3("viewPos", camera.Position);
-
-
-        pointlight1.setUpPointLight(lightingShader);
-        pointlight2.setUpPointLight(lightingShader);
-        pointlight3.setUpPointLight(lightingShader);
-        pointlight4.setUpPointLight(lightingShader);
-
-        spotlight.setUpSpotLight(lightingShader);
-
-        moonlight.setUpDirectionalLight(lightingShader);
-        daylight.setUpDirectionalLight(lightingShader);
-
-       
-
-
-        // pass projection matrix to shader (note that in this case it could change every frame)
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 400.0f);
-        //glm::mat4 projection = glm::ortho(-2.0f, +2.0f, -1.5f, +1.5f, 0.1f, 100.0f);
-        lightingShader.setMat4("projection", projection);
-        
-
-        // camera/view transformation
-        glm::mat4 view = camera.GetViewMatrix();
-        //glm::mat4 view = basic_camera.createViewMatrix();
-        lightingShader.setMat4("view", view);
-
-
-        
-
-
-
-        // Modelling Transformation
-        glm::mat4 identityMatrix = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
-        glm::mat4 translate, rotate, revtranslate, alTogether, next, model, scale;
-        //translateMatrix = glm::translate(identityMatrix, glm::vec3(10, 20, 10));
-        //rotateXMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_X), glm::vec3(1.0f, 0.0f, 0.0f));
-        //rotateYMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_Y), glm::vec3(0.0f, 1.0f, 0.0f));
-        //rotateZMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_Z), glm::vec3(0.0f, 0.0f, 1.0f));
-        //scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.1, 0.1, 0.1));
-        model =  identityMatrix;
-        lightingShader.setMat4("model", model);
-
+    // the red sphere stands next to the fractal tree
+    glm::mat4 sphereModel = glm::translate(glm::mat4(1.0f), glm::vec3(-15.0f + 1.5f, 1.2f, 18.0f + 0.5f));
 
+    // everything lit by the scene shaders except the textured walls, also drawn into the shadow maps
+    auto drawSceneGeometry = [&](Shader& sceneShader)
+    {
+        if (sceneFile.isLoaded())
+        {
+            sceneFile.draw(sceneShader);
+            return;
+        }
 
-        //scale = glm::scale(identityMatrix, glm::vec3(4.0, 4.0, 4.0));
-        //dome2.drawBezierCurve(lightingShader, scale);
+        glm::mat4 identityMatrix = glm::mat4(1.0f);
+        glm::mat4 translate, rotate, next, model, scale;
 
         model = identityMatrix;
-        drawLake(cubeVAO, lightingShader, model);
-        drawField(cubeVAO, lightingShader, model);
-        drawFloor(cubeVAO, lightingShader, model);
+        drawLake(cubeVAO, sceneShader, model);
+        drawField(cubeVAO, sceneShader, model);
+        drawFloor(cubeVAO, sceneShader, model);
 
         rotate = glm::rotate(identityMatrix, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         translate = glm::translate(identityMatrix, glm::vec3(0.0, 0.0, 133.0));
         model = translate * rotate;
-        drawField(cubeVAO, lightingShader, model);
+        drawField(cubeVAO, sceneShader, model);
 
          
 
@@ -639,77 +942,126 @@ int main()
         translate = glm::translate(identityMatrix, glm::vec3(0.0, 2.0, -8.0));
         scale = glm::scale(identityMatrix, glm::vec3(1.0, 1.3, 1.0));
         next = scale * translate;
-        drawTajmahal(cubeVAO, lightingShader, next);
+        drawTajmahal(cubeVAO, sceneShader, next);
         //central dome
         translate = glm::translate(identityMatrix, glm::vec3(-3.5f, 12.0f, -24.5f));
         scale = glm::scale(identityMatrix, glm::vec3(1.0, 1.0, 1.0));
         model = next * translate * scale;
-        drawDome(cubeVAO, dome, oct2, lightingShader, model);
+        drawDome(cubeVAO, dome, oct2, sceneShader, model);
         //SDFL
         translate = glm::translate(identityMatrix, glm::vec3(-10.0f, 12.0f, -16.0f));
         scale = glm::scale(identityMatrix, glm::vec3(1.5, 1.5, 1.5));
         model = next * translate * scale;
-        drawSemiDome(cubeVAO, semiDome, oct2, oct2, lightingShader, model);
+        drawSemiDome(cubeVAO, semiDome, oct2, oct2, sceneShader, model);
         //SDFR
         translate = glm::translate(identityMatrix, glm::vec3(5.0f, 12.0f, -16.0f));
         scale = glm::scale(identityMatrix, glm::vec3(1.5, 1.5, 1.5));
         model = next * translate * scale;
-        drawSemiDome(cubeVAO, semiDome, oct2, oct2, lightingShader, model);
+        drawSemiDome(cubeVAO, semiDome, oct2, oct2, sceneShader, model);
         //SDBL
         translate = glm::translate(identityMatrix, glm::vec3(-10.0f, 12.0f, -31.5f));
         scale = glm::scale(identityMatrix, glm::vec3(1.5, 1.5, 1.5));
         model = next * translate * scale;
-        drawSemiDome(cubeVAO, semiDome, oct2, oct2, lightingShader, model);
+        drawSemiDome(cubeVAO, semiDome, oct2, oct2, sceneShader, model);
         //SDBR
         translate = glm::translate(identityMatrix, glm::vec3(5.0f, 12.0f, -31.5f));
         scale = glm::scale(identityMatrix, glm::vec3(1.5, 1.5, 1.5));
         model = next * translate * scale;
-        drawSemiDome(cubeVAO, semiDome, oct2, oct2, lightingShader, model);
+        drawSemiDome(cubeVAO, semiDome, oct2, oct2, sceneShader, model);
 
 
         //Minar right
         translate = glm::translate(identityMatrix, glm::vec3(17.5, 0.0, -2.5));
         model = next * translate;
-        drawMinar(cubeVAO, minar, semiDome, oct3, oct2, lightingShader, model);
+        drawMinar(cubeVAO, minar, semiDome, oct3, oct2, sceneShader, model);
         //Minar left
         translate = glm::translate(identityMatrix, glm::vec3(-22.5, 0.0, -2.5));
         model = next * translate;
-        drawMinar(cubeVAO, minar, semiDome, oct3, oct2, lightingShader, model);
+        drawMinar(cubeVAO, minar, semiDome, oct3, oct2, sceneShader, model);
         //Minar right back
         translate = glm::translate(identityMatrix, glm::vec3(17.5, 0.0, -42.5));
         model = next * translate;
-        drawMinar(cubeVAO, minar, semiDome, oct3, oct2, lightingShader, model);
+        drawMinar(cubeVAO, minar, semiDome, oct3, oct2, sceneShader, model);
         //Minar left back
         translate = glm::translate(identityMatrix, glm::vec3(-22.5, 0.0, -42.5));
         model = next * translate;
-        drawMinar(cubeVAO, minar, semiDome, oct3, oct2, lightingShader, model);
+        drawMinar(cubeVAO, minar, semiDome, oct3, oct2, sceneShader, model);
 
-        drawNarrowMinarTogether(cubeVAO, minar, semiDome, oct3, oct2, lightingShader, next);
+        drawNarrowMinarTogether(cubeVAO, minar, semiDome, oct3, oct2, sceneShader, next);
         
 
 
         model = identityMatrix;
-        //drawCylindricalTree(greencylinder,greylinder,lightingShader,model);
-        //drawNormalTree(tree,greycylinder,lightingShader,model);
-        drawTrees(tree, greencylinder, greycylinder,lightingShader,model);
+        //drawCylindricalTree(greencylinder,greylinder,sceneShader,model);
+        //drawNormalTree(tree,greycylinder,sceneShader,model);
+        drawTrees(tree, greencylinder, greycylinder,sceneShader,model);
 
 
 
         //Drawing tree using fractiles
         translate = glm::translate(identityMatrix, glm::vec3(-15.0, 0.0, 18.0));
         model = translate;
-        drawTreeWithFractiles(cubeVAO, lightingShader, model, 0, 0, 0, 0);
+        drawTreeWithFractiles(cubeVAO, sceneShader, model, 0, 0, 0, 0);
 
         
         
 
 
-        glm::mat4 modelForSphere = glm::mat4(1.0f);
-        modelForSphere = glm::translate(model, glm::vec3(1.5f, 1.2f, 0.5f));
-        sphere.drawSphere(lightingShader, modelForSphere);
+        sphere.drawSphere(sceneShader, sphereModel);
+    };
 
-        // also draw the lamp object(s)
-        ourShader.use();
+    // the textured walls and sky, drawn with the textured Phong program
+    auto drawTexturedWalls = [&](Shader& wallShader)
+    {
+        glm::mat4 identityMatrix = glm::mat4(1.0f);
+        glm::mat4 translate, model, scale;
+
+        translate = glm::translate(identityMatrix, glm::vec3(-57.0f, -5.0f, -57.0f));
+        scale = glm::scale(identityMatrix, glm::vec3(114.0f, 114.0f, 1.0f));
+        model = translate * scale;
+        texcube.drawCubeWithTexture(wallShader, model);
+
+        translate = glm::translate(identityMatrix, glm::vec3(57.0f, -5.0f, -57.0f));
+        scale = glm::scale(identityMatrix, glm::vec3(1.0f, 114.0f, 114.0f));
+        model = translate * scale;
+        texcube.drawCubeWithTexture(wallShader, model);
+
+        translate = glm::translate(identityMatrix, glm::vec3(-57.0f, -5.0f, -57.0f));
+        scale = glm::scale(identityMatrix, glm::vec3(1.0f, 114.0f, 114.0f));
+        model = translate * scale;
+        texcube.drawCubeWithTexture(wallShader, model);
+
+        translate = glm::translate(identityMatrix, glm::vec3(57.0f, -5.0f, -57.0f));
+        scale = glm::scale(identityMatrix, glm::vec3(1.0f, 114.0f, 114.0f));
+        model = translate * scale;
+        texcube.drawCubeWithTexture(wallShader, model);
+
+        translate = glm::translate(identityMatrix, glm::vec3(-57.0f, -5.0f, 57.0f));
+        scale = glm::scale(identityMatrix, glm::vec3(1.0f, 114.0f, 114.0f));
+        model = translate * scale;
+        texcube.drawCubeWithTexture(wallShader, model);
+
+        translate = glm::translate(identityMatrix, glm::vec3(57.0f, -5.0f, 57.0f));
+        scale = glm::scale(identityMatrix, glm::vec3(1.0f, 114.0f, 114.0f));
+        model = translate * scale;
+        texcube.drawCubeWithTexture(wallShader, model);
+
+        translate = glm::translate(identityMatrix, glm::vec3(-57.0f, -5.0f, 138.0f));
+        scale = glm::scale(identityMatrix, glm::vec3(114.0f, 114.0f, 1.0f));
+        model = translate * scale;
+        texcube.drawCubeWithTexture(wallShader, model);
+
+        translate = glm::translate(identityMatrix, glm::vec3(-57.0f, 100.0f, -57.0f));
+        scale = glm::scale(identityMatrix, glm::vec3(190.0f, 1.0f, 200.0f));
+        model = translate * scale;
+        texcube2.drawCubeWithTexture(wallShader, model);
+    };
+
+    // unlit cubes at the point lights and the spot light, plus the garden lamps on the clustered path
+    auto drawLampCubes = [&](const glm::mat4& projection, const glm::mat4& view, bool withGardenLamps)
+    {
+        glm::mat4 model;
+            ourShader.use();
         ourShader.setMat4("projection", projection);
         ourShader.setMat4("view", view);
 
@@ -720,7 +1072,7 @@ int main()
             model = glm::mat4(1.0f);
             model = glm::translate(model, pointLightPositions[i]);
             model = glm::scale(model, glm::vec3(0.2f)); // Make it a smaller cube
-            ourShader.setMat4("model", model);
+            ourShader.setMat4("model", model * cubePositionTransform);
             ourShader.setVec3("color", glm::vec3(0.8f, 0.8f, 0.8f));
             glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
         }
@@ -728,35 +1080,376 @@ int main()
         model = glm::mat4(1.0f);
         model = glm::translate(model, spotLightPosition);
         model = glm::scale(model, glm::vec3(0.2f)); // Make it a smaller cube
-        ourShader.setMat4("model", model);
+        ourShader.setMat4("model", model * cubePositionTransform);
         ourShader.setVec3("color", glm::vec3(0.8f, 0.8f, 0.8f));
         glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
 
+        if (withGardenLamps)
+        {
+            for (PointLight& lamp : gardenLamps)
+            {
+                model = glm::mat4(1.0f);
+                model = glm::translate(model, lamp.position);
+                model = glm::scale(model, glm::vec3(0.2f));
+                ourShader.setMat4("model", model * cubePositionTransform);
+                ourShader.setVec3("color", lamp.getDiffuse());
+                glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+            }
+        }
+    };
+
+    if (!exportScenePath.empty())
+    {
+        // one pass over the draw functions with every draw recorded instead of rasterized
+        SceneExporter exporter;
+        softwareDevice->drawRecorder = [&exporter](const SoftwareDraw& draw) { exporter.add(draw); };
+        Shader& lightingShader = phongPermutations.get(currentLightFeatures());
+        lightingShader.use();
+        drawSceneGeometry(lightingShader);
+        softwareDevice->drawRecorder = nullptr;
+        exporter.addLight(pointlight1);
+        exporter.addLight(pointlight2);
+        exporter.addLight(pointlight3);
+        exporter.addLight(pointlight4);
+        exporter.addLight(spotlight);
+        exporter.addLight(daylight);
+        exporter.addLight(moonlight);
+        bool written = exporter.write(exportScenePath);
+        exporter.printStats();
+        return written ? 0 : -1;
+    }
+
+    if (softwareDevice)
+    {
+        // forward path only: shadow maps, clustered and deferred shading need render targets the rasterizer does not have
+        daylight.shadows = nullptr;
+        moonlight.shadows = nullptr;
+        PointLight* lamps[] = { &pointlight1, &pointlight2, &pointlight3, &pointlight4 };
+        for (PointLight* lamp : lamps)
+            lamp->shadows = nullptr;
+        spotlight.shadows = nullptr;
+
+        auto renderSoftwareFrame = [&](float t)
+        {
+            frameArena.beginFrame();
+            cameraRoute.apply(camera, t);
+            Shader& lightingShader = phongPermutations.get(currentLightFeatures());
+            Shader& lightingShaderWithTexture = phongPermutations.get(currentLightFeatures() | FEATURE_TEXTURED);
+
+            glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 400.0f);
+            glm::mat4 view = camera.GetViewMatrix();
+            for (Shader* shader : { &lightingShader, &lightingShaderWithTexture })
+            {
+                shader->use();
+                shader->setVec3("viewPos", camera.Position);
+                setUpPointLights(*shader);
+                spotlight.setUpSpotLight(*shader);
+                moonlight.setUpDirectionalLight(*shader);
+                daylight.setUpDirectionalLight(*shader);
+                shader->setMat4("projection", projection);
+                shader->setMat4("view", view);
+            }
+            drawSceneGeometry(lightingShader);
+            drawTexturedWalls(lightingShaderWithTexture);
+            drawLampCubes(projection, view, false);
+            softwareDevice->endFrame();
+            frameArena.endFrame();
+        };
+
+        SoftwareRasterizer& rasterizer = softwareDevice->rasterizer;
+        error_code error;
+        filesystem::create_directories(SOFTWARE_FRAMES_DIR, error);
+        for (int frame = 0; frame < softwareFrames; frame++)
+        {
+            renderSoftwareFrame(softwareFrames > 1 ? (float)frame / (softwareFrames - 1) : 0.0f);
+            char path[256];
+            snprintf(path, sizeof(path), "%s/frame_%04d.png", SOFTWARE_FRAMES_DIR, frame);
+            rasterizer.writePNG(path);
+        }
+        cout << "software: " << softwareFrames << " frames written to " << SOFTWARE_FRAMES_DIR << ", last frame " << rasterizer.drawCount << " draws, "
+            << rasterizer.triangleCount << " triangles, " << rasterizer.binnedTriangles << " tile bins" << endl;
+        frameArena.printStats();
+
+        // throughput over the same route with 1, 2, 4, ... threads up to every core
+        int cores = std::max(1, (int)thread::hardware_concurrency());
+        double singleThreadFps = 0.0;
+        for (int threads = 1; ; threads = std::min(threads * 2, cores))
+        {
+            rasterizer.setThreadCount(threads);
+            renderSoftwareFrame(0.0f);
+            double geometryMs = 0.0, rasterMs = 0.0;
+            auto start = chrono::high_resolution_clock::now();
+            for (int frame = 0; frame < SOFTWARE_BENCHMARK_FRAMES; frame++)
+            {
+                renderSoftwareFrame((float)frame / SOFTWARE_BENCHMARK_FRAMES);
+                geometryMs += rasterizer.geometryMs;
+                rasterMs += rasterizer.rasterMs;
+            }
+            double seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+            double fps = SOFTWARE_BENCHMARK_FRAMES / seconds;
+            if (threads == 1)
+                singleThreadFps = fps;
+            cout << "software benchmark " << SCR_WIDTH << "x" << SCR_HEIGHT << ": " << threads << " threads, " << fps << " frames/s, "
+                << geometryMs / SOFTWARE_BENCHMARK_FRAMES << " ms geometry, " << rasterMs / SOFTWARE_BENCHMARK_FRAMES << " ms tiles, speedup "
+                << fps / singleThreadFps << "x" << endl;
+            if (threads == cores)
+                break;
+        }
+        return 0;
+    }
+
+    // programs the driver is still compiling at this point are what the overlap did not hide. without parallel
+    // compile the driver cannot say before a program is used
+    if (shaderCompiler.parallelCompileAvailable())
+        cout << "startup: " << shaderCompiler.pendingCount() << " shader programs still compiling after scene setup" << endl;
+    if (AssetPack::current() != nullptr)
+        assetPack.printStats();
+    bool firstFrame = true;
+
+    // one frame on the thread that owns the context
+    // ---------------------------------------------
+    auto renderFrame = [&]()
+    {
+        frameArena.beginFrame();
+
+        // input that arrived since the last frame
+        InputEvent event;
+        while (inputEvents.pop(event))
+        {
+            if (event.type == INPUT_KEY)
+                handleKey(event.key);
+            else
+            {
+                framebufferWidth = event.width;
+                framebufferHeight = event.height;
+                glViewport(0, 0, framebufferWidth, framebufferHeight);
+                deferredRenderer.resize(framebufferWidth, framebufferHeight);
+                clusteredLighting.setScreenSize(framebufferWidth, framebufferHeight);
+            }
+            inputLatency.applied(event.time);
+        }
+        if (cameraSnapshots.update())
+            camera = cameraSnapshots.front();
+        double cameraTime = publishedCameraInput.exchange(0.0);
+        if (cameraTime != 0.0)
+            inputLatency.applied(cameraTime);
+        frameRing.beginFrame();
+        sphere.setRadius(sphereRadius);
+        sphere.setSectorCount(sphereSectors);
+        sphere.setStackCount(sphereStacks);
+        // the shadow maps, the lightmap and the path tracer hold the old sphere
+        float sphereChange = sphere.update(jobSystem);
+        if (sphereChange > 0.0f)
+        {
+            dayShadows.invalidate();
+            moonShadows.invalidate();
+            shadowCache.casterChanged(glm::vec3(sphereModel[3]), sphereChange);
+            lightmap.invalidateGeometry();
+            lightmapRequested = lightmapOn;
+            pathTracer.invalidateGeometry();
+        }
 
-        lightingShaderWithTexture.use();
-        lightingShaderWithTexture.setVec3("viewPos", camera.Position);
+        Shader& lightingShader = phongPermutations.get(currentLightFeatures());
+        Shader& lightingShaderWithTexture = phongPermutations.get(currentLightFeatures() | FEATURE_TEXTURED);
+        // the route benchmark switches to the deferred programs halfway, none may be left to finish in a timed frame
+        if (routeBenchmarkStage == 0 && routeBenchmarkFrame == 0)
+            shaderCompiler.finishAll();
+        if (routeBenchmarkStage >= 0)
+            cameraRoute.apply(camera, (float)routeBenchmarkFrame / ROUTE_FRAMES);
 
-        lightingShaderWithTexture.setMat4("projection", projection);
-        lightingShaderWithTexture.setMat4("view", view);
+        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // forward path evaluates the 4 point lights for every fragment, clustered path only the ones reaching the fragment's cluster,
+        // deferred path writes materials into the G-buffer and lights every pixel once after the scene is drawn
+        bool clusteredPath = clusteredShadingOn && !deferredShadingOn;
+        Shader& sceneShader = deferredShadingOn ? deferredRenderer.geometryShader : (clusteredPath ? clusteredShader : lightingShader);
+        Shader& texturedShader = deferredShadingOn ? deferredRenderer.geometryShaderWithTexture : lightingShaderWithTexture;
+        // the forward program's surfaces of revolution are drawn as patches by its tessellated permutation
+        bool patchPath = BezierCurve::tessellation() && !deferredShadingOn && !clusteredPath;
+        Shader* patchShader = patchPath ? &phongPermutations.get(currentLightFeatures() | FEATURE_TESSELLATED) : nullptr;
+        BezierCurve::patches().lightingProgram = lightingShader.ID;
+        BezierCurve::patches().patchShader = patchShader;
+        bool lightmapPath = lightmapOn && !deferredShadingOn;
+        if (lightmapPath && lightmapRequested)
+        {
+            lightmap.clearLights();
+            lightmap.addLight(pointlight1);
+            lightmap.addLight(pointlight2);
+            lightmap.addLight(pointlight3);
+            lightmap.addLight(pointlight4);
+            lightmap.addLight(spotlight);
+            lightmap.addLight(daylight);
+            lightmap.addLight(moonlight);
+            lightmap.build(drawSceneGeometry);
+            lightmap.printStats();
+            lightmapRequested = false;
+        }
+
+        // pass projection matrix to shader (note that in this case it could change every frame)
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 400.0f);
+        //glm::mat4 projection = glm::ortho(-2.0f, +2.0f, -1.5f, +1.5f, 0.1f, 100.0f);
+
+        // camera/view transformation
+        glm::mat4 view = camera.GetViewMatrix();
+        //glm::mat4 view = basic_camera.createViewMatrix();
+
+        if (referenceRequested)
+        {
+            pathTracer.clearLights();
+            pathTracer.addLight(pointlight1);
+            pathTracer.addLight(pointlight2);
+            pathTracer.addLight(pointlight3);
+            pathTracer.addLight(pointlight4);
+            pathTracer.addLight(spotlight);
+            pathTracer.addLight(daylight);
+            pathTracer.addLight(moonlight);
+            pathTracer.setCamera(projection, view);
+            pathTracer.prepare(drawSceneGeometry);
+            while (pathTracer.samplesPerPixel < REFERENCE_SAMPLES)
+            {
+                pathTracer.render(std::min(REFERENCE_BATCH, REFERENCE_SAMPLES - pathTracer.samplesPerPixel));
+                pathTracer.saveCheckpoint();
+                cout << "path tracer: " << pathTracer.samplesPerPixel << "/" << REFERENCE_SAMPLES << " samples per pixel" << endl;
+            }
+            pathTracer.writePNG();
+            pathTracer.printStats();
+            referenceRequested = false;
+        }
+
+        // the scene file is culled on the job system while the shadow maps are drawn, joined before the scene pass
+        JobCounter sceneCulled;
+        bool cullScene = sceneFile.isLoaded() && !lightmapPath;
+        if (cullScene)
+            sceneFile.cull(projection * view, jobSystem, sceneCulled);
+
+        // shadow maps of lights that are switched off are neither updated nor sampled
+        daylight.shadows = (directionShadowsOn && dayLightOn) ? &dayShadows : nullptr;
+        moonlight.shadows = (directionShadowsOn && moonLightOn) ? &moonShadows : nullptr;
+        dayShadows.pcf = shadowPCFOn;
+        moonShadows.pcf = shadowPCFOn;
+        if (daylight.shadows != nullptr)
+            dayShadows.update(daylight.direction, view, glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, shadowDepthShader, drawSceneGeometry);
+        if (moonlight.shadows != nullptr)
+            moonShadows.update(moonlight.direction, view, glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, shadowDepthShader, drawSceneGeometry);
+        PointLight* lamps[] = { &pointlight1, &pointlight2, &pointlight3, &pointlight4 };
+        for (int i = 0; i < 4; i++)
+            lamps[i]->shadows = localShadowsOn ? &lampShadows[i] : nullptr;
+        spotlight.shadows = localShadowsOn ? &entranceShadow : nullptr;
+        if (localShadowsOn)
+            shadowCache.update(pointShadowShader, shadowDepthShader, camera.Position, drawSceneGeometry);
+        if (printShadowStats)
+        {
+            dayShadows.printStats("day");
+            moonShadows.printStats("moon");
+            shadowCache.printStats();
+            printShadowStats = false;
+        }
+
+        if (deferredShadingOn)
+        {
+            deferredRenderer.beginGeometryPass(projection, view);
+        }
+        else
+        {
+            if (patchShader != nullptr)
+            {
+                patchShader->use();
+                patchShader->setVec2("viewportSize", glm::vec2((float)framebufferWidth, (float)framebufferHeight));
+                patchShader->setFloat("pixelsPerEdge", BezierCurve::patches().pixelsPerEdge);
+                patchShader->setFloat("maxTessLevel", (float)maxTessLevel);
+            }
+            // the patch program lights like the scene program, which is set up last so it stays bound
+            Shader* forwardShaders[] = { patchShader, &sceneShader };
+            for (Shader* shader : forwardShaders)
+            {
+                if (shader == nullptr)
+                    continue;
+                shader->use();
+                shader->setVec3("viewPos", camera.Position);
+
+                if (!clusteredPath)
+                    setUpPointLights(*shader);
+
+                spotlight.setUpSpotLight(*shader);
+
+                moonlight.setUpDirectionalLight(*shader);
+                daylight.setUpDirectionalLight(*shader);
+
+                shader->setMat4("projection", projection);
+                shader->setMat4("view", view);
+            }
+        }
+
+        if (clusteredPath)
+        {
+            pmr::vector<PointLight*> clusterLights(FrameArena::resource());
+            clusterLights.reserve(4 + gardenLamps.size());
+            clusterLights.insert(clusterLights.end(), { &pointlight1, &pointlight2, &pointlight3, &pointlight4 });
+            for (PointLight& lamp : gardenLamps)
+                clusterLights.push_back(&lamp);
+            clusteredLighting.updateClusters(projection);
+            clusteredLighting.assignLights(clusterLights.data(), clusterLights.size(), view);
+            clusteredLighting.bind(clusteredShader);
+        }
 
-        lightingShaderWithTexture.use();
 
         
 
-        pointlight1.setUpPointLight(lightingShaderWithTexture);
-        pointlight2.setUpPointLight(lightingShaderWithTexture);
-        pointlight3.setUpPointLight(lightingShaderWithTexture);
-        pointlight4.setUpPointLight(lightingShaderWithTexture);
 
-        spotlight.setUpSpotLight(lightingShaderWithTexture);
 
-        moonlight.setUpDirectionalLight(lightingShaderWithTexture);
-        daylight.setUpDirectionalLight(lightingShaderWithTexture);
+        // Modelling Transformation
+        glm::mat4 identityMatrix = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
+        glm::mat4 translate, rotate, revtranslate, alTogether, next, model, scale;
+        //translateMatrix = glm::translate(identityMatrix, glm::vec3(10, 20, 10));
+        //rotateXMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_X), glm::vec3(1.0f, 0.0f, 0.0f));
+        //rotateYMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_Y), glm::vec3(0.0f, 1.0f, 0.0f));
+        //rotateZMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_Z), glm::vec3(0.0f, 0.0f, 1.0f));
+        //scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.1, 0.1, 0.1));
+        model =  identityMatrix;
+        sceneShader.setMat4("model", model);
+
+
+
+        //scale = glm::scale(identityMatrix, glm::vec3(4.0, 4.0, 4.0));
+        //dome2.drawBezierCurve(sceneShader, scale);
+
+        if (lightmapPath)
+            lightmap.draw(projection, view);
+        else if (cullScene)
+        {
+            jobSystem.wait(sceneCulled);
+            sceneFile.drawVisible(sceneShader);
+        }
+        else
+            drawSceneGeometry(sceneShader);
+
+        if (!deferredShadingOn)
+        {
+            lightingShaderWithTexture.use();
+            lightingShaderWithTexture.setVec3("viewPos", camera.Position);
+
+            lightingShaderWithTexture.setMat4("projection", projection);
+            lightingShaderWithTexture.setMat4("view", view);
+
+            lightingShaderWithTexture.use();
+
+
+
+            setUpPointLights(lightingShaderWithTexture);
+
+            spotlight.setUpSpotLight(lightingShaderWithTexture);
+
+            moonlight.setUpDirectionalLight(lightingShaderWithTexture);
+            daylight.setUpDirectionalLight(lightingShaderWithTexture);
+        }
 
 
         
         model = identityMatrix;
-        lightingShaderWithTexture.setMat4("model", model);
+        texturedShader.setMat4("model", model);
         //drawFieldWithTexture(lightingShaderWithTexture, model);
 
 
@@ -771,54 +1464,88 @@ int main()
 
 
 
-        translate = glm::translate(identityMatrix, glm::vec3(-57.0f, -5.0f, -57.0f));
-        scale = glm::scale(identityMatrix, glm::vec3(114.0f, 114.0f, 1.0f));
-        model = translate * scale;
-        texcube.drawCubeWithTexture(lightingShaderWithTexture, model);
+        drawTexturedWalls(texturedShader);
 
-        translate = glm::translate(identityMatrix, glm::vec3(57.0f, -5.0f, -57.0f));
-        scale = glm::scale(identityMatrix, glm::vec3(1.0f, 114.0f, 114.0f));
-        model = translate * scale;
-        texcube.drawCubeWithTexture(lightingShaderWithTexture, model);
-        
-        translate = glm::translate(identityMatrix, glm::vec3(-57.0f, -5.0f, -57.0f));
-        scale = glm::scale(identityMatrix, glm::vec3(1.0f, 114.0f, 114.0f));
-        model = translate * scale;
-        texcube.drawCubeWithTexture(lightingShaderWithTexture, model);
-        
-        translate = glm::translate(identityMatrix, glm::vec3(57.0f, -5.0f, -57.0f));
-        scale = glm::scale(identityMatrix, glm::vec3(1.0f, 114.0f, 114.0f));
-        model = translate * scale;
-        texcube.drawCubeWithTexture(lightingShaderWithTexture, model);
+        glm::mat4 modelMatrixForContainer = glm::mat4(1.0f);
+        modelMatrixForContainer = glm::translate(identityMatrix, glm::vec3(0.0f, 3.0f, 2.0f));
+        //cube.drawCubeWithTexture(lightingShaderWithTexture, modelMatrixForContainer);
 
-        translate = glm::translate(identityMatrix, glm::vec3(-57.0f, -5.0f, 57.0f));
-        scale = glm::scale(identityMatrix, glm::vec3(1.0f, 114.0f, 114.0f));
-        model = translate * scale;
-        texcube.drawCubeWithTexture(lightingShaderWithTexture, model);
+        if (deferredShadingOn)
+        {
+            Shader& lightingPassShader = deferredRenderer.lightingPassShader;
+            pointlight1.setUpPointLight(lightingPassShader);
+            pointlight2.setUpPointLight(lightingPassShader);
+            pointlight3.setUpPointLight(lightingPassShader);
+            pointlight4.setUpPointLight(lightingPassShader);
 
-        translate = glm::translate(identityMatrix, glm::vec3(57.0f, -5.0f, 57.0f));
-        scale = glm::scale(identityMatrix, glm::vec3(1.0f, 114.0f, 114.0f));
-        model = translate * scale;
-        texcube.drawCubeWithTexture(lightingShaderWithTexture, model);
+            spotlight.setUpSpotLight(lightingPassShader);
 
-        translate = glm::translate(identityMatrix, glm::vec3(-57.0f, -5.0f, 138.0f));
-        scale = glm::scale(identityMatrix, glm::vec3(114.0f, 114.0f, 1.0f));
-        model = translate * scale;
-        texcube.drawCubeWithTexture(lightingShaderWithTexture, model);
+            moonlight.setUpDirectionalLight(lightingPassShader);
+            daylight.setUpDirectionalLight(lightingPassShader);
 
-        translate = glm::translate(identityMatrix, glm::vec3(-57.0f, 100.0f, -57.0f));
-        scale = glm::scale(identityMatrix, glm::vec3(190.0f, 1.0f, 200.0f));
-        model = translate * scale;
-        texcube2.drawCubeWithTexture(lightingShaderWithTexture, model);
+            deferredRenderer.lightingPass(projection, view, camera.Position);
+        }
 
-        glm::mat4 modelMatrixForContainer = glm::mat4(1.0f);
-        modelMatrixForContainer = glm::translate(identityMatrix, glm::vec3(0.0f, 3.0f, 2.0f));
-        //cube.drawCubeWithTexture(lightingShaderWithTexture, modelMatrixForContainer);
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
+        // also draw the lamp object(s)
+        drawLampCubes(projection, view, clusteredPath);
+
+        // glfw: swap buffers, input is polled by the main thread
+        // -----------------------------------------------------
+        frameRing.endFrame();
         glfwSwapBuffers(window);
-        glfwPollEvents();
+        inputLatency.presented(glfwGetTime());
+
+        // the first frame used every program it needs, the rest stay pending until they are switched to
+        if (firstFrame)
+        {
+            shaderCompiler.printReport();
+            Shader::printCacheStats();
+            firstFrame = false;
+        }
+
+        if (clusterBenchmarkStage >= 0)
+            updateClusterBenchmark(clusteredLighting);
+        if (routeBenchmarkStage >= 0)
+            updateRouteBenchmark();
+        frameArena.endFrame();
+    };
+
+    // render loop
+    // -----------
+    if (renderOnMain)
+    {
+        while (!glfwWindowShouldClose(window))
+        {
+            glfwPollEvents();
+            pollInput(window);
+            renderFrame();
+        }
+    }
+    else
+    {
+        // the context moves to the render thread, this one only waits for input and passes it on, so
+        // input is picked up while a frame is still being drawn or waits on the swap
+        atomic<bool> closing{ false };
+        glfwMakeContextCurrent(NULL);
+        thread renderThread([&]()
+        {
+            glfwMakeContextCurrent(window);
+            while (!closing.load(memory_order_acquire))
+                renderFrame();
+            glfwMakeContextCurrent(NULL);
+        });
+        while (!glfwWindowShouldClose(window))
+        {
+            glfwWaitEventsTimeout(INPUT_POLL_SECONDS);
+            pollInput(window);
+        }
+        closing.store(true, memory_order_release);
+        renderThread.join();
+        glfwMakeContextCurrent(window);
     }
+    inputLatency.printStats(renderOnMain ? "render on main thread" : "render thread");
+    frameRing.printStats();
+    frameArena.printStats();
 
 
     glDeleteVertexArrays(1, &cubeVAO);
@@ -1418,7 +2145,7 @@ void drawCube(unsigned int& cubeVAO, Shader& lightingShader, glm::mat4 model = g
     lightingShader.setVec3("material.specular", glm::vec3(0.5f, 0.5f, 0.5f));
     lightingShader.setFloat("material.shininess", 32.0f);
 
-    lightingShader.setMat4("model", model);
+    lightingShader.setMat4("model", model * cubePositionTransform);
 
     glBindVertexArray(cubeVAO);
     glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
@@ -2324,6 +3051,171 @@ void drawTreeWithFractiles(unsigned int& cubeVAO, Shader& lightingShader, glm::m
 }
 
 
+// permutation key of the forward Phong shaders for the lights that are currently switched on
+// ---------------------------------------------------------------------------------------------------------
+unsigned int currentLightFeatures()
+{
+    int pointLights = 0;
+    PointLight* lights[] = { &pointlight1, &pointlight2, &pointlight3, &pointlight4 };
+    for (PointLight* light : lights)
+    {
+        if (light->isOn())
+            pointLights++;
+    }
+    return ShaderPermutations::makeKey(pointLights, spotLightOn, dayLightOn, moonLightOn);
+}
+
+// uploads the switched on point lights packed from index 0, matching NR_POINT_LIGHTS of the permutation
+// ---------------------------------------------------------------------------------------------------------
+void setUpPointLights(Shader& lightingShader)
+{
+    int index = 0;
+    PointLight* lights[] = { &pointlight1, &pointlight2, &pointlight3, &pointlight4 };
+    for (PointLight* light : lights)
+    {
+        if (light->isOn())
+            light->setUpPointLight(lightingShader, index++);
+    }
+}
+
+// fills the garden and walkway with a grid of small warm lamps for the clustered path
+// ---------------------------------------------------------------------------------------------------------
+void buildGardenLamps(int count)
+{
+    gardenLamps.clear();
+    if (count <= 0)
+        return;
+    gardenLamps.reserve(count);
+
+    int columns = (int)ceil(sqrt((float)count));
+    int rows = (count + columns - 1) / columns;
+    float stepX = 100.0f / columns;
+    float stepZ = 130.0f / rows;
+    for (int i = 0; i < count; i++)
+    {
+        float x = -50.0f + stepX * (i % columns + 0.5f);
+        float z = stepZ * (i / columns + 0.5f);
+        gardenLamps.push_back(PointLight(
+            x, 2.5f, z,             // position
+            0.05f, 0.04f, 0.02f,    // ambient
+            1.0f, 0.8f, 0.5f,       // diffuse
+            1.0f, 0.8f, 0.5f,       // specular
+            1.0f,   //k_c
+            0.35f,  //k_l
+            0.44f,  //k_q
+            8 + i   // light number
+        ));
+    }
+}
+
+// runs each benchmark stage for a fixed number of frames from the current camera and prints one row per stage
+// ---------------------------------------------------------------------------------------------------------
+void updateClusterBenchmark(ClusteredLighting& clusteredLighting)
+{
+    static int frame = 0;
+    static double stageStart = 0.0;
+    static double assignMs = 0.0;
+
+    glFinish();
+    double now = glfwGetTime();
+
+    if (frame == BENCHMARK_WARMUP_FRAMES)
+    {
+        stageStart = now;
+        assignMs = 0.0;
+    }
+    else if (frame > BENCHMARK_WARMUP_FRAMES)
+    {
+        assignMs += clusteredLighting.assignTimeMs;
+    }
+
+    if (frame == BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES)
+    {
+        int lights = clusterBenchmarkCounts[clusterBenchmarkStage];
+        double frameMs = (now - stageStart) * 1000.0 / BENCHMARK_FRAMES;
+        if (clusterBenchmarkStage == 0)
+        {
+            cout << "path       lights   frame ms   assign ms   lights/cluster" << endl;
+            cout << "forward    " << lights << "        " << frameMs << endl;
+        }
+        else
+        {
+            cout << "clustered  " << lights << "        " << frameMs << "    " << assignMs / BENCHMARK_FRAMES << "    " << clusteredLighting.averageLightsPerCluster() << endl;
+        }
+
+        clusterBenchmarkStage++;
+        frame = 0;
+        if (clusterBenchmarkStage == CLUSTER_BENCHMARK_STAGES)
+        {
+            clusterBenchmarkStage = -1;
+            buildGardenLamps(DEFAULT_CLUSTERED_LIGHTS - 4);
+            return;
+        }
+        clusteredShadingOn = true;
+        buildGardenLamps(clusterBenchmarkCounts[clusterBenchmarkStage] - 4);
+        return;
+    }
+    frame++;
+}
+
+
+// flies the camera route once per render path and prints the average frame time of each
+// ---------------------------------------------------------------------------------------------------------
+void updateRouteBenchmark()
+{
+    static double stageStart = 0.0;
+
+    glFinish();
+    double now = glfwGetTime();
+
+    if (routeBenchmarkFrame == 0)
+        stageStart = now;
+
+    if (routeBenchmarkFrame == ROUTE_FRAMES)
+    {
+        double frameMs = (now - stageStart) * 1000.0 / ROUTE_FRAMES;
+        cout << (routeBenchmarkStage == 0 ? "forward   " : "deferred  ") << frameMs << " ms/frame over " << ROUTE_FRAMES << " frames" << endl;
+
+        routeBenchmarkStage++;
+        routeBenchmarkFrame = 0;
+        deferredShadingOn = true;
+        if (routeBenchmarkStage == 2)
+        {
+            routeBenchmarkStage = -1;
+            deferredShadingOn = false;
+        }
+        return;
+    }
+    routeBenchmarkFrame++;
+}
+
+
+// on the main thread: moves the input camera and hands a copy of it to the render thread
+// ----------------------------------------------------------------------------------------
+void pollInput(GLFWwindow* window)
+{
+    float currentFrame = static_cast<float>(glfwGetTime());
+    deltaTime = currentFrame - lastFrame;
+    lastFrame = currentFrame;
+
+    processInput(window);
+    if (cameraInputTime == 0.0)
+        return;
+    cameraSnapshots.back() = inputCamera;
+    cameraSnapshots.publish();
+    // set after the snapshot so a frame never counts input it does not show, an older time still waiting is kept
+    double none = 0.0;
+    publishedCameraInput.compare_exchange_strong(none, cameraInputTime);
+    cameraInputTime = 0.0;
+}
+
+// the input camera moved, the time of the oldest move is kept until it is published
+void cameraInput()
+{
+    if (cameraInputTime == 0.0)
+        cameraInputTime = glfwGetTime();
+}
+
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 // ---------------------------------------------------------------------------------------------------------
 void processInput(GLFWwindow* window)
@@ -2332,34 +3224,49 @@ void processInput(GLFWwindow* window)
         glfwSetWindowShouldClose(window, true);
 
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-        camera.ProcessKeyboard(FORWARD, deltaTime);
+        inputCamera.ProcessKeyboard(FORWARD, deltaTime);
+        cameraInput();
     }
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-        camera.ProcessKeyboard(BACKWARD, deltaTime);
+        inputCamera.ProcessKeyboard(BACKWARD, deltaTime);
+        cameraInput();
     }
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-        camera.ProcessKeyboard(LEFT, deltaTime);
+        inputCamera.ProcessKeyboard(LEFT, deltaTime);
+        cameraInput();
     }
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-        camera.ProcessKeyboard(RIGHT, deltaTime);
+        inputCamera.ProcessKeyboard(RIGHT, deltaTime);
+        cameraInput();
     }
     if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS) {
-        camera.ProcessKeyboard(YAWR, deltaTime);
+        inputCamera.ProcessKeyboard(YAWR, deltaTime);
+        cameraInput();
     }
     if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS) {
-        camera.ProcessKeyboard(YAWL, deltaTime);
+        inputCamera.ProcessKeyboard(YAWL, deltaTime);
+        cameraInput();
     }
     if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS) {
-        camera.ProcessKeyboard(PITCHU, deltaTime);
+        inputCamera.ProcessKeyboard(PITCHU, deltaTime);
+        cameraInput();
     }
     if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS) {
-        camera.ProcessKeyboard(PITCHD, deltaTime);
+        inputCamera.ProcessKeyboard(PITCHD, deltaTime);
+        cameraInput();
     }
 } 
 
+// key presses are queued for the render thread, which owns everything they toggle
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
-    if (key == GLFW_KEY_1 && action == GLFW_PRESS)
+    if (action == GLFW_PRESS)
+        inputEvents.push(InputEvent{ INPUT_KEY, key, action, 0, 0, glfwGetTime() });
+}
+
+void handleKey(int key)
+{
+    if (key == GLFW_KEY_1)
     {
         if (pointLightOn)
         {
@@ -2380,7 +3287,7 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     }
 
 
-    else if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS)
+    else if (key == GLFW_KEY_2)
     {
         if (specularToggle)
         {
@@ -2403,7 +3310,7 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         }
     }
 
-    else if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS)
+    else if (key == GLFW_KEY_3)
     {
         if (diffuseToggle)
         {
@@ -2425,7 +3332,7 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         }
     }
 
-    else if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS)
+    else if (key == GLFW_KEY_4)
     {
         if (ambientToggle)
         {
@@ -2447,7 +3354,7 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         }
     }
 
-    else if (glfwGetKey(window, GLFW_KEY_5) == GLFW_PRESS)
+    else if (key == GLFW_KEY_5)
     {
         if (spotLightOn)
         {
@@ -2462,7 +3369,7 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         }
     }
 
-    else if (glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS)
+    else if (key == GLFW_KEY_N)
     {
         if (dayLightOn)
         {
@@ -2477,7 +3384,7 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         }
     }
 
-    else if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS)
+    else if (key == GLFW_KEY_M)
     {
         if (moonLightOn)
         {
@@ -2491,15 +3398,108 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
             moonLightOn = !moonLightOn;
         }
     }
+
+    else if (key == GLFW_KEY_C)
+    {
+        clusteredShadingOn = !clusteredShadingOn;
+        if (clusteredShadingOn && gardenLamps.empty())
+            buildGardenLamps(DEFAULT_CLUSTERED_LIGHTS - 4);
+    }
+
+    else if (key == GLFW_KEY_G)
+    {
+        deferredShadingOn = !deferredShadingOn;
+    }
+
+    else if (key == GLFW_KEY_H)
+    {
+        directionShadowsOn = !directionShadowsOn;
+    }
+
+    else if (key == GLFW_KEY_F)
+    {
+        shadowPCFOn = !shadowPCFOn;
+    }
+
+    else if (key == GLFW_KEY_O)
+    {
+        localShadowsOn = !localShadowsOn;
+    }
+
+    else if (key == GLFW_KEY_P)
+    {
+        lightmapOn = !lightmapOn;
+        lightmapRequested = lightmapOn;
+    }
+
+    else if (key == GLFW_KEY_Y)
+    {
+        referenceRequested = true;
+    }
+
+    else if (key == GLFW_KEY_6 || key == GLFW_KEY_7)
+    {
+        int& slices = BezierCurve::pulledSlices();
+        slices = std::min(std::max(key == GLFW_KEY_6 ? slices / 2 : slices * 2, PULLED_SLICES_MIN), PULLED_SLICES_MAX);
+        cout << "vertex pulled surfaces: " << slices << " slices" << (BezierCurve::vertexPulling() ? "" : " (off, start with --vertex-pulling)") << endl;
+    }
+
+    else if (key == GLFW_KEY_8 || key == GLFW_KEY_9)
+    {
+        float& pixels = BezierCurve::patches().pixelsPerEdge;
+        pixels = std::min(std::max(key == GLFW_KEY_8 ? pixels / 2 : pixels * 2, PATCH_PIXELS_PER_EDGE_MIN), PATCH_PIXELS_PER_EDGE_MAX);
+        cout << "tessellated surfaces: edges of " << pixels << " pixels" << (BezierCurve::tessellation() ? "" : " (off, start with --tessellation)") << endl;
+    }
+
+    else if (key == GLFW_KEY_LEFT_BRACKET || key == GLFW_KEY_RIGHT_BRACKET)
+    {
+        bool finer = key == GLFW_KEY_RIGHT_BRACKET;
+        sphereSectors = std::min(std::max(finer ? sphereSectors * 2 : sphereSectors / 2, MIN_SECTOR_COUNT), SPHERE_SECTORS_MAX);
+        sphereStacks = std::min(std::max(finer ? sphereStacks * 2 : sphereStacks / 2, MIN_STACK_COUNT), SPHERE_STACKS_MAX);
+        cout << "sphere: " << sphereSectors << " sectors, " << sphereStacks << " stacks requested" << endl;
+    }
+
+    else if (key == GLFW_KEY_MINUS || key == GLFW_KEY_EQUAL)
+    {
+        float radius = key == GLFW_KEY_MINUS ? sphereRadius / SPHERE_RADIUS_STEP : sphereRadius * SPHERE_RADIUS_STEP;
+        sphereRadius = std::min(std::max(radius, SPHERE_RADIUS_MIN), SPHERE_RADIUS_MAX);
+        cout << "sphere: radius " << sphereRadius << endl;
+    }
+
+    else if (key == GLFW_KEY_T)
+    {
+        printShadowStats = true;
+    }
+
+    else if (key == GLFW_KEY_R)
+    {
+        if (routeBenchmarkStage < 0)
+        {
+            cout << "render path benchmark on the camera route" << endl;
+            routeBenchmarkStage = 0;
+            routeBenchmarkFrame = 0;
+            deferredShadingOn = false;
+        }
+    }
+
+    else if (key == GLFW_KEY_B)
+    {
+        if (clusterBenchmarkStage < 0)
+        {
+            cout << "clustered lighting benchmark" << endl;
+            clusterBenchmarkStage = 0;
+            clusteredShadingOn = false;
+        }
+    }
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 // ---------------------------------------------------------------------------------------------
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-    // make sure the viewport matches the new window dimensions; note that width and
+    // the render thread makes the viewport match the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
+    inputEvents.push(InputEvent{ INPUT_RESIZE, 0, 0, width, height, glfwGetTime() });
 }
 
 
@@ -2523,51 +3523,316 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
     lastX = xpos;
     lastY = ypos;
 
-    camera.ProcessMouseMovement(xoffset, yoffset);
+    inputCamera.ProcessMouseMovement(xoffset, yoffset);
+    cameraInput();
 }
 
 // glfw: whenever the mouse scroll wheel scrolls, this callback is called
 // ----------------------------------------------------------------------
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
-    camera.ProcessMouseScroll(static_cast<float>(yoffset));
+    inputCamera.ProcessMouseScroll(static_cast<float>(yoffset));
+    cameraInput();
 }
 
 unsigned int loadTexture(char const* path, GLenum textureWrappingModeS, GLenum textureWrappingModeT, GLenum textureFilteringModeMin, GLenum textureFilteringModeMax)
 {
-    
+    stbi_set_flip_vertically_on_load(true);
+    DecodedImage image = decodeImage(path);
+    unsigned int textureID = createTexture(image, textureWrappingModeS, textureWrappingModeT, textureFilteringModeMin, textureFilteringModeMax);
+    stbi_image_free(image.data);
+    return textureID;
+}
+
+// touches no GL state, so the startup graph runs it on its workers
+DecodedImage decodeImage(char const* path)
+{
+    DecodedImage image;
+    // images in the asset pack are decoded straight from the mapped archive
+    const unsigned char* packed;
+    size_t packedSize;
+    if (AssetPack::current() != nullptr && AssetPack::current()->find(path, packed, packedSize))
+        image.data = stbi_load_from_memory(packed, (int)packedSize, &image.width, &image.height, &image.components, 0);
+    else
+        image.data = stbi_load(path, &image.width, &image.height, &image.components, 0);
+    if (!image.data)
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+    return image;
+}
+
+unsigned int createTexture(const DecodedImage& image, GLenum textureWrappingModeS, GLenum textureWrappingModeT, GLenum textureFilteringModeMin, GLenum textureFilteringModeMax)
+{
     unsigned int textureID;
     glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    stbi_set_flip_vertically_on_load(true);
-    unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
+    if (image.data)
     {
         GLenum format = GL_RGB;
-        if (nrComponents == 1)
+        if (image.components == 1)
             format = GL_RED;
-        else if (nrComponents == 3)
+        else if (image.components == 3)
             format = GL_RGB;
-        else if (nrComponents == 4)
+        else if (image.components == 4)
             format = GL_RGBA;
 
         glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, textureWrappingModeS);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, textureWrappingModeT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, textureFilteringModeMin);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, textureFilteringModeMax);
+    }
+    return textureID;
+}
 
-        stbi_image_free(data);
+// reads and decodes every runtime asset once from the loose files and once from the pack, with the
+// files dropped from the OS cache first where the OS allows it, so both runs start cold
+void benchmarkAssetLoading(const string& packPath)
+{
+    vector<string> names = AssetPack::runtimeAssets();
+    auto isImage = [](const string& name)
+    {
+        return name.size() > 4 && (name.compare(name.size() - 4, 4, ".jpg") == 0 || name.compare(name.size() - 4, 4, ".png") == 0);
+    };
+    bool cold = true;
+    for (const string& name : names)
+        cold = AssetPack::evictFromCache(name) && cold;
+    cold = AssetPack::evictFromCache(packPath) && cold;
+
+    stbi_set_flip_vertically_on_load(true);
+    size_t bytes = 0;
+    auto start = chrono::high_resolution_clock::now();
+    for (const string& name : names)
+    {
+        int width, height, components;
+        if (isImage(name))
+        {
+            unsigned char* data = stbi_load(name.c_str(), &width, &height, &components, 0);
+            bytes += data != nullptr ? (size_t)width * height * components : 0;
+            stbi_image_free(data);
+        }
+        else
+        {
+            ifstream file(name, ios::binary);
+            string text((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+            bytes += text.size();
+        }
     }
-    else
+    double looseMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+    start = chrono::high_resolution_clock::now();
+    AssetPack pack;
+    if (!pack.open(packPath))
+        return;
+    for (const string& name : names)
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        const unsigned char* data;
+        size_t size;
+        if (!pack.find(name, data, size))
+        {
+            cout << "asset benchmark: " << name << " is missing from " << packPath << ", pack it again" << endl;
+            return;
+        }
+        if (isImage(name))
+        {
+            int width, height, components;
+            stbi_image_free(stbi_load_from_memory(data, (int)size, &width, &height, &components, 0));
+        }
     }
+    double packMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
 
-    return textureID;
+    cout << "asset benchmark (" << (cold ? "cold" : "warm, the OS cache could not be dropped") << "): " << names.size() << " files, "
+        << bytes / 1024 << " KB decoded, loose files " << looseMs << " ms, pack " << packMs << " ms" << endl;
+    pack.printStats();
+}
+
+// per job overhead with empty jobs, then the model matrices, world bounds and frustum test of a
+// synthetic scene in parallelFor chunks, with 1, 2, 4, ... threads up to every core
+void benchmarkJobSystem()
+{
+    vector<glm::vec3> positions(JOB_BENCHMARK_INSTANCES);
+    for (int i = 0; i < JOB_BENCHMARK_INSTANCES; i++)
+        positions[i] = glm::vec3((float)(i % 100) * 4.0f - 200.0f, (float)(i / 100 % 10) * 3.0f, -(float)(i / 1000) * 4.0f);
+    glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 400.0f)
+        * glm::lookAt(glm::vec3(0.0f, 35.0f, 135.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    vector<glm::mat4> models(JOB_BENCHMARK_INSTANCES);
+    vector<unsigned char> visible(JOB_BENCHMARK_INSTANCES);
+    auto buildAndCull = [&](int first, int last)
+    {
+        for (int i = first; i < last; i++)
+        {
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), positions[i]);
+            model = glm::rotate(model, glm::radians((float)(i % 360)), glm::vec3(0.0f, 1.0f, 0.0f));
+            model = glm::scale(model, glm::vec3(1.0f + (i % 7) * 0.25f));
+            models[i] = model;
+            // inside when any corner of the unit box lands inside the clip volume
+            bool inside = false;
+            for (int corner = 0; corner < 8 && !inside; corner++)
+            {
+                glm::vec4 clip = viewProjection * model * glm::vec4((float)(corner & 1), (float)((corner >> 1) & 1), (float)(corner >> 2), 1.0f);
+                inside = fabs(clip.x) <= clip.w && fabs(clip.y) <= clip.w && fabs(clip.z) <= clip.w;
+            }
+            visible[i] = inside;
+        }
+    };
+
+    int cores = std::max(1, (int)thread::hardware_concurrency());
+    double singleThreadMs = 0.0;
+    for (int threads = 1; ; threads = std::min(threads * 2, cores))
+    {
+        JobSystem jobs(threads);
+        // overhead: empty jobs forked one by one, then as parallelFor chunks of 1
+        JobCounter counter;
+        auto start = chrono::high_resolution_clock::now();
+        for (int i = 0; i < JOB_BENCHMARK_JOBS; i++)
+            jobs.run(counter, [] {});
+        jobs.wait(counter);
+        double runNs = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count() / JOB_BENCHMARK_JOBS;
+        start = chrono::high_resolution_clock::now();
+        jobs.parallelFor(JOB_BENCHMARK_JOBS, 1, [](int, int) {});
+        double forNs = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count() / JOB_BENCHMARK_JOBS;
+
+        jobs.parallelFor(JOB_BENCHMARK_INSTANCES, 256, buildAndCull);
+        jobs.resetStats();
+        start = chrono::high_resolution_clock::now();
+        for (int repeat = 0; repeat < JOB_BENCHMARK_REPEATS; repeat++)
+            jobs.parallelFor(JOB_BENCHMARK_INSTANCES, 256, buildAndCull);
+        double workMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count() / JOB_BENCHMARK_REPEATS;
+        if (threads == 1)
+            singleThreadMs = workMs;
+        int visibleCount = 0;
+        for (unsigned char flag : visible)
+            visibleCount += flag;
+        cout << "job benchmark: " << threads << " threads, " << runNs << " ns per run() job, " << forNs << " ns per parallelFor chunk, "
+            << JOB_BENCHMARK_INSTANCES << " transforms and frustum tests " << workMs << " ms (" << visibleCount << " visible), speedup "
+            << singleThreadMs / workMs << "x, " << jobs.jobsStolen / JOB_BENCHMARK_REPEATS << " chunks stolen per pass" << endl;
+        if (threads == cores)
+            break;
+    }
+}
+
+// tessellates the scene's surfaces of revolution and the sphere at every detail level without GL. before,
+// each mesh kept its positions, normals, texture coordinates and the interleaved vertices (14 floats a
+// vertex, counted without the vectors' spare capacity) and its indices for its lifetime. now only the
+// GpuMesh and an empty builder stay, the interleaved staging lives from generate() to upload()
+void benchmarkMeshMemory(BezierCurve* curves[], int curveCount, const Sphere& sphere)
+{
+    const size_t OLD_FLOATS_PER_VERTEX = 3 + 3 + 2 + 6;
+    size_t residentPerMesh = sizeof(GpuMesh) + sizeof(MeshBuilder);
+    int meshCount = curveCount + 1;
+    for (int detail : MESH_MEMORY_DETAILS)
+    {
+        size_t vertices = 0, indices = 0, peakStaging = 0;
+        for (int i = 0; i < meshCount; i++)
+        {
+            MeshBuilder builder;
+            if (i < curveCount)
+                curves[i]->tessellate(builder, detail);
+            else
+                sphere.tessellate(builder, detail);
+            vertices += builder.vertexCount();
+            indices += builder.indexCount();
+            peakStaging = std::max(peakStaging, builder.stagingBytes());
+        }
+        size_t gpuBytes = vertices * VertexData::strideOf(VertexData::defaultFormat(), false) + indices * sizeof(unsigned int);
+        size_t oldBytes = vertices * OLD_FLOATS_PER_VERTEX * sizeof(float) + indices * sizeof(unsigned int);
+        size_t newBytes = meshCount * residentPerMesh;
+        cout << "mesh memory, detail x" << detail << ": " << meshCount << " meshes, " << vertices << " vertices, " << indices << " indices, "
+            << gpuBytes / 1024 << " KB on the GPU, staging peak " << peakStaging / 1024 << " KB" << endl;
+        for (int scale : MESH_MEMORY_SCENE_SCALES)
+            cout << "    scene x" << scale << ": CPU resident " << oldBytes * scale / 1024 << " KB before, " << newBytes * scale
+                << " bytes now" << endl;
+    }
+}
+
+// packs the scene's surfaces of revolution and the sphere, at the normal and at a higher detail, in both
+// vertex formats. the error is what the shaders get back compared with the float vertices: positions in
+// units of the mesh's largest extent, normals as the angle between the two
+void benchmarkVertexFormats(BezierCurve* curves[], int curveCount, const Sphere& sphere)
+{
+    int details[] = { 1, VERTEX_FORMAT_BENCHMARK_DETAIL };
+    for (int detail : details)
+    {
+        size_t vertices = 0, bytes[2] = { 0, 0 };
+        double packMs[2] = { 0.0, 0.0 };
+        float positionError = 0.0f, normalErrorDegrees = 0.0f;
+        for (int i = 0; i <= curveCount; i++)
+        {
+            MeshBuilder builder;
+            if (i < curveCount)
+                curves[i]->tessellate(builder, detail);
+            else
+                sphere.tessellate(builder, detail);
+            GpuMesh mesh = builder.describe();
+            glm::vec3 size = mesh.boundsMax - mesh.boundsMin;
+            float extent = std::max(std::max(size.x, size.y), std::max(size.z, 1e-6f));
+            vertices += mesh.vertexCount;
+
+            auto start = chrono::high_resolution_clock::now();
+            VertexData floats = builder.pack(VERTEX_FLOAT);
+            packMs[0] += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+            start = chrono::high_resolution_clock::now();
+            VertexData packed = builder.pack(VERTEX_PACKED);
+            packMs[1] += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+            bytes[0] += floats.bytes.size();
+            bytes[1] += packed.bytes.size();
+
+            for (unsigned int v = 0; v < mesh.vertexCount; v++)
+            {
+                float exact[8], decoded[8];
+                floats.unpack(v, exact);
+                packed.unpack(v, decoded);
+                glm::vec3 normal(exact[3], exact[4], exact[5]);
+                if (!(glm::length(normal) > 0.5f))
+                    continue;           // the degenerate normals on the axis have no direction to keep
+                positionError = std::max(positionError, glm::length(glm::vec3(decoded[0], decoded[1], decoded[2]) - glm::vec3(exact[0], exact[1], exact[2])) / extent);
+                float cosAngle = glm::dot(glm::normalize(normal), glm::normalize(glm::vec3(decoded[3], decoded[4], decoded[5])));
+                normalErrorDegrees = std::max(normalErrorDegrees, glm::degrees(acos(std::min(cosAngle, 1.0f))));
+            }
+        }
+        cout << "vertex formats, detail x" << detail << ": " << vertices << " vertices, float " << bytes[0] / 1024 << " KB ("
+            << VertexData::strideOf(VERTEX_FLOAT, false) << " bytes each, " << packMs[0] << " ms), packed " << bytes[1] / 1024 << " KB ("
+            << VertexData::strideOf(VERTEX_PACKED, false) << " bytes each, " << packMs[1] << " ms), " << (double)bytes[0] / bytes[1]
+            << "x less to fetch; packed error: position " << positionError << " of the extent, normal " << normalErrorDegrees << " degrees" << endl;
+    }
+    cout << "    with texture coordinates (cubes, octagons): float " << VertexData::strideOf(VERTEX_FLOAT, true) << " bytes, packed "
+        << VertexData::strideOf(VERTEX_PACKED, true) << " bytes a vertex" << endl;
+}
+
+void benchmarkProfiles(BezierCurve* curves[], const char* names[], int curveCount)
+{
+    for (int i = 0; i < curveCount; i++)
+    {
+        const BezierCurve::CubicProfile& cubic = curves[i]->getProfile();
+        float sum = 0.0f, difference = 0.0f;
+        auto start = chrono::high_resolution_clock::now();
+        for (int k = 0; k <= PROFILE_BENCHMARK_SAMPLES; k++)
+        {
+            float xy[2];
+            curves[i]->evaluateBezier((double)k / PROFILE_BENCHMARK_SAMPLES, xy);
+            sum += xy[0] + xy[1];
+        }
+        double bezierNs = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count() / (PROFILE_BENCHMARK_SAMPLES + 1);
+        start = chrono::high_resolution_clock::now();
+        for (int k = 0; k <= PROFILE_BENCHMARK_SAMPLES; k++)
+        {
+            float xy[2];
+            cubic.evaluate((double)k / PROFILE_BENCHMARK_SAMPLES, xy);
+            sum += xy[0] + xy[1];
+        }
+        double cubicNs = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count() / (PROFILE_BENCHMARK_SAMPLES + 1);
+        for (int k = 0; k <= PROFILE_BENCHMARK_SAMPLES; k++)
+        {
+            float exact[2], fitted[2];
+            curves[i]->evaluateBezier((double)k / PROFILE_BENCHMARK_SAMPLES, exact);
+            cubic.evaluate((double)k / PROFILE_BENCHMARK_SAMPLES, fitted);
+            difference = std::max(difference, glm::length(glm::vec2(fitted[0] - exact[0], fitted[1] - exact[1])));
+        }
+        // stored so the timed loops are not optimized away
+        volatile float sink = sum;
+        (void)sink;
+        cout << "profile " << names[i] << ": degree " << curves[i]->cntrlPoints.size() / 3 - 1 << " Bezier " << bezierNs << " ns a point, "
+            << cubic.segments << " cubic segments " << cubicNs << " ns a point (" << bezierNs / cubicNs << "x), largest difference " << difference << endl;
+    }
 }
@@ -0,0 +1,172 @@
+//
+//  meshBuilder.h
+//  staging for generated meshes: the vertices are written once, interleaved position and
+//  normal, into storage reserved up front (from any std::pmr::memory_resource, an arena
+//  included), converted to a VertexFormat and copied into buffer objects by upload() and
+//  released right after. what stays resident is the GL names, the counts and the bounds
+//
+
+#ifndef meshBuilder_h
+#define meshBuilder_h
+
+#include <glad/glad.h>
+#include <memory_resource>
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "vertexFormat.h"
+#include "meshOptimizer.h"
+
+using namespace std;
+
+// a mesh that only lives on the GPU
+struct GpuMesh {
+    unsigned int vao = 0;
+    unsigned int vbo = 0;
+    unsigned int ebo = 0;
+    unsigned int vertexCount = 0;
+    unsigned int indexCount = 0;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    VertexFormat format = VERTEX_FLOAT;
+    glm::mat4 positionTransform = glm::mat4(1.0f);     // model * positionTransform is the draw's model matrix
+};
+
+class MeshBuilder {
+public:
+    static const int FLOATS_PER_VERTEX = 6;    // position, normal
+
+    // constructor, staging comes from resource and nothing is allocated before reserve() or the first vertex
+    MeshBuilder(pmr::memory_resource* resource = pmr::get_default_resource()) : vertices(resource), indices(resource)
+    {
+    }
+
+    // one allocation each when the counts are known, an upper bound is fine
+    void reserve(size_t vertexCount, size_t indexCount)
+    {
+        vertices.reserve(vertexCount * FLOATS_PER_VERTEX);
+        indices.reserve(indexCount);
+    }
+
+    void vertex(float x, float y, float z, float nx, float ny, float nz)
+    {
+        if (vertices.empty())
+            boundsMin = boundsMax = glm::vec3(x, y, z);
+        boundsMin = glm::min(boundsMin, glm::vec3(x, y, z));
+        boundsMax = glm::max(boundsMax, glm::vec3(x, y, z));
+        float values[FLOATS_PER_VERTEX] = { x, y, z, nx, ny, nz };
+        vertices.insert(vertices.end(), values, values + FLOATS_PER_VERTEX);
+    }
+
+    void triangle(unsigned int a, unsigned int b, unsigned int c)
+    {
+        unsigned int values[3] = { a, b, c };
+        indices.insert(indices.end(), values, values + 3);
+    }
+
+    unsigned int vertexCount() const
+    {
+        return (unsigned int)(vertices.size() / FLOATS_PER_VERTEX);
+    }
+
+    unsigned int indexCount() const
+    {
+        return (unsigned int)indices.size();
+    }
+
+    // bytes held while staging
+    size_t stagingBytes() const
+    {
+        return vertices.capacity() * sizeof(float) + indices.capacity() * sizeof(unsigned int);
+    }
+
+    // reorders the staged triangles and vertices for the vertex cache and overdraw, reported under name
+    void optimize(const char* name)
+    {
+        MeshOptimizer::optimize(name, indices.data(), indices.size(), vertices.data(), vertexCount(), FLOATS_PER_VERTEX);
+    }
+
+    // what upload() would return, without touching GL
+    GpuMesh describe() const
+    {
+        GpuMesh mesh;
+        mesh.vertexCount = vertexCount();
+        mesh.indexCount = indexCount();
+        mesh.boundsMin = boundsMin;
+        mesh.boundsMax = boundsMax;
+        return mesh;
+    }
+
+    // the staged vertices in format, for upload() or to compare the formats
+    VertexData pack(VertexFormat format) const
+    {
+        return VertexData(vertices.data(), vertexCount(), FLOATS_PER_VERTEX, false, format, vertices.get_allocator().resource());
+    }
+
+    // copies the staging into a new VAO (attribute 0 position, 1 normal) and releases it, needs the context
+    GpuMesh upload(VertexFormat format = VertexData::defaultFormat())
+    {
+        GpuMesh mesh = describe();
+        VertexData data = pack(format);
+        mesh.format = format;
+        mesh.positionTransform = data.positionTransform;
+        glGenVertexArrays(1, &mesh.vao);
+        glGenBuffers(1, &mesh.vbo);
+        glGenBuffers(1, &mesh.ebo);
+        glBindVertexArray(mesh.vao);
+
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+        glBufferData(GL_ARRAY_BUFFER, data.bytes.size(), data.bytes.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        data.setAttributes(true, false);
+
+        // the VAO first, so it keeps its element buffer
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+        release();
+        return mesh;
+    }
+
+    // copies the staging, packed into data in mesh's format, into the buffers upload() made for mesh and releases
+    // it, needs the context. both buffers are orphaned first, so the copy does not wait for draws still reading them
+    void update(GpuMesh& mesh, const VertexData& data)
+    {
+        GpuMesh described = describe();
+        mesh.vertexCount = described.vertexCount;
+        mesh.indexCount = described.indexCount;
+        mesh.boundsMin = described.boundsMin;
+        mesh.boundsMax = described.boundsMax;
+        mesh.positionTransform = data.positionTransform;
+        glBindVertexArray(mesh.vao);
+
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+        glBufferData(GL_ARRAY_BUFFER, data.bytes.size(), nullptr, GL_STATIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, data.bytes.size(), data.bytes.data());
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), nullptr, GL_STATIC_DRAW);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.size() * sizeof(unsigned int), indices.data());
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        release();
+    }
+
+    // gives the staging back to its resource
+    void release()
+    {
+        pmr::vector<float>(vertices.get_allocator()).swap(vertices);
+        pmr::vector<unsigned int>(indices.get_allocator()).swap(indices);
+    }
+
+private:
+    pmr::vector<float> vertices;
+    pmr::vector<unsigned int> indices;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+};
+
+#endif /* meshBuilder_h */
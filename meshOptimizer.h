@@ -0,0 +1,466 @@
+//
+//  meshOptimizer.h
+//  reorders a mesh for the GPU: triangles for the post-transform vertex cache (Forsyth's
+//  linear-speed algorithm), then clusters of them so the ones most likely to occlude the
+//  rest are drawn first (view independent, as in Tipsify), then the vertices in the order
+//  the indices first use them. the result of a mesh is cached on disk by its contents,
+//  and every optimized mesh reports its average cache miss ratio (ACMR) before and after
+//
+
+#ifndef meshOptimizer_h
+#define meshOptimizer_h
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+// optimized meshes are stored here, keyed on their vertices and indices
+#define MESH_CACHE_DIR "mesh_cache"
+
+class MeshOptimizer {
+public:
+    static constexpr int CACHE_SIZE = 16;           // FIFO cache the ACMR and the cluster boundaries are measured with
+    static constexpr int FORSYTH_CACHE_SIZE = 32;   // LRU cache the triangle order is scored with
+    static constexpr float OVERDRAW_THRESHOLD = 1.05f;  // ACMR the overdraw clusters may cost over the cache order
+
+    struct Report {
+        string name;
+        unsigned int vertices = 0;
+        unsigned int triangles = 0;
+        float acmrBefore = 0.0f;
+        float acmrAfter = 0.0f;
+        unsigned int clusters = 0;
+        bool cached = false;
+        bool skipped = false;       // indices outside the vertices, left as they are
+        double ms = 0.0;
+    };
+
+    // misses of a FIFO cache per triangle, 3 is the worst and 0.5 about the best a regular grid allows
+    static float acmr(const unsigned int* indices, size_t indexCount, unsigned int vertexCount, int cacheSize = CACHE_SIZE)
+    {
+        if (indexCount < 3)
+            return 0.0f;
+        FifoCache cache(vertexCount, cacheSize);
+        size_t misses = 0;
+        for (size_t i = 0; i < indexCount; i++)
+            misses += cache.miss(indices[i]) ? 1 : 0;
+        return (float)misses / (float)(indexCount / 3);
+    }
+
+    // all three passes on a mesh of vertexCount vertices, floatsPerVertex floats each with the position first.
+    // the indices and vertices are rewritten in place, a mesh optimized before is read from MESH_CACHE_DIR
+    static Report optimize(const char* name, unsigned int* indices, size_t indexCount, float* vertices, unsigned int vertexCount, int floatsPerVertex)
+    {
+        auto start = chrono::high_resolution_clock::now();
+        Report report;
+        report.name = name;
+        report.vertices = vertexCount;
+        report.triangles = (unsigned int)(indexCount / 3);
+        for (size_t i = 0; i < indexCount && !report.skipped; i++)
+            report.skipped = indices[i] >= vertexCount;
+        if (report.skipped || indexCount < 3)
+        {
+            report.skipped = true;
+            addReport(report);
+            return report;
+        }
+        report.acmrBefore = acmr(indices, indexCount, vertexCount);
+
+        string key = cacheKey(indices, indexCount, vertices, vertexCount, floatsPerVertex);
+        vector<unsigned int> optimized(indexCount), remap;
+        report.cached = load(key, optimized, remap, vertexCount, report.clusters);
+        if (!report.cached)
+        {
+            optimizeVertexCache(optimized.data(), indices, indexCount, vertexCount);
+            report.clusters = optimizeOverdraw(optimized.data(), indexCount, vertices, floatsPerVertex, vertexCount);
+            optimizeVertexFetch(optimized.data(), indexCount, vertexCount, remap);
+            save(key, optimized, remap, report.clusters);
+        }
+
+        memcpy(indices, optimized.data(), indexCount * sizeof(unsigned int));
+        vector<float> reordered((size_t)vertexCount * floatsPerVertex);
+        for (unsigned int v = 0; v < vertexCount; v++)
+            memcpy(&reordered[(size_t)remap[v] * floatsPerVertex], vertices + (size_t)v * floatsPerVertex, floatsPerVertex * sizeof(float));
+        memcpy(vertices, reordered.data(), reordered.size() * sizeof(float));
+
+        report.acmrAfter = acmr(indices, indexCount, vertexCount);
+        report.ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+        addReport(report);
+        return report;
+    }
+
+    // triangles in the order that keeps the most recently used vertices busiest (Forsyth). destination
+    // must not be indices
+    static void optimizeVertexCache(unsigned int* destination, const unsigned int* indices, size_t indexCount, unsigned int vertexCount)
+    {
+        size_t triangleCount = indexCount / 3;
+        // the triangles of every vertex, the first live[v] of its range are the ones not emitted yet
+        vector<unsigned int> offsets(vertexCount + 1, 0), live(vertexCount, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+            live[indices[i]]++;
+        for (unsigned int v = 0; v < vertexCount; v++)
+            offsets[v + 1] = offsets[v] + live[v];
+        vector<unsigned int> adjacency(triangleCount * 3), fill(offsets.begin(), offsets.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++)
+            for (int k = 0; k < 3; k++)
+                adjacency[fill[indices[t * 3 + k]]++] = (unsigned int)t;
+
+        vector<int> cachePosition(vertexCount, -1);
+        vector<float> vertexScore(vertexCount), triangleScore(triangleCount);
+        for (unsigned int v = 0; v < vertexCount; v++)
+            vertexScore[v] = forsythScore(-1, live[v]);
+        long long best = -1;
+        float bestScore = -1.0f;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+            if (triangleScore[t] > bestScore)
+            {
+                best = (long long)t;
+                bestScore = triangleScore[t];
+            }
+        }
+
+        vector<char> emitted(triangleCount, 0);
+        unsigned int cache[FORSYTH_CACHE_SIZE + 3];
+        int cacheCount = 0;
+        size_t deadEnd = 0;
+        for (size_t out = 0; out < triangleCount; out++)
+        {
+            if (best < 0)
+            {
+                // nothing in the cache has triangles left, continue with the next one in input order
+                while (emitted[deadEnd])
+                    deadEnd++;
+                best = (long long)deadEnd;
+            }
+            const unsigned int* triangle = indices + best * 3;
+            memcpy(destination + out * 3, triangle, 3 * sizeof(unsigned int));
+            emitted[best] = 1;
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int* list = &adjacency[offsets[triangle[k]]];
+                unsigned int& count = live[triangle[k]];
+                for (unsigned int j = 0; j < count; j++)
+                    if (list[j] == (unsigned int)best)
+                    {
+                        list[j] = list[--count];
+                        break;
+                    }
+            }
+
+            // the triangle's vertices move to the front, whatever falls off the end leaves the cache
+            unsigned int updated[FORSYTH_CACHE_SIZE + 3];
+            int updatedCount = 0;
+            for (int k = 0; k < 3; k++)
+                if (find(updated, updated + updatedCount, triangle[k]) == updated + updatedCount)
+                    updated[updatedCount++] = triangle[k];
+            for (int i = 0; i < cacheCount; i++)
+                if (find(updated, updated + updatedCount, cache[i]) == updated + updatedCount)
+                    updated[updatedCount++] = cache[i];
+            for (int i = 0; i < updatedCount; i++)
+            {
+                unsigned int v = updated[i];
+                cachePosition[v] = i < FORSYTH_CACHE_SIZE ? i : -1;
+                vertexScore[v] = forsythScore(cachePosition[v], live[v]);
+            }
+            cacheCount = std::min(updatedCount, FORSYTH_CACHE_SIZE);
+            memcpy(cache, updated, cacheCount * sizeof(unsigned int));
+
+            best = -1;
+            bestScore = -1.0f;
+            for (int i = 0; i < updatedCount; i++)
+            {
+                unsigned int v = updated[i];
+                for (unsigned int j = 0; j < live[v]; j++)
+                {
+                    unsigned int t = adjacency[offsets[v] + j];
+                    triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+                    if (triangleScore[t] > bestScore)
+                    {
+                        best = t;
+                        bestScore = triangleScore[t];
+                    }
+                }
+            }
+        }
+    }
+
+    // splits the cache ordered triangles into clusters where the cache starts over anyway, or where a split
+    // costs less than threshold times the cluster's ACMR, and draws the clusters facing away from the mesh
+    // centre first: from most views they are in front of the rest. returns the number of clusters
+    static unsigned int optimizeOverdraw(unsigned int* indices, size_t indexCount, const float* vertices, int floatsPerVertex, unsigned int vertexCount,
+        float threshold = OVERDRAW_THRESHOLD)
+    {
+        size_t triangleCount = indexCount / 3;
+        FifoCache cache(vertexCount, CACHE_SIZE);
+        auto misses = [&](size_t t)
+        {
+            return (cache.miss(indices[t * 3]) ? 1 : 0) + (cache.miss(indices[t * 3 + 1]) ? 1 : 0) + (cache.miss(indices[t * 3 + 2]) ? 1 : 0);
+        };
+        vector<size_t> hard;
+        for (size_t t = 0; t < triangleCount; t++)
+            if (misses(t) == 3 || t == 0)
+                hard.push_back(t);
+        hard.push_back(triangleCount);
+
+        vector<size_t> clusters;
+        for (size_t c = 0; c + 1 < hard.size(); c++)
+        {
+            size_t first = hard[c], end = hard[c + 1];
+            cache.flush();
+            size_t clusterMisses = 0;
+            for (size_t t = first; t < end; t++)
+                clusterMisses += misses(t);
+            float limit = threshold * (float)clusterMisses / (float)(end - first);
+            cache.flush();
+            clusters.push_back(first);
+            size_t segmentStart = first, segmentMisses = 0;
+            for (size_t t = first; t + 1 < end; t++)
+            {
+                segmentMisses += misses(t);
+                if ((float)segmentMisses <= limit * (float)(t + 1 - segmentStart))
+                {
+                    clusters.push_back(t + 1);
+                    cache.flush();
+                    segmentStart = t + 1;
+                    segmentMisses = 0;
+                }
+            }
+        }
+        clusters.push_back(triangleCount);
+
+        auto position = [&](unsigned int v)
+        {
+            const float* p = vertices + (size_t)v * floatsPerVertex;
+            return glm::vec3(p[0], p[1], p[2]);
+        };
+        // area weighted, the cross products are twice the areas
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        vector<glm::vec3> centroids(clusters.size() - 1, glm::vec3(0.0f)), normals(clusters.size() - 1, glm::vec3(0.0f));
+        for (size_t c = 0; c + 1 < clusters.size(); c++)
+        {
+            float area = 0.0f;
+            for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+            {
+                glm::vec3 a = position(indices[t * 3]), b = position(indices[t * 3 + 1]), d = position(indices[t * 3 + 2]);
+                glm::vec3 normal = glm::cross(b - a, d - a);
+                float triangleArea = glm::length(normal);
+                centroids[c] += (a + b + d) * (triangleArea / 3.0f);
+                normals[c] += normal;
+                area += triangleArea;
+            }
+            meshCentroid += centroids[c];
+            meshArea += area;
+            centroids[c] = area > 0.0f ? centroids[c] / area : position(indices[clusters[c] * 3]);
+        }
+        meshCentroid = meshArea > 0.0f ? meshCentroid / meshArea : glm::vec3(0.0f);
+
+        vector<float> sortKey(clusters.size() - 1);
+        vector<unsigned int> order(clusters.size() - 1);
+        for (size_t c = 0; c < order.size(); c++)
+        {
+            float length = glm::length(normals[c]);
+            sortKey[c] = length > 0.0f ? glm::dot(centroids[c] - meshCentroid, normals[c] / length) : 0.0f;
+            order[c] = (unsigned int)c;
+        }
+        stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return sortKey[a] > sortKey[b]; });
+
+        vector<unsigned int> sorted;
+        sorted.reserve(triangleCount * 3);
+        for (unsigned int c : order)
+            sorted.insert(sorted.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+        memcpy(indices, sorted.data(), sorted.size() * sizeof(unsigned int));
+        return (unsigned int)order.size();
+    }
+
+    // numbers the vertices in the order the indices first use them, remap[old] is the new number.
+    // vertices no index uses go last
+    static void optimizeVertexFetch(unsigned int* indices, size_t indexCount, unsigned int vertexCount, vector<unsigned int>& remap)
+    {
+        remap.assign(vertexCount, UNUSED);
+        unsigned int next = 0;
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            unsigned int& target = remap[indices[i]];
+            if (target == UNUSED)
+                target = next++;
+            indices[i] = target;
+        }
+        for (unsigned int v = 0; v < vertexCount; v++)
+            if (remap[v] == UNUSED)
+                remap[v] = next++;
+    }
+
+    // the reports of the meshes optimized since the last call, from any thread
+    static void printStats()
+    {
+        lock_guard<mutex> lock(reportLock());
+        for (const Report& report : reports())
+        {
+            cout << "mesh optimizer: " << report.name << ", " << report.vertices << " vertices, " << report.triangles << " triangles";
+            if (report.skipped)
+                cout << ", left unchanged (indices outside the vertices)" << endl;
+            else
+                cout << ", ACMR " << report.acmrBefore << " -> " << report.acmrAfter << " (FIFO " << CACHE_SIZE << "), " << report.clusters
+                    << " overdraw clusters, " << (report.cached ? "cached, " : "") << report.ms << " ms" << endl;
+        }
+        reports().clear();
+    }
+
+private:
+    static constexpr unsigned int UNUSED = 0xffffffffu;
+    static constexpr uint32_t MESH_CACHE_MAGIC = 0x314F4D42;    // "BMO1"
+
+    // a FIFO of vertices, a vertex is in it while fewer than size misses came after its own
+    struct FifoCache {
+        vector<unsigned int> insertedAt;
+        unsigned int time;
+        unsigned int size;
+
+        FifoCache(unsigned int vertexCount, int size) : insertedAt(vertexCount, 0), time((unsigned int)size + 1), size((unsigned int)size)
+        {
+        }
+
+        bool miss(unsigned int v)
+        {
+            if (time - insertedAt[v] <= size)
+                return false;
+            insertedAt[v] = time++;
+            return true;
+        }
+
+        void flush()
+        {
+            time += size + 1;
+        }
+    };
+
+    // Forsyth's vertex score: recently used vertices score high, the three of the last triangle a bit less
+    // so it is not repeated, and vertices with few triangles left are boosted to finish them off
+    static float forsythScore(int cachePosition, unsigned int liveTriangles)
+    {
+        if (liveTriangles == 0)
+            return -1.0f;
+        float score = 0.0f;
+        if (cachePosition >= 0)
+            score = cachePosition < 3 ? 0.75f : powf(1.0f - (float)(cachePosition - 3) / (FORSYTH_CACHE_SIZE - 3), 1.5f);
+        return score + 2.0f / sqrtf((float)liveTriangles);
+    }
+
+    static vector<Report>& reports()
+    {
+        static vector<Report> list;
+        return list;
+    }
+
+    static mutex& reportLock()
+    {
+        static mutex lock;
+        return lock;
+    }
+
+    static void addReport(const Report& report)
+    {
+        lock_guard<mutex> lock(reportLock());
+        reports().push_back(report);
+    }
+
+    // FNV-1a over the mesh and the settings
+    static string cacheKey(const unsigned int* indices, size_t indexCount, const float* vertices, unsigned int vertexCount, int floatsPerVertex)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](const void* data, size_t size)
+        {
+            const unsigned char* bytes = (const unsigned char*)data;
+            for (size_t i = 0; i < size; i++)
+            {
+                hash ^= bytes[i];
+                hash *= 1099511628211ull;
+            }
+        };
+        mix(indices, indexCount * sizeof(unsigned int));
+        mix(vertices, (size_t)vertexCount * floatsPerVertex * sizeof(float));
+        float settings[4] = { (float)CACHE_SIZE, (float)FORSYTH_CACHE_SIZE, OVERDRAW_THRESHOLD, (float)floatsPerVertex };
+        mix(settings, sizeof(settings));
+
+        stringstream key;
+        key << hex << hash;
+        return key.str();
+    }
+
+    static string cachePath(const string& key)
+    {
+        return string(MESH_CACHE_DIR) + "/" + key + ".bin";
+    }
+
+    static bool load(const string& key, vector<unsigned int>& indices, vector<unsigned int>& remap, unsigned int vertexCount, unsigned int& clusters)
+    {
+        ifstream file(cachePath(key), ios::binary);
+        if (!file)
+            return false;
+        uint32_t header[4] = {};
+        file.read((char*)header, sizeof(header));
+        if (!file || header[0] != MESH_CACHE_MAGIC || header[1] != vertexCount || header[2] != indices.size())
+            return false;
+        remap.resize(vertexCount);
+        file.read((char*)remap.data(), remap.size() * sizeof(unsigned int));
+        file.read((char*)indices.data(), indices.size() * sizeof(unsigned int));
+        if (!file)
+            return false;
+        for (unsigned int index : indices)
+            if (index >= vertexCount)
+                return false;
+        // remap has to be a permutation, or the vertices would be lost
+        vector<char> used(vertexCount, 0);
+        for (unsigned int target : remap)
+        {
+            if (target >= vertexCount || used[target])
+                return false;
+            used[target] = 1;
+        }
+        clusters = header[3];
+        return true;
+    }
+
+    // written under a name of its own first, meshes with the same contents may be built on two threads at once
+    static void save(const string& key, const vector<unsigned int>& indices, const vector<unsigned int>& remap, unsigned int clusters)
+    {
+        error_code error;
+        filesystem::create_directories(MESH_CACHE_DIR, error);
+        stringstream temporary;
+        temporary << cachePath(key) << "." << hash<thread::id>()(this_thread::get_id()) << ".tmp";
+        {
+            ofstream file(temporary.str(), ios::binary);
+            if (!file)
+            {
+                std::cout << "ERROR::MESH_OPTIMIZER::CACHE_NOT_WRITTEN: " << cachePath(key) << std::endl;
+                return;
+            }
+            uint32_t header[4] = { MESH_CACHE_MAGIC, (uint32_t)remap.size(), (uint32_t)indices.size(), clusters };
+            file.write((const char*)header, sizeof(header));
+            file.write((const char*)remap.data(), remap.size() * sizeof(unsigned int));
+            file.write((const char*)indices.data(), indices.size() * sizeof(unsigned int));
+        }
+        filesystem::rename(temporary.str(), cachePath(key), error);
+        if (error)
+            filesystem::remove(temporary.str(), error);
+    }
+};
+
+#endif /* meshOptimizer_h */
@@ -14,6 +14,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "shader.h"
+#include "vertexFormat.h"
 
 using namespace std;
 
@@ -91,7 +92,7 @@ public:
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_2D, this->specularMap);
 
-        lightingShaderWithTexture.setMat4("model", model);
+        lightingShaderWithTexture.setMat4("model", model * positionTransform);
 
         glBindVertexArray(lightTexOctagonVAO);
         glDrawElements(GL_TRIANGLES, 84, GL_UNSIGNED_INT, 0);
@@ -105,7 +106,7 @@ public:
         lightingShader.setVec3("material.specular", this->specular);
         lightingShader.setFloat("material.shininess", this->shininess);
 
-        lightingShader.setMat4("model", model);
+        lightingShader.setMat4("model", model * positionTransform);
 
         glBindVertexArray(lightOctagonVAO);
         glDrawElements(GL_TRIANGLES, 84, GL_UNSIGNED_INT, 0);
@@ -120,7 +121,7 @@ public:
         lightingShader.setVec3("material.specular", glm::vec3(r, g, b));
         lightingShader.setFloat("material.shininess", 32.0f);
 
-        lightingShader.setMat4("model", model);
+        lightingShader.setMat4("model", model * positionTransform);
 
         glBindVertexArray(octagonVAO);
         glDrawElements(GL_TRIANGLES, 84, GL_UNSIGNED_INT, 0);
@@ -147,6 +148,7 @@ private:
     unsigned int lightTexOctagonVAO;
     unsigned int octagonVBO;
     unsigned int octagonEBO;
+    glm::mat4 positionTransform = glm::mat4(1.0f);     // from the stored positions, see VertexData
 
     void setUpOctagonVertexDataAndConfigureVertexAttribute()
     {
@@ -278,6 +280,9 @@ private:
             44, 46, 47 //H AP A
         };
 
+        VertexData vertexData(octagon_vertices, 48, 8, true);
+        positionTransform = vertexData.positionTransform;
+
         glGenVertexArrays(1, &octagonVAO);
         glGenVertexArrays(1, &lightOctagonVAO);
         glGenVertexArrays(1, &lightTexOctagonVAO);
@@ -288,22 +293,13 @@ private:
         glBindVertexArray(lightTexOctagonVAO);
 
         glBindBuffer(GL_ARRAY_BUFFER, octagonVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(octagon_vertices), octagon_vertices, GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, vertexData.bytes.size(), vertexData.bytes.data(), GL_STATIC_DRAW);
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, octagonEBO);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(octagon_indices), octagon_indices, GL_STATIC_DRAW);
 
-        // position attribute
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
-
-        // vertex normal attribute
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)12);
-        glEnableVertexAttribArray(1);
-
-        // texture coordinate attribute
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)24);
-        glEnableVertexAttribArray(2);
+        // position, vertex normal and texture coordinate attributes
+        vertexData.setAttributes(true, true);
 
 
         glBindVertexArray(lightOctagonVAO);
@@ -311,11 +307,7 @@ private:
         glBindBuffer(GL_ARRAY_BUFFER, octagonVBO);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, octagonEBO);
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
-
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)12);
-        glEnableVertexAttribArray(1);
+        vertexData.setAttributes(true, false);
 
 
         glBindVertexArray(octagonVAO);
@@ -323,8 +315,7 @@ private:
         glBindBuffer(GL_ARRAY_BUFFER, octagonVBO);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, octagonEBO);
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
+        vertexData.setAttributes(false, false);
     }
 
 };
@@ -0,0 +1,697 @@
+//
+//  pathTracer.h
+//  offline path tracer for reference images of the static scene. the triangles and
+//  materials are captured with transform feedback like for the lightmap, the BVH is
+//  built on all cores and paths are traced in SSE packets of 4. tiles go through
+//  per thread queues that idle threads steal from, and the accumulated samples are
+//  checkpointed to disk so a long render can be resumed
+//
+
+#ifndef pathTracer_h
+#define pathTracer_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <deque>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <cstdint>
+#include <cmath>
+#include <iostream>
+#include "shader.h"
+#include "bvh.h"
+#include "sceneCapture.h"
+#include "pngWriter.h"
+#include "pointLight.h"
+#include "directionLight.h"
+#include "spotLight.h"
+
+using namespace std;
+
+// checkpoints and finished images, keyed on the geometry, the lights, the camera and the settings
+#define PATH_TRACER_DIR "reference_renders"
+
+class PathTracer {
+public:
+    int width;
+    int height;
+    int maxBounces;             // indirect bounces after the camera ray, russian roulette from the third
+    int threadCount;
+    bool ambientTerm = true;    // the lights' unshadowed ambient at the first hit, like the forward shaders. off for a purely physical image
+    glm::vec3 background = glm::vec3(0.1f);    // seen by camera rays that miss, the clear colour
+
+    // statistics, the ray counts and times are summed over the render() calls since prepare()
+    unsigned int triangleCount = 0;
+    int samplesPerPixel = 0;
+    int resumedSamples = 0;     // part of samplesPerPixel that came from a checkpoint
+    unsigned long long raysTraced = 0;
+    unsigned long long tilesStolen = 0;
+    double captureMs = 0.0;
+    double bvhMs = 0.0;
+    double traceMs = 0.0;
+
+    // constructor, needs a current context
+    PathTracer(int width, int height, int maxBounces = 4)
+        : captureShader("vertexShaderForCapture.vs", "fragmentShaderForShadowDepth.fs", nullptr, "", false,
+            { "worldPos", "worldNormal", "ambientColor", "diffuseColor", "specularColor", "shininess" })
+    {
+        this->width = width;
+        this->height = height;
+        this->maxBounces = maxBounces;
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // lights are taken with their current on/off state
+    void clearLights()
+    {
+        lights.clear();
+    }
+    void addLight(const PointLight& light)
+    {
+        if (!light.isOn())
+            return;
+        TraceLight traceLight;
+        traceLight.type = TraceLight::POINT;
+        traceLight.position = light.position;
+        traceLight.ambient = light.getAmbient();
+        traceLight.diffuse = light.getDiffuse();
+        traceLight.specular = light.getSpecular();
+        traceLight.k_c = light.k_c;
+        traceLight.k_l = light.k_l;
+        traceLight.k_q = light.k_q;
+        traceLight.range = light.radius;
+        lights.push_back(traceLight);
+    }
+    void addLight(const DirectionLight& light)
+    {
+        if (!light.isOn())
+            return;
+        TraceLight traceLight;
+        traceLight.type = TraceLight::DIRECTION;
+        traceLight.direction = glm::normalize(light.direction);
+        traceLight.ambient = light.getAmbient();
+        traceLight.diffuse = light.getDiffuse();
+        traceLight.specular = light.getSpecular();
+        lights.push_back(traceLight);
+    }
+    void addLight(const SpotLight& light)
+    {
+        if (!light.isOn())
+            return;
+        TraceLight traceLight;
+        traceLight.type = TraceLight::SPOT;
+        traceLight.position = light.position;
+        traceLight.direction = glm::normalize(light.direction);
+        traceLight.ambient = light.getAmbient();
+        traceLight.diffuse = light.getDiffuse();
+        traceLight.specular = light.getSpecular();
+        traceLight.k_c = light.k_c;
+        traceLight.k_l = light.k_l;
+        traceLight.k_q = light.k_q;
+        traceLight.cosCutOff = glm::cos(glm::radians(light.Angle));
+        lights.push_back(traceLight);
+    }
+
+    // rays start on the near plane, through the same pixels the rasterizer covers
+    void setCamera(const glm::mat4& projection, const glm::mat4& view)
+    {
+        cameraProjection = projection;
+        cameraView = view;
+        inverseViewProjection = glm::inverse(projection * view);
+    }
+
+    // captures the geometry on the first call. when the scene, lights, camera or settings differ from
+    // the image being accumulated it starts over, from a checkpoint of the new setup if there is one
+    void prepare(const function<void(Shader&)>& drawStatic)
+    {
+        if (triangles.empty())
+        {
+            auto start = chrono::high_resolution_clock::now();
+            triangleCount = captureTriangles(captureShader, drawStatic, triangles, positions);
+            captureMs = elapsedMs(start);
+            start = chrono::high_resolution_clock::now();
+            bvh.build(positions, threadCount);
+            bvhMs = elapsedMs(start);
+        }
+
+        raysTraced = 0;
+        tilesStolen = 0;
+        traceMs = 0.0;
+        string key = cacheKey();
+        if (key == accumulatedKey)
+            return;
+        accumulatedKey = key;
+        accumulation.assign((size_t)width * height * 3, 0.0f);
+        samplesPerPixel = 0;
+        resumedSamples = loadCheckpoint() ? samplesPerPixel : 0;
+    }
+
+    // the static geometry changed: the next prepare() captures it again and starts a new image
+    void invalidateGeometry()
+    {
+        triangles.clear();
+        positions.clear();
+    }
+
+    // adds samples paths to every pixel
+    void render(int samples)
+    {
+        if (samples <= 0 || accumulation.empty())
+            return;
+        int tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+        int tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+        int tileCount = tilesX * tilesY;
+
+        // every thread starts with a contiguous block of tiles, works it from the back and
+        // steals from the front of the others once its own queue runs dry
+        vector<TileQueue> queues(threadCount);
+        for (int tile = 0; tile < tileCount; tile++)
+            queues[(size_t)tile * threadCount / tileCount].tiles.push_back(tile);
+
+        int firstSample = samplesPerPixel;
+        atomic<unsigned long long> totalRays(0);
+        atomic<unsigned long long> totalSteals(0);
+        auto worker = [&](int self)
+        {
+            unsigned long long rays = 0;
+            unsigned long long steals = 0;
+            int tile;
+            while (nextTile(queues, self, tile, steals))
+            {
+                int x0 = (tile % tilesX) * TILE_SIZE;
+                int y0 = (tile / tilesX) * TILE_SIZE;
+                renderTile(x0, y0, std::min(x0 + TILE_SIZE, width), std::min(y0 + TILE_SIZE, height), firstSample, samples, rays);
+            }
+            totalRays += rays;
+            totalSteals += steals;
+        };
+
+        auto start = chrono::high_resolution_clock::now();
+        vector<thread> workers;
+        for (int i = 1; i < threadCount; i++)
+            workers.emplace_back(worker, i);
+        worker(0);
+        for (thread& t : workers)
+            t.join();
+        traceMs += elapsedMs(start);
+        raysTraced += totalRays;
+        tilesStolen += totalSteals;
+        samplesPerPixel += samples;
+    }
+
+    // written through a temporary file, so a render killed while saving keeps the previous checkpoint
+    bool saveCheckpoint() const
+    {
+        error_code error;
+        filesystem::create_directories(PATH_TRACER_DIR, error);
+        string path = checkpointPath();
+        string temporaryPath = path + ".tmp";
+        {
+            ofstream file(temporaryPath, ios::binary);
+            if (!file)
+            {
+                std::cout << "ERROR::PATH_TRACER::CHECKPOINT_NOT_WRITTEN: " << path << std::endl;
+                return false;
+            }
+            uint32_t header[4] = { CHECKPOINT_MAGIC, (uint32_t)width, (uint32_t)height, (uint32_t)samplesPerPixel };
+            file.write((const char*)header, sizeof(header));
+            file.write((const char*)accumulation.data(), accumulation.size() * sizeof(float));
+            if (!file)
+            {
+                std::cout << "ERROR::PATH_TRACER::CHECKPOINT_NOT_WRITTEN: " << path << std::endl;
+                return false;
+            }
+        }
+        filesystem::rename(temporaryPath, path, error);
+        return !error;
+    }
+
+    // the average so far, clamped like the framebuffer
+    bool writePNG() const
+    {
+        error_code error;
+        filesystem::create_directories(PATH_TRACER_DIR, error);
+        vector<unsigned char> rgb(accumulation.size());
+        float scale = samplesPerPixel > 0 ? 1.0f / samplesPerPixel : 0.0f;
+        for (size_t i = 0; i < accumulation.size(); i++)
+            rgb[i] = (unsigned char)(std::min(std::max(accumulation[i] * scale, 0.0f), 1.0f) * 255.0f + 0.5f);
+        return PngWriter::write(imagePath(), width, height, rgb);
+    }
+
+    string imagePath() const
+    {
+        return string(PATH_TRACER_DIR) + "/" + accumulatedKey + ".png";
+    }
+
+    void printStats()
+    {
+        cout << "path tracer: " << triangleCount << " triangles, " << width << "x" << height << " at " << samplesPerPixel << " samples per pixel";
+        if (resumedSamples > 0)
+            cout << " (" << resumedSamples << " from the checkpoint)";
+        cout << ", " << imagePath() << endl;
+        cout << "  capture " << captureMs << " ms, bvh " << bvhMs << " ms on " << threadCount << " threads (" << bvh.nodeCount << " nodes, "
+            << bvh.leafCount << " leaves)" << endl;
+        double mraysPerSecond = traceMs > 0.0 ? raysTraced / (traceMs * 1000.0) : 0.0;
+        cout << "  trace " << traceMs << " ms, " << raysTraced << " rays, " << mraysPerSecond << " Mrays/s, "
+            << mraysPerSecond / threadCount << " Mrays/s per core, " << tilesStolen << " tiles stolen" << endl;
+    }
+
+private:
+    struct TraceLight {
+        enum Type { POINT, DIRECTION, SPOT } type = POINT;
+        glm::vec3 position = glm::vec3(0.0f);
+        glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+        glm::vec3 ambient = glm::vec3(0.0f);
+        glm::vec3 diffuse = glm::vec3(0.0f);
+        glm::vec3 specular = glm::vec3(0.0f);
+        float k_c = 1.0f;
+        float k_l = 0.0f;
+        float k_q = 0.0f;
+        float cosCutOff = -1.0f;
+        float range = FLT_MAX;
+    };
+    struct CapturedVertex {
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec3 ambient;
+        glm::vec3 diffuse;
+        glm::vec3 specular;
+        float shininess;
+    };
+    struct TileQueue {
+        mutex lock;
+        deque<int> tiles;
+    };
+    // where a path is and what it carries, one per packet lane
+    struct PathState {
+        Ray ray;
+        glm::vec3 throughput = glm::vec3(1.0f);
+        glm::vec3 radiance = glm::vec3(0.0f);
+        bool alive = true;
+    };
+    // the surface a lane hit, kept while its shadow rays are traced
+    struct SurfacePoint {
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec3 offset;       // geometric normal on the side the ray came from
+        glm::vec3 view;
+        glm::vec3 ambient, diffuse, specular;
+        float shininess;
+    };
+    // PCG seeded per pixel and sample, so an image does not depend on the thread count,
+    // on which thread rendered a tile or on where a checkpoint was taken
+    struct Random {
+        uint64_t state;
+        Random(uint32_t pixel, uint32_t sample)
+        {
+            state = (pixel + 1) * 0x9E3779B97F4A7C15ull ^ (sample + 1) * 0xD1B54A32D192ED03ull;
+            next();
+        }
+        float next()
+        {
+            uint64_t old = state;
+            state = old * 6364136223846793005ull + 1442695040888963407ull;
+            uint32_t shifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+            uint32_t rotation = (uint32_t)(old >> 59u);
+            uint32_t bits = (shifted >> rotation) | (shifted << ((32 - rotation) & 31));
+            return (bits >> 8) * (1.0f / 16777216.0f);
+        }
+    };
+    static const int TILE_SIZE = 16;
+    static const uint32_t CHECKPOINT_MAGIC = 0x31435450;    // "PTC1"
+
+    Shader captureShader;
+    vector<TraceLight> lights;
+    glm::mat4 cameraProjection = glm::mat4(1.0f);
+    glm::mat4 cameraView = glm::mat4(1.0f);
+    glm::mat4 inverseViewProjection = glm::mat4(1.0f);
+
+    vector<CapturedVertex> triangles;           // 3 vertices per triangle
+    vector<glm::vec3> positions;
+    Bvh bvh;
+    vector<float> accumulation;                 // RGB sums, bottom row first
+    string accumulatedKey;
+
+    static double elapsedMs(chrono::high_resolution_clock::time_point start)
+    {
+        return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    }
+
+    bool nextTile(vector<TileQueue>& queues, int self, int& tile, unsigned long long& steals) const
+    {
+        {
+            lock_guard<mutex> guard(queues[self].lock);
+            if (!queues[self].tiles.empty())
+            {
+                tile = queues[self].tiles.back();
+                queues[self].tiles.pop_back();
+                return true;
+            }
+        }
+        for (int i = 1; i < (int)queues.size(); i++)
+        {
+            TileQueue& victim = queues[(self + i) % queues.size()];
+            lock_guard<mutex> guard(victim.lock);
+            if (!victim.tiles.empty())
+            {
+                tile = victim.tiles.front();
+                victim.tiles.pop_front();
+                steals++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 2x2 pixel quads make up the packets, so the camera rays of a packet stay coherent
+    void renderTile(int x0, int y0, int x1, int y1, int firstSample, int samples, unsigned long long& rays)
+    {
+        for (int y = y0; y < y1; y += 2)
+        {
+            for (int x = x0; x < x1; x += 2)
+            {
+                int pixels[4];
+                for (int lane = 0; lane < 4; lane++)
+                {
+                    int px = x + (lane & 1), py = y + (lane >> 1);
+                    pixels[lane] = (px < x1 && py < y1) ? py * width + px : -1;
+                }
+                for (int sample = firstSample; sample < firstSample + samples; sample++)
+                {
+                    glm::vec3 color[4];
+                    tracePackets(pixels, sample, color, rays);
+                    for (int lane = 0; lane < 4; lane++)
+                    {
+                        if (pixels[lane] < 0)
+                            continue;
+                        float* sum = &accumulation[(size_t)pixels[lane] * 3];
+                        sum[0] += color[lane].x;
+                        sum[1] += color[lane].y;
+                        sum[2] += color[lane].z;
+                    }
+                }
+            }
+        }
+    }
+
+    template <typename T>
+    static T interpolate(const T& a, const T& b, const T& c, float u, float v)
+    {
+        return a * (1.0f - u - v) + b * u + c * v;
+    }
+
+    static float luminance(const glm::vec3& color)
+    {
+        return 0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z;
+    }
+
+    // unit vector around axis, cos(angle to axis) = cosTheta
+    static glm::vec3 aroundAxis(const glm::vec3& axis, float cosTheta, float phi)
+    {
+        glm::vec3 tangent = fabs(axis.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+        tangent = glm::normalize(glm::cross(tangent, axis));
+        glm::vec3 bitangent = glm::cross(axis, tangent);
+        float sinTheta = sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+        return glm::normalize(tangent * (sinTheta * cos(phi)) + bitangent * (sinTheta * sin(phi)) + axis * cosTheta);
+    }
+
+    // one path per lane. direct light evaluates exactly the terms of the forward shaders, with shadow
+    // rays, so an unshadowed surface matches the rasterizer. the bounces sample the energy conserving
+    // versions of the same lobes: Lambert with albedo K_D and a normalized Phong lobe of weight K_S
+    void tracePackets(const int pixels[4], int sample, glm::vec3 color[4], unsigned long long& rays) const
+    {
+        PathState paths[4];
+        Random random[4] = {
+            Random((uint32_t)pixels[0], (uint32_t)sample), Random((uint32_t)pixels[1], (uint32_t)sample),
+            Random((uint32_t)pixels[2], (uint32_t)sample), Random((uint32_t)pixels[3], (uint32_t)sample) };
+        for (int lane = 0; lane < 4; lane++)
+        {
+            paths[lane].alive = pixels[lane] >= 0;
+            if (!paths[lane].alive)
+                continue;
+            float px = (pixels[lane] % width) + random[lane].next();
+            float py = (pixels[lane] / width) + random[lane].next();
+            glm::vec2 ndc(px / width * 2.0f - 1.0f, py / height * 2.0f - 1.0f);
+            glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc.x, ndc.y, -1.0f, 1.0f);
+            glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc.x, ndc.y, 1.0f, 1.0f);
+            glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+            paths[lane].ray.origin = origin;
+            paths[lane].ray.direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+        }
+
+        for (int bounce = 0; bounce <= maxBounces; bounce++)
+        {
+            RayPacket packet;
+            for (int lane = 0; lane < 4; lane++)
+            {
+                packet.set(lane, paths[lane].ray);
+                packet.active[lane] = paths[lane].alive;
+            }
+            if (!packet.active[0] && !packet.active[1] && !packet.active[2] && !packet.active[3])
+                break;
+            RayHit hits[4];
+            bvh.intersect(packet, hits);
+
+            SurfacePoint surfaces[4];
+            for (int lane = 0; lane < 4; lane++)
+            {
+                PathState& path = paths[lane];
+                if (!path.alive)
+                    continue;
+                rays++;
+                if (hits[lane].triangle < 0)
+                {
+                    if (bounce == 0)
+                        path.radiance += background;
+                    path.alive = false;
+                    continue;
+                }
+                surfaces[lane] = surfaceAt(hits[lane], path.ray.direction);
+                if (bounce == 0 && ambientTerm)
+                    path.radiance += surfaces[lane].ambient * ambientLight(surfaces[lane].position);
+            }
+
+            directLight(paths, surfaces, rays);
+
+            for (int lane = 0; lane < 4; lane++)
+            {
+                PathState& path = paths[lane];
+                if (!path.alive)
+                    continue;
+                if (bounce == maxBounces || !scatter(path, surfaces[lane], random[lane]))
+                    path.alive = false;
+                else if (bounce >= 2)
+                {
+                    float survival = std::min(0.95f, std::max(path.throughput.x, std::max(path.throughput.y, path.throughput.z)));
+                    if (random[lane].next() >= survival)
+                        path.alive = false;
+                    else
+                        path.throughput /= survival;
+                }
+            }
+        }
+
+        for (int lane = 0; lane < 4; lane++)
+            color[lane] = paths[lane].radiance;
+    }
+
+    SurfacePoint surfaceAt(const RayHit& hit, const glm::vec3& direction) const
+    {
+        const CapturedVertex* vertex = &triangles[hit.triangle * 3];
+        float u = hit.u, v = hit.v;
+        SurfacePoint surface;
+        surface.position = interpolate(vertex[0].position, vertex[1].position, vertex[2].position, u, v);
+        surface.normal = glm::normalize(interpolate(vertex[0].normal, vertex[1].normal, vertex[2].normal, u, v));
+        surface.ambient = interpolate(vertex[0].ambient, vertex[1].ambient, vertex[2].ambient, u, v);
+        surface.diffuse = interpolate(vertex[0].diffuse, vertex[1].diffuse, vertex[2].diffuse, u, v);
+        surface.specular = interpolate(vertex[0].specular, vertex[1].specular, vertex[2].specular, u, v);
+        surface.shininess = std::max(1.0f, vertex[0].shininess);
+        surface.view = -direction;
+        // the architecture is drawn double sided, shade the side the ray arrived at
+        if (glm::dot(surface.normal, direction) > 0.0f)
+            surface.normal = -surface.normal;
+        glm::vec3 e1 = vertex[1].position - vertex[0].position;
+        glm::vec3 e2 = vertex[2].position - vertex[0].position;
+        glm::vec3 geometric = glm::cross(e1, e2);
+        float length = glm::length(geometric);
+        surface.offset = length > 0.0f ? geometric / length : surface.normal;
+        if (glm::dot(surface.offset, direction) > 0.0f)
+            surface.offset = -surface.offset;
+        return surface;
+    }
+
+    // direction to the light, its distance and the attenuation (with the spot cone) at p
+    bool lightAt(const TraceLight& light, const glm::vec3& p, glm::vec3& L, float& distance, float& attenuation) const
+    {
+        attenuation = 1.0f;
+        distance = FLT_MAX;
+        if (light.type == TraceLight::DIRECTION)
+        {
+            L = -light.direction;
+            return true;
+        }
+        distance = glm::length(light.position - p);
+        if (distance > light.range || distance <= 0.0f)
+            return false;
+        L = (light.position - p) / distance;
+        attenuation = 1.0f / (light.k_c + light.k_l * distance + light.k_q * distance * distance);
+        if (light.type == TraceLight::SPOT)
+        {
+            float cosAlpha = glm::dot(L, -light.direction);
+            attenuation *= cosAlpha >= light.cosCutOff ? cosAlpha : 0.0f;
+        }
+        return attenuation > 0.0f;
+    }
+
+    glm::vec3 ambientLight(const glm::vec3& p) const
+    {
+        glm::vec3 ambient(0.0f);
+        for (const TraceLight& light : lights)
+        {
+            glm::vec3 L;
+            float distance, attenuation;
+            if (lightAt(light, p, L, distance, attenuation))
+                ambient += light.ambient * attenuation;
+        }
+        return ambient;
+    }
+
+    // the 4 lanes' shadow rays towards one light go out as one packet
+    void directLight(PathState paths[4], const SurfacePoint surfaces[4], unsigned long long& rays) const
+    {
+        for (const TraceLight& light : lights)
+        {
+            RayPacket packet;
+            glm::vec3 contribution[4];
+            for (int lane = 0; lane < 4; lane++)
+            {
+                packet.active[lane] = false;
+                if (!paths[lane].alive)
+                    continue;
+                const SurfacePoint& surface = surfaces[lane];
+                glm::vec3 L;
+                float distance, attenuation;
+                if (!lightAt(light, surface.position, L, distance, attenuation))
+                    continue;
+                float nDotL = glm::dot(surface.normal, L);
+                if (nDotL <= 0.0f)
+                    continue;
+                glm::vec3 R = glm::reflect(-L, surface.normal);
+                glm::vec3 diffuse = surface.diffuse * nDotL * light.diffuse;
+                glm::vec3 specular = surface.specular * pow(std::max(glm::dot(surface.view, R), 0.0f), surface.shininess) * light.specular;
+                contribution[lane] = paths[lane].throughput * (diffuse + specular) * attenuation;
+                Ray ray;
+                ray.origin = surface.position + surface.offset * 0.01f;
+                ray.direction = L;
+                ray.tMax = distance == FLT_MAX ? FLT_MAX : distance - 0.02f;
+                packet.set(lane, ray);
+            }
+            if (!packet.active[0] && !packet.active[1] && !packet.active[2] && !packet.active[3])
+                continue;
+            bool blocked[4];
+            bvh.occluded(packet, blocked);
+            for (int lane = 0; lane < 4; lane++)
+            {
+                if (!packet.active[lane])
+                    continue;
+                rays++;
+                if (!blocked[lane])
+                    paths[lane].radiance += contribution[lane];
+            }
+        }
+    }
+
+    // picks the diffuse or the specular lobe by their weight and samples it, false ends the path
+    bool scatter(PathState& path, const SurfacePoint& surface, Random& random) const
+    {
+        float diffuseWeight = luminance(surface.diffuse);
+        float specularWeight = luminance(surface.specular);
+        if (diffuseWeight + specularWeight <= 0.0f)
+            return false;
+        float diffuseChance = diffuseWeight / (diffuseWeight + specularWeight);
+        glm::vec3 direction;
+        if (random.next() < diffuseChance)
+        {
+            // cosine weighted, the cosine and the 1/pi cancel against the pdf
+            direction = aroundAxis(surface.normal, sqrt(random.next()), 6.2831853f * random.next());
+            path.throughput *= surface.diffuse / diffuseChance;
+        }
+        else
+        {
+            // cos^n around the mirror direction, what is left of the normalized lobe over the pdf is (n + 2) / (n + 1) * cos
+            glm::vec3 mirror = glm::reflect(-surface.view, surface.normal);
+            float cosAlpha = pow(random.next(), 1.0f / (surface.shininess + 1.0f));
+            direction = aroundAxis(mirror, cosAlpha, 6.2831853f * random.next());
+            float cosTheta = glm::dot(direction, surface.normal);
+            if (cosTheta <= 0.0f)
+                return false;
+            path.throughput *= surface.specular * ((surface.shininess + 2.0f) / (surface.shininess + 1.0f) * cosTheta / (1.0f - diffuseChance));
+        }
+        path.ray.origin = surface.position + surface.offset * 0.01f;
+        path.ray.direction = direction;
+        path.ray.tMax = FLT_MAX;
+        return true;
+    }
+
+    // FNV-1a over the captured geometry, the lights, the camera and the settings
+    string cacheKey() const
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](const void* data, size_t size)
+        {
+            const unsigned char* bytes = (const unsigned char*)data;
+            for (size_t i = 0; i < size; i++)
+            {
+                hash ^= bytes[i];
+                hash *= 1099511628211ull;
+            }
+        };
+        if (!triangles.empty())
+            mix(triangles.data(), triangles.size() * sizeof(CapturedVertex));
+        for (const TraceLight& light : lights)
+            mix(&light, sizeof(TraceLight));
+        mix(&cameraProjection, sizeof(cameraProjection));
+        mix(&cameraView, sizeof(cameraView));
+        mix(&background, sizeof(background));
+        int settings[4] = { width, height, maxBounces, ambientTerm ? 1 : 0 };
+        mix(settings, sizeof(settings));
+
+        stringstream key;
+        key << hex << hash;
+        return key.str();
+    }
+
+    string checkpointPath() const
+    {
+        return string(PATH_TRACER_DIR) + "/" + accumulatedKey + ".accum";
+    }
+
+    bool loadCheckpoint()
+    {
+        ifstream file(checkpointPath(), ios::binary);
+        if (!file)
+            return false;
+        uint32_t header[4] = {};
+        file.read((char*)header, sizeof(header));
+        if (!file || header[0] != CHECKPOINT_MAGIC || (int)header[1] != width || (int)header[2] != height)
+            return false;
+        vector<float> loaded(accumulation.size());
+        file.read((char*)loaded.data(), loaded.size() * sizeof(float));
+        if (!file)
+            return false;
+        accumulation.swap(loaded);
+        samplesPerPixel = (int)header[3];
+        return true;
+    }
+};
+
+#endif /* pathTracer_h */
@@ -0,0 +1,107 @@
+//
+//  pngWriter.h
+//  minimal PNG encoder for render checks and reference images: 8 bit RGB rows in
+//  uncompressed deflate blocks, which keeps the writer small
+//
+
+#ifndef pngWriter_h
+#define pngWriter_h
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+
+using namespace std;
+
+class PngWriter {
+public:
+    // rgb holds width * height RGB8 pixels, bottom row first like glReadPixels
+    static bool write(const string& path, int width, int height, const vector<unsigned char>& rgb)
+    {
+        vector<unsigned char> raw;
+        raw.reserve((size_t)(width * 3 + 1) * height);
+        for (int y = height - 1; y >= 0; y--)
+        {
+            raw.push_back(0);   // no filter
+            raw.insert(raw.end(), rgb.begin() + (size_t)y * width * 3, rgb.begin() + (size_t)(y + 1) * width * 3);
+        }
+
+        vector<unsigned char> zlib = { 0x78, 0x01 };
+        for (size_t offset = 0; offset < raw.size() || offset == 0; offset += 65535)
+        {
+            size_t length = std::min<size_t>(65535, raw.size() - offset);
+            zlib.push_back(offset + length >= raw.size() ? 1 : 0);
+            zlib.push_back(length & 0xFF);
+            zlib.push_back((length >> 8) & 0xFF);
+            zlib.push_back(~length & 0xFF);
+            zlib.push_back((~length >> 8) & 0xFF);
+            zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+            if (raw.empty())
+                break;
+        }
+        uint32_t a = 1, b = 0;
+        for (unsigned char c : raw)
+        {
+            a = (a + c) % 65521;
+            b = (b + a) % 65521;
+        }
+        appendBigEndian(zlib, (b << 16) | a);
+
+        ofstream file(path, ios::binary);
+        if (!file)
+        {
+            std::cout << "ERROR::PNG_WRITER::FILE_NOT_WRITTEN: " << path << std::endl;
+            return false;
+        }
+        const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        file.write((const char*)signature, 8);
+        vector<unsigned char> header;
+        appendBigEndian(header, (uint32_t)width);
+        appendBigEndian(header, (uint32_t)height);
+        header.insert(header.end(), { 8, 2, 0, 0, 0 });    // 8 bit RGB
+        writeChunk(file, "IHDR", header);
+        writeChunk(file, "IDAT", zlib);
+        writeChunk(file, "IEND", vector<unsigned char>());
+        return (bool)file;
+    }
+
+private:
+    static void appendBigEndian(vector<unsigned char>& out, uint32_t value)
+    {
+        out.push_back((value >> 24) & 0xFF);
+        out.push_back((value >> 16) & 0xFF);
+        out.push_back((value >> 8) & 0xFF);
+        out.push_back(value & 0xFF);
+    }
+
+    static void writeChunk(ofstream& file, const char* type, const vector<unsigned char>& data)
+    {
+        static uint32_t table[256];
+        static bool tableReady = false;
+        if (!tableReady)
+        {
+            for (uint32_t n = 0; n < 256; n++)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                table[n] = c;
+            }
+            tableReady = true;
+        }
+        vector<unsigned char> chunk;
+        appendBigEndian(chunk, (uint32_t)data.size());
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        uint32_t crc = 0xFFFFFFFFu;
+        for (size_t i = 4; i < chunk.size(); i++)
+            crc = table[(crc ^ chunk[i]) & 0xFF] ^ (crc >> 8);
+        appendBigEndian(chunk, crc ^ 0xFFFFFFFFu);
+        file.write((const char*)chunk.data(), chunk.size());
+    }
+};
+
+#endif /* pngWriter_h */
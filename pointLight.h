@@ -8,7 +8,12 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
 #include "shader.h"
+#include "localLightShadows.h"
+#include "frameArena.h"
 
 class PointLight {
 public:
@@ -19,7 +24,9 @@ public:
     float k_c;
     float k_l;
     float k_q;
+    float radius;       // distance beyond which the light contributes nothing visible
     int lightNumber;
+    PointShadowMap* shadows = nullptr;  // set once there is a GL context, null means no shadows
 
     PointLight(float posX, float posY, float posZ, float ambR, float ambG, float ambB, float diffR, float diffG, float diffB, float specR, float specG, float specB, float constant, float linear, float quadratic, int num) {
 
@@ -31,6 +38,38 @@ public:
         k_l = linear;
         k_q = quadratic;
         lightNumber = num;
+        radius = calculateRadius();
+    }
+    // solve k_c + k_l * d + k_q * d^2 = I_max * 256 / 5, i.e. the distance where the
+    // brightest channel has been attenuated below 5/256
+    float calculateRadius() const
+    {
+        float lightMax = std::max({ ambient.x, ambient.y, ambient.z, diffuse.x, diffuse.y, diffuse.z, specular.x, specular.y, specular.z });
+        float c = k_c - lightMax * (256.0f / 5.0f);
+        if (c >= 0.0f)
+            return 0.0f;
+        if (k_q > 0.0f)
+            return (-k_l + std::sqrt(k_l * k_l - 4.0f * k_q * c)) / (2.0f * k_q);
+        if (k_l > 0.0f)
+            return -c / k_l;
+        return FLT_MAX;
+    }
+    // colours as they are currently sent to the shader
+    glm::vec3 getAmbient() const
+    {
+        return ambientOn * ambient;
+    }
+    glm::vec3 getDiffuse() const
+    {
+        return diffuseOn * diffuse;
+    }
+    glm::vec3 getSpecular() const
+    {
+        return specularOn * specular;
+    }
+    bool isOn() const
+    {
+        return ambientOn != 0.0f || diffuseOn != 0.0f || specularOn != 0.0f;
     }
     void setUpPointLight(Shader& lightingShader)
     {
@@ -76,6 +115,28 @@ public:
             lightingShader.setFloat("pointLights[3].k_l", k_l);
             lightingShader.setFloat("pointLights[3].k_q", k_q);
         }
+        setUpShadows(lightingShader, lightNumber >= 1 && lightNumber <= 4 ? lightNumber - 1 : 3);
+    }
+    // uploads the light into pointLights[index], used by shader permutations that only
+    // declare as many point lights as are switched on
+    void setUpPointLight(Shader& lightingShader, int index)
+    {
+        lightingShader.use();
+        lightingShader.setVec3(frameFormat("pointLights[%d].position", index), position);
+        lightingShader.setVec3(frameFormat("pointLights[%d].ambient", index), ambientOn * ambient);
+        lightingShader.setVec3(frameFormat("pointLights[%d].diffuse", index), diffuseOn * diffuse);
+        lightingShader.setVec3(frameFormat("pointLights[%d].specular", index), specularOn * specular);
+        lightingShader.setFloat(frameFormat("pointLights[%d].k_c", index), k_c);
+        lightingShader.setFloat(frameFormat("pointLights[%d].k_l", index), k_l);
+        lightingShader.setFloat(frameFormat("pointLights[%d].k_q", index), k_q);
+        setUpShadows(lightingShader, index);
+    }
+    void setUpShadows(Shader& lightingShader, int index)
+    {
+        if (shadows != nullptr)
+            shadows->bind(lightingShader, index);
+        else
+            PointShadowMap::bindNone(lightingShader, index);
     }
     void turnOff()
     {
@@ -0,0 +1,22 @@
+// surfaces of revolution are drawn without attributes: the vertex is pulled from their profile, one texel
+// per step along it of radius, height and the derivative of both. revolutionSlices is 0 for other meshes
+uniform int revolutionSlices;
+uniform float revolutionStart;
+uniform float revolutionStep;
+uniform samplerBuffer revolutionProfile;
+
+void revolutionVertex(out vec3 position, out vec3 normal)
+{
+    // two triangles a quad, (k1, k2, k1 + 1) and (k1 + 1, k2, k2 + 1) like the tessellated mesh
+    int quad = gl_VertexID / 6;
+    int corner = gl_VertexID - quad * 6;
+    int row = quad / revolutionSlices;
+    int along = row + ((corner == 1 || corner == 4 || corner == 5) ? 1 : 0);
+    int slice = quad - row * revolutionSlices + ((corner == 2 || corner == 3 || corner == 5) ? 1 : 0);
+    vec4 profile = texelFetch(revolutionProfile, along);
+    float theta = revolutionStart + float(slice) * revolutionStep;
+    vec2 around = vec2(sin(theta), cos(theta));
+    position = vec3(profile.x * around.x, profile.y, profile.x * around.y);
+    vec2 inward = dot(profile.zw, profile.zw) > 0.0 ? normalize(vec2(-profile.w, profile.z)) : vec2(-1.0, 0.0);
+    normal = vec3(inward.x * around.x, inward.y, inward.x * around.y);
+}
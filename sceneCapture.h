@@ -0,0 +1,61 @@
+//
+//  sceneCapture.h
+//  records the world space triangles of a set of draws with transform feedback, for the
+//  CPU ray tracers (the lightmap baker and the path tracer). the vertex layout is whatever
+//  the capture shader's varyings write, it has to start with a position and a normal
+//
+
+#ifndef sceneCapture_h
+#define sceneCapture_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <functional>
+#include "shader.h"
+
+using namespace std;
+
+// two passes over the draws with rasterization off: one to count the triangles, one to record them.
+// fills triangles with 3 vertices per triangle and positions with their positions, returns the triangle count
+template <typename CapturedVertex>
+unsigned int captureTriangles(Shader& captureShader, const function<void(Shader&)>& drawStatic, vector<CapturedVertex>& triangles, vector<glm::vec3>& positions)
+{
+    glEnable(GL_RASTERIZER_DISCARD);
+    unsigned int query;
+    glGenQueries(1, &query);
+    glBeginQuery(GL_PRIMITIVES_GENERATED, query);
+    captureShader.use();
+    drawStatic(captureShader);
+    glEndQuery(GL_PRIMITIVES_GENERATED);
+    GLuint primitives = 0;
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT, &primitives);
+    glDeleteQueries(1, &query);
+
+    unsigned int feedbackBuffer;
+    glGenBuffers(1, &feedbackBuffer);
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, feedbackBuffer);
+    glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, (GLsizeiptr)primitives * 3 * sizeof(CapturedVertex), NULL, GL_STATIC_READ);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, feedbackBuffer);
+    captureShader.use();
+    glBeginTransformFeedback(GL_TRIANGLES);
+    drawStatic(captureShader);
+    glEndTransformFeedback();
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    triangles.resize((size_t)primitives * 3);
+    if (!triangles.empty())
+        glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, triangles.size() * sizeof(CapturedVertex), triangles.data());
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glDeleteBuffers(1, &feedbackBuffer);
+
+    positions.resize(triangles.size());
+    for (size_t i = 0; i < triangles.size(); i++)
+    {
+        positions[i] = triangles[i].position;
+        triangles[i].normal = glm::length(triangles[i].normal) > 0.0f ? glm::normalize(triangles[i].normal) : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+    return primitives;
+}
+
+#endif /* sceneCapture_h */
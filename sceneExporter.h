@@ -0,0 +1,266 @@
+//
+//  sceneExporter.h
+//  writes the draws of the hard-coded scene into the binary scene format. the draws are
+//  recorded through the SoftwareDevice, identical meshes and materials are merged and
+//  the instances are sorted so the loader changes material as rarely as possible
+//
+
+#ifndef sceneExporter_h
+#define sceneExporter_h
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cfloat>
+#include <iostream>
+#include "sceneFile.h"
+#include "softwareRasterizer.h"
+
+using namespace std;
+
+class SceneExporter {
+public:
+    // statistics
+    unsigned int recordedDraws = 0;
+    unsigned int skippedDraws = 0;      // textured draws, the format only has colour materials
+
+    // copies the draw's vertices on the first sighting of its mesh, the pointers are only valid during the call
+    void add(const SoftwareDraw& draw)
+    {
+        recordedDraws++;
+        if (draw.material.diffuseMap != nullptr || draw.count <= 0)
+        {
+            skippedDraws++;
+            return;
+        }
+        MeshKey key(draw.positions, draw.normals, draw.texCoords, draw.indices, draw.first, draw.count);
+        auto found = meshIds.find(key);
+        uint32_t mesh;
+        if (found != meshIds.end())
+            mesh = found->second;
+        else
+        {
+            mesh = addMesh(draw);
+            meshIds[key] = mesh;
+        }
+
+        SceneMaterial material = {};
+        setVec3(material.ambient, draw.material.ambient);
+        setVec3(material.diffuse, draw.material.diffuse);
+        setVec3(material.specular, draw.material.specular);
+        material.shininess = draw.material.shininess;
+        uint32_t materialId = (uint32_t)materials.size();
+        for (uint32_t i = 0; i < materials.size(); i++)
+        {
+            if (memcmp(&materials[i], &material, sizeof(SceneMaterial)) == 0)
+            {
+                materialId = i;
+                break;
+            }
+        }
+        if (materialId == materials.size())
+            materials.push_back(material);
+
+        SceneInstance instance = {};
+        for (int column = 0; column < 4; column++)
+            for (int row = 0; row < 4; row++)
+                instance.model[column * 4 + row] = draw.model[column][row];
+        instance.mesh = mesh;
+        instance.material = materialId;
+        worldBounds(meshes[mesh], draw.model, instance.boundsMin, instance.boundsMax);
+        instances.push_back(instance);
+    }
+
+    void addLight(const PointLight& light)
+    {
+        SceneLight entry = {};
+        entry.type = SCENE_LIGHT_POINT;
+        entry.number = light.lightNumber;
+        setVec3(entry.position, light.position);
+        setColors(entry, light.ambient, light.diffuse, light.specular);
+        entry.k_c = light.k_c;
+        entry.k_l = light.k_l;
+        entry.k_q = light.k_q;
+        lights.push_back(entry);
+    }
+    void addLight(const DirectionLight& light)
+    {
+        SceneLight entry = {};
+        entry.type = SCENE_LIGHT_DIRECTION;
+        entry.number = light.lightNumber;
+        setVec3(entry.direction, light.direction);
+        setColors(entry, light.ambient, light.diffuse, light.specular);
+        lights.push_back(entry);
+    }
+    void addLight(const SpotLight& light)
+    {
+        SceneLight entry = {};
+        entry.type = SCENE_LIGHT_SPOT;
+        entry.number = light.lightNumber;
+        setVec3(entry.position, light.position);
+        setVec3(entry.direction, light.direction);
+        setColors(entry, light.ambient, light.diffuse, light.specular);
+        entry.k_c = light.k_c;
+        entry.k_l = light.k_l;
+        entry.k_q = light.k_q;
+        entry.angle = light.Angle;
+        lights.push_back(entry);
+    }
+
+    bool write(const string& path)
+    {
+        // by material, then mesh, so runs of the same uniforms stay together
+        stable_sort(instances.begin(), instances.end(), [](const SceneInstance& a, const SceneInstance& b)
+            {
+                return a.material != b.material ? a.material < b.material : a.mesh < b.mesh;
+            });
+
+        SceneHeader header = {};
+        header.magic = SCENE_FILE_MAGIC;
+        header.version = SCENE_FILE_VERSION;
+        header.meshCount = (uint32_t)meshes.size();
+        header.materialCount = (uint32_t)materials.size();
+        header.instanceCount = (uint32_t)instances.size();
+        header.lightCount = (uint32_t)lights.size();
+        header.vertexCount = (uint32_t)vertices.size();
+        header.indexCount = (uint32_t)indices.size();
+        uint64_t offset = sizeof(SceneHeader);
+        auto place = [&offset](uint64_t& field, size_t bytes)
+        {
+            field = offset;
+            offset = (offset + bytes + 15) & ~15ull;
+        };
+        place(header.meshOffset, meshes.size() * sizeof(SceneMesh));
+        place(header.materialOffset, materials.size() * sizeof(SceneMaterial));
+        place(header.instanceOffset, instances.size() * sizeof(SceneInstance));
+        place(header.lightOffset, lights.size() * sizeof(SceneLight));
+        place(header.vertexOffset, vertices.size() * sizeof(SceneVertex));
+        place(header.indexOffset, indices.size() * sizeof(uint32_t));
+
+        vector<unsigned char> bytes((size_t)offset, 0);
+        memcpy(bytes.data(), &header, sizeof(header));
+        copyTable(bytes, header.meshOffset, meshes);
+        copyTable(bytes, header.materialOffset, materials);
+        copyTable(bytes, header.instanceOffset, instances);
+        copyTable(bytes, header.lightOffset, lights);
+        copyTable(bytes, header.vertexOffset, vertices);
+        copyTable(bytes, header.indexOffset, indices);
+
+        ofstream file(path, ios::binary);
+        if (!file)
+        {
+            std::cout << "ERROR::SCENE_EXPORTER::FILE_NOT_WRITTEN: " << path << std::endl;
+            return false;
+        }
+        file.write((const char*)bytes.data(), bytes.size());
+        fileSize = bytes.size();
+        return (bool)file;
+    }
+
+    void printStats()
+    {
+        cout << "scene export: " << recordedDraws << " draws recorded, " << skippedDraws << " skipped, " << instances.size() << " instances of "
+            << meshes.size() << " meshes with " << materials.size() << " materials, " << lights.size() << " lights, "
+            << vertices.size() << " vertices, " << indices.size() / 3 << " triangles, " << fileSize / 1024 << " KB" << endl;
+    }
+
+private:
+    // a draw's mesh is identified by where its data lives and which part of it it draws
+    typedef tuple<const unsigned char*, const unsigned char*, const unsigned char*, const unsigned int*, int, int> MeshKey;
+
+    map<MeshKey, uint32_t> meshIds;
+    vector<SceneMesh> meshes;
+    vector<SceneMaterial> materials;
+    vector<SceneInstance> instances;
+    vector<SceneLight> lights;
+    vector<SceneVertex> vertices;
+    vector<uint32_t> indices;
+    size_t fileSize = 0;
+
+    static void setVec3(float* out, const glm::vec3& value)
+    {
+        out[0] = value.x;
+        out[1] = value.y;
+        out[2] = value.z;
+    }
+
+    static void setColors(SceneLight& entry, const glm::vec3& ambient, const glm::vec3& diffuse, const glm::vec3& specular)
+    {
+        setVec3(entry.ambient, ambient);
+        setVec3(entry.diffuse, diffuse);
+        setVec3(entry.specular, specular);
+    }
+
+    template <typename T>
+    static void copyTable(vector<unsigned char>& bytes, uint64_t offset, const vector<T>& table)
+    {
+        if (!table.empty())
+            memcpy(bytes.data() + offset, table.data(), table.size() * sizeof(T));
+    }
+
+    // only the vertices the draw references are kept, renumbered in first use order
+    uint32_t addMesh(const SoftwareDraw& draw)
+    {
+        SceneMesh mesh = {};
+        mesh.firstIndex = (uint32_t)indices.size();
+        mesh.firstVertex = (uint32_t)vertices.size();
+        mesh.indexCount = (uint32_t)draw.count;
+        glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+        unordered_map<unsigned int, uint32_t> remap;
+        for (int i = 0; i < draw.count; i++)
+        {
+            unsigned int source = draw.indices != nullptr ? draw.indices[i] : (unsigned int)(draw.first + i);
+            auto found = remap.find(source);
+            if (found != remap.end())
+            {
+                indices.push_back(found->second);
+                continue;
+            }
+            SceneVertex vertex = {};
+            memcpy(vertex.position, draw.positions + (size_t)source * draw.positionStride, 3 * sizeof(float));
+            if (draw.normals != nullptr)
+                memcpy(vertex.normal, draw.normals + (size_t)source * draw.normalStride, 3 * sizeof(float));
+            else
+                vertex.normal[1] = 1.0f;
+            if (draw.texCoords != nullptr)
+                memcpy(vertex.uv, draw.texCoords + (size_t)source * draw.texCoordStride, 2 * sizeof(float));
+            glm::vec3 position(vertex.position[0], vertex.position[1], vertex.position[2]);
+            boundsMin = glm::min(boundsMin, position);
+            boundsMax = glm::max(boundsMax, position);
+            uint32_t index = (uint32_t)vertices.size();
+            vertices.push_back(vertex);
+            remap[source] = index;
+            indices.push_back(index);
+        }
+        mesh.vertexCount = (uint32_t)vertices.size() - mesh.firstVertex;
+        setVec3(mesh.boundsMin, boundsMin);
+        setVec3(mesh.boundsMax, boundsMax);
+        meshes.push_back(mesh);
+        return (uint32_t)meshes.size() - 1;
+    }
+
+    // box around the 8 transformed corners of the mesh's local box
+    static void worldBounds(const SceneMesh& mesh, const glm::mat4& model, float* boundsMin, float* boundsMax)
+    {
+        glm::vec3 worldMin(FLT_MAX), worldMax(-FLT_MAX);
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 local((corner & 1) ? mesh.boundsMax[0] : mesh.boundsMin[0],
+                (corner & 2) ? mesh.boundsMax[1] : mesh.boundsMin[1],
+                (corner & 4) ? mesh.boundsMax[2] : mesh.boundsMin[2]);
+            glm::vec3 world = glm::vec3(model * glm::vec4(local, 1.0f));
+            worldMin = glm::min(worldMin, world);
+            worldMax = glm::max(worldMax, world);
+        }
+        setVec3(boundsMin, worldMin);
+        setVec3(boundsMax, worldMax);
+    }
+};
+
+#endif /* sceneExporter_h */
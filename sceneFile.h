@@ -0,0 +1,432 @@
+//
+//  sceneFile.h
+//  binary scene format and its loader. a header is followed by the mesh, material,
+//  instance and light tables and the vertex and index data, every part 16 byte aligned.
+//  the file is memory mapped and used in place: the tables are read straight from the
+//  mapping and the vertex and index data go to the GPU without an intermediate copy.
+//  scene files are written by SceneExporter from the hard-coded draw functions
+//
+
+#ifndef sceneFile_h
+#define sceneFile_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <chrono>
+#include <iostream>
+#include "shader.h"
+#include "mappedFile.h"
+#include "jobSystem.h"
+#include "pointLight.h"
+#include "directionLight.h"
+#include "spotLight.h"
+
+using namespace std;
+
+#define SCENE_FILE_MAGIC 0x31435354u     // "TSC1"
+#define SCENE_FILE_VERSION 1u
+
+enum SceneLightType { SCENE_LIGHT_POINT = 0, SCENE_LIGHT_DIRECTION = 1, SCENE_LIGHT_SPOT = 2 };
+
+struct SceneHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t meshCount;
+    uint32_t materialCount;
+    uint32_t instanceCount;
+    uint32_t lightCount;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    // byte offsets from the start of the file
+    uint64_t meshOffset;
+    uint64_t materialOffset;
+    uint64_t instanceOffset;
+    uint64_t lightOffset;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+};
+
+// a range of the shared index data, the indices already point into the shared vertex data
+struct SceneMesh {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t firstVertex;
+    uint32_t vertexCount;
+    float boundsMin[3];
+    float padding0;
+    float boundsMax[3];
+    float padding1;
+};
+
+struct SceneMaterial {
+    float ambient[3];
+    float shininess;
+    float diffuse[3];
+    float padding0;
+    float specular[3];
+    float padding1;
+};
+
+// bounds are the world space box of the mesh under the model matrix
+struct SceneInstance {
+    float model[16];            // column major like glm
+    float boundsMin[3];
+    uint32_t mesh;
+    float boundsMax[3];
+    uint32_t material;
+};
+
+// light colours are stored without the on/off state, that stays with the running scene
+struct SceneLight {
+    uint32_t type;
+    int32_t number;             // lightNumber of the light this entry configures
+    float k_c;
+    float k_l;
+    float k_q;
+    float angle;                // spot light cut off in degrees
+    float padding[2];
+    float position[4];
+    float direction[4];
+    float ambient[4];
+    float diffuse[4];
+    float specular[4];
+};
+
+// position, normal, texture coordinates, the layout of the meshes' own vertex buffers
+struct SceneVertex {
+    float position[3];
+    float normal[3];
+    float uv[2];
+};
+
+static_assert(sizeof(SceneHeader) % 16 == 0, "scene header must keep the tables aligned");
+static_assert(sizeof(SceneMesh) % 16 == 0, "scene meshes must be 16 byte aligned");
+static_assert(sizeof(SceneMaterial) % 16 == 0, "scene materials must be 16 byte aligned");
+static_assert(sizeof(SceneInstance) % 16 == 0, "scene instances must be 16 byte aligned");
+static_assert(sizeof(SceneLight) % 16 == 0, "scene lights must be 16 byte aligned");
+static_assert(sizeof(SceneVertex) == 32, "scene vertices must match the vertex layout");
+
+class SceneFile {
+public:
+    // statistics of the last load()
+    double mapMs = 0.0;
+    double uploadMs = 0.0;
+    // of the last drawVisible()
+    unsigned int visibleCount = 0;
+
+    // constructor
+    SceneFile() {}
+
+    // destructor
+    ~SceneFile()
+    {
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        glDeleteVertexArrays(1, &VAO);
+    }
+
+    // maps and validates the file, then uploads the vertex and index data, needs a current context
+    bool load(const string& path)
+    {
+        auto start = chrono::high_resolution_clock::now();
+        if (!file.open(path))
+        {
+            std::cout << "ERROR::SCENE_FILE::NOT_OPENED: " << path << std::endl;
+            return false;
+        }
+        if (!validate())
+        {
+            std::cout << "ERROR::SCENE_FILE::INVALID: " << path << std::endl;
+            file.close();
+            return false;
+        }
+        mapMs = elapsedMs(start);
+
+        start = chrono::high_resolution_clock::now();
+        const SceneHeader& header = this->header();
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)header.vertexCount * sizeof(SceneVertex), file.data() + header.vertexOffset, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)header.indexCount * sizeof(uint32_t), file.data() + header.indexOffset, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SceneVertex), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(SceneVertex), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(SceneVertex), (void*)(6 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+        glBindVertexArray(0);
+        uploadMs = elapsedMs(start);
+        return true;
+    }
+
+    bool isLoaded() const
+    {
+        return VAO != 0;
+    }
+
+    const SceneHeader& header() const
+    {
+        return *(const SceneHeader*)file.data();
+    }
+    const SceneMesh* meshes() const
+    {
+        return table<SceneMesh>(header().meshOffset);
+    }
+    const SceneMaterial* materials() const
+    {
+        return table<SceneMaterial>(header().materialOffset);
+    }
+    const SceneInstance* instances() const
+    {
+        return table<SceneInstance>(header().instanceOffset);
+    }
+    const SceneLight* lights() const
+    {
+        return table<SceneLight>(header().lightOffset);
+    }
+
+    // every instance with its model matrix and material, the material uniforms are only set when they change
+    void draw(Shader& shader) const
+    {
+        const SceneHeader& header = this->header();
+        const SceneMesh* meshes = this->meshes();
+        const SceneMaterial* materials = this->materials();
+        const SceneInstance* instances = this->instances();
+        glBindVertexArray(VAO);
+        uint32_t currentMaterial = UINT32_MAX;
+        for (uint32_t i = 0; i < header.instanceCount; i++)
+        {
+            const SceneInstance& instance = instances[i];
+            if (instance.material != currentMaterial)
+            {
+                setMaterial(shader, materials[instance.material]);
+                currentMaterial = instance.material;
+            }
+            shader.setMat4("model", toMat4(instance.model));
+            const SceneMesh& mesh = meshes[instance.mesh];
+            glDrawElements(GL_TRIANGLES, (GLsizei)mesh.indexCount, GL_UNSIGNED_INT, (void*)((size_t)mesh.firstIndex * sizeof(uint32_t)));
+        }
+        glBindVertexArray(0);
+    }
+
+    // fork: builds the model matrices and tests every instance's world bounds against the frustum of
+    // viewProjection, in jobs of CULL_GRAIN instances. drawVisible() may be called once counter is done
+    void cull(const glm::mat4& viewProjection, JobSystem& jobs, JobCounter& counter)
+    {
+        const SceneHeader& header = this->header();
+        commands.resize(header.instanceCount);
+        // the planes as a x + b y + c z + d >= 0 inside, from the rows of the matrix
+        for (int i = 0; i < 3; i++)
+        {
+            for (int k = 0; k < 4; k++)
+            {
+                planes[i * 2][k] = viewProjection[k][3] + viewProjection[k][i];
+                planes[i * 2 + 1][k] = viewProjection[k][3] - viewProjection[k][i];
+            }
+        }
+        jobs.parallelFor(counter, (int)header.instanceCount, CULL_GRAIN, [this](int first, int last) { cullRange(first, last); });
+    }
+
+    // the instances cull() kept, in file order so the material runs stay intact
+    void drawVisible(Shader& shader)
+    {
+        const SceneMaterial* materials = this->materials();
+        glBindVertexArray(VAO);
+        uint32_t currentMaterial = UINT32_MAX;
+        visibleCount = 0;
+        for (const DrawCommand& command : commands)
+        {
+            if (!command.visible)
+                continue;
+            if (command.material != currentMaterial)
+            {
+                setMaterial(shader, materials[command.material]);
+                currentMaterial = command.material;
+            }
+            shader.setMat4("model", command.model);
+            glDrawElements(GL_TRIANGLES, (GLsizei)command.indexCount, GL_UNSIGNED_INT, (void*)((size_t)command.firstIndex * sizeof(uint32_t)));
+            visibleCount++;
+        }
+        glBindVertexArray(0);
+    }
+
+    // lights are matched on their lightNumber, false when the file has no entry for it
+    bool applyLight(PointLight& light) const
+    {
+        const SceneLight* entry = findLight(SCENE_LIGHT_POINT, light.lightNumber);
+        if (entry == nullptr)
+            return false;
+        light.position = toVec3(entry->position);
+        light.ambient = toVec3(entry->ambient);
+        light.diffuse = toVec3(entry->diffuse);
+        light.specular = toVec3(entry->specular);
+        light.k_c = entry->k_c;
+        light.k_l = entry->k_l;
+        light.k_q = entry->k_q;
+        light.radius = light.calculateRadius();
+        return true;
+    }
+    bool applyLight(DirectionLight& light) const
+    {
+        const SceneLight* entry = findLight(SCENE_LIGHT_DIRECTION, light.lightNumber);
+        if (entry == nullptr)
+            return false;
+        light.direction = toVec3(entry->direction);
+        light.ambient = toVec3(entry->ambient);
+        light.diffuse = toVec3(entry->diffuse);
+        light.specular = toVec3(entry->specular);
+        return true;
+    }
+    bool applyLight(SpotLight& light) const
+    {
+        const SceneLight* entry = findLight(SCENE_LIGHT_SPOT, light.lightNumber);
+        if (entry == nullptr)
+            return false;
+        light.position = toVec3(entry->position);
+        light.direction = toVec3(entry->direction);
+        light.ambient = toVec3(entry->ambient);
+        light.diffuse = toVec3(entry->diffuse);
+        light.specular = toVec3(entry->specular);
+        light.k_c = entry->k_c;
+        light.k_l = entry->k_l;
+        light.k_q = entry->k_q;
+        light.Angle = entry->angle;
+        return true;
+    }
+
+    void printStats()
+    {
+        if (!file.isOpen())
+            return;
+        const SceneHeader& header = this->header();
+        cout << "scene file: " << file.size() / 1024 << " KB, " << header.meshCount << " meshes, " << header.materialCount << " materials, "
+            << header.instanceCount << " instances, " << header.lightCount << " lights, " << header.vertexCount << " vertices, "
+            << header.indexCount / 3 << " triangles" << endl;
+        cout << "  map and validate " << mapMs << " ms, upload " << uploadMs << " ms" << endl;
+    }
+
+private:
+    // what the GL thread needs to draw one instance, built by the cull jobs
+    struct DrawCommand {
+        glm::mat4 model;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        uint32_t material;
+        bool visible;
+    };
+    static const int CULL_GRAIN = 64;
+
+    MappedFile file;
+    unsigned int VAO = 0;
+    unsigned int VBO = 0;
+    unsigned int EBO = 0;
+    vector<DrawCommand> commands;
+    glm::vec4 planes[6];
+
+    void cullRange(int first, int last)
+    {
+        const SceneMesh* meshes = this->meshes();
+        const SceneInstance* instances = this->instances();
+        for (int i = first; i < last; i++)
+        {
+            const SceneInstance& instance = instances[i];
+            DrawCommand& command = commands[i];
+            command.visible = true;
+            // outside when the box corner furthest along a plane's normal is behind it
+            for (int p = 0; p < 6 && command.visible; p++)
+            {
+                glm::vec3 corner(planes[p].x >= 0.0f ? instance.boundsMax[0] : instance.boundsMin[0],
+                    planes[p].y >= 0.0f ? instance.boundsMax[1] : instance.boundsMin[1],
+                    planes[p].z >= 0.0f ? instance.boundsMax[2] : instance.boundsMin[2]);
+                command.visible = glm::dot(glm::vec3(planes[p]), corner) + planes[p].w >= 0.0f;
+            }
+            if (!command.visible)
+                continue;
+            command.model = toMat4(instance.model);
+            command.firstIndex = meshes[instance.mesh].firstIndex;
+            command.indexCount = meshes[instance.mesh].indexCount;
+            command.material = instance.material;
+        }
+    }
+
+    static glm::mat4 toMat4(const float* values)
+    {
+        glm::mat4 matrix;
+        for (int column = 0; column < 4; column++)
+            for (int row = 0; row < 4; row++)
+                matrix[column][row] = values[column * 4 + row];
+        return matrix;
+    }
+
+    static void setMaterial(Shader& shader, const SceneMaterial& material)
+    {
+        shader.setVec3("material.ambient", toVec3(material.ambient));
+        shader.setVec3("material.diffuse", toVec3(material.diffuse));
+        shader.setVec3("material.specular", toVec3(material.specular));
+        shader.setFloat("material.shininess", material.shininess);
+    }
+
+    static double elapsedMs(chrono::high_resolution_clock::time_point start)
+    {
+        return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    }
+
+    template <typename T>
+    const T* table(uint64_t offset) const
+    {
+        return (const T*)(file.data() + offset);
+    }
+
+    static glm::vec3 toVec3(const float* values)
+    {
+        return glm::vec3(values[0], values[1], values[2]);
+    }
+
+    const SceneLight* findLight(uint32_t type, int number) const
+    {
+        const SceneLight* lights = this->lights();
+        for (uint32_t i = 0; i < header().lightCount; i++)
+            if (lights[i].type == type && lights[i].number == number)
+                return &lights[i];
+        return nullptr;
+    }
+
+    // every table has to be aligned and inside the file, and every index has to point into its table
+    bool validate() const
+    {
+        if (file.size() < sizeof(SceneHeader))
+            return false;
+        const SceneHeader& header = this->header();
+        if (header.magic != SCENE_FILE_MAGIC || header.version != SCENE_FILE_VERSION)
+            return false;
+        auto fits = [&](uint64_t offset, uint64_t count, uint64_t size)
+        {
+            return offset % 16 == 0 && offset <= file.size() && count * size <= file.size() - offset;
+        };
+        if (!fits(header.meshOffset, header.meshCount, sizeof(SceneMesh)) || !fits(header.materialOffset, header.materialCount, sizeof(SceneMaterial))
+            || !fits(header.instanceOffset, header.instanceCount, sizeof(SceneInstance)) || !fits(header.lightOffset, header.lightCount, sizeof(SceneLight))
+            || !fits(header.vertexOffset, header.vertexCount, sizeof(SceneVertex)) || !fits(header.indexOffset, header.indexCount, sizeof(uint32_t)))
+            return false;
+        const SceneMesh* meshes = this->meshes();
+        for (uint32_t i = 0; i < header.meshCount; i++)
+        {
+            if ((uint64_t)meshes[i].firstIndex + meshes[i].indexCount > header.indexCount
+                || (uint64_t)meshes[i].firstVertex + meshes[i].vertexCount > header.vertexCount)
+                return false;
+        }
+        const SceneInstance* instances = this->instances();
+        for (uint32_t i = 0; i < header.instanceCount; i++)
+            if (instances[i].mesh >= header.meshCount || instances[i].material >= header.materialCount)
+                return false;
+        return true;
+    }
+};
+
+#endif /* sceneFile_h */
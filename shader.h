@@ -5,17 +5,57 @@
 #include <glm/glm.hpp>
 
 #include <string>
+#include <memory_resource>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include "assetPack.h"
+
+// linked programs are stored here with glGetProgramBinary and reloaded on the next launch
+#define SHADER_CACHE_DIR "shader_cache"
+
+// startup cost of all programs built so far, split by cache hits and source compiles
+struct ShaderCacheStats {
+    int loaded = 0;
+    int compiled = 0;
+    double loadMs = 0.0;
+    double compileMs = 0.0;
+    double savedMs = 0.0;       // compile time recorded in the cache entries minus the time to load them
+};
+
+// uniform name for the set functions, a literal is passed through without building a std::string per call
+class UniformName {
+public:
+    UniformName(const char* name) : name(name) {}
+    UniformName(const std::string& name) : name(name.c_str()) {}
+    UniformName(const std::pmr::string& name) : name(name.c_str()) {}
+
+    const char* c_str() const
+    {
+        return name;
+    }
+
+private:
+    const char* name;
+};
 
 class Shader
 {
 public:
     unsigned int ID;
     // constructor generates the shader on the fly
+    // defines are inserted right after the #version line of every stage, used for shader permutations
+    // with deferLinkCheck the compile and link status is not queried until the program is first used,
+    // so the driver can keep compiling while the caller does other work (see ShaderCompiler)
+    // feedbackVaryings are captured interleaved with transform feedback, in the given order
+    // tessControlPath and tessEvaluationPath add both tessellation stages, the caller checks for ARB_tessellation_shader
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const std::string& defines = "", bool deferLinkCheck = false,
+        const std::vector<std::string>& feedbackVaryings = {}, const char* tessControlPath = nullptr, const char* tessEvaluationPath = nullptr)
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
@@ -28,143 +68,494 @@ public:
         vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
         fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
         gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        try
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
-            // if geometry shader path is present, also load a geometry shader
+        // an open asset pack replaces the files
+        AssetPack* pack = AssetPack::current();
+        bool packed = pack != nullptr && pack->read(vertexPath, vertexCode) && pack->read(fragmentPath, fragmentCode)
+            && (geometryPath == nullptr || pack->read(geometryPath, geometryCode));
+        if (!packed)
+        {
+            try
+            {
+                // open files
+                vShaderFile.open(vertexPath);
+                fShaderFile.open(fragmentPath);
+                std::stringstream vShaderStream, fShaderStream;
+                // read file's buffer contents into streams
+                vShaderStream << vShaderFile.rdbuf();
+                fShaderStream << fShaderFile.rdbuf();
+                // close file handlers
+                vShaderFile.close();
+                fShaderFile.close();
+                // convert stream into string
+                vertexCode = vShaderStream.str();
+                fragmentCode = fShaderStream.str();
+                // if geometry shader path is present, also load a geometry shader
+                if (geometryPath != nullptr)
+                {
+                    gShaderFile.open(geometryPath);
+                    std::stringstream gShaderStream;
+                    gShaderStream << gShaderFile.rdbuf();
+                    gShaderFile.close();
+                    geometryCode = gShaderStream.str();
+                }
+            }
+            catch (std::ifstream::failure& e)
+            {
+                std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+            }
+        }
+        for (const std::pair<std::string, std::string>& library : vertexLibraries())
+            if (vertexCode.find(library.first + "(") != std::string::npos)
+                vertexCode = addDefines(vertexCode, readStageSource(library.second.c_str()));
+        std::string tessControlCode, tessEvaluationCode;
+        bool tessellated = tessControlPath != nullptr && tessEvaluationPath != nullptr;
+        if (tessellated)
+        {
+            tessControlCode = readStageSource(tessControlPath);
+            tessEvaluationCode = readStageSource(tessEvaluationPath);
+        }
+        if (!defines.empty())
+        {
+            vertexCode = addDefines(vertexCode, defines);
+            fragmentCode = addDefines(fragmentCode, defines);
             if (geometryPath != nullptr)
+                geometryCode = addDefines(geometryCode, defines);
+            if (tessellated)
             {
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
+                tessControlCode = addDefines(tessControlCode, defines);
+                tessEvaluationCode = addDefines(tessEvaluationCode, defines);
             }
         }
-        catch (std::ifstream::failure& e)
+        // a cached binary for exactly these sources on this driver skips compiling and linking
+        auto start = std::chrono::high_resolution_clock::now();
+        std::string cacheKey = programCacheKey(vertexCode, fragmentCode, geometryCode, tessControlCode + tessEvaluationCode);
+        for (const std::string& varying : feedbackVaryings)
+            cacheKey += "_" + varying;
+        float cachedCompileMs = 0.0f;
+        if (loadProgramBinary(cacheKey, cachedCompileMs))
         {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+            double loadMs = elapsedMs(start);
+            cacheStats().loaded++;
+            cacheStats().loadMs += loadMs;
+            cacheStats().savedMs += cachedCompileMs - loadMs;
+            bindFixedSamplers();
+            return;
         }
+
         const char* vShaderCode = vertexCode.c_str();
         const char* fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
+        // 2. compile shaders, the status is checked in finishLink so no stage forces the driver to finish early
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
         glShaderSource(vertex, 1, &vShaderCode, NULL);
         glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
         // fragment Shader
         fragment = glCreateShader(GL_FRAGMENT_SHADER);
         glShaderSource(fragment, 1, &fShaderCode, NULL);
         glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
         // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
         if (geometryPath != nullptr)
         {
             const char* gShaderCode = geometryCode.c_str();
             geometry = glCreateShader(GL_GEOMETRY_SHADER);
             glShaderSource(geometry, 1, &gShaderCode, NULL);
             glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
         }
+#ifdef GL_ARB_tessellation_shader
+        if (tessellated)
+        {
+            const char* tcShaderCode = tessControlCode.c_str();
+            const char* teShaderCode = tessEvaluationCode.c_str();
+            tessControl = glCreateShader(GL_TESS_CONTROL_SHADER);
+            glShaderSource(tessControl, 1, &tcShaderCode, NULL);
+            glCompileShader(tessControl);
+            tessEvaluation = glCreateShader(GL_TESS_EVALUATION_SHADER);
+            glShaderSource(tessEvaluation, 1, &teShaderCode, NULL);
+            glCompileShader(tessEvaluation);
+        }
+#endif
         // shader Program
         ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
-        if (geometryPath != nullptr)
+        if (geometry != 0)
             glAttachShader(ID, geometry);
+        if (tessControl != 0)
+        {
+            glAttachShader(ID, tessControl);
+            glAttachShader(ID, tessEvaluation);
+        }
+#ifdef GL_ARB_get_program_binary
+        if (programBinarySupported())
+            glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+        if (!feedbackVaryings.empty())
+        {
+            std::vector<const char*> names;
+            for (const std::string& varying : feedbackVaryings)
+                names.push_back(varying.c_str());
+            glTransformFeedbackVaryings(ID, (GLsizei)names.size(), names.data(), GL_INTERLEAVED_ATTRIBS);
+        }
         glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+
+        linkPending = true;
+        pendingCacheKey = cacheKey;
+        pendingStart = start;
+        if (!deferLinkCheck)
+            finishLink();
+    }
+    // true once the driver has finished linking, never blocks when KHR_parallel_shader_compile is available.
+    // without the extension there is no non-blocking query, so the program is reported ready and
+    // finishLink waits for it
+    // ------------------------------------------------------------------------
+    bool isReady() const
+    {
+        if (!linkPending)
+            return true;
+#ifdef GL_KHR_parallel_shader_compile
+        if (GLAD_GL_KHR_parallel_shader_compile)
+        {
+            GLint completed = 0;
+            glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &completed);
+            return completed != 0;
+        }
+#endif
+        return true;
+    }
+    bool isLinkPending() const
+    {
+        return linkPending;
+    }
+    // report compile/link errors of a deferred program and store its binary in the cache
+    // ------------------------------------------------------------------------
+    void finishLink()
+    {
+        if (!linkPending)
+            return;
+        linkPending = false;
+
+        checkCompileErrors(vertex, "VERTEX");
+        checkCompileErrors(fragment, "FRAGMENT");
+        if (geometry != 0)
+            checkCompileErrors(geometry, "GEOMETRY");
+        if (tessControl != 0)
+        {
+            checkCompileErrors(tessControl, "TESS_CONTROL");
+            checkCompileErrors(tessEvaluation, "TESS_EVALUATION");
+        }
+        bool linked = checkCompileErrors(ID, "PROGRAM");
         // delete the shaders as they're linked into our program now and no longer necessary
         glDeleteShader(vertex);
         glDeleteShader(fragment);
-        if (geometryPath != nullptr)
+        if (geometry != 0)
             glDeleteShader(geometry);
+        if (tessControl != 0)
+        {
+            glDeleteShader(tessControl);
+            glDeleteShader(tessEvaluation);
+        }
+        vertex = fragment = geometry = tessControl = tessEvaluation = 0;
 
+        // for deferred programs this is submit to completion, so it includes any overlapped work
+        double compileMs = elapsedMs(pendingStart);
+        cacheStats().compiled++;
+        cacheStats().compileMs += compileMs;
+        if (linked)
+        {
+            saveProgramBinary(pendingCacheKey, (float)compileMs);
+            bindFixedSamplers();
+        }
+    }
+    // totals for every Shader constructed so far
+    // ------------------------------------------------------------------------
+    static ShaderCacheStats& cacheStats()
+    {
+        static ShaderCacheStats stats;
+        return stats;
+    }
+    // samplers that sit on the same texture unit in every program, set once when a program is ready.
+    // GLSL 3.30 has no layout(binding), and a sampler left at unit 0 next to one of another type there
+    // fails every draw of the program
+    static std::vector<std::pair<std::string, int>>& fixedSamplerUnits()
+    {
+        static std::vector<std::pair<std::string, int>> units;
+        return units;
+    }
+    // functions shared by vertex shaders, by name and the file that defines them. GLSL 3.30 has no #include,
+    // so a vertex shader that calls one gets the file spliced in after #version, the way the defines are
+    static std::vector<std::pair<std::string, std::string>>& vertexLibraries()
+    {
+        static std::vector<std::pair<std::string, std::string>> libraries;
+        return libraries;
+    }
+    // program bound by the last use(), every program in the application is bound through use()
+    static unsigned int& currentProgram()
+    {
+        static unsigned int program = 0;
+        return program;
+    }
+    static void printCacheStats()
+    {
+        const ShaderCacheStats& stats = cacheStats();
+        std::cout << "shader programs: " << stats.loaded << " from cache in " << stats.loadMs << " ms, "
+            << stats.compiled << " compiled in " << stats.compileMs << " ms, cache saved " << stats.savedMs << " ms" << std::endl;
     }
     // activate the shader
     // ------------------------------------------------------------------------
+    // a program that is already current is not bound again, which also keeps use() legal between
+    // glBeginTransformFeedback and glEndTransformFeedback on a 3.3 context
     void use()
     {
+        finishLink();
+        if (currentProgram() == ID)
+            return;
         glUseProgram(ID);
+        currentProgram() = ID;
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
-    void setBool(const std::string& name, bool value) const
+    void setBool(UniformName name, bool value) const
     {
         glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
     }
     // ------------------------------------------------------------------------
-    void setInt(const std::string& name, int value) const
+    void setInt(UniformName name, int value) const
     {
         glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string& name, float value) const
+    void setFloat(UniformName name, float value) const
     {
         glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
     }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string& name, const glm::vec2& value) const
+    void setVec2(UniformName name, const glm::vec2& value) const
     {
         glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
     }
-    void setVec2(const std::string& name, float x, float y) const
+    void setVec2(UniformName name, float x, float y) const
     {
         glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
     }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string& name, const glm::vec3& value) const
+    void setVec3(UniformName name, const glm::vec3& value) const
     {
         glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
     }
-    void setVec3(const std::string& name, float x, float y, float z) const
+    void setVec3(UniformName name, float x, float y, float z) const
     {
         glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
     }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string& name, const glm::vec4& value) const
+    void setVec4(UniformName name, const glm::vec4& value) const
     {
         glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
     }
-    void setVec4(const std::string& name, float x, float y, float z, float w)
+    void setVec4(UniformName name, float x, float y, float z, float w)
     {
         glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
     }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string& name, const glm::mat2& mat) const
+    void setMat2(UniformName name, const glm::mat2& mat) const
     {
         glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string& name, const glm::mat3& mat) const
+    void setMat3(UniformName name, const glm::mat3& mat) const
     {
         glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string& name, const glm::mat4& mat) const
+    void setMat4(UniformName name, const glm::mat4& mat) const
     {
         glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    // stages and cache entry of a program whose link status has not been checked yet
+    unsigned int vertex = 0, fragment = 0, geometry = 0, tessControl = 0, tessEvaluation = 0;
+    bool linkPending = false;
+    std::string pendingCacheKey;
+    std::chrono::high_resolution_clock::time_point pendingStart;
+
+    // source of an optional stage from the open asset pack or its file
+    // ------------------------------------------------------------------------
+    static std::string readStageSource(const char* path)
+    {
+        std::string code;
+        AssetPack* pack = AssetPack::current();
+        if (pack != nullptr && pack->read(path, code))
+            return code;
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+            return code;
+        }
+        std::stringstream stream;
+        stream << file.rdbuf();
+        return stream.str();
+    }
+    // inserts defines after the #version directive, which has to stay the first statement
+    // ------------------------------------------------------------------------
+    static std::string addDefines(const std::string& code, const std::string& defines)
+    {
+        size_t version = code.find("#version");
+        if (version == std::string::npos)
+            return defines + code;
+        size_t lineEnd = code.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return code + "\n" + defines;
+        return code.substr(0, lineEnd + 1) + defines + code.substr(lineEnd + 1);
+    }
+    // header in front of every cached program binary
+    struct ProgramBinaryHeader {
+        uint32_t magic;
+        GLenum binaryFormat;
+        GLint length;
+        float compileMs;
+    };
+    static const uint32_t PROGRAM_BINARY_MAGIC = 0x31434253;     // "SBC1"
+
+    static double elapsedMs(std::chrono::high_resolution_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // glGetProgramBinary is core in 4.1, on a 3.3 context it needs ARB_get_program_binary
+    // (glad has to be generated with that extension, otherwise the cache is compiled out)
+    static bool programBinarySupported()
+    {
+#ifdef GL_ARB_get_program_binary
+        if (!GLAD_GL_ARB_get_program_binary)
+            return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+#else
+        return false;
+#endif
+    }
+
+    // FNV-1a over the final sources and the driver identity, a driver update gives new keys
+    static std::string programCacheKey(const std::string& vertexCode, const std::string& fragmentCode, const std::string& geometryCode,
+        const std::string& tessellationCode = "")
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](const char* data, size_t size)
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                hash ^= (unsigned char)data[i];
+                hash *= 1099511628211ull;
+            }
+            hash ^= 0xFF;   // separator so "ab"+"c" and "a"+"bc" differ
+            hash *= 1099511628211ull;
+        };
+        mix(vertexCode.data(), vertexCode.size());
+        mix(fragmentCode.data(), fragmentCode.size());
+        mix(geometryCode.data(), geometryCode.size());
+        if (!tessellationCode.empty())
+            mix(tessellationCode.data(), tessellationCode.size());
+        GLenum driverStrings[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+        for (GLenum name : driverStrings)
+        {
+            const char* value = (const char*)glGetString(name);
+            if (value != nullptr)
+                mix(value, std::string(value).size());
+        }
+
+        std::stringstream key;
+        key << std::hex << hash;
+        return key.str();
+    }
+
+    static std::string programCachePath(const std::string& cacheKey)
+    {
+        return std::string(SHADER_CACHE_DIR) + "/" + cacheKey + ".bin";
+    }
+
+    void bindFixedSamplers()
+    {
+        bool bound = false;
+        for (const std::pair<std::string, int>& sampler : fixedSamplerUnits())
+        {
+            int location = glGetUniformLocation(ID, sampler.first.c_str());
+            if (location < 0)
+                continue;
+            if (!bound)
+                glUseProgram(ID);
+            bound = true;
+            glUniform1i(location, sampler.second);
+        }
+        if (bound)
+            glUseProgram(currentProgram());
+    }
+
+    bool loadProgramBinary(const std::string& cacheKey, float& compileMs)
+    {
+#ifdef GL_ARB_get_program_binary
+        if (!programBinarySupported())
+            return false;
+        std::ifstream file(programCachePath(cacheKey), std::ios::binary);
+        if (!file)
+            return false;
+
+        ProgramBinaryHeader header;
+        file.read((char*)&header, sizeof(header));
+        if (!file || header.magic != PROGRAM_BINARY_MAGIC || header.length <= 0)
+            return false;
+        std::vector<char> binary(header.length);
+        file.read(binary.data(), header.length);
+        if (!file)
+            return false;
+
+        // the driver may still reject the binary, in that case fall back to compiling from source
+        ID = glCreateProgram();
+        glProgramBinary(ID, header.binaryFormat, binary.data(), header.length);
+        GLint success = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glDeleteProgram(ID);
+            ID = 0;
+            return false;
+        }
+        compileMs = header.compileMs;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void saveProgramBinary(const std::string& cacheKey, float compileMs)
+    {
+#ifdef GL_ARB_get_program_binary
+        if (!programBinarySupported())
+            return;
+        ProgramBinaryHeader header;
+        header.magic = PROGRAM_BINARY_MAGIC;
+        header.compileMs = compileMs;
+        header.length = 0;
+        glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &header.length);
+        if (header.length <= 0)
+            return;
+        std::vector<char> binary(header.length);
+        glGetProgramBinary(ID, header.length, NULL, &header.binaryFormat, binary.data());
+
+        std::error_code error;
+        std::filesystem::create_directories(SHADER_CACHE_DIR, error);
+        std::ofstream file(programCachePath(cacheKey), std::ios::binary | std::ios::trunc);
+        if (!file)
+            return;
+        file.write((const char*)&header, sizeof(header));
+        file.write(binary.data(), header.length);
+#endif
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -186,6 +577,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success != 0;
     }
 };
 #endif
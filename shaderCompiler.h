@@ -0,0 +1,97 @@
+//
+//  shaderCompiler.h
+//  submits every program at startup without waiting on the driver, compile and
+//  link status is only checked when a program is first used
+//
+
+#ifndef shaderCompiler_h
+#define shaderCompiler_h
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <vector>
+#include <memory>
+#include <string>
+#include <iostream>
+#include "shader.h"
+
+using namespace std;
+
+class ShaderCompiler {
+public:
+    // constructor, needs a current context
+    ShaderCompiler()
+    {
+        // let the driver pick as many background compile threads as it wants
+#ifdef GL_KHR_parallel_shader_compile
+        if (GLAD_GL_KHR_parallel_shader_compile)
+        {
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+            parallel = true;
+        }
+#endif
+#ifdef GL_ARB_parallel_shader_compile
+        if (!parallel && GLAD_GL_ARB_parallel_shader_compile)
+        {
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+            parallel = true;
+        }
+#endif
+        submitTime = glfwGetTime();
+    }
+
+    // compiles and links without checking, the program is finished on its first use()
+    Shader& add(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const string& defines = "")
+    {
+        Shader* shader = new Shader(vertexPath, fragmentPath, geometryPath, defines, true);
+        owned.push_back(unique_ptr<Shader>(shader));
+        programs.push_back(shader);
+        return *shader;
+    }
+
+    // programs created elsewhere with deferLinkCheck, so finishAll and the report cover them too
+    void track(Shader& shader)
+    {
+        programs.push_back(&shader);
+    }
+
+    bool parallelCompileAvailable() const
+    {
+        return parallel;
+    }
+
+    // number of programs the driver is still working on, does not block with KHR_parallel_shader_compile
+    int pendingCount() const
+    {
+        int pending = 0;
+        for (Shader* shader : programs)
+            if (!shader->isReady())
+                pending++;
+        return pending;
+    }
+
+    // check every program that has not been used yet
+    void finishAll()
+    {
+        for (Shader* shader : programs)
+            shader->finishLink();
+    }
+
+    void printReport()
+    {
+        int unused = 0;
+        for (Shader* shader : programs)
+            if (shader->isLinkPending())
+                unused++;
+        cout << "shader compiler: " << programs.size() << " programs submitted " << (glfwGetTime() - submitTime) * 1000.0
+            << " ms ago, " << unused << " not used yet, driver parallel compile " << (parallel ? "on" : "off") << endl;
+    }
+
+private:
+    vector<unique_ptr<Shader>> owned;
+    vector<Shader*> programs;
+    bool parallel = false;
+    double submitTime = 0.0;
+};
+
+#endif /* shaderCompiler_h */
@@ -0,0 +1,118 @@
+//
+//  shaderPermutations.h
+//  builds Phong program variants from compile time defines so lights that are
+//  switched off are compiled out instead of being evaluated with zero colour
+//
+
+#ifndef shaderPermutations_h
+#define shaderPermutations_h
+
+#include <map>
+#include <memory>
+#include <string>
+#include <iostream>
+#include "shader.h"
+
+using namespace std;
+
+// feature bits of a permutation key, the point light count lives in bits 8..15
+enum ShaderFeature {
+    FEATURE_TEXTURED = 1 << 0,
+    FEATURE_SPOT_LIGHT = 1 << 1,
+    FEATURE_DAY_LIGHT = 1 << 2,
+    FEATURE_MOON_LIGHT = 1 << 3,
+    FEATURE_TESSELLATED = 1 << 4     // surfaces of revolution as Bezier patches, needs ARB_tessellation_shader
+};
+const unsigned int POINT_LIGHT_COUNT_SHIFT = 8;
+const unsigned int POINT_LIGHT_COUNT_MASK = 0xFF << POINT_LIGHT_COUNT_SHIFT;
+
+class ShaderPermutations {
+public:
+    // constructor
+    // the tessellated permutations replace the vertex stage with patchVertexPath and the two tessellation stages
+    // and keep the untextured fragment stage
+    ShaderPermutations(const char* vertexPath, const char* fragmentPath, const char* texturedVertexPath, const char* texturedFragmentPath,
+        const char* patchVertexPath = nullptr, const char* tessControlPath = nullptr, const char* tessEvaluationPath = nullptr)
+    {
+        this->vertexPath = vertexPath;
+        this->fragmentPath = fragmentPath;
+        this->texturedVertexPath = texturedVertexPath;
+        this->texturedFragmentPath = texturedFragmentPath;
+        this->patchVertexPath = patchVertexPath;
+        this->tessControlPath = tessControlPath;
+        this->tessEvaluationPath = tessEvaluationPath;
+    }
+
+    static unsigned int makeKey(int pointLights, bool spotLight, bool dayLight, bool moonLight, bool textured = false)
+    {
+        unsigned int key = ((unsigned int)pointLights << POINT_LIGHT_COUNT_SHIFT) & POINT_LIGHT_COUNT_MASK;
+        if (spotLight)
+            key |= FEATURE_SPOT_LIGHT;
+        if (dayLight)
+            key |= FEATURE_DAY_LIGHT;
+        if (moonLight)
+            key |= FEATURE_MOON_LIGHT;
+        if (textured)
+            key |= FEATURE_TEXTURED;
+        return key;
+    }
+
+    static int pointLightCount(unsigned int key)
+    {
+        return (key & POINT_LIGHT_COUNT_MASK) >> POINT_LIGHT_COUNT_SHIFT;
+    }
+
+    static string definesFor(unsigned int key)
+    {
+        string defines = "#define SHADER_PERMUTATION\n";
+        defines += "#define NR_POINT_LIGHTS " + to_string(pointLightCount(key)) + "\n";
+        defines += string("#define SPOT_LIGHT ") + ((key & FEATURE_SPOT_LIGHT) ? "1" : "0") + "\n";
+        defines += string("#define DAY_LIGHT ") + ((key & FEATURE_DAY_LIGHT) ? "1" : "0") + "\n";
+        defines += string("#define MOON_LIGHT ") + ((key & FEATURE_MOON_LIGHT) ? "1" : "0") + "\n";
+        return defines;
+    }
+
+    // returns the program for a key, compiling it the first time the key is seen
+    Shader& get(unsigned int key)
+    {
+        auto found = variants.find(key);
+        if (found != variants.end())
+            return *found->second;
+        return create(key, false);
+    }
+
+    // starts compiling a key without waiting for the driver, the link is checked on first use
+    Shader& submit(unsigned int key)
+    {
+        auto found = variants.find(key);
+        if (found != variants.end())
+            return *found->second;
+        return create(key, true);
+    }
+
+private:
+    Shader& create(unsigned int key, bool deferLinkCheck)
+    {
+        const char* vs = (key & FEATURE_TEXTURED) ? texturedVertexPath : vertexPath;
+        const char* fs = (key & FEATURE_TEXTURED) ? texturedFragmentPath : fragmentPath;
+        Shader* shader;
+        if (key & FEATURE_TESSELLATED)
+            shader = new Shader(patchVertexPath, fragmentPath, nullptr, definesFor(key), deferLinkCheck, {}, tessControlPath, tessEvaluationPath);
+        else
+            shader = new Shader(vs, fs, nullptr, definesFor(key), deferLinkCheck);
+        variants[key] = unique_ptr<Shader>(shader);
+        cout << "shader permutation 0x" << hex << key << dec << (deferLinkCheck ? " submitted, " : " compiled, ") << variants.size() << " cached" << endl;
+        return *shader;
+    }
+
+    const char* vertexPath;
+    const char* fragmentPath;
+    const char* texturedVertexPath;
+    const char* texturedFragmentPath;
+    const char* patchVertexPath;
+    const char* tessControlPath;
+    const char* tessEvaluationPath;
+    map<unsigned int, unique_ptr<Shader>> variants;
+};
+
+#endif /* shaderPermutations_h */
@@ -0,0 +1,141 @@
+//
+//  shadowCache.h
+//  keeps the local light shadow maps and re-renders one only when its light or a
+//  caster in its range changed, at most updatesPerFrame maps per frame
+//
+
+#ifndef shadowCache_h
+#define shadowCache_h
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <iostream>
+#include "shader.h"
+#include "pointLight.h"
+#include "spotLight.h"
+#include "localLightShadows.h"
+#include "frameArena.h"
+
+using namespace std;
+
+// point shadows do not need to reach as far as the attenuation radius of a very bright lamp
+const float MAX_POINT_SHADOW_RANGE = 100.0f;
+
+class ShadowCache {
+public:
+    int updatesPerFrame;
+
+    // statistics
+    unsigned int updatesLastFrame = 0;
+    unsigned int pendingUpdates = 0;        // dirty maps left waiting for a later frame
+    unsigned long long totalUpdates = 0;
+
+    // constructor
+    ShadowCache(int updatesPerFrame = 1)
+    {
+        this->updatesPerFrame = updatesPerFrame;
+    }
+
+    void add(PointLight& light, PointShadowMap& shadowMap)
+    {
+        Entry entry;
+        entry.pointLight = &light;
+        entry.pointMap = &shadowMap;
+        entry.range = std::min(light.radius, MAX_POINT_SHADOW_RANGE);
+        entries.push_back(entry);
+    }
+
+    // range is the far plane of the spot light's shadow frustum
+    void add(SpotLight& light, SpotShadowMap& shadowMap, float range)
+    {
+        Entry entry;
+        entry.spotLight = &light;
+        entry.spotMap = &shadowMap;
+        entry.range = range;
+        entries.push_back(entry);
+    }
+
+    // a caster moved or changed inside the given sphere, every light reaching it needs a new map
+    void casterChanged(const glm::vec3& center, float radius)
+    {
+        for (Entry& entry : entries)
+            if (glm::length(center - lightPosition(entry)) < entry.range + radius)
+                entry.dirty = true;
+    }
+
+    // render up to updatesPerFrame dirty maps of lights that are on, lights without any map first,
+    // then the ones nearest to the viewer. the others keep their old map until a later frame
+    void update(Shader& cubeDepthShader, Shader& depthShader, const glm::vec3& viewPos, const function<void(Shader&)>& drawCasters)
+    {
+        pmr::vector<Entry*> candidates(FrameArena::resource());
+        for (Entry& entry : entries)
+        {
+            if (lightPosition(entry) != entry.renderedPosition || lightDirection(entry) != entry.renderedDirection)
+                entry.dirty = true;
+            if (entry.dirty && lightOn(entry))
+                candidates.push_back(&entry);
+        }
+        sort(candidates.begin(), candidates.end(), [&](const Entry* a, const Entry* b)
+            {
+                bool aValid = a->pointMap != nullptr ? a->pointMap->valid : a->spotMap->valid;
+                bool bValid = b->pointMap != nullptr ? b->pointMap->valid : b->spotMap->valid;
+                if (aValid != bValid)
+                    return !aValid;
+                return glm::length(lightPosition(*a) - viewPos) < glm::length(lightPosition(*b) - viewPos);
+            });
+
+        updatesLastFrame = 0;
+        for (Entry* entry : candidates)
+        {
+            if ((int)updatesLastFrame >= updatesPerFrame)
+                break;
+            if (entry->pointLight != nullptr)
+                entry->pointMap->render(entry->pointLight->position, entry->range, cubeDepthShader, drawCasters);
+            else
+                entry->spotMap->render(entry->spotLight->position, entry->spotLight->direction, entry->spotLight->Angle, entry->range, depthShader, drawCasters);
+            entry->renderedPosition = lightPosition(*entry);
+            entry->renderedDirection = lightDirection(*entry);
+            entry->dirty = false;
+            updatesLastFrame++;
+            totalUpdates++;
+        }
+        pendingUpdates = (unsigned int)candidates.size() - updatesLastFrame;
+    }
+
+    void printStats()
+    {
+        cout << "local light shadows: " << entries.size() << " maps, " << updatesLastFrame << " updated last frame, "
+            << pendingUpdates << " pending, " << totalUpdates << " updates in total, budget " << updatesPerFrame << " per frame" << endl;
+    }
+
+private:
+    struct Entry {
+        PointLight* pointLight = nullptr;
+        SpotLight* spotLight = nullptr;
+        PointShadowMap* pointMap = nullptr;
+        SpotShadowMap* spotMap = nullptr;
+        float range = 0.0f;
+        bool dirty = true;
+        // light state the map was rendered with
+        glm::vec3 renderedPosition = glm::vec3(0.0f);
+        glm::vec3 renderedDirection = glm::vec3(0.0f);
+    };
+    vector<Entry> entries;
+
+    static glm::vec3 lightPosition(const Entry& entry)
+    {
+        return entry.pointLight != nullptr ? entry.pointLight->position : entry.spotLight->position;
+    }
+    static glm::vec3 lightDirection(const Entry& entry)
+    {
+        return entry.spotLight != nullptr ? entry.spotLight->direction : glm::vec3(0.0f);
+    }
+    static bool lightOn(const Entry& entry)
+    {
+        return entry.pointLight != nullptr ? entry.pointLight->isOn() : entry.spotLight->isOn();
+    }
+};
+
+#endif /* shadowCache_h */
@@ -0,0 +1,641 @@
+//
+//  softwareDevice.h
+//  the part of OpenGL the scene uses, implemented on the SoftwareRasterizer and installed
+//  into glad's function pointers, so the meshes, materials and lights draw unchanged without
+//  a GPU. render targets, shadow maps, queries and transform feedback are accepted but inert
+//
+
+#ifndef softwareDevice_h
+#define softwareDevice_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <map>
+#include <tuple>
+#include <functional>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include "softwareRasterizer.h"
+#include "vertexFormat.h"
+
+using namespace std;
+
+class SoftwareDevice {
+public:
+    SoftwareRasterizer rasterizer;
+
+    // statistics
+    unsigned int ignoredDraws = 0;      // draws into framebuffer objects, with rasterizer discard or unsupported formats
+
+    // when set, draws are handed to it instead of the rasterizer, e.g. to export the scene
+    function<void(const SoftwareDraw&)> drawRecorder;
+
+    // constructor
+    SoftwareDevice(int width, int height, int threadCount = 0) : rasterizer(width, height, threadCount)
+    {
+        viewport[2] = width;
+        viewport[3] = height;
+        vaos[0] = VertexArray();
+        // uniforms that change per draw, everything else a program holds is light or camera state
+        const char* perDraw[] = { "model", "color", "material.ambient", "material.diffuse", "material.specular", "material.shininess" };
+        for (const char* name : perDraw)
+        {
+            int location = uniformLocation(name);
+            if ((int)perDrawUniform.size() <= location)
+                perDrawUniform.resize(location + 1, false);
+            perDrawUniform[location] = true;
+        }
+    }
+
+    // points glad at this device, call instead of gladLoadGLLoader. the device has to outlive every GL call
+    void install()
+    {
+        current() = this;
+        glad_glGenVertexArrays = [](GLsizei n, GLuint* arrays) { for (GLsizei i = 0; i < n; i++) { arrays[i] = device().nextName++; device().vaos[arrays[i]] = VertexArray(); } };
+        glad_glBindVertexArray = [](GLuint array) { device().boundVertexArray = array; };
+        glad_glDeleteVertexArrays = [](GLsizei n, const GLuint* arrays) { for (GLsizei i = 0; i < n; i++) if (arrays[i] != 0) device().vaos.erase(arrays[i]); };
+        glad_glGenBuffers = [](GLsizei n, GLuint* buffers) { for (GLsizei i = 0; i < n; i++) buffers[i] = device().nextName++; };
+        glad_glBindBuffer = [](GLenum target, GLuint buffer) { device().bindBuffer(target, buffer); };
+        glad_glBindBufferBase = [](GLenum target, GLuint, GLuint buffer) { device().bindBuffer(target, buffer); };
+        glad_glBufferData = [](GLenum target, GLsizeiptr size, const void* data, GLenum) { device().bufferData(target, 0, size, data, true); };
+        glad_glBufferSubData = [](GLenum target, GLintptr offset, GLsizeiptr size, const void* data) { device().bufferData(target, offset, size, data, false); };
+        glad_glGetBufferSubData = [](GLenum, GLintptr, GLsizeiptr size, void* data) { memset(data, 0, size); };
+        glad_glDeleteBuffers = [](GLsizei n, const GLuint* buffers) { for (GLsizei i = 0; i < n; i++) { device().buffers.erase(buffers[i]); device().forgetDecoded(buffers[i]); } };
+        glad_glVertexAttribPointer = [](GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer) { device().attribPointer(index, size, type, normalized, stride, pointer); };
+        glad_glEnableVertexAttribArray = [](GLuint index) { if (index < MAX_ATTRIBS) device().vaos[device().boundVertexArray].attribs[index].enabled = true; };
+
+        glad_glGenTextures = [](GLsizei n, GLuint* textures) { for (GLsizei i = 0; i < n; i++) textures[i] = device().nextName++; };
+        glad_glActiveTexture = [](GLenum texture) { device().activeUnit = std::min<int>(texture - GL_TEXTURE0, MAX_UNITS - 1); };
+        glad_glBindTexture = [](GLenum target, GLuint texture) { device().bindTexture(target, texture); };
+        glad_glTexImage2D = [](GLenum target, GLint level, GLint, GLsizei width, GLsizei height, GLint, GLenum format, GLenum type, const void* pixels) { if (target == GL_TEXTURE_2D && level == 0) device().texImage(width, height, format, type, pixels); };
+        glad_glTexParameteri = [](GLenum target, GLenum name, GLint param) { if (target == GL_TEXTURE_2D && name == GL_TEXTURE_WRAP_S) device().textures[device().boundTextures[device().activeUnit]].repeat = param == GL_REPEAT; };
+        glad_glPixelStorei = [](GLenum name, GLint param) { if (name == GL_UNPACK_ALIGNMENT) device().unpackAlignment = param; };
+        glad_glDeleteTextures = [](GLsizei n, const GLuint* textures) { for (GLsizei i = 0; i < n; i++) { device().textures.erase(textures[i]); device().textureBuffers.erase(textures[i]); } };
+        glad_glGenerateMipmap = [](GLenum) {};
+        glad_glTexImage3D = [](GLenum, GLint, GLint, GLsizei, GLsizei, GLsizei, GLint, GLenum, GLenum, const void*) {};
+        glad_glTexBuffer = [](GLenum target, GLenum format, GLuint buffer) { if (target == GL_TEXTURE_BUFFER && format == GL_RGBA32F) device().textureBuffers[device().boundBufferTextures[device().activeUnit]] = buffer; };
+
+        glad_glCreateShader = [](GLenum) -> GLuint { return device().nextName++; };
+        glad_glShaderSource = [](GLuint shader, GLsizei count, const GLchar* const* strings, const GLint* lengths)
+        {
+            string& source = device().shaderSources[shader];
+            source.clear();
+            for (GLsizei i = 0; i < count; i++)
+                source += (lengths != nullptr && lengths[i] >= 0) ? string(strings[i], lengths[i]) : string(strings[i]);
+        };
+        glad_glCompileShader = [](GLuint) {};
+        glad_glGetShaderiv = [](GLuint, GLenum name, GLint* params) { *params = name == GL_COMPILE_STATUS ? 1 : 0; };
+        glad_glGetShaderInfoLog = [](GLuint, GLsizei size, GLsizei* length, GLchar* log) { if (size > 0) log[0] = 0; if (length != nullptr) *length = 0; };
+        glad_glDeleteShader = [](GLuint shader) { device().shaderSources.erase(shader); };
+        glad_glCreateProgram = [](void) -> GLuint { GLuint program = device().nextName++; device().programs[program] = Program(); return program; };
+        glad_glAttachShader = [](GLuint program, GLuint shader) { device().programs[program].source += device().shaderSources[shader]; };
+        glad_glLinkProgram = [](GLuint program) { device().linkProgram(device().programs[program]); };
+        glad_glGetProgramiv = [](GLuint, GLenum name, GLint* params) { *params = (name == GL_LINK_STATUS || name == GL_COMPLETION_STATUS_KHR) ? 1 : 0; };
+        glad_glGetProgramInfoLog = [](GLuint, GLsizei size, GLsizei* length, GLchar* log) { if (size > 0) log[0] = 0; if (length != nullptr) *length = 0; };
+        glad_glProgramParameteri = [](GLuint, GLenum, GLint) {};
+        glad_glTransformFeedbackVaryings = [](GLuint, GLsizei, const GLchar* const*, GLenum) {};
+        glad_glUseProgram = [](GLuint program) { device().currentProgram = program; };
+        glad_glDeleteProgram = [](GLuint program) { device().programs.erase(program); };
+
+        glad_glGetUniformLocation = [](GLuint, const GLchar* name) -> GLint { return device().uniformLocation(name); };
+        glad_glUniform1i = [](GLint location, GLint v0) { float value = (float)v0; device().setUniform(location, &value, 1, true); };
+        glad_glUniform1f = [](GLint location, GLfloat v0) { device().setUniform(location, &v0, 1, false); };
+        glad_glUniform2f = [](GLint location, GLfloat v0, GLfloat v1) { float value[2] = { v0, v1 }; device().setUniform(location, value, 2, false); };
+        glad_glUniform2fv = [](GLint location, GLsizei, const GLfloat* value) { device().setUniform(location, value, 2, false); };
+        glad_glUniform3f = [](GLint location, GLfloat v0, GLfloat v1, GLfloat v2) { float value[3] = { v0, v1, v2 }; device().setUniform(location, value, 3, false); };
+        glad_glUniform3fv = [](GLint location, GLsizei, const GLfloat* value) { device().setUniform(location, value, 3, false); };
+        glad_glUniform4f = [](GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3) { float value[4] = { v0, v1, v2, v3 }; device().setUniform(location, value, 4, false); };
+        glad_glUniform4fv = [](GLint location, GLsizei, const GLfloat* value) { device().setUniform(location, value, 4, false); };
+        glad_glUniformMatrix2fv = [](GLint location, GLsizei, GLboolean, const GLfloat* value) { device().setUniform(location, value, 4, false); };
+        glad_glUniformMatrix3fv = [](GLint location, GLsizei, GLboolean, const GLfloat* value) { device().setUniform(location, value, 9, false); };
+        glad_glUniformMatrix4fv = [](GLint location, GLsizei, GLboolean, const GLfloat* value) { device().setUniform(location, value, 16, false); };
+
+        glad_glDrawElements = [](GLenum mode, GLsizei count, GLenum type, const void* indices) { device().drawTriangles(mode, 0, count, type, indices, true); };
+        glad_glDrawArrays = [](GLenum mode, GLint first, GLsizei count) { device().drawTriangles(mode, first, count, GL_UNSIGNED_INT, nullptr, false); };
+        glad_glClearColor = [](GLfloat red, GLfloat green, GLfloat blue, GLfloat) { device().clearColor = glm::vec3(red, green, blue); };
+        glad_glClear = [](GLbitfield mask) { device().clear(mask); };
+        glad_glViewport = [](GLint x, GLint y, GLsizei width, GLsizei height) { int* v = device().viewport; v[0] = x; v[1] = y; v[2] = width; v[3] = height; };
+        glad_glGetIntegerv = [](GLenum name, GLint* data) { if (name == GL_VIEWPORT) memcpy(data, device().viewport, sizeof(device().viewport)); else data[0] = 0; };
+        glad_glGetString = [](GLenum) -> const GLubyte* { return (const GLubyte*)"software rasterizer"; };
+        glad_glEnable = [](GLenum cap) { if (cap == GL_RASTERIZER_DISCARD) device().rasterizerDiscard = true; };
+        glad_glDisable = [](GLenum cap) { if (cap == GL_RASTERIZER_DISCARD) device().rasterizerDiscard = false; };
+        glad_glFinish = [](void) {};
+
+        // render targets
+        glad_glGenFramebuffers = [](GLsizei n, GLuint* framebuffers) { for (GLsizei i = 0; i < n; i++) framebuffers[i] = device().nextName++; };
+        glad_glBindFramebuffer = [](GLenum target, GLuint framebuffer) { if (target != GL_READ_FRAMEBUFFER) device().drawFramebuffer = framebuffer; };
+        glad_glDeleteFramebuffers = [](GLsizei, const GLuint*) {};
+        glad_glCheckFramebufferStatus = [](GLenum) -> GLenum { return GL_FRAMEBUFFER_COMPLETE; };
+        glad_glFramebufferTexture = [](GLenum, GLenum, GLuint, GLint) {};
+        glad_glFramebufferTexture2D = [](GLenum, GLenum, GLenum, GLuint, GLint) {};
+        glad_glFramebufferTextureLayer = [](GLenum, GLenum, GLuint, GLint, GLint) {};
+        glad_glDrawBuffer = [](GLenum) {};
+        glad_glDrawBuffers = [](GLsizei, const GLenum*) {};
+        glad_glReadBuffer = [](GLenum) {};
+        glad_glBlitFramebuffer = [](GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLbitfield, GLenum) {};
+        glad_glReadPixels = [](GLint, GLint, GLsizei width, GLsizei height, GLenum, GLenum, void* pixels) { memset(pixels, 0, (size_t)width * height * 4); };
+        glad_glDepthMask = [](GLboolean) {};
+        glad_glPolygonOffset = [](GLfloat, GLfloat) {};
+        glad_glPolygonMode = [](GLenum, GLenum) {};
+        glad_glBlendFunc = [](GLenum, GLenum) {};
+
+        // queries and transform feedback
+        glad_glGenQueries = [](GLsizei n, GLuint* ids) { for (GLsizei i = 0; i < n; i++) ids[i] = device().nextName++; };
+        glad_glDeleteQueries = [](GLsizei, const GLuint*) {};
+        glad_glBeginQuery = [](GLenum, GLuint) {};
+        glad_glEndQuery = [](GLenum) {};
+        glad_glGetQueryObjectiv = [](GLuint, GLenum name, GLint* params) { *params = name == GL_QUERY_RESULT_AVAILABLE ? 1 : 0; };
+        glad_glGetQueryObjectuiv = [](GLuint, GLenum name, GLuint* params) { *params = name == GL_QUERY_RESULT_AVAILABLE ? 1 : 0; };
+        glad_glGetQueryObjectui64v = [](GLuint, GLenum, GLuint64* params) { *params = 0; };
+        glad_glBeginTransformFeedback = [](GLenum) { device().transformFeedback = true; };
+        glad_glEndTransformFeedback = [](void) { device().transformFeedback = false; };
+    }
+
+    // rasterizes everything drawn since the last glClear of the default framebuffer
+    void endFrame()
+    {
+        rasterizer.endFrame();
+    }
+
+private:
+    static const unsigned int MAX_ATTRIBS = 4;
+    static const int MAX_UNITS = 16;
+
+    struct VertexAttrib {
+        bool enabled = false;
+        GLuint buffer = 0;
+        int size = 0;
+        int stride = 0;
+        size_t offset = 0;
+        bool isFloat = false;
+        GLenum type = GL_FLOAT;
+        bool normalized = false;
+    };
+    // a packed attribute converted to floats, made once per buffer upload
+    struct DecodedKey {
+        GLuint buffer;
+        size_t offset;
+        int stride;
+        GLenum type;
+        bool operator<(const DecodedKey& other) const
+        {
+            return tie(buffer, offset, stride, type) < tie(other.buffer, other.offset, other.stride, other.type);
+        }
+    };
+    struct VertexArray {
+        GLuint elementBuffer = 0;
+        VertexAttrib attribs[MAX_ATTRIBS];
+    };
+    struct Uniform {
+        float value[16] = {};
+        bool isInt = false;
+    };
+    struct Program {
+        string source;
+        bool lit = false;               // Phong program, otherwise the flat colour of the lamp cubes
+        bool permutation = false;       // lights fixed by ShaderPermutations defines
+        int pointLights = 4;
+        bool spotLight = true, dayLight = true, moonLight = true;
+        vector<Uniform> uniforms;
+        // light and camera uniforms are turned into one SoftwareLights per change and frame
+        unsigned int lightsVersion = 1;
+        unsigned int builtVersion = 0;
+        unsigned int builtFrame = 0;
+        int lightsIndex = 0;
+    };
+
+    unsigned int nextName = 1;
+    unordered_map<GLuint, VertexArray> vaos;
+    unordered_map<GLuint, vector<unsigned char>> buffers;
+    map<DecodedKey, vector<float>> decoded;
+    map<tuple<GLuint, int, float, float>, vector<float>> pulled;     // vertex pulled surfaces by profile buffer and slices
+    unordered_map<GLuint, SoftwareTexture> textures;
+    unordered_map<GLuint, string> shaderSources;
+    unordered_map<GLuint, Program> programs;
+    unordered_map<string, int> uniformNames;
+    string uniformKey;                  // reused for lookups, so a long name does not allocate on every call
+    vector<bool> perDrawUniform;
+    GLuint boundVertexArray = 0;
+    GLuint arrayBuffer = 0;
+    unordered_map<GLenum, GLuint> otherBuffers;
+    GLuint boundTextures[MAX_UNITS] = {};
+    GLuint boundBufferTextures[MAX_UNITS] = {};
+    unordered_map<GLuint, GLuint> textureBuffers;     // RGBA32F buffer textures and their buffers
+    int activeUnit = 0;
+    int unpackAlignment = 4;
+    GLuint currentProgram = 0;
+    GLuint drawFramebuffer = 0;
+    bool rasterizerDiscard = false;
+    bool transformFeedback = false;
+    int viewport[4] = { 0, 0, 0, 0 };
+    glm::vec3 clearColor = glm::vec3(0.0f);
+    unsigned int frame = 0;
+    int unlitLights = 0;
+
+    static SoftwareDevice*& current()
+    {
+        static SoftwareDevice* device = nullptr;
+        return device;
+    }
+    static SoftwareDevice& device()
+    {
+        return *current();
+    }
+
+    int uniformLocation(const char* name)
+    {
+        uniformKey.assign(name);
+        auto found = uniformNames.find(uniformKey);
+        if (found != uniformNames.end())
+            return found->second;
+        int location = (int)uniformNames.size();
+        uniformNames[uniformKey] = location;
+        return location;
+    }
+
+    void bindBuffer(GLenum target, GLuint buffer)
+    {
+        if (target == GL_ARRAY_BUFFER)
+            arrayBuffer = buffer;
+        else if (target == GL_ELEMENT_ARRAY_BUFFER)
+            vaos[boundVertexArray].elementBuffer = buffer;
+        else
+            otherBuffers[target] = buffer;
+    }
+
+    void bufferData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data, bool allocate)
+    {
+        GLuint buffer = target == GL_ARRAY_BUFFER ? arrayBuffer : (target == GL_ELEMENT_ARRAY_BUFFER ? vaos[boundVertexArray].elementBuffer : otherBuffers[target]);
+        if (buffer == 0)
+            return;
+        vector<unsigned char>& storage = buffers[buffer];
+        forgetDecoded(buffer);
+        if (allocate)
+            storage.assign(size, 0);
+        if (data != nullptr && (size_t)(offset + size) <= storage.size())
+            memcpy(storage.data() + offset, data, size);
+    }
+
+    void attribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer)
+    {
+        if (index >= MAX_ATTRIBS)
+            return;
+        VertexAttrib& attrib = vaos[boundVertexArray].attribs[index];
+        attrib.buffer = arrayBuffer;
+        attrib.size = size;
+        attrib.isFloat = type == GL_FLOAT;
+        attrib.type = type;
+        attrib.normalized = normalized == GL_TRUE;
+        attrib.stride = stride != 0 ? stride : size * (int)sizeof(float);
+        attrib.offset = (size_t)pointer;
+    }
+
+    void bindTexture(GLenum target, GLuint texture)
+    {
+        if (target == GL_TEXTURE_2D)
+            boundTextures[activeUnit] = texture;
+        else if (target == GL_TEXTURE_BUFFER)
+            boundBufferTextures[activeUnit] = texture;
+    }
+
+    void forgetDecoded(GLuint buffer)
+    {
+        for (auto it = pulled.begin(); it != pulled.end();)
+            it = get<0>(it->first) == buffer ? pulled.erase(it) : next(it);
+        if (decoded.empty())
+            return;
+        auto first = decoded.lower_bound({ buffer, 0, 0, 0 });
+        auto last = first;
+        while (last != decoded.end() && last->first.buffer == buffer)
+            ++last;
+        decoded.erase(first, last);
+    }
+
+    // the attribute as components floats per vertex, or null for a format the rasterizer cannot take. the
+    // packed VertexData formats are converted like the vertex fetch does and kept until the buffer changes
+    const unsigned char* attribFloats(const VertexAttrib& attrib, int components, int& stride)
+    {
+        if (attrib.isFloat)
+        {
+            stride = attrib.stride;
+            return attrib.size == components ? buffers[attrib.buffer].data() + attrib.offset : nullptr;
+        }
+        bool position = attrib.type == GL_UNSIGNED_SHORT && attrib.normalized && attrib.size == 3 && components == 3;
+        bool normal = attrib.type == GL_INT_2_10_10_10_REV && attrib.normalized && attrib.size == 4 && components == 3;
+        bool texCoord = attrib.type == GL_HALF_FLOAT && attrib.size == 2 && components == 2;
+        if (!position && !normal && !texCoord)
+            return nullptr;
+        stride = components * (int)sizeof(float);
+        vector<float>& values = decoded[{ attrib.buffer, attrib.offset, attrib.stride, attrib.type }];
+        if (!values.empty())
+            return (const unsigned char*)values.data();
+        const vector<unsigned char>& storage = buffers[attrib.buffer];
+        size_t elementSize = position ? 6 : 4;
+        size_t count = storage.size() >= attrib.offset + elementSize ? (storage.size() - attrib.offset - elementSize) / attrib.stride + 1 : 0;
+        values.resize(count * components);
+        for (size_t i = 0; i < count; i++)
+        {
+            const unsigned char* source = storage.data() + attrib.offset + i * attrib.stride;
+            float* target = values.data() + i * components;
+            if (position)
+            {
+                unsigned short stored[3];
+                memcpy(stored, source, sizeof(stored));
+                for (int k = 0; k < 3; k++)
+                    target[k] = stored[k] / 65535.0f;
+            }
+            else if (normal)
+            {
+                unsigned int packed;
+                memcpy(&packed, source, sizeof(packed));
+                glm::vec3 n = unpackNormal(packed);
+                target[0] = n.x;
+                target[1] = n.y;
+                target[2] = n.z;
+            }
+            else
+            {
+                unsigned short uv[2];
+                memcpy(uv, source, sizeof(uv));
+                target[0] = halfToFloat(uv[0]);
+                target[1] = halfToFloat(uv[1]);
+            }
+        }
+        return (const unsigned char*)values.data();
+    }
+
+    // what revolutionVertex() in the vertex shaders makes of gl_VertexID 0 to count - 1: position and normal,
+    // 6 floats a vertex. null unless the program's profile sampler is bound to an RGBA32F buffer texture
+    const float* pullRevolution(const Program& program, int count)
+    {
+        int slices = (int)uniform(program, "revolutionSlices").value[0];
+        int unit = (int)uniform(program, "revolutionProfile").value[0];
+        if (slices <= 0 || unit < 0 || unit >= MAX_UNITS)
+            return nullptr;
+        auto texture = textureBuffers.find(boundBufferTextures[unit]);
+        if (texture == textureBuffers.end())
+            return nullptr;
+        float start = floatUniform(program, "revolutionStart"), step = floatUniform(program, "revolutionStep");
+        vector<float>& values = pulled[make_tuple(texture->second, slices, start, step)];
+        if (values.size() >= (size_t)count * 6)
+            return values.data();
+        const vector<unsigned char>& storage = buffers[texture->second];
+        size_t texels = storage.size() / (4 * sizeof(float));
+        values.assign((size_t)count * 6, 0.0f);
+        for (int id = 0; id < count; id++)
+        {
+            int quad = id / 6, corner = id - quad * 6, row = quad / slices;
+            size_t along = (size_t)row + ((corner == 1 || corner == 4 || corner == 5) ? 1 : 0);
+            int slice = quad - row * slices + ((corner == 2 || corner == 3 || corner == 5) ? 1 : 0);
+            if (along >= texels)
+                return nullptr;
+            float profile[4];
+            memcpy(profile, storage.data() + along * sizeof(profile), sizeof(profile));
+            float theta = start + (float)slice * step;
+            float sine = sinf(theta), cosine = cosf(theta);
+            glm::vec2 inward(-1.0f, 0.0f);
+            if (profile[2] * profile[2] + profile[3] * profile[3] > 0.0f)
+                inward = glm::normalize(glm::vec2(-profile[3], profile[2]));
+            float vertex[6] = { profile[0] * sine, profile[1], profile[0] * cosine, inward.x * sine, inward.y, inward.x * cosine };
+            memcpy(&values[(size_t)id * 6], vertex, sizeof(vertex));
+        }
+        return values.data();
+    }
+
+    void texImage(GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels)
+    {
+        SoftwareTexture& texture = textures[boundTextures[activeUnit]];
+        texture.width = width;
+        texture.height = height;
+        texture.channels = format == GL_RED ? 1 : (format == GL_RGBA ? 4 : 3);
+        texture.texels.clear();
+        if (pixels == nullptr || type != GL_UNSIGNED_BYTE)
+            return;
+        // rows are padded to GL_UNPACK_ALIGNMENT like the driver reads them
+        size_t row = (size_t)width * texture.channels;
+        size_t pitch = (row + unpackAlignment - 1) / unpackAlignment * unpackAlignment;
+        texture.texels.resize(row * height);
+        for (GLsizei y = 0; y < height; y++)
+            memcpy(&texture.texels[y * row], (const unsigned char*)pixels + y * pitch, row);
+    }
+
+    // only the defines matter, the shading itself is the rasterizer's Phong model
+    void linkProgram(Program& program)
+    {
+        const string& source = program.source;
+        program.lit = source.find("Material material") != string::npos;
+        program.permutation = source.find("#define SHADER_PERMUTATION") != string::npos;
+        auto defineValue = [&](const string& name, int fallback)
+        {
+            size_t at = source.find("#define " + name + " ");
+            return at == string::npos ? fallback : atoi(source.c_str() + at + name.size() + 9);
+        };
+        program.pointLights = std::min(defineValue("NR_POINT_LIGHTS", 4), (int)SoftwareLights::MAX_POINT_LIGHTS);
+        program.spotLight = defineValue("SPOT_LIGHT", 1) != 0;
+        program.dayLight = defineValue("DAY_LIGHT", 1) != 0;
+        program.moonLight = defineValue("MOON_LIGHT", 1) != 0;
+    }
+
+    void setUniform(GLint location, const float* value, int count, bool isInt)
+    {
+        if (location < 0 || currentProgram == 0)
+            return;
+        Program& program = programs[currentProgram];
+        if ((int)program.uniforms.size() <= location)
+            program.uniforms.resize(location + 1);
+        Uniform& uniform = program.uniforms[location];
+        memcpy(uniform.value, value, count * sizeof(float));
+        uniform.isInt = isInt;
+        if (location >= (int)perDrawUniform.size() || !perDrawUniform[location])
+            program.lightsVersion++;
+    }
+
+    const Uniform& uniform(const Program& program, const char* name)
+    {
+        static const Uniform unset;
+        int location = uniformLocation(name);
+        return location < (int)program.uniforms.size() ? program.uniforms[location] : unset;
+    }
+    glm::vec3 vec3Uniform(const Program& program, const char* name)
+    {
+        const float* v = uniform(program, name).value;
+        return glm::vec3(v[0], v[1], v[2]);
+    }
+    float floatUniform(const Program& program, const char* name)
+    {
+        return uniform(program, name).value[0];
+    }
+    glm::mat4 mat4Uniform(const Program& program, const char* name)
+    {
+        const float* v = uniform(program, name).value;
+        glm::mat4 m(1.0f);
+        for (int c = 0; c < 4; c++)
+            for (int r = 0; r < 4; r++)
+                m[c][r] = v[c * 4 + r];
+        return m;
+    }
+
+    void clear(GLbitfield mask)
+    {
+        if (drawFramebuffer != 0 || !(mask & GL_COLOR_BUFFER_BIT))
+            return;
+        rasterizer.beginFrame(clearColor);
+        frame++;
+        // the lamp cubes' flat colour is the material's ambient term under a white ambient light
+        SoftwareLights unlit;
+        unlit.directionCount = 1;
+        unlit.direction[0].ambient = glm::vec3(1.0f);
+        unlitLights = rasterizer.addLights(unlit);
+    }
+
+    int lightsFor(Program& program)
+    {
+        if (!program.lit)
+            return unlitLights;
+        if (program.builtVersion == program.lightsVersion && program.builtFrame == frame)
+            return program.lightsIndex;
+
+        SoftwareLights lights;
+        lights.viewPos = vec3Uniform(program, "viewPos");
+        lights.pointCount = program.pointLights;
+        for (int i = 0; i < lights.pointCount; i++)
+        {
+            string prefix = "pointLights[" + to_string(i) + "].";
+            SoftwareLights::Point& light = lights.point[i];
+            light.position = vec3Uniform(program, (prefix + "position").c_str());
+            light.ambient = vec3Uniform(program, (prefix + "ambient").c_str());
+            light.diffuse = vec3Uniform(program, (prefix + "diffuse").c_str());
+            light.specular = vec3Uniform(program, (prefix + "specular").c_str());
+            light.k_c = floatUniform(program, (prefix + "k_c").c_str());
+            light.k_l = floatUniform(program, (prefix + "k_l").c_str());
+            light.k_q = floatUniform(program, (prefix + "k_q").c_str());
+        }
+        bool dayOn = program.permutation ? program.dayLight : floatUniform(program, "dayLightOn") != 0.0f;
+        bool moonOn = program.permutation ? program.moonLight : floatUniform(program, "moonLightOn") != 0.0f;
+        for (int i = 0; i < 2; i++)
+        {
+            if (!(i == 0 ? dayOn : moonOn))
+                continue;
+            string prefix = "directionLight[" + to_string(i) + "].";
+            SoftwareLights::Direction& light = lights.direction[lights.directionCount++];
+            light.direction = vec3Uniform(program, (prefix + "direction").c_str());
+            light.ambient = vec3Uniform(program, (prefix + "ambient").c_str());
+            light.diffuse = vec3Uniform(program, (prefix + "diffuse").c_str());
+            light.specular = vec3Uniform(program, (prefix + "specular").c_str());
+        }
+        lights.spotOn = program.permutation ? program.spotLight : floatUniform(program, "spotLightOn") != 0.0f;
+        if (lights.spotOn)
+        {
+            SoftwareLights::Spot& light = lights.spot;
+            light.position = vec3Uniform(program, "spotLight.position");
+            light.direction = vec3Uniform(program, "spotLight.direction");
+            light.ambient = vec3Uniform(program, "spotLight.ambient");
+            light.diffuse = vec3Uniform(program, "spotLight.diffuse");
+            light.specular = vec3Uniform(program, "spotLight.specular");
+            light.k_c = floatUniform(program, "spotLight.k_c");
+            light.k_l = floatUniform(program, "spotLight.k_l");
+            light.k_q = floatUniform(program, "spotLight.k_q");
+            light.cos_theta = floatUniform(program, "spotLight.cos_theta");
+        }
+
+        program.lightsIndex = rasterizer.addLights(lights);
+        program.builtVersion = program.lightsVersion;
+        program.builtFrame = frame;
+        return program.lightsIndex;
+    }
+
+    const SoftwareTexture* textureAt(const Uniform& unit)
+    {
+        int index = (int)unit.value[0];
+        if (index < 0 || index >= MAX_UNITS)
+            return nullptr;
+        auto found = textures.find(boundTextures[index]);
+        return found != textures.end() && !found->second.texels.empty() ? &found->second : nullptr;
+    }
+
+    void drawTriangles(GLenum mode, GLint first, GLsizei count, GLenum type, const void* indices, bool indexed)
+    {
+        VertexArray& vao = vaos[boundVertexArray];
+        VertexAttrib& position = vao.attribs[0];
+        if (mode != GL_TRIANGLES || drawFramebuffer != 0 || rasterizerDiscard || transformFeedback || (frame == 0 && !drawRecorder)
+            || currentProgram == 0 || (indexed && type != GL_UNSIGNED_INT))
+        {
+            ignoredDraws++;
+            return;
+        }
+        Program& program = programs[currentProgram];
+        SoftwareDraw draw;
+        if (!position.enabled)
+        {
+            // a surface of revolution pulls its vertices from its profile
+            const float* vertices = indexed ? nullptr : pullRevolution(program, first + count);
+            if (vertices == nullptr)
+            {
+                ignoredDraws++;
+                return;
+            }
+            draw.positions = (const unsigned char*)vertices;
+            draw.normals = (const unsigned char*)(vertices + 3);
+            draw.positionStride = draw.normalStride = 6 * (int)sizeof(float);
+        }
+        else
+        {
+            draw.positions = attribFloats(position, 3, draw.positionStride);
+            if (draw.positions == nullptr)
+            {
+                ignoredDraws++;
+                return;
+            }
+            VertexAttrib& normal = vao.attribs[1];
+            if (normal.enabled)
+                draw.normals = attribFloats(normal, 3, draw.normalStride);
+            VertexAttrib& texCoord = vao.attribs[2];
+            if (texCoord.enabled)
+                draw.texCoords = attribFloats(texCoord, 2, draw.texCoordStride);
+        }
+        if (indexed)
+            draw.indices = (const unsigned int*)(buffers[vao.elementBuffer].data() + (size_t)indices);
+        draw.first = first;
+        draw.count = count;
+        draw.model = mat4Uniform(program, "model");
+        draw.view = mat4Uniform(program, "view");
+        draw.projection = mat4Uniform(program, "projection");
+
+        SoftwareMaterial& material = draw.material;
+        if (program.lit)
+        {
+            const Uniform& diffuse = uniform(program, "material.diffuse");
+            material.shininess = floatUniform(program, "material.shininess");
+            if (diffuse.isInt)
+            {
+                material.diffuseMap = textureAt(diffuse);
+                material.specularMap = textureAt(uniform(program, "material.specular"));
+            }
+            else
+            {
+                material.ambient = vec3Uniform(program, "material.ambient");
+                material.diffuse = vec3Uniform(program, "material.diffuse");
+                material.specular = vec3Uniform(program, "material.specular");
+            }
+        }
+        else
+        {
+            material.ambient = vec3Uniform(program, "color");
+            material.diffuse = glm::vec3(0.0f);
+            material.specular = glm::vec3(0.0f);
+        }
+        if (drawRecorder)
+        {
+            drawRecorder(draw);
+            return;
+        }
+        draw.lights = lightsFor(program);
+        rasterizer.draw(draw);
+    }
+};
+
+#endif /* softwareDevice_h */
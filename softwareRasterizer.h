@@ -0,0 +1,806 @@
+//
+//  softwareRasterizer.h
+//  CPU renderer for machines without a GPU: draws are transformed, clipped and binned
+//  into screen tiles on all cores, then every tile is rasterized 8 pixels at a time with
+//  a depth pre-pass, so the Phong shading only runs on visible pixels
+//
+
+#ifndef softwareRasterizer_h
+#define softwareRasterizer_h
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <iostream>
+#include "pngWriter.h"
+
+// the AVX2 lanes need a build for AVX2 CPUs (the ReleaseAVX2 configuration, or -mavx2),
+// the other builds run the plain loops
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SOFTWARE_RASTERIZER_AVX2 1
+#endif
+
+using namespace std;
+
+// 8 horizontally adjacent pixels. masks are lanes with all bits set (AVX2) or 1.0 (plain loops)
+#ifdef SOFTWARE_RASTERIZER_AVX2
+struct Lane8 {
+    __m256 v;
+    Lane8() : v(_mm256_setzero_ps()) {}
+    Lane8(__m256 v) : v(v) {}
+    Lane8(float s) : v(_mm256_set1_ps(s)) {}
+    static Lane8 ramp(float start) { return _mm256_add_ps(_mm256_set1_ps(start), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f)); }
+    static Lane8 load(const float* p) { return _mm256_loadu_ps(p); }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+inline Lane8 operator+(Lane8 a, Lane8 b) { return _mm256_add_ps(a.v, b.v); }
+inline Lane8 operator-(Lane8 a, Lane8 b) { return _mm256_sub_ps(a.v, b.v); }
+inline Lane8 operator*(Lane8 a, Lane8 b) { return _mm256_mul_ps(a.v, b.v); }
+inline Lane8 operator/(Lane8 a, Lane8 b) { return _mm256_div_ps(a.v, b.v); }
+inline Lane8 minLane(Lane8 a, Lane8 b) { return _mm256_min_ps(a.v, b.v); }
+inline Lane8 maxLane(Lane8 a, Lane8 b) { return _mm256_max_ps(a.v, b.v); }
+inline Lane8 sqrtLane(Lane8 a) { return _mm256_sqrt_ps(a.v); }
+inline Lane8 lessThan(Lane8 a, Lane8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+inline Lane8 greaterThan(Lane8 a, Lane8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+inline Lane8 greaterEqual(Lane8 a, Lane8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+inline Lane8 equal(Lane8 a, Lane8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+inline Lane8 maskAnd(Lane8 a, Lane8 b) { return _mm256_and_ps(a.v, b.v); }
+inline Lane8 select(Lane8 mask, Lane8 a, Lane8 b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+inline int maskBits(Lane8 mask) { return _mm256_movemask_ps(mask.v); }
+#else
+struct Lane8 {
+    float v[8];
+    Lane8() { for (int i = 0; i < 8; i++) v[i] = 0.0f; }
+    Lane8(float s) { for (int i = 0; i < 8; i++) v[i] = s; }
+    static Lane8 ramp(float start) { Lane8 r; for (int i = 0; i < 8; i++) r.v[i] = start + i; return r; }
+    static Lane8 load(const float* p) { Lane8 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+    void store(float* p) const { memcpy(p, v, sizeof(v)); }
+};
+#define SOFTWARE_LANE8_OP(name, expr) inline Lane8 name(Lane8 a, Lane8 b) { Lane8 r; for (int i = 0; i < 8; i++) r.v[i] = (expr); return r; }
+SOFTWARE_LANE8_OP(operator+, a.v[i] + b.v[i])
+SOFTWARE_LANE8_OP(operator-, a.v[i] - b.v[i])
+SOFTWARE_LANE8_OP(operator*, a.v[i] * b.v[i])
+SOFTWARE_LANE8_OP(operator/, a.v[i] / b.v[i])
+SOFTWARE_LANE8_OP(minLane, std::min(a.v[i], b.v[i]))
+SOFTWARE_LANE8_OP(maxLane, std::max(a.v[i], b.v[i]))
+SOFTWARE_LANE8_OP(lessThan, a.v[i] < b.v[i] ? 1.0f : 0.0f)
+SOFTWARE_LANE8_OP(greaterThan, a.v[i] > b.v[i] ? 1.0f : 0.0f)
+SOFTWARE_LANE8_OP(greaterEqual, a.v[i] >= b.v[i] ? 1.0f : 0.0f)
+SOFTWARE_LANE8_OP(equal, a.v[i] == b.v[i] ? 1.0f : 0.0f)
+SOFTWARE_LANE8_OP(maskAnd, (a.v[i] != 0.0f && b.v[i] != 0.0f) ? 1.0f : 0.0f)
+#undef SOFTWARE_LANE8_OP
+inline Lane8 sqrtLane(Lane8 a) { Lane8 r; for (int i = 0; i < 8; i++) r.v[i] = sqrt(a.v[i]); return r; }
+inline Lane8 select(Lane8 mask, Lane8 a, Lane8 b) { Lane8 r; for (int i = 0; i < 8; i++) r.v[i] = mask.v[i] != 0.0f ? a.v[i] : b.v[i]; return r; }
+inline int maskBits(Lane8 mask) { int bits = 0; for (int i = 0; i < 8; i++) if (mask.v[i] != 0.0f) bits |= 1 << i; return bits; }
+#endif
+
+struct Vec3Lane8 {
+    Lane8 x, y, z;
+    Vec3Lane8() {}
+    Vec3Lane8(Lane8 x, Lane8 y, Lane8 z) : x(x), y(y), z(z) {}
+    Vec3Lane8(const glm::vec3& v) : x(v.x), y(v.y), z(v.z) {}
+};
+inline Vec3Lane8 operator+(const Vec3Lane8& a, const Vec3Lane8& b) { return Vec3Lane8(a.x + b.x, a.y + b.y, a.z + b.z); }
+inline Vec3Lane8 operator-(const Vec3Lane8& a, const Vec3Lane8& b) { return Vec3Lane8(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline Vec3Lane8 operator*(const Vec3Lane8& a, const Vec3Lane8& b) { return Vec3Lane8(a.x * b.x, a.y * b.y, a.z * b.z); }
+inline Vec3Lane8 operator*(const Vec3Lane8& a, Lane8 s) { return Vec3Lane8(a.x * s, a.y * s, a.z * s); }
+inline Lane8 dot(const Vec3Lane8& a, const Vec3Lane8& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Vec3Lane8 normalize(const Vec3Lane8& a) { return a * (Lane8(1.0f) / maxLane(sqrtLane(dot(a, a)), Lane8(1e-20f))); }
+
+// pow has no cheap vector form, it is only evaluated for the lanes that see a highlight
+inline Lane8 powLane(Lane8 base, float exponent)
+{
+    float lanes[8];
+    base.store(lanes);
+    for (int i = 0; i < 8; i++)
+        lanes[i] = lanes[i] > 0.0f ? pow(lanes[i], exponent) : 0.0f;
+    return Lane8::load(lanes);
+}
+
+// persistent workers, the calling thread takes part in every parallelFor
+class SoftwareThreadPool {
+public:
+    // constructor
+    SoftwareThreadPool(int threadCount)
+    {
+        for (int i = 1; i < threadCount; i++)
+            workers.emplace_back(&SoftwareThreadPool::workerLoop, this, i);
+    }
+
+    // destructor
+    ~SoftwareThreadPool()
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (thread& worker : workers)
+            worker.join();
+    }
+
+    int size() const
+    {
+        return (int)workers.size() + 1;
+    }
+
+    // job(index, thread) for every index in [0, count), indices are handed out in order
+    void parallelFor(int count, const function<void(int, int)>& job)
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            currentJob = &job;
+            jobCount = count;
+            next = 0;
+            busy = (int)workers.size();
+            generation++;
+        }
+        wake.notify_all();
+        run(0);
+        unique_lock<mutex> waitLock(lock);
+        done.wait(waitLock, [this]() { return busy == 0; });
+        currentJob = nullptr;
+    }
+
+private:
+    vector<thread> workers;
+    mutex lock;
+    condition_variable wake;
+    condition_variable done;
+    const function<void(int, int)>* currentJob = nullptr;
+    int jobCount = 0;
+    atomic<int> next{ 0 };
+    int busy = 0;
+    unsigned int generation = 0;
+    bool stopping = false;
+
+    void run(int threadIndex)
+    {
+        for (int i = next++; i < jobCount; i = next++)
+            (*currentJob)(i, threadIndex);
+    }
+
+    void workerLoop(int threadIndex)
+    {
+        unsigned int seen = 0;
+        while (true)
+        {
+            {
+                unique_lock<mutex> waitLock(lock);
+                wake.wait(waitLock, [&]() { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+            run(threadIndex);
+            {
+                lock_guard<mutex> guard(lock);
+                if (--busy == 0)
+                    done.notify_one();
+            }
+        }
+    }
+};
+
+struct SoftwareTexture {
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    bool repeat = true;         // GL_REPEAT, otherwise clamped to the edge
+    vector<unsigned char> texels;
+
+    // bilinear, the first row is v = 0 like a texture uploaded with glTexImage2D
+    glm::vec3 sample(float u, float v) const
+    {
+        if (texels.empty())
+            return glm::vec3(1.0f);
+        float x = u * width - 0.5f;
+        float y = v * height - 0.5f;
+        int x0 = (int)floor(x);
+        int y0 = (int)floor(y);
+        float fx = x - x0;
+        float fy = y - y0;
+        glm::vec3 c00 = texel(x0, y0), c10 = texel(x0 + 1, y0), c01 = texel(x0, y0 + 1), c11 = texel(x0 + 1, y0 + 1);
+        return (c00 * (1.0f - fx) + c10 * fx) * (1.0f - fy) + (c01 * (1.0f - fx) + c11 * fx) * fy;
+    }
+
+private:
+    glm::vec3 texel(int x, int y) const
+    {
+        if (repeat)
+        {
+            x = ((x % width) + width) % width;
+            y = ((y % height) + height) % height;
+        }
+        else
+        {
+            x = std::min(std::max(x, 0), width - 1);
+            y = std::min(std::max(y, 0), height - 1);
+        }
+        const unsigned char* p = &texels[((size_t)y * width + x) * channels];
+        if (channels < 3)
+            return glm::vec3(p[0] / 255.0f);
+        return glm::vec3(p[0] / 255.0f, p[1] / 255.0f, p[2] / 255.0f);
+    }
+};
+
+struct SoftwareMaterial {
+    glm::vec3 ambient = glm::vec3(1.0f);
+    glm::vec3 diffuse = glm::vec3(1.0f);
+    glm::vec3 specular = glm::vec3(0.5f);
+    float shininess = 32.0f;
+    // textured materials take ambient and diffuse from diffuseMap and specular from specularMap
+    const SoftwareTexture* diffuseMap = nullptr;
+    const SoftwareTexture* specularMap = nullptr;
+};
+
+// the light uniforms of the forward Phong shaders
+struct SoftwareLights {
+    static const int MAX_POINT_LIGHTS = 4;
+    static const int MAX_DIRECTION_LIGHTS = 2;
+    struct Point {
+        glm::vec3 position = glm::vec3(0.0f), ambient = glm::vec3(0.0f), diffuse = glm::vec3(0.0f), specular = glm::vec3(0.0f);
+        float k_c = 1.0f, k_l = 0.0f, k_q = 0.0f;
+    };
+    struct Direction {
+        glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f), ambient = glm::vec3(0.0f), diffuse = glm::vec3(0.0f), specular = glm::vec3(0.0f);
+    };
+    struct Spot {
+        glm::vec3 position = glm::vec3(0.0f), direction = glm::vec3(0.0f, -1.0f, 0.0f);
+        glm::vec3 ambient = glm::vec3(0.0f), diffuse = glm::vec3(0.0f), specular = glm::vec3(0.0f);
+        float k_c = 1.0f, k_l = 0.0f, k_q = 0.0f, cos_theta = 1.0f;
+    };
+
+    int pointCount = 0;
+    Point point[MAX_POINT_LIGHTS];
+    int directionCount = 0;
+    Direction direction[MAX_DIRECTION_LIGHTS];
+    bool spotOn = false;
+    Spot spot;
+    glm::vec3 viewPos = glm::vec3(0.0f);
+};
+
+// one triangle list draw. attributes are read from the caller's memory during endFrame(),
+// so it has to stay untouched until then
+struct SoftwareDraw {
+    const unsigned char* positions = nullptr;
+    int positionStride = 12;
+    const unsigned char* normals = nullptr;         // null gives +y normals
+    int normalStride = 12;
+    const unsigned char* texCoords = nullptr;
+    int texCoordStride = 8;
+    const unsigned int* indices = nullptr;          // null draws the vertices in order
+    int first = 0;
+    int count = 0;
+    glm::mat4 model = glm::mat4(1.0f);
+    glm::mat4 view = glm::mat4(1.0f);
+    glm::mat4 projection = glm::mat4(1.0f);
+    SoftwareMaterial material;
+    int lights = 0;                                 // index returned by addLights()
+};
+
+class SoftwareRasterizer {
+public:
+    static const int TILE_SIZE = 32;
+
+    int width;
+    int height;
+
+    // statistics of the last frame
+    unsigned int drawCount = 0;
+    unsigned int triangleCount = 0;     // after clipping and culling
+    unsigned int binnedTriangles = 0;   // triangle references over all tiles
+    double geometryMs = 0.0;
+    double rasterMs = 0.0;
+
+    // constructor, threadCount 0 uses every core
+    SoftwareRasterizer(int width, int height, int threadCount = 0)
+    {
+        this->width = width;
+        this->height = height;
+        tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+        tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+        colorBuffer.assign((size_t)width * height * 3, 0);
+        setThreadCount(threadCount);
+    }
+
+    void setThreadCount(int threadCount)
+    {
+        if (threadCount <= 0)
+            threadCount = std::max(1, (int)thread::hardware_concurrency());
+        pool.reset(new SoftwareThreadPool(threadCount));
+    }
+
+    int getThreadCount() const
+    {
+        return pool->size();
+    }
+
+    void beginFrame(const glm::vec3& clearColor)
+    {
+        draws.clear();
+        lightSets.clear();
+        unsigned char clear[3] = { toByte(clearColor.x), toByte(clearColor.y), toByte(clearColor.z) };
+        for (size_t i = 0; i < colorBuffer.size(); i += 3)
+            memcpy(&colorBuffer[i], clear, 3);
+    }
+
+    int addLights(const SoftwareLights& lights)
+    {
+        lightSets.push_back(lights);
+        return (int)lightSets.size() - 1;
+    }
+
+    void draw(const SoftwareDraw& draw)
+    {
+        if (draw.count >= 3 && draw.positions != nullptr)
+            draws.push_back(draw);
+    }
+
+    // geometry on all cores into per job tile bins, then every tile on its own
+    void endFrame()
+    {
+        auto start = chrono::high_resolution_clock::now();
+        drawCount = (unsigned int)draws.size();
+        splitGeometryJobs();
+        pool->parallelFor((int)jobs.size(), [this](int job, int) { processGeometry(jobs[job]); });
+        auto geometryEnd = chrono::high_resolution_clock::now();
+
+        pool->parallelFor(tilesX * tilesY, [this](int tile, int threadIndex) { rasterizeTile(tile, threadIndex); });
+        auto rasterEnd = chrono::high_resolution_clock::now();
+
+        triangleCount = 0;
+        binnedTriangles = 0;
+        for (const GeometryJob& job : jobs)
+        {
+            triangleCount += (unsigned int)job.triangles.size();
+            for (const vector<unsigned int>& bin : job.bins)
+                binnedTriangles += (unsigned int)bin.size();
+        }
+        geometryMs = chrono::duration<double, milli>(geometryEnd - start).count();
+        rasterMs = chrono::duration<double, milli>(rasterEnd - geometryEnd).count();
+    }
+
+    // RGB8, bottom row first like glReadPixels
+    const vector<unsigned char>& pixels() const
+    {
+        return colorBuffer;
+    }
+
+    bool writePNG(const string& path) const
+    {
+        return PngWriter::write(path, width, height, colorBuffer);
+    }
+
+private:
+    struct Vertex {
+        glm::vec4 clip;
+        glm::vec3 world;
+        glm::vec3 normal;
+        glm::vec2 uv;
+    };
+    // edge i is the one opposite vertex i. it is evaluated from its lower endpoint (x, y) along
+    // (dx, dy) whichever triangle it belongs to, so both triangles sharing it get exactly opposite
+    // values and sign turns that into the barycentric of vertex i times |area|. pixels exactly on
+    // the edge go to the triangle with a positive sign. the 1/w weights make the attribute
+    // interpolation perspective correct
+    struct Triangle {
+        float edgeX[3], edgeY[3], edgeDX[3], edgeDY[3], edgeSign[3];
+        float inverseArea;
+        float z[3];
+        float invW[3];
+        glm::vec3 world[3];
+        glm::vec3 normal[3];
+        glm::vec2 uv[3];
+        int draw;
+        int minX, minY, maxX, maxY;
+    };
+    // a contiguous range of draws, so the bins keep the submission order
+    struct GeometryJob {
+        int firstDraw = 0;
+        int endDraw = 0;
+        vector<Triangle> triangles;
+        vector<vector<unsigned int>> bins;
+        vector<Vertex> vertices;
+    };
+
+    int tilesX, tilesY;
+    unique_ptr<SoftwareThreadPool> pool;
+    vector<unsigned char> colorBuffer;
+    vector<SoftwareDraw> draws;
+    vector<SoftwareLights> lightSets;
+    vector<GeometryJob> jobs;
+
+    static unsigned char toByte(float value)
+    {
+        return (unsigned char)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+    }
+
+    // about 4 jobs per thread with a similar number of triangles each
+    void splitGeometryJobs()
+    {
+        size_t totalTriangles = 0;
+        for (const SoftwareDraw& draw : draws)
+            totalTriangles += draw.count / 3;
+        int jobCount = std::max(1, std::min((int)draws.size(), pool->size() * 4));
+        size_t perJob = totalTriangles / jobCount + 1;
+
+        if ((int)jobs.size() < jobCount)
+            jobs.resize(jobCount);
+        int used = 0;
+        size_t filled = 0;
+        int first = 0;
+        for (int d = 0; d < (int)draws.size(); d++)
+        {
+            filled += draws[d].count / 3;
+            if (filled >= perJob || d + 1 == (int)draws.size())
+            {
+                jobs[used].firstDraw = first;
+                jobs[used].endDraw = d + 1;
+                used++;
+                first = d + 1;
+                filled = 0;
+            }
+        }
+        jobs.resize(used);
+        for (GeometryJob& job : jobs)
+        {
+            job.triangles.clear();
+            job.bins.resize((size_t)tilesX * tilesY);
+            for (vector<unsigned int>& bin : job.bins)
+                bin.clear();
+        }
+    }
+
+    void processGeometry(GeometryJob& job)
+    {
+        for (int d = job.firstDraw; d < job.endDraw; d++)
+        {
+            const SoftwareDraw& draw = draws[d];
+            glm::mat4 viewProjection = draw.projection * draw.view;
+            glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(draw.model)));
+
+            // every referenced vertex is transformed once per draw
+            unsigned int minIndex = 0xFFFFFFFFu, maxIndex = 0;
+            for (int i = 0; i < draw.count; i++)
+            {
+                unsigned int index = draw.indices != nullptr ? draw.indices[draw.first + i] : (unsigned int)(draw.first + i);
+                minIndex = std::min(minIndex, index);
+                maxIndex = std::max(maxIndex, index);
+            }
+            job.vertices.resize(maxIndex - minIndex + 1);
+            for (unsigned int index = minIndex; index <= maxIndex; index++)
+            {
+                Vertex& vertex = job.vertices[index - minIndex];
+                float p[3], n[3] = { 0.0f, 1.0f, 0.0f }, t[2] = { 0.0f, 0.0f };
+                memcpy(p, draw.positions + (size_t)index * draw.positionStride, sizeof(p));
+                if (draw.normals != nullptr)
+                    memcpy(n, draw.normals + (size_t)index * draw.normalStride, sizeof(n));
+                if (draw.texCoords != nullptr)
+                    memcpy(t, draw.texCoords + (size_t)index * draw.texCoordStride, sizeof(t));
+                glm::vec4 world = draw.model * glm::vec4(p[0], p[1], p[2], 1.0f);
+                vertex.world = glm::vec3(world);
+                vertex.clip = viewProjection * world;
+                vertex.normal = normalMatrix * glm::vec3(n[0], n[1], n[2]);
+                vertex.uv = glm::vec2(t[0], t[1]);
+            }
+
+            for (int i = 0; i + 2 < draw.count; i += 3)
+            {
+                const Vertex* v[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int index = draw.indices != nullptr ? draw.indices[draw.first + i + k] : (unsigned int)(draw.first + i + k);
+                    v[k] = &job.vertices[index - minIndex];
+                }
+                clipAndSetUp(job, d, *v[0], *v[1], *v[2]);
+            }
+        }
+    }
+
+    static Vertex lerp(const Vertex& a, const Vertex& b, float t)
+    {
+        Vertex r;
+        r.clip = a.clip + (b.clip - a.clip) * t;
+        r.world = a.world + (b.world - a.world) * t;
+        r.normal = a.normal + (b.normal - a.normal) * t;
+        r.uv = a.uv + (b.uv - a.uv) * t;
+        return r;
+    }
+
+    // only the near plane is clipped, x, y and far are handled by the bounding box and the depth test
+    void clipAndSetUp(GeometryJob& job, int drawIndex, const Vertex& a, const Vertex& b, const Vertex& c)
+    {
+        const Vertex* v[3] = { &a, &b, &c };
+        // whole triangle outside one plane
+        for (int axis = 0; axis < 3; axis++)
+        {
+            bool allBelow = true, allAbove = true;
+            for (int k = 0; k < 3; k++)
+            {
+                allBelow = allBelow && v[k]->clip[axis] < -v[k]->clip.w;
+                allAbove = allAbove && v[k]->clip[axis] > v[k]->clip.w;
+            }
+            if (allBelow || allAbove)
+                return;
+        }
+
+        float d[3];
+        bool allInside = true;
+        for (int k = 0; k < 3; k++)
+        {
+            d[k] = v[k]->clip.z + v[k]->clip.w;
+            allInside = allInside && d[k] >= 0.0f;
+        }
+        if (allInside)
+        {
+            setUp(job, drawIndex, a, b, c);
+            return;
+        }
+
+        Vertex polygon[4];
+        int count = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            int next = (k + 1) % 3;
+            if (d[k] >= 0.0f)
+                polygon[count++] = *v[k];
+            if ((d[k] >= 0.0f) != (d[next] >= 0.0f))
+                polygon[count++] = lerp(*v[k], *v[next], d[k] / (d[k] - d[next]));
+        }
+        for (int k = 1; k + 1 < count; k++)
+            setUp(job, drawIndex, polygon[0], polygon[k], polygon[k + 1]);
+    }
+
+    void setUp(GeometryJob& job, int drawIndex, const Vertex& a, const Vertex& b, const Vertex& c)
+    {
+        const Vertex* v[3] = { &a, &b, &c };
+        Triangle triangle;
+        float x[3], y[3];
+        for (int k = 0; k < 3; k++)
+        {
+            float invW = 1.0f / v[k]->clip.w;
+            x[k] = (v[k]->clip.x * invW * 0.5f + 0.5f) * width;
+            y[k] = (v[k]->clip.y * invW * 0.5f + 0.5f) * height;
+            triangle.z[k] = v[k]->clip.z * invW * 0.5f + 0.5f;
+            triangle.invW[k] = invW;
+            triangle.world[k] = v[k]->world;
+            triangle.normal[k] = v[k]->normal;
+            triangle.uv[k] = v[k]->uv;
+        }
+        // nothing is culled, the scene is drawn without GL_CULL_FACE
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (fabs(area) < 1e-8f)
+            return;
+        for (int i = 0; i < 3; i++)
+        {
+            int j = (i + 1) % 3, k = (i + 2) % 3;
+            bool swapped = x[k] < x[j] || (x[k] == x[j] && y[k] < y[j]);
+            int from = swapped ? k : j, to = swapped ? j : k;
+            triangle.edgeX[i] = x[from];
+            triangle.edgeY[i] = y[from];
+            triangle.edgeDX[i] = x[to] - x[from];
+            triangle.edgeDY[i] = y[to] - y[from];
+            triangle.edgeSign[i] = (swapped != (area < 0.0f)) ? -1.0f : 1.0f;
+        }
+        triangle.inverseArea = 1.0f / fabs(area);
+        triangle.minX = std::max(0, (int)floor(std::min({ x[0], x[1], x[2] })));
+        triangle.minY = std::max(0, (int)floor(std::min({ y[0], y[1], y[2] })));
+        triangle.maxX = std::min(width - 1, (int)ceil(std::max({ x[0], x[1], x[2] })));
+        triangle.maxY = std::min(height - 1, (int)ceil(std::max({ y[0], y[1], y[2] })));
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+            return;
+        triangle.draw = drawIndex;
+
+        unsigned int index = (unsigned int)job.triangles.size();
+        job.triangles.push_back(triangle);
+        for (int ty = triangle.minY / TILE_SIZE; ty <= triangle.maxY / TILE_SIZE; ty++)
+            for (int tx = triangle.minX / TILE_SIZE; tx <= triangle.maxX / TILE_SIZE; tx++)
+                job.bins[(size_t)ty * tilesX + tx].push_back(index);
+    }
+
+    // calls visit(triangle, y, x, inside mask, barycentrics, depth) for every 8 pixel block of the
+    // triangle inside the tile that has at least one covered pixel
+    template <typename Visit>
+    void forEachBlock(const Triangle& triangle, int tileX0, int tileY0, int tileX1, int tileY1, Visit visit) const
+    {
+        int startX = std::max(triangle.minX, tileX0);
+        startX = tileX0 + ((startX - tileX0) & ~7);
+        int endX = std::min(triangle.maxX, tileX1 - 1);
+        int startY = std::max(triangle.minY, tileY0);
+        int endY = std::min(triangle.maxY, tileY1 - 1);
+        Lane8 zero(0.0f);
+        Lane8 tileEnd((float)tileX1);
+        for (int y = startY; y <= endY; y++)
+        {
+            float fy = y + 0.5f;
+            float row[3];
+            for (int i = 0; i < 3; i++)
+                row[i] = triangle.edgeDX[i] * (fy - triangle.edgeY[i]);
+            for (int x = startX; x <= endX; x += 8)
+            {
+                Lane8 px = Lane8::ramp(x + 0.5f);
+                Lane8 inside = lessThan(px, tileEnd);
+                Lane8 edge[3];
+                for (int i = 0; i < 3; i++)
+                {
+                    edge[i] = (Lane8(row[i]) - Lane8(triangle.edgeDY[i]) * (px - Lane8(triangle.edgeX[i]))) * Lane8(triangle.edgeSign[i]);
+                    inside = maskAnd(inside, triangle.edgeSign[i] > 0.0f ? greaterEqual(edge[i], zero) : greaterThan(edge[i], zero));
+                }
+                if (maskBits(inside) == 0)
+                    continue;
+                Lane8 inverseArea(triangle.inverseArea);
+                Lane8 l0 = edge[0] * inverseArea;
+                Lane8 l1 = edge[1] * inverseArea;
+                Lane8 l2 = edge[2] * inverseArea;
+                Lane8 z = l0 * Lane8(triangle.z[0]) + l1 * Lane8(triangle.z[1]) + l2 * Lane8(triangle.z[2]);
+                visit(y, x, inside, l0, l1, l2, z);
+            }
+        }
+    }
+
+    // depth pre-pass over the tile's triangles, then shading of the first triangle that reached each pixel's depth
+    void rasterizeTile(int tile, int)
+    {
+        int tileX0 = (tile % tilesX) * TILE_SIZE;
+        int tileY0 = (tile / tilesX) * TILE_SIZE;
+        int tileX1 = std::min(tileX0 + TILE_SIZE, width);
+        int tileY1 = std::min(tileY0 + TILE_SIZE, height);
+        // padded so a block starting at the last column never reads past the end
+        float depth[TILE_SIZE * (TILE_SIZE + 8)];
+        float shaded[TILE_SIZE * (TILE_SIZE + 8)];
+        const int stride = TILE_SIZE + 8;
+        for (int i = 0; i < TILE_SIZE * stride; i++)
+        {
+            depth[i] = 1.0f;
+            shaded[i] = 0.0f;
+        }
+
+        for (const GeometryJob& job : jobs)
+        {
+            for (unsigned int index : job.bins[tile])
+            {
+                const Triangle& triangle = job.triangles[index];
+                forEachBlock(triangle, tileX0, tileY0, tileX1, tileY1, [&](int y, int x, Lane8 inside, Lane8, Lane8, Lane8, Lane8 z)
+                    {
+                        float* d = &depth[(y - tileY0) * stride + (x - tileX0)];
+                        Lane8 current = Lane8::load(d);
+                        Lane8 pass = maskAnd(inside, lessThan(z, current));
+                        select(pass, z, current).store(d);
+                    });
+            }
+        }
+
+        for (const GeometryJob& job : jobs)
+        {
+            for (unsigned int index : job.bins[tile])
+            {
+                const Triangle& triangle = job.triangles[index];
+                forEachBlock(triangle, tileX0, tileY0, tileX1, tileY1, [&](int y, int x, Lane8 inside, Lane8 l0, Lane8 l1, Lane8 l2, Lane8 z)
+                    {
+                        int offset = (y - tileY0) * stride + (x - tileX0);
+                        Lane8 done = Lane8::load(&shaded[offset]);
+                        Lane8 visible = maskAnd(maskAnd(inside, equal(z, Lane8::load(&depth[offset]))), equal(done, Lane8(0.0f)));
+                        int bits = maskBits(visible);
+                        if (bits == 0)
+                            return;
+                        shade(triangle, y, x, bits, l0, l1, l2);
+                        select(visible, Lane8(1.0f), done).store(&shaded[offset]);
+                    });
+            }
+        }
+    }
+
+    // the forward Phong shaders without shadows, perspective correct attributes
+    void shade(const Triangle& triangle, int y, int x, int bits, Lane8 l0, Lane8 l1, Lane8 l2)
+    {
+        const SoftwareDraw& draw = draws[triangle.draw];
+        const SoftwareMaterial& material = draw.material;
+        const SoftwareLights& lights = lightSets[draw.lights];
+
+        Lane8 w0 = l0 * Lane8(triangle.invW[0]);
+        Lane8 w1 = l1 * Lane8(triangle.invW[1]);
+        Lane8 w2 = l2 * Lane8(triangle.invW[2]);
+        Lane8 inverseSum = Lane8(1.0f) / (w0 + w1 + w2);
+        w0 = w0 * inverseSum;
+        w1 = w1 * inverseSum;
+        w2 = w2 * inverseSum;
+        Vec3Lane8 P = Vec3Lane8(triangle.world[0]) * w0 + Vec3Lane8(triangle.world[1]) * w1 + Vec3Lane8(triangle.world[2]) * w2;
+        Vec3Lane8 N = normalize(Vec3Lane8(triangle.normal[0]) * w0 + Vec3Lane8(triangle.normal[1]) * w1 + Vec3Lane8(triangle.normal[2]) * w2);
+        Vec3Lane8 V = normalize(Vec3Lane8(lights.viewPos) - P);
+
+        Vec3Lane8 K_A(material.ambient), K_D(material.diffuse), K_S(material.specular);
+        if (material.diffuseMap != nullptr)
+        {
+            Lane8 u = Lane8(triangle.uv[0].x) * w0 + Lane8(triangle.uv[1].x) * w1 + Lane8(triangle.uv[2].x) * w2;
+            Lane8 v = Lane8(triangle.uv[0].y) * w0 + Lane8(triangle.uv[1].y) * w1 + Lane8(triangle.uv[2].y) * w2;
+            float us[8], vs[8], diffuse[3][8] = {}, specular[3][8] = {};
+            u.store(us);
+            v.store(vs);
+            for (int i = 0; i < 8; i++)
+            {
+                if (!(bits & (1 << i)))
+                    continue;
+                glm::vec3 d = material.diffuseMap->sample(us[i], vs[i]);
+                glm::vec3 s = material.specularMap != nullptr ? material.specularMap->sample(us[i], vs[i]) : d;
+                for (int c = 0; c < 3; c++)
+                {
+                    diffuse[c][i] = d[c];
+                    specular[c][i] = s[c];
+                }
+            }
+            K_D = Vec3Lane8(Lane8::load(diffuse[0]), Lane8::load(diffuse[1]), Lane8::load(diffuse[2]));
+            K_A = K_D;
+            K_S = Vec3Lane8(Lane8::load(specular[0]), Lane8::load(specular[1]), Lane8::load(specular[2]));
+        }
+
+        Lane8 zero(0.0f);
+        Vec3Lane8 result(zero, zero, zero);
+        auto phong = [&](const Vec3Lane8& L, const glm::vec3& ambient, const glm::vec3& diffuse, const glm::vec3& specular, Lane8 scale)
+        {
+            Lane8 nDotL = dot(N, L);
+            Vec3Lane8 R = N * (nDotL + nDotL) - L;
+            Lane8 highlight = maxLane(dot(V, R), zero);
+            Lane8 spec = maskBits(lessThan(zero, highlight)) != 0 ? powLane(highlight, material.shininess) : zero;
+            result = result + (K_A * Vec3Lane8(ambient) + K_D * Vec3Lane8(diffuse) * maxLane(nDotL, zero) + K_S * Vec3Lane8(specular) * spec) * scale;
+        };
+        auto attenuation = [&](const glm::vec3& position, float k_c, float k_l, float k_q, Vec3Lane8& L)
+        {
+            L = Vec3Lane8(position) - P;
+            Lane8 d = sqrtLane(dot(L, L));
+            L = L * (Lane8(1.0f) / maxLane(d, Lane8(1e-20f)));
+            return Lane8(1.0f) / (Lane8(k_c) + Lane8(k_l) * d + Lane8(k_q) * d * d);
+        };
+
+        for (int i = 0; i < lights.pointCount; i++)
+        {
+            const SoftwareLights::Point& light = lights.point[i];
+            Vec3Lane8 L;
+            Lane8 scale = attenuation(light.position, light.k_c, light.k_l, light.k_q, L);
+            phong(L, light.ambient, light.diffuse, light.specular, scale);
+        }
+        for (int i = 0; i < lights.directionCount; i++)
+        {
+            const SoftwareLights::Direction& light = lights.direction[i];
+            phong(Vec3Lane8(glm::normalize(-light.direction)), light.ambient, light.diffuse, light.specular, Lane8(1.0f));
+        }
+        if (lights.spotOn)
+        {
+            const SoftwareLights::Spot& light = lights.spot;
+            Vec3Lane8 L;
+            Lane8 scale = attenuation(light.position, light.k_c, light.k_l, light.k_q, L);
+            Lane8 cosAlpha = dot(L, Vec3Lane8(glm::normalize(-light.direction)));
+            Lane8 intensity = select(greaterEqual(cosAlpha, Lane8(light.cos_theta)), cosAlpha, zero);
+            phong(L, light.ambient, light.diffuse, light.specular, scale * intensity);
+        }
+
+        float channels[3][8];
+        result.x.store(channels[0]);
+        result.y.store(channels[1]);
+        result.z.store(channels[2]);
+        unsigned char* row = &colorBuffer[((size_t)y * width + x) * 3];
+        for (int i = 0; i < 8; i++)
+        {
+            if (!(bits & (1 << i)))
+                continue;
+            row[i * 3] = toByte(channels[0][i]);
+            row[i * 3 + 1] = toByte(channels[1][i]);
+            row[i * 3 + 2] = toByte(channels[2][i]);
+        }
+    }
+};
+
+#endif /* softwareRasterizer_h */
@@ -10,10 +10,15 @@
 
 #include <glad/glad.h>
 #include <vector>
+#include <optional>
+#include <chrono>
+#include <iostream>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "shader.h"
+#include "meshBuilder.h"
+#include "jobSystem.h"
 
 # define PI 3.1416
 
@@ -37,40 +42,88 @@ public:
     float shininess;
 
     // ctor/dtor
-    Sphere(unsigned int dMap, unsigned int sMap, float textureXmin, float textureYmin, float textureXmax, float textureYmax, float radius = 0.5f, int sectorCount = 48, int stackCount = 18, glm::vec3 amb = glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3 diff = glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3 spec = glm::vec3(0.5f, 0.5f, 0.5f), float shiny = 32.0f) : verticesStride(24)
+    // with deferBuild the mesh is left to generate() and upload(), so it can be built off the context thread
+    Sphere(unsigned int dMap, unsigned int sMap, float textureXmin, float textureYmin, float textureXmax, float textureYmax, float radius = 0.5f, int sectorCount = 48, int stackCount = 18, glm::vec3 amb = glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3 diff = glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3 spec = glm::vec3(0.5f, 0.5f, 0.5f), float shiny = 32.0f, bool deferBuild = false) : verticesStride(24)
     {
         set(radius, sectorCount, stackCount, amb, diff, spec, shiny, dMap, sMap, textureXmin, textureYmin, textureXmax, textureYmax);
-        buildCoordinatesAndIndices();
-        buildVertices();
-
-        glGenVertexArrays(1, &sphereTexVAO);
-        glGenBuffers(1, &sphereVBO);
-        glGenBuffers(1, &sphereEBO);
-
-        glBindVertexArray(sphereTexVAO);
-
-        glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
-        int stride = this->getVerticesStride();
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
+        if (!deferBuild)
+        {
+            generate();
+            upload();
+        }
+    }
+    ~Sphere() {}
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereEBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    // builds the mesh into the staging builder and optimizes it, reported as name. touches no GL state
+    void generate(const char* name = "sphere")
+    {
+        meshRadius = drawnRadius = radius;
+        meshSectors = sectorCount;
+        meshStacks = stackCount;
+        tessellate(staging);
+        staging.optimize(name);
+    }
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
-        glEnableVertexAttribArray(0);
+    // this sphere into any builder, with detail times the sectors and stacks
+    void tessellate(MeshBuilder& builder, int detail = 1) const
+    {
+        int sectors = sectorCount * detail, stacks = stackCount * detail;
+        builder.reserve((size_t)(stacks + 1) * (sectors + 1), (size_t)stacks * sectors * 6);
+        tessellate(builder, radius, sectors, stacks);
+    }
 
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(1);
+    // copies the generated mesh into a VAO and frees the staging, needs the context
+    void upload()
+    {
+        mesh = staging.upload();
+        sphereVAO = sphereTexVAO = mesh.vao;
+    }
 
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
-        glEnableVertexAttribArray(2);
+    // once a frame on the context thread, after the setters. new sectors or stacks are tessellated by a job while
+    // the old mesh is still drawn, and copied into its buffers in the first frame after it is done. a new radius
+    // only scales the mesh in the draws. jobs has to outlive the rebuild, destroying it runs what is still queued.
+    // returns 0 when the sphere looks as in the last frame, else a radius around its center that holds both the
+    // old and the new surface, for the shadow maps and captures that have the old one
+    float update(JobSystem& jobs)
+    {
+        float changed = 0.0f;
+        if (radius != drawnRadius)
+        {
+            changed = std::max(radius, drawnRadius);
+            drawnRadius = radius;
+        }
+        if (rebuildQueued)
+        {
+            if (!rebuilding.done())
+                return changed;
+            rebuildQueued = false;
+            changed = radius;
+            auto start = chrono::high_resolution_clock::now();
+            rebuilt.update(mesh, *rebuiltData);
+            rebuiltData.reset();
+            cout << "sphere: " << meshSectors << " sectors, " << meshStacks << " stacks, " << mesh.vertexCount << " vertices, built in "
+                << rebuildMs << " ms by a job, swapped in " << chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count() << " ms" << endl;
+        }
+        if (mesh.vao == 0 || (sectorCount == meshSectors && stackCount == meshStacks))
+            return changed;
 
-        // unbind VAO and VBOs
-        /*glBindVertexArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);*/
+        meshSectors = sectorCount;
+        meshStacks = stackCount;
+        rebuildQueued = true;
+        jobs.run(rebuilding, [this, format = mesh.format]
+        {
+            auto start = chrono::high_resolution_clock::now();
+            rebuilt.reserve((size_t)(meshStacks + 1) * (meshSectors + 1), (size_t)meshStacks * meshSectors * 6);
+            tessellate(rebuilt, meshRadius, meshSectors, meshStacks);
+            rebuilt.optimize("sphere rebuild");
+            rebuiltData.emplace(rebuilt.pack(format));
+            rebuildMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+        });
+        // without workers the job system only runs jobs inside wait()
+        if (jobs.threadCount() == 1)
+            jobs.wait(rebuilding);
+        return changed;
     }
-    ~Sphere() {}
 
     // getters/setters
 
@@ -98,135 +151,76 @@ public:
         this->TYmax = textureYmax;
     }
 
+    // the mesh follows in update()
     void setRadius(float radius)
     {
         if (radius != this->radius)
-            set(radius, sectorCount, stackCount, ambient, diffuse, specular, shininess, diffuseMap, specularMap, TYmax, TYmin, TXmax, TYmax);
+            set(radius, sectorCount, stackCount, ambient, diffuse, specular, shininess, diffuseMap, specularMap, TXmin, TYmin, TXmax, TYmax);
     }
 
     void setSectorCount(int sectors)
     {
         if (sectors != this->sectorCount)
-            set(radius, sectorCount, stackCount, ambient, diffuse, specular, shininess, diffuseMap, specularMap, TYmax, TYmin, TXmax, TYmax);
+            set(radius, sectors, stackCount, ambient, diffuse, specular, shininess, diffuseMap, specularMap, TXmin, TYmin, TXmax, TYmax);
     }
 
     void setStackCount(int stacks)
     {
         if (stacks != this->stackCount)
-            set(radius, sectorCount, stackCount, ambient, diffuse, specular, shininess, diffuseMap, specularMap, TYmax, TYmin, TXmax, TYmax);
+            set(radius, sectorCount, stacks, ambient, diffuse, specular, shininess, diffuseMap, specularMap, TXmin, TYmin, TXmax, TYmax);
     }
 
-    // for interleaved vertices
-    unsigned int getVertexCount() const
+    float getRadius() const
     {
-        return (unsigned int)coordinates.size() / 3;     // # of vertices
+        return radius;
     }
 
-    unsigned int getVertexSize() const
+    int getSectorCount() const
     {
-        return (unsigned int)vertices.size() * sizeof(float);  // # of bytes
+        return sectorCount;
     }
 
-    int getVerticesStride() const
-    {
-        return verticesStride;   // should be 24 bytes
-    }
-    const float* getVertices() const
+    int getStackCount() const
     {
-        return vertices.data();
+        return stackCount;
     }
 
-    unsigned int getIndexSize() const
+    // for interleaved vertices
+    unsigned int getVertexCount() const
     {
-        return (unsigned int)indices.size() * sizeof(unsigned int);
+        return mesh.vertexCount;     // # of vertices
     }
 
-    const unsigned int* getIndices() const
+    unsigned int getVertexSize() const
     {
-        return indices.data();
+        return mesh.vertexCount * verticesStride;  // # of bytes
     }
 
-    unsigned int getIndexCount() const
+    int getVerticesStride() const
     {
-        return (unsigned int)indices.size();
+        return verticesStride;   // should be 24 bytes
     }
 
-    // draw in VertexArray mode
-    void drawSphere(Shader& lightingShader, glm::mat4 model) const      // draw surface
+    unsigned int getIndexSize() const
     {
-        lightingShader.use();
-
-        lightingShader.setVec3("material.ambient", this->ambient);
-        lightingShader.setVec3("material.diffuse", this->diffuse);
-        lightingShader.setVec3("material.specular", this->specular);
-        lightingShader.setFloat("material.shininess", this->shininess);
-
-
-        lightingShader.setMat4("model", model);
-
-        // draw a sphere with VAO
-        glBindVertexArray(sphereVAO);
-        glDrawElements(GL_TRIANGLES,                    // primitive type
-            this->getIndexCount(),          // # of indices
-            GL_UNSIGNED_INT,                 // data type
-            (void*)0);                       // offset to indices
-
-        // unbind VAO
-        glBindVertexArray(0);
+        return mesh.indexCount * sizeof(unsigned int);
     }
-    void drawSphere2(Shader& lightingShader, glm::mat4 model = glm::mat4(1.0f), float r = 1.0f, float g = 1.0f, float b = 1.0f, float alpha = 0.5f) const      // draw surface
-    {
-        lightingShader.use();
-
-        lightingShader.setVec3("material.ambient", glm::vec3(r, g, b));
-        lightingShader.setVec3("material.diffuse", glm::vec3(r, g, b));
-        lightingShader.setVec3("material.specular", glm::vec3(r, g, b));
-        lightingShader.setFloat("material.shininess", 32.0f);
-
-        lightingShader.setVec4("color", glm::vec4(r, g, b, alpha));
-        lightingShader.setMat4("model", model);
 
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        // draw a sphere with VAO
-        glBindVertexArray(sphereVAO);
-        glDrawElements(GL_TRIANGLES,                    // primitive type
-            this->getIndexCount(),          // # of indices
-            GL_UNSIGNED_INT,                 // data type
-            (void*)0);                       // offset to indices
-        //
-        // unbind VAO
-        glBindVertexArray(0);
-        glDisable(GL_BLEND);
+    unsigned int getIndexCount() const
+    {
+        return mesh.indexCount;
     }
 
-    void drawSphereWithTexture(Shader& lightingShaderWithTexture, glm::mat4 model = glm::mat4(1.0f)) {
-        lightingShaderWithTexture.use();
-
-        lightingShaderWithTexture.setVec3("material.ambient", this->ambient);
-        lightingShaderWithTexture.setVec3("material.diffuse", this->diffuse);
-        lightingShaderWithTexture.setVec3("material.specular", this->specular);
-        lightingShaderWithTexture.setFloat("material.shininess", this->shininess);
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, this->diffuseMap);
-
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, this->specularMap);
-
-        lightingShaderWithTexture.setMat4("model", model);
-
-        glBindVertexArray(sphereTexVAO);
-        glDrawElements(GL_TRIANGLES, getIndexCount(), GL_UNSIGNED_INT, 0);
+    const GpuMesh& getMesh() const
+    {
+        return mesh;
     }
 
-private:
-    // member functions
-    void buildCoordinatesAndIndices()
+    // the sphere of radius around the origin, sectorCount slices of longitude and stackCount of latitude
+    static void tessellate(MeshBuilder& builder, float radius, int sectorCount, int stackCount)
     {
         float x, y, z, xz;                              // vertex position
         float nx, ny, nz, lengthInv = 1.0f / radius;    // vertex normal
-        float s, t;
 
         float sectorStep = 2 * PI / sectorCount;
         float stackStep = PI / stackCount;
@@ -247,28 +241,12 @@ private:
                 // vertex position (x, y, z)
                 z = xz * cosf(sectorAngle);
                 x = xz * sinf(sectorAngle);
-                coordinates.push_back(x);
-                coordinates.push_back(y);
-                coordinates.push_back(z);
 
-                // normalized vertex normal (nx, ny, nz)
+                // normalized vertex normal (nx, ny, nz), stored negated
                 nx = x * lengthInv;
                 ny = y * lengthInv;
                 nz = z * lengthInv;
-                normals.push_back(nx);
-                normals.push_back(ny);
-                normals.push_back(nz);
-
-                // vertex tex coord (s, t) range between [0, 1]
-                /*s = (float)j / sectorCount;
-                t = (float)i / stackCount;
-                texCoords.push_back(s);
-                texCoords.push_back(t);*/
-                s = j * 0.05;//(1/20)
-                //t = t;
-
-                texCoords.push_back(s);
-                texCoords.push_back(t);
+                builder.vertex(x, y, z, -1 * nx, -1 * ny, -1 * nz);
             }
         }
 
@@ -290,85 +268,100 @@ private:
                 if (i != 0 && i != (stackCount - 1))
                 {
                     // k1 => k2 => k1+1
-                    indices.push_back(k1);
-                    indices.push_back(k2);
-                    indices.push_back(k1 + 1);
-
+                    builder.triangle(k1, k2, k1 + 1);
                     // k1+1 => k2 => k2+1
-                    indices.push_back(k1 + 1);
-                    indices.push_back(k2);
-                    indices.push_back(k2 + 1);
+                    builder.triangle(k1 + 1, k2, k2 + 1);
                 }
                 // 2 triangles per sector excluding first and last stacks
                 else if (i == 0)
                 {
-                    indices.push_back(k1 + 1);
-                    indices.push_back(k2);
-                    indices.push_back(k2 + 1);
-
+                    builder.triangle(k1 + 1, k2, k2 + 1);
                 }
 
                 else if (i == (stackCount - 1))
                 {
-                    indices.push_back(k1);
-                    indices.push_back(k2);
-                    indices.push_back(k1 + 1);
+                    builder.triangle(k1, k2, k1 + 1);
                 }
             }
         }
     }
 
-    void buildTextureCoordinates()
+    // draw in VertexArray mode
+    void drawSphere(Shader& lightingShader, glm::mat4 model) const      // draw surface
     {
-        float sectorStep = 2 * PI / sectorCount;
-        float stackStep = PI / stackCount;
+        lightingShader.use();
 
-        for (int i = 0; i <= stackCount; ++i)
-        {
-            float stackAngle = PI / 2 - i * stackStep;
+        lightingShader.setVec3("material.ambient", this->ambient);
+        lightingShader.setVec3("material.diffuse", this->diffuse);
+        lightingShader.setVec3("material.specular", this->specular);
+        lightingShader.setFloat("material.shininess", this->shininess);
 
-            for (int j = 0; j <= sectorCount; ++j)
-            {
-                float sectorAngle = j * sectorStep;
 
-                float x = cosf(sectorAngle) * sinf(stackAngle);
-                float y = cosf(stackAngle);
-                float z = sinf(sectorAngle) * sinf(stackAngle);
+        lightingShader.setMat4("model", meshModel(model));
 
-                textureCoordinates.push_back(x);
-                textureCoordinates.push_back(y);
-            }
-        }
+        // draw a sphere with VAO
+        glBindVertexArray(sphereVAO);
+        glDrawElements(GL_TRIANGLES,                    // primitive type
+            this->getIndexCount(),          // # of indices
+            GL_UNSIGNED_INT,                 // data type
+            (void*)0);                       // offset to indices
+
+        // unbind VAO
+        glBindVertexArray(0);
     }
+    void drawSphere2(Shader& lightingShader, glm::mat4 model = glm::mat4(1.0f), float r = 1.0f, float g = 1.0f, float b = 1.0f, float alpha = 0.5f) const      // draw surface
+    {
+        lightingShader.use();
 
-    void buildVertices()
+        lightingShader.setVec3("material.ambient", glm::vec3(r, g, b));
+        lightingShader.setVec3("material.diffuse", glm::vec3(r, g, b));
+        lightingShader.setVec3("material.specular", glm::vec3(r, g, b));
+        lightingShader.setFloat("material.shininess", 32.0f);
+
+        lightingShader.setVec4("color", glm::vec4(r, g, b, alpha));
+        lightingShader.setMat4("model", meshModel(model));
+
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        // draw a sphere with VAO
+        glBindVertexArray(sphereVAO);
+        glDrawElements(GL_TRIANGLES,                    // primitive type
+            this->getIndexCount(),          // # of indices
+            GL_UNSIGNED_INT,                 // data type
+            (void*)0);                       // offset to indices
+        //
+        // unbind VAO
+        glBindVertexArray(0);
+        glDisable(GL_BLEND);
+    }
+
+    void drawSphereWithTexture(Shader& lightingShaderWithTexture, glm::mat4 model = glm::mat4(1.0f)) {
+        lightingShaderWithTexture.use();
+
+        lightingShaderWithTexture.setVec3("material.ambient", this->ambient);
+        lightingShaderWithTexture.setVec3("material.diffuse", this->diffuse);
+        lightingShaderWithTexture.setVec3("material.specular", this->specular);
+        lightingShaderWithTexture.setFloat("material.shininess", this->shininess);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, this->diffuseMap);
+
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, this->specularMap);
+
+        lightingShaderWithTexture.setMat4("model", meshModel(model));
+
+        glBindVertexArray(sphereTexVAO);
+        glDrawElements(GL_TRIANGLES, getIndexCount(), GL_UNSIGNED_INT, 0);
+    }
+
+private:
+    // member functions
+
+    // the draw's model matrix, a radius changed since the mesh was tessellated is a scale of it
+    glm::mat4 meshModel(const glm::mat4& model) const
     {
-        size_t i, j;
-        size_t count = coordinates.size();
-        for (i = 0, j = 0; i < count; i += 3, j += 2)
-        {
-            vertices.push_back(coordinates[i]);
-            vertices.push_back(coordinates[i + 1]);
-            vertices.push_back(coordinates[i + 2]);
-
-            vertices.push_back(-1 * normals[i]);
-            vertices.push_back(-1 * normals[i + 1]);
-            vertices.push_back(-1 * normals[i + 2]);
-
-            /*if (i < normals.size())
-                vertices.push_back(normals[i]);
-            if (i + 1 < normals.size())
-                vertices.push_back(normals[i + 1]);
-            if (i + 2 < normals.size())
-                vertices.push_back(normals[i + 2]);*/
-
-
-                // Add texture coordinates
-            if (j < textureCoordinates.size())
-                vertices.push_back(textureCoordinates[j]);
-            if (j + 1 < textureCoordinates.size())
-                vertices.push_back(textureCoordinates[j + 1]);
-        }
+        return glm::scale(model, glm::vec3(radius / meshRadius)) * mesh.positionTransform;
     }
 
     vector<float> computeFaceNormal(float x1, float y1, float z1, float x2, float y2, float z2, float x3, float y3, float z3)
@@ -407,15 +400,21 @@ private:
 
     // memeber vars
     unsigned int sphereTexVAO;
-    unsigned int sphereVAO, sphereVBO, sphereEBO;
+    unsigned int sphereVAO;
+    GpuMesh mesh;
+    MeshBuilder staging;                    // empty again after upload()
     float radius;
     int sectorCount;                        // longitude, # of slices
     int stackCount;                         // latitude, # of stacks
-    vector<float> vertices;
-    vector<float> normals;
-    vector<unsigned int> indices;
-    vector<float> coordinates;
-    vector<float> textureCoordinates, texCoords;
+    float meshRadius = 1.0f;                // what the mesh was tessellated with, or is being rebuilt with
+    int meshSectors = 0;
+    int meshStacks = 0;
+    float drawnRadius = 1.0f;               // the radius the last update() reported
+    JobCounter rebuilding;                  // the rebuild job owns rebuilt and rebuiltData until it is done
+    bool rebuildQueued = false;
+    MeshBuilder rebuilt;
+    optional<VertexData> rebuiltData;
+    double rebuildMs = 0.0;
     int verticesStride;                 // # of bytes to hop to the next vertex (should be 24 bytes)
 
 };
@@ -9,6 +9,7 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include "shader.h"
+#include "localLightShadows.h"
 
 class SpotLight {
 public:
@@ -23,6 +24,7 @@ public:
     float Angle;
     int lightNumber;
     //bool spotLightOn;
+    SpotShadowMap* shadows = nullptr;   // set once there is a GL context, null means no shadows
 
     SpotLight(float posX, float posY, float posZ, float dirX, float dirY, float dirZ, float ambR, float ambG, float ambB, float diffR, float diffG, float diffB, float specR, float specG, float specB, float constant, float linear, float quadratic, float angle, int num) {
 
@@ -52,8 +54,29 @@ public:
             lightingShader.setFloat("spotLight.k_q", k_q);
             lightingShader.setFloat("spotLight.cos_theta", glm::cos(glm::radians(Angle)));
             lightingShader.setBool("spotLightOn", true);
+            if (shadows != nullptr)
+                shadows->bind(lightingShader);
+            else
+                SpotShadowMap::bindNone(lightingShader);
         } 
     }
+    // colours as they are currently sent to the shader
+    glm::vec3 getAmbient() const
+    {
+        return ambientOn * ambient;
+    }
+    glm::vec3 getDiffuse() const
+    {
+        return diffuseOn * diffuse;
+    }
+    glm::vec3 getSpecular() const
+    {
+        return specularOn * specular;
+    }
+    bool isOn() const
+    {
+        return ambientOn != 0.0f || diffuseOn != 0.0f || specularOn != 0.0f;
+    }
     void turnOff()
     {
         ambientOn = 0.0;
@@ -0,0 +1,216 @@
+//
+//  vertexFormat.h
+//  the two ways a mesh's vertices can sit in a buffer object: 32-bit floats, or packed with
+//  16-bit positions relative to the mesh bounds, 10:10:10 normals and half float texture
+//  coordinates. the packed attributes are converted by the vertex fetch, so the shaders read
+//  the same vec3 and vec2 either way. the bounds go into positionTransform, which the draw
+//  multiplies into its model matrix
+//
+
+#ifndef vertexFormat_h
+#define vertexFormat_h
+
+#include <glad/glad.h>
+#include <memory_resource>
+#include <vector>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace std;
+
+enum VertexFormat { VERTEX_FLOAT, VERTEX_PACKED };
+
+// IEEE half float, rounded to nearest even
+inline unsigned short floatToHalf(float value)
+{
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    unsigned int sign = (bits >> 16) & 0x8000;
+    unsigned int mantissa = bits & 0x7fffff;
+    int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+    if (((bits >> 23) & 0xff) == 0xff)
+        return (unsigned short)(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+    if (exponent >= 31)
+        return (unsigned short)(sign | 0x7c00);
+    int shift = 13;
+    unsigned int half = sign | ((unsigned int)exponent << 10);
+    if (exponent <= 0)
+    {
+        // subnormal, the implicit bit shifts in with the mantissa
+        if (exponent < -10)
+            return (unsigned short)sign;
+        mantissa |= 0x800000;
+        shift = 14 - exponent;
+        half = sign;
+    }
+    half |= mantissa >> shift;
+    unsigned int rest = mantissa & ((1u << shift) - 1);
+    unsigned int halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1)))
+        half++;             // a carry into the exponent is still the right value
+    return (unsigned short)half;
+}
+
+inline float halfToFloat(unsigned short half)
+{
+    unsigned int sign = (unsigned int)(half & 0x8000) << 16;
+    unsigned int exponent = (half >> 10) & 0x1f;
+    unsigned int mantissa = half & 0x3ff;
+    if (exponent == 0)
+    {
+        float value = ldexp((float)mantissa, -24);
+        return sign != 0 ? -value : value;
+    }
+    unsigned int bits = sign | (exponent == 31 ? 0x7f800000 | (mantissa << 13) : ((exponent + 112) << 23) | (mantissa << 13));
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// a unit vector as GL_INT_2_10_10_10_REV, x in the low bits and w left 0
+inline unsigned int packNormal(const glm::vec3& normal)
+{
+    unsigned int packed = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        float value = normal[i] == normal[i] ? std::min(std::max(normal[i], -1.0f), 1.0f) : 0.0f;
+        int component = (int)lround(value * 511.0f);
+        packed |= ((unsigned int)component & 0x3ff) << (i * 10);
+    }
+    return packed;
+}
+
+// what the vertex fetch makes of it: signed normalized, -512 clamped to -1
+inline glm::vec3 unpackNormal(unsigned int packed)
+{
+    glm::vec3 normal;
+    for (int i = 0; i < 3; i++)
+    {
+        int component = (int)(packed << (22 - i * 10)) >> 22;
+        normal[i] = std::max((float)component / 511.0f, -1.0f);
+    }
+    return normal;
+}
+
+// the vertices of one mesh converted for its buffer object. the source is position, normal and with
+// texCoords the texture coordinates as floats, floatsPerVertex apart
+class VertexData {
+public:
+    VertexFormat format;
+    bool texCoords;
+    int stride;
+    unsigned int count;
+    glm::mat4 positionTransform;        // from the stored positions to the mesh's own, identity for floats
+    pmr::vector<unsigned char> bytes;
+
+    // the format new meshes are built in
+    static VertexFormat& defaultFormat()
+    {
+        static VertexFormat format = VERTEX_PACKED;
+        return format;
+    }
+
+    static int strideOf(VertexFormat format, bool texCoords)
+    {
+        if (format == VERTEX_PACKED)
+            return texCoords ? 16 : 12;
+        return (texCoords ? 8 : 6) * (int)sizeof(float);
+    }
+
+    // constructor
+    VertexData(const float* vertices, unsigned int count, int floatsPerVertex, bool texCoords, VertexFormat format = defaultFormat(),
+        pmr::memory_resource* resource = pmr::get_default_resource()) : bytes(resource)
+    {
+        this->format = format;
+        this->texCoords = texCoords;
+        this->count = count;
+        stride = strideOf(format, texCoords);
+        positionTransform = glm::mat4(1.0f);
+        bytes.resize((size_t)count * stride);
+        if (format == VERTEX_FLOAT)
+        {
+            for (unsigned int i = 0; i < count; i++)
+                memcpy(bytes.data() + (size_t)i * stride, vertices + (size_t)i * floatsPerVertex, stride);
+            return;
+        }
+
+        // one scale for all three axes, so the normal matrix of the model stays a rotation times a uniform scale
+        glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            glm::vec3 position(vertices[(size_t)i * floatsPerVertex], vertices[(size_t)i * floatsPerVertex + 1], vertices[(size_t)i * floatsPerVertex + 2]);
+            boundsMin = i == 0 ? position : glm::min(boundsMin, position);
+            boundsMax = i == 0 ? position : glm::max(boundsMax, position);
+        }
+        glm::vec3 size = boundsMax - boundsMin;
+        float extent = std::max(std::max(size.x, size.y), size.z);
+        if (extent <= 0.0f)
+            extent = 1.0f;
+        positionTransform = glm::scale(glm::translate(glm::mat4(1.0f), boundsMin), glm::vec3(extent));
+
+        for (unsigned int i = 0; i < count; i++)
+        {
+            const float* source = vertices + (size_t)i * floatsPerVertex;
+            unsigned char* target = bytes.data() + (size_t)i * stride;
+            unsigned short position[4] = { 0, 0, 0, 0 };
+            for (int k = 0; k < 3; k++)
+                position[k] = (unsigned short)lround(std::min(std::max((source[k] - boundsMin[k]) / extent, 0.0f), 1.0f) * 65535.0f);
+            memcpy(target, position, sizeof(position));
+            unsigned int normal = packNormal(glm::vec3(source[3], source[4], source[5]));
+            memcpy(target + 8, &normal, sizeof(normal));
+            if (texCoords)
+            {
+                unsigned short uv[2] = { floatToHalf(source[6]), floatToHalf(source[7]) };
+                memcpy(target + 12, uv, sizeof(uv));
+            }
+        }
+    }
+
+    // vertex i as the shaders see it: position in the mesh's space, normal and texture coordinates
+    void unpack(unsigned int i, float vertex[8]) const
+    {
+        const unsigned char* source = bytes.data() + (size_t)i * stride;
+        if (format == VERTEX_FLOAT)
+        {
+            memset(vertex, 0, 8 * sizeof(float));
+            memcpy(vertex, source, stride);
+            return;
+        }
+        unsigned short position[3];
+        memcpy(position, source, sizeof(position));
+        glm::vec4 stored(position[0] / 65535.0f, position[1] / 65535.0f, position[2] / 65535.0f, 1.0f);
+        glm::vec4 mesh = positionTransform * stored;
+        unsigned int packed;
+        memcpy(&packed, source + 8, sizeof(packed));
+        glm::vec3 normal = unpackNormal(packed);
+        unsigned short uv[2] = { 0, 0 };
+        if (texCoords)
+            memcpy(uv, source + 12, sizeof(uv));
+        float values[8] = { mesh.x, mesh.y, mesh.z, normal.x, normal.y, normal.z, halfToFloat(uv[0]), halfToFloat(uv[1]) };
+        memcpy(vertex, values, sizeof(values));
+    }
+
+    // points attribute 0 (position), 1 (normal) and 2 (texture coordinates) of the bound vertex array at the
+    // bound array buffer, holding bytes. the ones not asked for are left disabled
+    void setAttributes(bool normals = true, bool texCoords = true) const
+    {
+        bool packed = format == VERTEX_PACKED;
+        glVertexAttribPointer(0, 3, packed ? GL_UNSIGNED_SHORT : GL_FLOAT, packed ? GL_TRUE : GL_FALSE, stride, (void*)0);
+        glEnableVertexAttribArray(0);
+        if (normals)
+        {
+            glVertexAttribPointer(1, packed ? 4 : 3, packed ? GL_INT_2_10_10_10_REV : GL_FLOAT, packed ? GL_TRUE : GL_FALSE, stride, (void*)(size_t)(packed ? 8 : 12));
+            glEnableVertexAttribArray(1);
+        }
+        if (texCoords && this->texCoords)
+        {
+            glVertexAttribPointer(2, 2, packed ? GL_HALF_FLOAT : GL_FLOAT, GL_FALSE, stride, (void*)(size_t)(packed ? 12 : 24));
+            glEnableVertexAttribArray(2);
+        }
+    }
+};
+
+#endif /* vertexFormat_h */
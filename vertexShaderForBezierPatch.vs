@@ -0,0 +1,24 @@
+#version 330 core
+
+// surfaces of revolution drawn as patches have no attributes: vertex gl_VertexID % 4 is a corner of patch
+// gl_VertexID / 4 in a grid of patchRows along the profile and patchColumns around the axis
+uniform int patchRows;
+uniform int patchColumns;
+uniform float revolutionStart;
+uniform float revolutionSpan;
+
+// (t along the profile, angle around the axis)
+out vec2 domain;
+
+void main()
+{
+    int cell = gl_VertexID / 4;
+    int corner = gl_VertexID - cell * 4;
+    int row = cell / patchColumns;
+    int column = cell - row * patchColumns;
+    // corners counterclockwise from (0, 0), u around the axis and v along the profile
+    float u = (corner == 1 || corner == 2) ? 1.0 : 0.0;
+    float v = corner >= 2 ? 1.0 : 0.0;
+    domain = vec2((float(row) + v) / float(patchRows), revolutionStart + (float(column) + u) * revolutionSpan / float(patchColumns));
+    gl_Position = vec4(0.0);
+}
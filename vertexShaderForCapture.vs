@@ -0,0 +1,38 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+
+struct Material {
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+};
+
+// world space triangles with their material, captured with transform feedback for the lightmap baker
+// and the path tracer. each of them lists the outputs it records
+out vec3 worldPos;
+out vec3 worldNormal;
+out vec3 ambientColor;
+out vec3 diffuseColor;
+out vec3 specularColor;
+out float shininess;
+
+uniform mat4 model;
+uniform Material material;
+
+// revolutionVertex() and its uniforms are spliced in from revolutionVertex.glsl
+void main()
+{
+    vec3 position = aPos;
+    vec3 normal = aNormal;
+    if (revolutionSlices > 0)
+        revolutionVertex(position, normal);
+    worldPos = vec3(model * vec4(position, 1.0));
+    worldNormal = mat3(transpose(inverse(model))) * normal;
+    ambientColor = material.ambient;
+    diffuseColor = material.diffuse;
+    specularColor = material.specular;
+    shininess = material.shininess;
+    gl_Position = vec4(worldPos, 1.0);
+}
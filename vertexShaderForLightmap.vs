@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aLightmapUV;
+
+out vec2 LightmapUV;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// merged static geometry is already in world space
+void main()
+{
+    gl_Position = projection * view * vec4(aPos, 1.0);
+    LightmapUV = aLightmapUV;
+}
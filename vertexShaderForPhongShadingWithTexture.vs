@@ -11,12 +11,17 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// revolutionVertex() and its uniforms are spliced in from revolutionVertex.glsl
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    vec3 position = aPos;
+    vec3 normal = aNormal;
+    if (revolutionSlices > 0)
+        revolutionVertex(position, normal);
+    gl_Position = projection * view * model * vec4(position, 1.0);
     
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    FragPos = vec3(model * vec4(position, 1.0));
+    Normal = mat3(transpose(inverse(model))) * normal;
     TexCoords = aTexCoords;
     
 }
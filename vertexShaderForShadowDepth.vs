@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 model;
+uniform mat4 lightSpaceMatrix;
+
+// revolutionVertex() and its uniforms are spliced in from revolutionVertex.glsl
+void main()
+{
+    vec3 position = aPos;
+    vec3 normal;
+    if (revolutionSlices > 0)
+        revolutionVertex(position, normal);
+    gl_Position = lightSpaceMatrix * model * vec4(position, 1.0);
+}